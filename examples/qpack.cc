@@ -32,6 +32,7 @@
 
 #include "qpack_encode.h"
 #include "qpack_decode.h"
+#include "qpack_bench.h"
 
 namespace nghttp3 {
 
@@ -40,7 +41,8 @@ Config config{};
 namespace {
 void print_usage() {
   std::cerr << "Usage: qpack [OPTIONS] <COMMAND> <INFILE> <OUTFILE>"
-            << std::endl;
+            << std::endl
+            << "       qpack [OPTIONS] bench <INFILE>" << std::endl;
 }
 } // namespace
 
@@ -52,19 +54,38 @@ void print_help() {
   <COMMAND>   "encode" or "decode"
   <INFILE>    Path to an input file
   <OUTFILE>   Path to an output file
+
+  "bench" encodes and decodes QIF formatted <INFILE> repeatedly, and
+  reports ns/field, bytes/field, compression ratio and the number of
+  allocations for each combination of --allocator, --max-dtable-size
+  and --max-blocked.
 Options:
   -h, --help  Display this help and exit.
   -m, --max-blocked=<N>
               The maximum number of streams which are permitted to be blocked.
+              For bench, this option can be given multiple times.
+              Default for bench: 0 and 100
   -s, --max-dtable-size=<N>
-              The maximum size of dynamic table.
+              The maximum size of dynamic table.  For bench, this option
+              can be given multiple times.
+              Default for bench: 0, 256, 512, and 4096
   -a, --immediate-ack
               Turn on immediate acknowledgement.
+  -n, --iterations=<N>
+              The number of times bench repeats the input.
+              Default: 10
+  -A, --allocator=<NAME>
+              The memory allocator that bench uses.  "system" uses
+              malloc(3) and friends, and "slab" uses nghttp3_slab_mem.
+              This option can be given multiple times.
+              Default: system and slab
 )";
 }
 } // namespace
 
 int main(int argc, char **argv) {
+  config.iterations = 10;
+
   for (;;) {
     static int flag = 0;
     (void)flag;
@@ -73,11 +94,13 @@ int main(int argc, char **argv) {
       {"max-blocked", required_argument, nullptr, 'm'},
       {"max-dtable-size", required_argument, nullptr, 's'},
       {"immediate-ack", no_argument, nullptr, 'a'},
+      {"iterations", required_argument, nullptr, 'n'},
+      {"allocator", required_argument, nullptr, 'A'},
       {nullptr, 0, nullptr, 0},
     };
 
     auto optidx = 0;
-    auto c = getopt_long(argc, argv, "hm:s:a", long_opts, &optidx);
+    auto c = getopt_long(argc, argv, "hm:s:an:A:", long_opts, &optidx);
     if (c == -1) {
       break;
     }
@@ -89,17 +112,31 @@ int main(int argc, char **argv) {
     case 'm': {
       // --max-blocked
       config.max_blocked = strtoul(optarg, nullptr, 10);
+      config.bench_max_blocked.push_back(config.max_blocked);
       break;
     }
     case 's': {
       // --max-dtable-size
       config.max_dtable_size = strtoul(optarg, nullptr, 10);
+      config.bench_max_dtable_sizes.push_back(config.max_dtable_size);
       break;
     }
     case 'a':
       // --immediate-ack
       config.immediate_ack = true;
       break;
+    case 'n':
+      // --iterations
+      config.iterations = strtoul(optarg, nullptr, 10);
+      if (config.iterations == 0) {
+        std::cerr << "-n: iterations must be greater than 0" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'A':
+      // --allocator
+      config.bench_allocators.emplace_back(optarg);
+      break;
     case '?':
       print_usage();
       exit(EXIT_FAILURE);
@@ -110,13 +147,28 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (argc - optind < 3) {
+  if (argc - optind < 2) {
     std::cerr << "Too few arguments" << std::endl;
     print_usage();
     exit(EXIT_FAILURE);
   }
 
   auto command = std::string_view(argv[optind++]);
+
+  if (command == "bench") {
+    if (bench(argv[optind]) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    return 0;
+  }
+
+  if (argc - optind < 2) {
+    std::cerr << "Too few arguments" << std::endl;
+    print_usage();
+    exit(EXIT_FAILURE);
+  }
+
   auto infile = std::string_view(argv[optind++]);
   auto outfile = std::string_view(argv[optind++]);
 
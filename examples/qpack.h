@@ -31,12 +31,28 @@
 
 #include <nghttp3/nghttp3.h>
 
+#include <string>
+#include <vector>
+
 namespace nghttp3 {
 
 struct Config {
   size_t max_blocked;
   size_t max_dtable_size;
   bool immediate_ack;
+  // iterations is the number of times bench command repeats the
+  // whole input.
+  size_t iterations;
+  // bench_max_dtable_sizes is the list of the maximum dynamic table
+  // sizes that bench command tries.
+  std::vector<size_t> bench_max_dtable_sizes;
+  // bench_max_blocked is the list of the maximum number of blocked
+  // streams that bench command tries.
+  std::vector<size_t> bench_max_blocked;
+  // bench_allocators is the list of the memory allocators that bench
+  // command tries.  "system" uses nghttp3_mem_default, and "slab"
+  // uses nghttp3_slab_mem.
+  std::vector<std::string> bench_allocators;
 };
 
 } // namespace nghttp3
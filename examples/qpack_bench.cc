@@ -0,0 +1,502 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "qpack_bench.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include "qpack.h"
+#include "template.h"
+
+namespace nghttp3 {
+
+extern Config config;
+
+namespace {
+struct AllocStats {
+  // nalloc is the number of calls to malloc, calloc, and realloc.
+  size_t nalloc;
+  // parent is the allocator that actually allocates memory.
+  const nghttp3_mem *parent;
+};
+} // namespace
+
+namespace {
+void *bench_malloc(size_t size, void *user_data) {
+  auto stats = static_cast<AllocStats *>(user_data);
+  ++stats->nalloc;
+  return stats->parent->malloc(size, stats->parent->user_data);
+}
+} // namespace
+
+namespace {
+void bench_free(void *ptr, void *user_data) {
+  auto stats = static_cast<AllocStats *>(user_data);
+  stats->parent->free(ptr, stats->parent->user_data);
+}
+} // namespace
+
+namespace {
+void *bench_calloc(size_t nmemb, size_t size, void *user_data) {
+  auto stats = static_cast<AllocStats *>(user_data);
+  ++stats->nalloc;
+  return stats->parent->calloc(nmemb, size, stats->parent->user_data);
+}
+} // namespace
+
+namespace {
+void *bench_realloc(void *ptr, size_t size, void *user_data) {
+  auto stats = static_cast<AllocStats *>(user_data);
+  ++stats->nalloc;
+  return stats->parent->realloc(ptr, size, stats->parent->user_data);
+}
+} // namespace
+
+namespace {
+using Section = std::vector<nghttp3_nv>;
+} // namespace
+
+namespace {
+// load_qif parses QIF formatted header lists in [p, end) into
+// |sections|.  Lines starting with '#' are comments.  Each
+// nghttp3_nv points directly into the input buffer.  It returns the
+// sum of the length of names and values.
+size_t load_qif(std::vector<Section> &sections, const uint8_t *p,
+                const uint8_t *end) {
+  size_t srclen = 0;
+  Section nva;
+
+  for (; p != end;) {
+    auto eol = static_cast<const uint8_t *>(memchr(p, '\n', end - p));
+    if (!eol) {
+      eol = end;
+    }
+
+    auto line = std::string_view{reinterpret_cast<const char *>(p),
+                                 static_cast<size_t>(eol - p)};
+
+    p = eol == end ? end : eol + 1;
+
+    if (line.empty()) {
+      if (!nva.empty()) {
+        sections.emplace_back(std::move(nva));
+        nva = Section{};
+      }
+
+      continue;
+    }
+
+    if (line[0] == '#') {
+      continue;
+    }
+
+    auto d = line.find('\t');
+    if (d == std::string_view::npos) {
+      std::cerr << "Could not find TAB in " << line << std::endl;
+      return 0;
+    }
+
+    auto name = line.substr(0, d);
+    auto value = line.substr(d + 1);
+    value.remove_prefix(std::min(value.find_first_not_of(" "), value.size()));
+
+    srclen += name.size() + value.size();
+
+    nva.emplace_back(nghttp3_nv{
+      const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(name.data())),
+      const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(value.data())),
+      name.size(), value.size()});
+  }
+
+  if (!nva.empty()) {
+    sections.emplace_back(std::move(nva));
+  }
+
+  return srclen;
+}
+} // namespace
+
+namespace {
+struct Result {
+  // encode_ns is the time spent in the encoder in nanoseconds.
+  uint64_t encode_ns;
+  // decode_ns is the time spent in the decoder in nanoseconds.
+  uint64_t decode_ns;
+  // nfields is the number of fields decoded.
+  size_t nfields;
+  // rslen is the number of bytes written to request streams.
+  size_t rslen;
+  // eslen is the number of bytes written to encoder stream.
+  size_t eslen;
+  // dslen is the number of bytes written to decoder stream.
+  size_t dslen;
+};
+} // namespace
+
+namespace {
+uint64_t elapsed_ns(const std::chrono::steady_clock::time_point &t) {
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - t)
+      .count());
+}
+} // namespace
+
+namespace {
+int read_request(nghttp3_qpack_decoder *dec,
+                 nghttp3_qpack_stream_context *sctx, size_t &nfields,
+                 const nghttp3_buf *buf, int fin) {
+  nghttp3_qpack_nv nv;
+  uint8_t flags;
+
+  for (auto p = buf->pos, end = buf->last;;) {
+    auto nread = nghttp3_qpack_decoder_read_request(dec, sctx, &nv, &flags, p,
+                                                    end - p, fin);
+    if (nread < 0) {
+      std::cerr << "nghttp3_qpack_decoder_read_request: "
+                << nghttp3_strerror(nread) << std::endl;
+      return -1;
+    }
+
+    p += nread;
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_BLOCKED) {
+      std::cerr << "Stream blocked after encoder stream was consumed"
+                << std::endl;
+      return -1;
+    }
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+      ++nfields;
+      nghttp3_rcbuf_decref(nv.name);
+      nghttp3_rcbuf_decref(nv.value);
+    }
+
+    if ((flags & NGHTTP3_QPACK_DECODE_FLAG_FINAL) ||
+        (p == end && !(flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT))) {
+      return 0;
+    }
+  }
+}
+} // namespace
+
+namespace {
+// run_once encodes and decodes |sections| using a fresh encoder and
+// decoder pair.  Encoder stream is fed to the decoder before each
+// request stream, and decoder stream is fed back to the encoder
+// unless immediate acknowledgement is enabled.
+int run_once(Result &res, const std::vector<Section> &sections,
+             size_t max_dtable_size, size_t max_blocked, bool immediate_ack,
+             const nghttp3_mem *mem) {
+  nghttp3_qpack_encoder *enc;
+  nghttp3_qpack_decoder *dec;
+
+  if (auto rv = nghttp3_qpack_encoder_new(&enc, max_dtable_size, mem);
+      rv != 0) {
+    std::cerr << "nghttp3_qpack_encoder_new: " << nghttp3_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  auto encd = defer(nghttp3_qpack_encoder_del, enc);
+
+  nghttp3_qpack_encoder_set_max_dtable_capacity(enc, max_dtable_size);
+  nghttp3_qpack_encoder_set_max_blocked_streams(enc, max_blocked);
+
+  if (auto rv =
+        nghttp3_qpack_decoder_new(&dec, max_dtable_size, max_blocked, mem);
+      rv != 0) {
+    std::cerr << "nghttp3_qpack_decoder_new: " << nghttp3_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  auto decd = defer(nghttp3_qpack_decoder_del, dec);
+
+  if (auto rv =
+        nghttp3_qpack_decoder_set_max_dtable_capacity(dec, max_dtable_size);
+      rv != 0) {
+    std::cerr << "nghttp3_qpack_decoder_set_max_dtable_capacity: "
+              << nghttp3_strerror(rv) << std::endl;
+    return -1;
+  }
+
+  nghttp3_buf pbuf, rbuf, ebuf;
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+
+  auto pbufd = defer(nghttp3_buf_free, &pbuf, mem);
+  auto rbufd = defer(nghttp3_buf_free, &rbuf, mem);
+  auto ebufd = defer(nghttp3_buf_free, &ebuf, mem);
+
+  std::vector<uint8_t> dstream;
+  int64_t stream_id = 0;
+
+  for (auto &nva : sections) {
+    auto t = std::chrono::steady_clock::now();
+
+    if (auto rv = nghttp3_qpack_encoder_encode(enc, &pbuf, &rbuf, &ebuf,
+                                               stream_id, nva.data(),
+                                               nva.size());
+        rv != 0) {
+      std::cerr << "nghttp3_qpack_encoder_encode: " << nghttp3_strerror(rv)
+                << std::endl;
+      return -1;
+    }
+
+    if (immediate_ack) {
+      nghttp3_qpack_encoder_ack_everything(enc);
+    }
+
+    res.encode_ns += elapsed_ns(t);
+
+    res.rslen += nghttp3_buf_len(&pbuf) + nghttp3_buf_len(&rbuf);
+    res.eslen += nghttp3_buf_len(&ebuf);
+
+    nghttp3_qpack_stream_context *sctx;
+
+    t = std::chrono::steady_clock::now();
+
+    if (nghttp3_buf_len(&ebuf)) {
+      auto nread = nghttp3_qpack_decoder_read_encoder(dec, ebuf.pos,
+                                                      nghttp3_buf_len(&ebuf));
+      if (nread < 0) {
+        std::cerr << "nghttp3_qpack_decoder_read_encoder: "
+                  << nghttp3_strerror(nread) << std::endl;
+        return -1;
+      }
+    }
+
+    if (auto rv = nghttp3_qpack_stream_context_new(&sctx, stream_id, mem);
+        rv != 0) {
+      std::cerr << "nghttp3_qpack_stream_context_new: " << nghttp3_strerror(rv)
+                << std::endl;
+      return -1;
+    }
+
+    auto rv = read_request(dec, sctx, res.nfields, &pbuf, 0);
+    if (rv == 0) {
+      rv = read_request(dec, sctx, res.nfields, &rbuf, 1);
+    }
+
+    nghttp3_qpack_stream_context_del(sctx);
+
+    if (rv != 0) {
+      return -1;
+    }
+
+    auto dslen = nghttp3_qpack_decoder_get_decoder_streamlen2(dec);
+    if (dslen) {
+      dstream.resize(dslen);
+
+      nghttp3_buf dbuf;
+      dbuf.begin = dbuf.pos = dbuf.last = dstream.data();
+      dbuf.end = dstream.data() + dstream.size();
+
+      nghttp3_qpack_decoder_write_decoder(dec, &dbuf);
+    }
+
+    res.decode_ns += elapsed_ns(t);
+
+    if (dslen) {
+      res.dslen += dslen;
+
+      if (!immediate_ack) {
+        t = std::chrono::steady_clock::now();
+
+        auto nread =
+          nghttp3_qpack_encoder_read_decoder(enc, dstream.data(), dslen);
+        if (nread < 0) {
+          std::cerr << "nghttp3_qpack_encoder_read_decoder: "
+                    << nghttp3_strerror(nread) << std::endl;
+          return -1;
+        }
+
+        res.encode_ns += elapsed_ns(t);
+      }
+    }
+
+    nghttp3_buf_reset(&pbuf);
+    nghttp3_buf_reset(&rbuf);
+    nghttp3_buf_reset(&ebuf);
+
+    stream_id += 4;
+  }
+
+  return 0;
+}
+} // namespace
+
+int bench(const std::string_view &infile) {
+  auto fd = open(infile.data(), O_RDONLY);
+  if (fd == -1) {
+    std::cerr << "Could not open " << infile << ": " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  auto fd_closer = defer(close, fd);
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    std::cerr << "fstat: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  if (st.st_size == 0) {
+    std::cerr << "No header field processed" << std::endl;
+    return -1;
+  }
+
+  auto in = reinterpret_cast<uint8_t *>(
+    mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+  if (in == MAP_FAILED) {
+    std::cerr << "mmap: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  auto unmapper = defer(munmap, in, st.st_size);
+
+  std::vector<Section> sections;
+
+  auto srclen = load_qif(sections, in, in + st.st_size);
+  if (srclen == 0) {
+    std::cerr << "No header field processed" << std::endl;
+    return -1;
+  }
+
+  auto max_dtable_sizes = config.bench_max_dtable_sizes;
+  if (max_dtable_sizes.empty()) {
+    max_dtable_sizes = {0, 256, 512, 4096};
+  }
+
+  auto max_blocked_list = config.bench_max_blocked;
+  if (max_blocked_list.empty()) {
+    max_blocked_list = {0, 100};
+  }
+
+  auto allocators = config.bench_allocators;
+  if (allocators.empty()) {
+    allocators = {"system", "slab"};
+  }
+
+  for (auto &name : allocators) {
+    if (name != "system" && name != "slab") {
+      std::cerr << "Unknown allocator: " << name << std::endl;
+      return -1;
+    }
+  }
+
+  AllocStats stats{};
+  nghttp3_mem mem{&stats, bench_malloc, bench_free, bench_calloc,
+                  bench_realloc};
+
+  std::cout << "# " << infile << ": " << sections.size() << " sections, "
+            << config.iterations << " iterations, immediate_ack="
+            << config.immediate_ack << std::endl;
+  std::cout << std::setw(8) << "alloc" << std::setw(8) << "dtable"
+            << std::setw(8) << "blocked" << std::setw(12) << "enc ns/f"
+            << std::setw(12) << "dec ns/f" << std::setw(10) << "bytes/f"
+            << std::setw(8) << "ratio" << std::setw(12) << "allocs"
+            << std::setw(10) << "allocs/f" << std::setw(10) << "slabs"
+            << std::setw(10) << "large" << std::endl;
+
+  for (auto &name : allocators) {
+    for (auto max_dtable_size : max_dtable_sizes) {
+      for (auto max_blocked : max_blocked_list) {
+        Result res{};
+        nghttp3_slab_mem *slab = nullptr;
+
+        if (name == "slab") {
+          if (auto rv = nghttp3_slab_mem_new(&slab, nullptr); rv != 0) {
+            std::cerr << "nghttp3_slab_mem_new: " << nghttp3_strerror(rv)
+                      << std::endl;
+            return -1;
+          }
+
+          stats.parent = nghttp3_slab_mem_get_mem(slab);
+        } else {
+          stats.parent = nghttp3_mem_default();
+        }
+
+        auto slabd = defer(nghttp3_slab_mem_del, slab);
+
+        stats.nalloc = 0;
+
+        for (size_t i = 0; i < config.iterations; ++i) {
+          if (run_once(res, sections, max_dtable_size, max_blocked,
+                       config.immediate_ack, &mem) != 0) {
+            return -1;
+          }
+        }
+
+        if (res.nfields == 0) {
+          std::cerr << "No header field processed" << std::endl;
+          return -1;
+        }
+
+        nghttp3_slab_mem_stat slab_stat{};
+        if (slab) {
+          nghttp3_slab_mem_get_stat(slab, &slab_stat);
+        }
+
+        auto nfields = static_cast<double>(res.nfields);
+        auto enclen = res.rslen + res.eslen;
+
+        std::cout << std::setw(8) << name << std::setw(8) << max_dtable_size
+                  << std::setw(8) << max_blocked << std::fixed
+                  << std::setprecision(1) << std::setw(12)
+                  << res.encode_ns / nfields << std::setw(12)
+                  << res.decode_ns / nfields << std::setprecision(2)
+                  << std::setw(10) << enclen / nfields << std::setprecision(3)
+                  << std::setw(8)
+                  << static_cast<double>(enclen) /
+                       static_cast<double>(srclen * config.iterations)
+                  << std::setw(12) << stats.nalloc / config.iterations
+                  << std::setprecision(2) << std::setw(10)
+                  << stats.nalloc / nfields << std::setw(10)
+                  << slab_stat.nslab << std::setw(10)
+                  << slab_stat.nlarge_alloc << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
+
+} // namespace nghttp3
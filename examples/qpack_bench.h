@@ -0,0 +1,47 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef QPACK_BENCH_H
+#define QPACK_BENCH_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // defined(HAVE_CONFIG_H)
+
+#include <nghttp3/nghttp3.h>
+
+#include <string>
+
+namespace nghttp3 {
+
+// bench reads QIF formatted header lists from |infile|, and encodes
+// and decodes them repeatedly for each combination of the maximum
+// dynamic table capacity and the maximum number of blocked streams
+// in config.  It prints timing, compression and allocation
+// statistics to stdout.
+int bench(const std::string_view &infile);
+
+} // namespace nghttp3
+
+#endif // !defined(QPACK_BENCH_H)
@@ -616,6 +616,128 @@ typedef struct nghttp3_mem {
  */
 NGHTTP3_EXTERN const nghttp3_mem *nghttp3_mem_default(void);
 
+/**
+ * @struct
+ *
+ * :type:`nghttp3_slab_mem` is an optional memory allocator which
+ * serves small allocations from the per-size-class slabs.  See
+ * `nghttp3_slab_mem_new`.  The details of this structure are
+ * intentionally hidden from the public API.
+ */
+typedef struct nghttp3_slab_mem nghttp3_slab_mem;
+
+#define NGHTTP3_SLAB_MEM_STAT_V1 1
+#define NGHTTP3_SLAB_MEM_STAT_VERSION NGHTTP3_SLAB_MEM_STAT_V1
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_slab_mem_stat` is the statistics of
+ * :type:`nghttp3_slab_mem`.
+ */
+typedef struct nghttp3_slab_mem_stat {
+  /**
+   * :member:`nalloc` is the number of allocations that are served
+   * from the slabs.
+   */
+  uint64_t nalloc;
+  /**
+   * :member:`nlarge_alloc` is the number of allocations that are too
+   * large for any size class and are passed through to the
+   * underlying allocator.
+   */
+  uint64_t nlarge_alloc;
+  /**
+   * :member:`nfree` is the number of deallocations, including the
+   * ones of the large allocations.
+   */
+  uint64_t nfree;
+  /**
+   * :member:`nslab` is the number of slabs that are currently
+   * allocated from the underlying allocator.
+   */
+  size_t nslab;
+  /**
+   * :member:`slab_bytes` is the number of bytes that are occupied by
+   * the slabs.
+   */
+  size_t slab_bytes;
+  /**
+   * :member:`inuse_bytes` is the number of bytes that are currently
+   * handed out to the callers, including the rounding up to the size
+   * class, but excluding the per-allocation header.
+   */
+  size_t inuse_bytes;
+} nghttp3_slab_mem_stat;
+
+/**
+ * @function
+ *
+ * `nghttp3_slab_mem_new` creates :type:`nghttp3_slab_mem`, and stores
+ * the pointer to the object in |*pslab|.  The allocator rounds up
+ * small allocations to one of the size classes, and carves them out
+ * of the slabs which are obtained from |mem|.  Freed chunks are kept
+ * in the per-size-class free list, and the slabs are returned to
+ * |mem| only when the object is freed by `nghttp3_slab_mem_del`.  The
+ * allocations larger than the largest size class are passed through
+ * to |mem|.  If |mem| is ``NULL``, the memory allocator returned by
+ * `nghttp3_mem_default` is used.
+ *
+ * The object is not thread-safe.  It is intended to be created per
+ * thread, and all :type:`nghttp3_conn` objects that use the allocator
+ * returned by `nghttp3_slab_mem_get_mem` must be used by the thread
+ * that owns the object.  This eliminates the contention in the
+ * system allocator between the worker threads.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_slab_mem_new(nghttp3_slab_mem **pslab,
+                                        const nghttp3_mem *mem);
+
+/**
+ * @function
+ *
+ * `nghttp3_slab_mem_del` frees |slab| and all slabs that it owns.
+ * This function does nothing if |slab| is ``NULL``.  No object that
+ * is allocated by the allocator returned by `nghttp3_slab_mem_get_mem`
+ * must be alive.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void nghttp3_slab_mem_del(nghttp3_slab_mem *slab);
+
+/**
+ * @function
+ *
+ * `nghttp3_slab_mem_get_mem` returns :type:`nghttp3_mem` that
+ * allocates memory from |slab|.  The returned pointer is valid until
+ * |slab| is freed, and it can be passed to the functions that take
+ * :type:`nghttp3_mem`, such as `nghttp3_conn_server_new`.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN const nghttp3_mem *
+nghttp3_slab_mem_get_mem(nghttp3_slab_mem *slab);
+
+/**
+ * @function
+ *
+ * `nghttp3_slab_mem_get_stat` stores the statistics of |slab| into
+ * |*dest|.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void
+nghttp3_slab_mem_get_stat_versioned(const nghttp3_slab_mem *slab,
+                                    int stat_version,
+                                    nghttp3_slab_mem_stat *dest);
+
 /**
  * @struct
  *
@@ -1190,6 +1312,37 @@ typedef enum nghttp3_qpack_indexing_strat {
   NGHTTP3_QPACK_INDEXING_STRAT_EAGER
 } nghttp3_qpack_indexing_strat;
 
+/**
+ * @enum
+ *
+ * :type:`nghttp3_qpack_encoding_strat` defines how QPACK encoder
+ * chooses the representation of a field line.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef enum nghttp3_qpack_encoding_strat {
+  /**
+   * :enum:`NGHTTP3_QPACK_ENCODING_STRAT_FAST` chooses the
+   * representation by the fixed rules without estimating its encoded
+   * size.  This is the default strategy.
+   *
+   * .. version-added:: 1.19.0
+   */
+  NGHTTP3_QPACK_ENCODING_STRAT_FAST,
+  /**
+   * :enum:`NGHTTP3_QPACK_ENCODING_STRAT_COMPACT` estimates the encoded
+   * size of each candidate representation, including Huffman encoded
+   * length and the width of the index, and chooses the smallest one.
+   * The cost of inserting a field into the dynamic table is amortized
+   * over its expected reuse.  A field is not expected to be reused if
+   * the dynamic table already has its name with a different value.
+   * This strategy produces fewer bytes at the expense of CPU time.
+   *
+   * .. version-added:: 1.19.0
+   */
+  NGHTTP3_QPACK_ENCODING_STRAT_COMPACT
+} nghttp3_qpack_encoding_strat;
+
 /**
  * @struct
  *
@@ -1350,6 +1503,91 @@ NGHTTP3_EXTERN void
 nghttp3_qpack_encoder_set_indexing_strat(nghttp3_qpack_encoder *encoder,
                                          nghttp3_qpack_indexing_strat strat);
 
+/**
+ * @function
+ *
+ * `nghttp3_qpack_encoder_set_encoding_strat` sets the field line
+ * encoding strategy |strat| to |encoder|.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void
+nghttp3_qpack_encoder_set_encoding_strat(nghttp3_qpack_encoder *encoder,
+                                         nghttp3_qpack_encoding_strat strat);
+
+/**
+ * @function
+ *
+ * `nghttp3_qpack_encoder_set_crumble_cookie` makes |encoder| split
+ * the value of a cookie header field into individual cookie-pairs
+ * (crumbs) delimited by ";" if |enable| is nonzero, and encode each
+ * crumb as a separate cookie field line as permitted by :rfc:`9114`.
+ * Crumbs that do not change between requests can be indexed in
+ * dynamic table on their own.  Crumbs shorter than 20 bytes are not
+ * indexed, like unsplit cookie header fields.  By default, cookie
+ * header fields are not split.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void
+nghttp3_qpack_encoder_set_crumble_cookie(nghttp3_qpack_encoder *encoder,
+                                         int enable);
+
+/**
+ * @function
+ *
+ * `nghttp3_qpack_encoder_set_path_estimate` tells |encoder| the
+ * smoothed round-trip time |rtt| and the packet loss rate |loss_ppm|
+ * in parts per million of the underlying QUIC connection.  |encoder|
+ * uses them to estimate how long a field section would be blocked if
+ * the encoder stream data it depends on is lost.  If the estimate
+ * exceeds 1 millisecond, |encoder| stops referencing dynamic table
+ * entries which are not acknowledged yet, even if the number of
+ * blocked streams is below the limit set by
+ * `nghttp3_qpack_encoder_set_max_blocked_streams`.  It resumes
+ * referencing them once the estimate goes down.  By default, both
+ * |rtt| and |loss_ppm| are 0.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void
+nghttp3_qpack_encoder_set_path_estimate(nghttp3_qpack_encoder *encoder,
+                                        nghttp3_duration rtt,
+                                        uint32_t loss_ppm);
+
+/**
+ * @function
+ *
+ * `nghttp3_qpack_encoder_prime` inserts the HTTP fields |nva| of
+ * length |nvlen| into the dynamic table of |encoder| ahead of time,
+ * and writes the encoder stream instructions to |ebuf|.  The field
+ * sections encoded later can refer to these entries without carrying
+ * them in the encoder stream at the same time.  The field which is
+ * already in the static or the dynamic table is skipped.  The field
+ * which must not be indexed (e.g., the one with
+ * :macro:`NGHTTP3_NV_FLAG_NEVER_INDEX` or authorization) is also
+ * skipped.  The field which does not fit into the dynamic table is
+ * skipped as well.  :macro:`NGHTTP3_NV_FLAG_TRY_INDEX` is implied.
+ *
+ * The buffer pointed by |ebuf| follows the same rules as the one
+ * passed to `nghttp3_qpack_encoder_encode`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory
+ * :macro:`NGHTTP3_ERR_QPACK_FATAL`
+ *      |encoder| is in unrecoverable error state, and cannot be used
+ *      anymore.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_qpack_encoder_prime(nghttp3_qpack_encoder *encoder,
+                                               nghttp3_buf *ebuf,
+                                               const nghttp3_nv *nva,
+                                               size_t nvlen);
+
 /**
  * @function
  *
@@ -1564,6 +1802,17 @@ nghttp3_qpack_decoder_get_icnt(const nghttp3_qpack_decoder *decoder);
  */
 #define NGHTTP3_QPACK_DECODE_FLAG_BLOCKED 0x04U
 
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT` indicates that the
+ * value of the decoded HTTP field is delivered in fragments.  See
+ * `nghttp3_qpack_decoder_set_value_fragment_size`.
+ *
+ * .. version-added:: 1.19.0
+ */
+#define NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT 0x08U
+
 /**
  * @function
  *
@@ -1579,7 +1828,12 @@ nghttp3_qpack_decoder_get_icnt(const nghttp3_qpack_decoder *decoder);
  * :macro:`NGHTTP3_QPACK_DECODE_FLAG_FINAL` set, an entire HTTP field
  * section has been successfully decoded.  If |*pflags| has
  * :macro:`NGHTTP3_QPACK_DECODE_FLAG_BLOCKED` set, decoding is blocked
- * due to required insert count.
+ * due to required insert count.  If |*pflags| has
+ * :macro:`NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT` set, :member:`nv->value
+ * <nghttp3_qpack_nv.value>` only contains a fragment of the value of
+ * the HTTP field, and the fragments that follow are assigned to |nv|
+ * by the subsequent calls.  The last fragment also has
+ * :macro:`NGHTTP3_QPACK_DECODE_FLAG_EMIT` set.
  *
  * When an HTTP field is decoded, an application receives it in |nv|.
  * :member:`nv->name <nghttp3_qpack_nv.name>` and :member:`nv->value
@@ -1689,11 +1943,59 @@ nghttp3_qpack_decoder_cancel_stream(nghttp3_qpack_decoder *decoder,
  * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
  *     |max_dtable_capacity| exceeds the upper bound of the dynamic
  *     table capacity.
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.  This only happens if the contiguous dynamic
+ *     table layout is enabled (see
+ *     `nghttp3_qpack_decoder_set_contiguous_dtable`).
  */
 NGHTTP3_EXTERN int
 nghttp3_qpack_decoder_set_max_dtable_capacity(nghttp3_qpack_decoder *decoder,
                                               size_t max_dtable_capacity);
 
+/**
+ * @function
+ *
+ * `nghttp3_qpack_decoder_set_contiguous_dtable` enables the
+ * contiguous dynamic table layout if |enable| is nonzero.  In this
+ * layout, the names and values of the dynamic table entries are
+ * stored in a single circular buffer which is allocated when the
+ * first entry is inserted, and the entry objects are reused after
+ * eviction.  This saves the memory allocation per entry at the
+ * expense of the circular buffer of twice the size of
+ * ``hard_max_dtable_capacity`` parameter of
+ * `nghttp3_qpack_decoder_new`.  The :type:`nghttp3_rcbuf` objects
+ * that refer to an entry remain valid after the entry is evicted;
+ * their contents are copied out of the circular buffer on eviction
+ * if they are still referenced.
+ *
+ * This function has no effect if the dynamic table is not empty.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void
+nghttp3_qpack_decoder_set_contiguous_dtable(nghttp3_qpack_decoder *decoder,
+                                            int enable);
+
+/**
+ * @function
+ *
+ * `nghttp3_qpack_decoder_set_value_fragment_size` makes |decoder|
+ * deliver a literal field value in fragments of at most |size| bytes
+ * if its encoded length exceeds |size|.  Such a value is never
+ * buffered entirely in |decoder|.  The values of pseudo header fields
+ * and the header fields that nghttp3 interprets (e.g.,
+ * content-length, and priority) are not fragmented.  If |size| is 0,
+ * the values are not fragmented, which is the default.  If |size| is
+ * less than 16, 16 is used instead.  See
+ * :macro:`NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT` for the way the
+ * fragments are delivered.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void
+nghttp3_qpack_decoder_set_value_fragment_size(nghttp3_qpack_decoder *decoder,
+                                              size_t size);
+
 /**
  * @function
  *
@@ -1794,11 +2096,37 @@ NGHTTP3_EXTERN void nghttp3_set_debug_vprintf_callback(
  */
 typedef struct nghttp3_conn nghttp3_conn;
 
+/**
+ * @struct
+ *
+ * :type:`nghttp3_conn_factory` creates :type:`nghttp3_conn` objects
+ * that share the same settings and callbacks, and recycles the memory
+ * of the deleted ones.  See `nghttp3_conn_factory_new`.  The details
+ * of this structure are intentionally hidden from the public API.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef struct nghttp3_conn_factory nghttp3_conn_factory;
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_preamble` is an immutable, serialized control stream
+ * preamble, that is the stream type, SETTINGS frame, and optional
+ * ORIGIN frame, which can be shared by many :type:`nghttp3_conn`
+ * objects.  See `nghttp3_preamble_new`.  The details of this
+ * structure are intentionally hidden from the public API.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef struct nghttp3_preamble nghttp3_preamble;
+
 #define NGHTTP3_SETTINGS_V1 1
 #define NGHTTP3_SETTINGS_V2 2
 #define NGHTTP3_SETTINGS_V3 3
 #define NGHTTP3_SETTINGS_V4 4
-#define NGHTTP3_SETTINGS_VERSION NGHTTP3_SETTINGS_V4
+#define NGHTTP3_SETTINGS_V5 5
+#define NGHTTP3_SETTINGS_VERSION NGHTTP3_SETTINGS_V5
 
 /**
  * @struct
@@ -1899,6 +2227,161 @@ typedef struct nghttp3_settings {
    * .. version-added:: 1.13.0
    */
   nghttp3_qpack_indexing_strat qpack_indexing_strat;
+  /* The following fields have been added since
+     NGHTTP3_SETTINGS_V5. */
+  /**
+   * :member:`qpack_decoder_ack_delay` is the maximum duration that
+   * QPACK decoder instructions (Section Acknowledgment, Stream
+   * Cancellation, and Insert Count Increment) are held back in order
+   * to send them together in a single write to QPACK decoder stream.
+   * The instructions are held back only by
+   * `nghttp3_conn_writev_stream2`.  They are sent without delay if
+   * they get large enough, or a Section Acknowledgment increases the
+   * Known Received Count of the remote QPACK encoder, which might be
+   * waiting for it to unblock streams.  See `nghttp3_conn_get_expiry`
+   * to get the time when the held instructions must be sent.  If
+   * this field is 0, the instructions are sent as soon as possible.
+   *
+   * .. version-added:: 1.19.0
+   */
+  nghttp3_duration qpack_decoder_ack_delay;
+  /**
+   * :member:`qpack_encoding_strat` defines how QPACK encoder chooses
+   * the representation of a field line.
+   *
+   * .. version-added:: 1.19.0
+   */
+  nghttp3_qpack_encoding_strat qpack_encoding_strat;
+  /**
+   * :member:`qpack_decoder_contiguous_dtable`, if set to nonzero,
+   * stores the QPACK decoder dynamic table in a single circular
+   * buffer.  See `nghttp3_qpack_decoder_set_contiguous_dtable`.
+   *
+   * .. version-added:: 1.19.0
+   */
+  uint8_t qpack_decoder_contiguous_dtable;
+  /**
+   * :member:`qpack_encoder_crumble_cookie`, if set to nonzero, splits
+   * cookie header fields into crumbs before QPACK encoding them.  See
+   * `nghttp3_qpack_encoder_set_crumble_cookie`.
+   *
+   * .. version-added:: 1.19.0
+   */
+  uint8_t qpack_encoder_crumble_cookie;
+  /**
+   * :member:`qpack_decoder_join_cookie`, if set to nonzero, joins the
+   * cookie field lines received in a field section with "; " as
+   * described in :rfc:`9114#section-4.2.1`, and passes them as a
+   * single cookie header field to
+   * :member:`nghttp3_callbacks.recv_header` or
+   * :member:`nghttp3_callbacks.recv_trailer` after all other header
+   * fields in the field section.  If only one cookie field line is
+   * received, it is passed as is.
+   *
+   * .. version-added:: 1.19.0
+   */
+  uint8_t qpack_decoder_join_cookie;
+  /**
+   * :member:`qpack_decoder_value_fragment_size`, if set to nonzero
+   * and :member:`nghttp3_callbacks.recv_header_fragment` is set,
+   * makes QPACK decoder deliver a field value longer than this value
+   * in fragments of at most this value bytes, so that it is never
+   * buffered in full.  A cookie delivered in fragments is not joined
+   * even if :member:`qpack_decoder_join_cookie` is set.  See
+   * `nghttp3_qpack_decoder_set_value_fragment_size`.
+   *
+   * .. version-added:: 1.19.0
+   */
+  size_t qpack_decoder_value_fragment_size;
+  /**
+   * :member:`preamble`, if set, is sent on the control stream instead
+   * of the stream type, SETTINGS frame, and ORIGIN frame that would
+   * be serialized from this object.  It must have been created by
+   * `nghttp3_preamble_new` from the settings that have the same
+   * :member:`max_field_section_size`,
+   * :member:`qpack_max_dtable_capacity`,
+   * :member:`qpack_blocked_streams`,
+   * :member:`enable_connect_protocol`, :member:`h3_datagram`, and
+   * :member:`origin_list` as this object.  It is not copied, and an
+   * application must keep it alive until the :type:`nghttp3_conn` to
+   * which this field was passed is freed by `nghttp3_conn_del`.
+   *
+   * .. version-added:: 1.19.0
+   */
+  const nghttp3_preamble *preamble;
+  /**
+   * :member:`read_data_veccnt` is the maximum number of
+   * :type:`nghttp3_vec` or :type:`nghttp3_data_buf` that the library
+   * asks :type:`nghttp3_read_data_callback` or
+   * :type:`nghttp3_read_data_buf_callback` to fill in a single call.
+   * If this field is 0, 8 is used.  The value larger than 64 is
+   * treated as 64.
+   *
+   * .. version-added:: 1.19.0
+   */
+  size_t read_data_veccnt;
+  /**
+   * :member:`data_coalesce_threshold`, if set to nonzero, makes the
+   * library copy the data provided by
+   * :type:`nghttp3_read_data_callback` or
+   * :type:`nghttp3_read_data_buf_callback` into its own buffer if its
+   * length is less than or equal to this value, so that adjacent
+   * small pieces are sent as a single contiguous buffer.  The value
+   * larger than 256 is treated as 256.  The copied data is still
+   * reported by :type:`nghttp3_acked_stream_data` when it is
+   * acknowledged.  The :member:`nghttp3_data_buf.release` of the
+   * copied buffer is called right after the copy.
+   *
+   * .. version-added:: 1.19.0
+   */
+  size_t data_coalesce_threshold;
+  /**
+   * :member:`consumed_report_threshold`, if set to nonzero, makes the
+   * library accumulate the consumed bytes instead of reporting them
+   * each time they are consumed.  In this mode,
+   * `nghttp3_conn_read_stream2` always returns 0 on success, and the
+   * consumed bytes are reported in 2 ways.  The stream level credit
+   * is reported by :type:`nghttp3_deferred_consume` once the bytes
+   * accumulated for a stream reach this value, when the stream is
+   * closed, or when `nghttp3_conn_flush_consumed` is called.  The
+   * connection level credit is only reported by
+   * `nghttp3_conn_flush_consumed` in aggregate.  An application
+   * should call `nghttp3_conn_flush_consumed` once after it has fed
+   * a batch of received data to the library.
+   *
+   * .. version-added:: 1.19.0
+   */
+  size_t consumed_report_threshold;
+  /**
+   * :member:`data_frame_min_len`, if set to nonzero, makes the
+   * library call :type:`nghttp3_read_data_callback` or
+   * :type:`nghttp3_read_data_buf_callback` repeatedly, and put the
+   * data into a single DATA frame until its payload reaches this
+   * value.  The library stops earlier if the callback returns
+   * :macro:`NGHTTP3_ERR_WOULDBLOCK`, sets
+   * :macro:`NGHTTP3_DATA_FLAG_EOF`, or returns no data, and sends
+   * the data gathered so far.  Therefore, it never delays the data
+   * already provided by an application.
+   *
+   * .. version-added:: 1.19.0
+   */
+  size_t data_frame_min_len;
+  /**
+   * :member:`urgency_weights`, if set to non-NULL, points to the
+   * array of 8 weights, one for each urgency level, indexed by the
+   * urgency.  It enables weighted scheduling of request streams.  By
+   * default, streams are scheduled in strict priority order, and a
+   * stream never sends while a stream with more urgent level has
+   * data to send.  With this field, non-empty urgency levels are
+   * served in deficit round robin, and each level gets a share of
+   * the bandwidth proportional to its weight.  Streams in the same
+   * urgency level are scheduled as before.  The weight 0 is treated
+   * as 1.  The array is copied by the library, and it does not have
+   * to outlive the call.
+   *
+   * .. version-added:: 1.19.0
+   */
+  const uint32_t *urgency_weights;
 } nghttp3_settings;
 
 #define NGHTTP3_PROTO_SETTINGS_V1 1
@@ -1999,6 +2482,65 @@ typedef int (*nghttp3_recv_data)(nghttp3_conn *conn, int64_t stream_id,
                                  const uint8_t *data, size_t datalen,
                                  void *conn_user_data, void *stream_user_data);
 
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_recv_datav` is a callback function which is invoked
+ * when parts of request or response body on stream identified by
+ * |stream_id| are received.  |datav| of length |datavcnt| contains
+ * the payload of DATA frames parsed from a single input passed to
+ * `nghttp3_conn_read_stream2` in order.  The memory pointed by
+ * |datav| is only valid during this callback.
+ *
+ * The application is responsible for increasing flow control credit
+ * by the sum of the length of each element in |datav|.
+ *
+ * The implementation of this callback must return 0 if it succeeds.
+ * Returning :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` will return to the
+ * caller immediately.  Any values other than 0 is treated as
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef int (*nghttp3_recv_datav)(nghttp3_conn *conn, int64_t stream_id,
+                                  const nghttp3_vec *datav, size_t datavcnt,
+                                  void *conn_user_data,
+                                  void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_stream_writable` is a callback function which is
+ * invoked when a stream identified by |stream_id| gets data to send
+ * after it has had nothing to send, or has been blocked.  It is
+ * invoked for a request stream when it is scheduled for writing, for
+ * example, by `nghttp3_conn_submit_request`,
+ * `nghttp3_conn_resume_stream`, or `nghttp3_conn_unblock_stream`.
+ * It is also invoked for the control stream when a frame is queued to
+ * it, for QPACK decoder stream when QPACK decoder produces
+ * instructions while processing the incoming data, and for QPACK
+ * encoder stream when the fields passed to `nghttp3_conn_prime_qpack`
+ * are inserted into the dynamic table.  The application
+ * can call `nghttp3_conn_writev_stream2` after this callback is
+ * invoked, instead of calling it speculatively.  QPACK decoder
+ * instructions might be held back according to
+ * :member:`nghttp3_settings.qpack_decoder_ack_delay`.  In that case,
+ * see `nghttp3_conn_get_expiry`.
+ *
+ * The application must not call `nghttp3_conn_writev_stream2` or
+ * the similar functions inside this callback.
+ *
+ * The implementation of this callback must return 0 if it succeeds.
+ * Returning :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` will return to the
+ * caller immediately.  Any values other than 0 is treated as
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef int (*nghttp3_stream_writable)(nghttp3_conn *conn, int64_t stream_id,
+                                       void *conn_user_data,
+                                       void *stream_user_data);
+
 /**
  * @functypedef
  *
@@ -2312,11 +2854,48 @@ typedef int (*nghttp3_stream_close2)(nghttp3_conn *conn, uint32_t flags,
                                      void *conn_user_data,
                                      void *stream_user_data);
 
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_recv_header_fragment` is a callback function which
+ * is invoked when a fragment of a large HTTP field value is received
+ * on a stream denoted by |stream_id|.  |name| contains a field name,
+ * and |value| contains a fragment of a field value.  |token| is one
+ * of token defined in :type:`nghttp3_qpack_token` or -1 if no token
+ * is defined for |name|.  |flags| is bitwise OR of zero or more of
+ * :macro:`NGHTTP3_NV_FLAG_* <NGHTTP3_NV_FLAG_NONE>`.  |fin| is
+ * nonzero if |value| is the last fragment of the field value.  The
+ * fragments of a field value are delivered in order, and no other
+ * field is delivered between them.  This callback is used for both
+ * header fields and trailer fields.
+ *
+ * The field value is validated as a whole, and a stream that receives
+ * an invalid field value is treated as malformed after the last
+ * fragment has been delivered.
+ *
+ * The buffers for |name| and |value| are reference counted. If
+ * application needs to keep them, increment the reference count with
+ * `nghttp3_rcbuf_incref`.  When they are no longer used, call
+ * `nghttp3_rcbuf_decref`.
+ *
+ * The implementation of this callback must return 0 if it succeeds.
+ * Returning :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` will return to the
+ * caller immediately.  Any values other than 0 is treated as
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef int (*nghttp3_recv_header_fragment)(
+  nghttp3_conn *conn, int64_t stream_id, int32_t token, nghttp3_rcbuf *name,
+  nghttp3_rcbuf *value, uint8_t flags, int fin, void *conn_user_data,
+  void *stream_user_data);
+
 #define NGHTTP3_CALLBACKS_V1 1
 #define NGHTTP3_CALLBACKS_V2 2
 #define NGHTTP3_CALLBACKS_V3 3
 #define NGHTTP3_CALLBACKS_V4 4
-#define NGHTTP3_CALLBACKS_VERSION NGHTTP3_CALLBACKS_V4
+#define NGHTTP3_CALLBACKS_V5 5
+#define NGHTTP3_CALLBACKS_VERSION NGHTTP3_CALLBACKS_V5
 
 /**
  * @struct
@@ -2462,6 +3041,36 @@ typedef struct nghttp3_callbacks {
    * .. version-added:: 1.18.0
    */
   nghttp3_stream_close2 stream_close2;
+  /* The following fields have been added since
+     NGHTTP3_CALLBACKS_V5. */
+  /**
+   * :member:`recv_header_fragment` is a callback function which is
+   * invoked when a fragment of a large HTTP field value is received.
+   * If this field is set, the field values longer than
+   * :member:`nghttp3_settings.qpack_decoder_value_fragment_size` are
+   * delivered to this callback instead of
+   * :member:`recv_header` or :member:`recv_trailer`.
+   *
+   * .. version-added:: 1.19.0
+   */
+  nghttp3_recv_header_fragment recv_header_fragment;
+  /**
+   * :member:`recv_datav` is a callback function which is invoked
+   * when request or response body is received.  If this field is
+   * set, :member:`recv_data` is not called, and the DATA frame
+   * payload found in a single input to `nghttp3_conn_read_stream2`
+   * is delivered to this callback in a batch.
+   *
+   * .. version-added:: 1.19.0
+   */
+  nghttp3_recv_datav recv_datav;
+  /**
+   * :member:`stream_writable` is a callback function which is invoked
+   * when a stream gets data to send.
+   *
+   * .. version-added:: 1.19.0
+   */
+  nghttp3_stream_writable stream_writable;
 } nghttp3_callbacks;
 
 /**
@@ -2489,6 +3098,47 @@ NGHTTP3_EXTERN void
 nghttp3_settings_default_versioned(int settings_version,
                                    nghttp3_settings *settings);
 
+/**
+ * @function
+ *
+ * `nghttp3_preamble_new` serializes the control stream preamble that
+ * :type:`nghttp3_conn` created with |settings| sends, and stores it
+ * in a newly allocated :type:`nghttp3_preamble` object.  The pointer
+ * to the object is stored in |*ppreamble|.  The preamble includes
+ * ORIGIN frame if :member:`settings->origin_list
+ * <nghttp3_settings.origin_list>` is set, and such a preamble must
+ * only be used by server.  :member:`settings->preamble
+ * <nghttp3_settings.preamble>` is ignored.  If |mem| is ``NULL``, the
+ * memory allocator returned by `nghttp3_mem_default` is used.
+ *
+ * The object is never modified after creation, and it can be shared
+ * by any number of :type:`nghttp3_conn` objects via
+ * :member:`nghttp3_settings.preamble`, including the ones that are
+ * used by the different threads.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_preamble_new_versioned(
+  nghttp3_preamble **ppreamble, int settings_version,
+  const nghttp3_settings *settings, const nghttp3_mem *mem);
+
+/**
+ * @function
+ *
+ * `nghttp3_preamble_del` frees |preamble|.  This function does
+ * nothing if |preamble| is ``NULL``.  No :type:`nghttp3_conn` that
+ * refers to |preamble| must be alive.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void nghttp3_preamble_del(nghttp3_preamble *preamble);
+
 /**
  * @function
  *
@@ -2501,7 +3151,9 @@ nghttp3_settings_default_versioned(int settings_version,
  * negative error codes:
  *
  * :macro:`NGHTTP3_ERR_NOMEM`
- *     Out of memory.
+ *     Out of memory. * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     :member:`settings->preamble <nghttp3_settings.preamble>` does
+ *     not advertise the same values as |settings|.
  */
 NGHTTP3_EXTERN int
 nghttp3_conn_client_new_versioned(nghttp3_conn **pconn, int callbacks_version,
@@ -2522,7 +3174,9 @@ nghttp3_conn_client_new_versioned(nghttp3_conn **pconn, int callbacks_version,
  * negative error codes:
  *
  * :macro:`NGHTTP3_ERR_NOMEM`
- *     Out of memory.
+ *     Out of memory. * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     :member:`settings->preamble <nghttp3_settings.preamble>` does
+ *     not advertise the same values as |settings|.
  */
 NGHTTP3_EXTERN int
 nghttp3_conn_server_new_versioned(nghttp3_conn **pconn, int callbacks_version,
@@ -2540,6 +3194,78 @@ nghttp3_conn_server_new_versioned(nghttp3_conn **pconn, int callbacks_version,
  */
 NGHTTP3_EXTERN void nghttp3_conn_del(nghttp3_conn *conn);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_factory_new` creates :type:`nghttp3_conn_factory`
+ * which creates :type:`nghttp3_conn` for server use if |server| is
+ * nonzero, or for client use otherwise.  The pointer to the object is
+ * stored in |*pfactory|.  |callbacks| and |settings| are copied, and
+ * used by all :type:`nghttp3_conn` objects that the factory creates.
+ * If :member:`settings->origin_list <nghttp3_settings.origin_list>`
+ * or :member:`settings->preamble <nghttp3_settings.preamble>` is set,
+ * an application must keep the object pointed by them alive until the
+ * factory is freed.  If |mem| is ``NULL``, the memory allocator
+ * returned by `nghttp3_mem_default` is used.
+ *
+ * The factory pools up to |max_shells| connection shells, and all of
+ * them are allocated by this function.  A shell is the memory of
+ * :type:`nghttp3_conn` that retains its internal memory pools and
+ * buffers.  `nghttp3_conn_factory_conn_new` takes a shell from the
+ * pool, and `nghttp3_conn_del` resets the connection and puts it back
+ * to the pool instead of freeing it if the pool is not full.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     :member:`settings->preamble <nghttp3_settings.preamble>` does
+ *     not advertise the same values as |settings|.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_conn_factory_new_versioned(
+  nghttp3_conn_factory **pfactory, int server, int callbacks_version,
+  const nghttp3_callbacks *callbacks, int settings_version,
+  const nghttp3_settings *settings, size_t max_shells,
+  const nghttp3_mem *mem);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_factory_del` frees resources allocated for |factory|
+ * including the pooled connection shells.  All :type:`nghttp3_conn`
+ * objects created by |factory| must be freed by `nghttp3_conn_del`
+ * before calling this function.  This function does nothing if
+ * |factory| is ``NULL``.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void nghttp3_conn_factory_del(nghttp3_conn_factory *factory);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_factory_conn_new` creates :type:`nghttp3_conn` with
+ * the settings and callbacks of |factory|, and stores the pointer to
+ * it in |*pconn|.  A pooled connection shell is used if available.
+ * |conn_user_data| is the user data of the connection.  The created
+ * object must be freed by `nghttp3_conn_del`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_conn_factory_conn_new(nghttp3_conn_factory *factory,
+                                                 nghttp3_conn **pconn,
+                                                 void *conn_user_data);
+
 /**
  * @function
  *
@@ -2649,6 +3375,31 @@ NGHTTP3_EXTERN nghttp3_ssize nghttp3_conn_read_stream2(nghttp3_conn *conn,
                                                        size_t srclen, int fin,
                                                        nghttp3_tstamp ts);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_flush_consumed` reports the consumed bytes
+ * accumulated by |conn| if
+ * :member:`nghttp3_settings.consumed_report_threshold` is nonzero.
+ * It calls :type:`nghttp3_deferred_consume` once for each stream
+ * which has the bytes not reported yet, and assigns the number of
+ * bytes consumed by all streams since the last call of this function
+ * to |*pnconsumed|.  The application is responsible for increasing
+ * the connection level flow control credit by |*pnconsumed| bytes.
+ * If :member:`nghttp3_settings.consumed_report_threshold` is 0, this
+ * function does nothing, and assigns 0 to |*pnconsumed|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`
+ *     User callback failed.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_conn_flush_consumed(nghttp3_conn *conn,
+                                               uint64_t *pnconsumed);
+
 /**
  * @function
  *
@@ -2685,6 +3436,36 @@ NGHTTP3_EXTERN nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
                                                         nghttp3_vec *vec,
                                                         size_t veccnt);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_writev_stream2` is similar to
+ * `nghttp3_conn_writev_stream`, but it takes the current timestamp
+ * |ts|.  |ts| must be non-decreasing.  It should be obtained from the
+ * clock that is steadily increasing.  If
+ * :member:`nghttp3_settings.qpack_decoder_ack_delay` is nonzero, this
+ * function may hold back QPACK decoder instructions until the time
+ * returned from `nghttp3_conn_get_expiry`, so that they are sent
+ * together.  `nghttp3_conn_writev_stream` never holds them back.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN nghttp3_ssize nghttp3_conn_writev_stream2(
+  nghttp3_conn *conn, int64_t *pstream_id, int *pfin, nghttp3_vec *vec,
+  size_t veccnt, nghttp3_tstamp ts);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_get_expiry` returns the time when an application
+ * should call `nghttp3_conn_writev_stream2` to send QPACK decoder
+ * instructions held back by it.  It returns UINT64_MAX if there is
+ * nothing to wait for.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN nghttp3_tstamp nghttp3_conn_get_expiry(const nghttp3_conn *conn);
+
 /**
  * @function
  *
@@ -3010,6 +3791,60 @@ NGHTTP3_EXTERN void
 nghttp3_conn_set_max_client_streams_bidi(nghttp3_conn *conn,
                                          uint64_t max_streams);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_set_path_estimate` tells |conn| the smoothed
+ * round-trip time |rtt| and the packet loss rate |loss_ppm| in parts
+ * per million of the underlying QUIC connection.  An application
+ * should call this function whenever QUIC stack updates them.  QPACK
+ * encoder uses them to decide whether it risks head-of-line blocking
+ * by referencing dynamic table entries which are not acknowledged
+ * yet.  See `nghttp3_qpack_encoder_set_path_estimate` for details.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void nghttp3_conn_set_path_estimate(nghttp3_conn *conn,
+                                                   nghttp3_duration rtt,
+                                                   uint32_t loss_ppm);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_prime_qpack` inserts the HTTP fields |nva| of length
+ * |nvlen|, which an application expects to send repeatedly, into
+ * QPACK dynamic table so that the entries are in place before the
+ * first HEADERS frame needs them.  If SETTINGS frame has not been
+ * received from the remote endpoint yet, |nva| is copied and the
+ * insertion is deferred until the frame arrives because the dynamic
+ * table capacity is unknown until then.  Otherwise, the fields are
+ * inserted immediately.  The encoder stream instructions are queued
+ * to QPACK encoder stream, and sent by
+ * `nghttp3_conn_writev_stream`.  See `nghttp3_qpack_encoder_prime`
+ * for which fields are skipped.
+ *
+ * `nghttp3_conn_bind_qpack_streams` must be called before calling
+ * this function.  This function can be called at most once before
+ * SETTINGS frame is received.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_INVALID_STATE`
+ *     QPACK encoder stream has not been bound yet, or the fields
+ *     passed by the previous call are still waiting for SETTINGS
+ *     frame.
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory
+ * :macro:`NGHTTP3_ERR_QPACK_FATAL`
+ *     QPACK encoder is in unrecoverable error state.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_conn_prime_qpack(nghttp3_conn *conn,
+                                            const nghttp3_nv *nva,
+                                            size_t nvlen);
+
 /**
  * @function
  *
@@ -3068,6 +3903,164 @@ typedef struct nghttp3_data_reader {
   nghttp3_read_data_callback read_data;
 } nghttp3_data_reader;
 
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_data_buf_release` is a callback function which is
+ * invoked when the library no longer needs the buffer that was passed
+ * by :type:`nghttp3_data_buf`.  |user_data| is
+ * :member:`nghttp3_data_buf.user_data`.
+ *
+ * This callback may be called from `nghttp3_conn_del`, and it must
+ * not call any nghttp3 function.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef void (*nghttp3_data_buf_release)(void *user_data);
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_data_buf` is a buffer that an application passes to
+ * the library via :type:`nghttp3_read_data_buf_callback`.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef struct nghttp3_data_buf {
+  /**
+   * :member:`base` points to the data.
+   */
+  uint8_t *base;
+  /**
+   * :member:`len` is the number of bytes that the buffer contains.
+   */
+  size_t len;
+  /**
+   * :member:`release`, if set, is called with :member:`user_data`
+   * exactly once when all bytes of the buffer are acknowledged by the
+   * remote endpoint, or the stream is freed.
+   */
+  nghttp3_data_buf_release release;
+  /**
+   * :member:`user_data` is an arbitrary user data which is passed to
+   * :member:`release`.  Typically, it points to the reference counted
+   * object that owns :member:`base`.
+   */
+  void *user_data;
+} nghttp3_data_buf;
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_read_data_buf_callback` is like
+ * :type:`nghttp3_read_data_callback`, but the application fills
+ * |buf| of length |bufcnt|, and each buffer carries its own release
+ * callback.  The application must retain data until
+ * :member:`nghttp3_data_buf.release` is called.  Once this callback
+ * returns successfully, the library calls
+ * :member:`nghttp3_data_buf.release` for each returned buffer exactly
+ * once, including the buffers of length 0.
+ * :type:`nghttp3_acked_stream_data` is not called for the data
+ * provided by this callback, and the application does not need to
+ * count the acknowledged bytes.
+ *
+ * The flags and the return value are the same as
+ * :type:`nghttp3_read_data_callback`.  If this callback fails, the
+ * library does not call any :member:`nghttp3_data_buf.release`.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef nghttp3_ssize (*nghttp3_read_data_buf_callback)(
+  nghttp3_conn *conn, int64_t stream_id, nghttp3_data_buf *buf, size_t bufcnt,
+  uint32_t *pflags, void *conn_user_data, void *stream_user_data);
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_data_buf_reader` is like :type:`nghttp3_data_reader`,
+ * but it generates request or response body in the buffers which are
+ * released individually on acknowledgement.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef struct nghttp3_data_buf_reader {
+  /**
+   * :member:`read_data_buf` is a callback function to generate body.
+   */
+  nghttp3_read_data_buf_callback read_data_buf;
+} nghttp3_data_buf_reader;
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_file_reader` serves a range of a file as a body
+ * through :type:`nghttp3_data_buf` which points directly to the
+ * memory mapped file.  See `nghttp3_file_reader_new`.  The details
+ * of this structure are intentionally hidden from the public API.
+ */
+typedef struct nghttp3_file_reader nghttp3_file_reader;
+
+/**
+ * @function
+ *
+ * `nghttp3_file_reader_new` creates :type:`nghttp3_file_reader` which
+ * serves |len| bytes of the file denoted by |fd| starting at
+ * |offset|, and stores the pointer to the object in |*preader|.  The
+ * file is mapped into memory window by window as the body is read,
+ * and the next window is prefetched.  Each window is unmapped when
+ * all of its bytes are acknowledged by the remote endpoint, or the
+ * stream is freed.  |fd| must be kept open until
+ * `nghttp3_file_reader_read` returns
+ * :macro:`NGHTTP3_DATA_FLAG_EOF` or the object is freed.  The file
+ * must not be truncated while it is mapped.  If |mem| is ``NULL``,
+ * the memory allocator returned by `nghttp3_mem_default` is used.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_INVALID_STATE`
+ *     Memory mapped file is not supported on this platform.
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_file_reader_new(nghttp3_file_reader **preader,
+                                           int fd, uint64_t offset,
+                                           uint64_t len,
+                                           const nghttp3_mem *mem);
+
+/**
+ * @function
+ *
+ * `nghttp3_file_reader_del` frees |reader|.  The windows that are
+ * still referenced by the streams stay mapped until they are
+ * released.  This function does nothing if |reader| is ``NULL``.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN void nghttp3_file_reader_del(nghttp3_file_reader *reader);
+
+/**
+ * @function
+ *
+ * `nghttp3_file_reader_read` fills |buf| of length |bufcnt| with the
+ * next window of the file.  It is intended to be called from
+ * :type:`nghttp3_read_data_buf_callback`, and its return value can
+ * be returned from the callback as is.  It sets
+ * :macro:`NGHTTP3_DATA_FLAG_EOF` to |*pflags| when the last window is
+ * returned.
+ *
+ * This function returns the number of filled objects if it succeeds,
+ * or :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` if it fails to map the
+ * file.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN nghttp3_ssize
+nghttp3_file_reader_read(nghttp3_file_reader *reader, nghttp3_data_buf *buf,
+                         size_t bufcnt, uint32_t *pflags);
+
 /**
  * @function
  *
@@ -3137,6 +4130,32 @@ NGHTTP3_EXTERN int nghttp3_conn_submit_response(nghttp3_conn *conn,
                                                 size_t nvlen,
                                                 const nghttp3_data_reader *dr);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_submit_request_buf` is like
+ * `nghttp3_conn_submit_request`, but it takes
+ * :type:`nghttp3_data_buf_reader` to provide a request body.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_conn_submit_request_buf(
+  nghttp3_conn *conn, int64_t stream_id, const nghttp3_nv *nva, size_t nvlen,
+  const nghttp3_data_buf_reader *dr, void *stream_user_data);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_submit_response_buf` is like
+ * `nghttp3_conn_submit_response`, but it takes
+ * :type:`nghttp3_data_buf_reader` to provide a response body.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN int nghttp3_conn_submit_response_buf(
+  nghttp3_conn *conn, int64_t stream_id, const nghttp3_nv *nva, size_t nvlen,
+  const nghttp3_data_buf_reader *dr);
+
 /**
  * @function
  *
@@ -3315,6 +4334,52 @@ typedef struct NGHTTP3_ALIGN(8) nghttp3_pri {
   uint8_t inc;
 } nghttp3_pri;
 
+#define NGHTTP3_WRITEV_HINT_V1 1
+#define NGHTTP3_WRITEV_HINT_VERSION NGHTTP3_WRITEV_HINT_V1
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_writev_hint` describes the stream whose data is
+ * returned from `nghttp3_conn_writev_stream_hint`, so that QUIC
+ * stack can take it into account when it assembles packets and
+ * retransmits lost data.
+ *
+ * .. version-added:: 1.19.0
+ */
+typedef struct nghttp3_writev_hint {
+  /**
+   * :member:`pri` is the priority of the stream.  For the control
+   * stream and QPACK encoder/decoder streams, :member:`pri.urgency
+   * <nghttp3_pri.urgency>` is :macro:`NGHTTP3_URGENCY_HIGH` and
+   * :member:`pri.inc <nghttp3_pri.inc>` is 0.
+   */
+  nghttp3_pri pri;
+  /**
+   * :member:`more` is nonzero if the stream has more data to send
+   * beyond the data returned by the same call, and it can be sent
+   * without waiting for flow control credit or
+   * :type:`nghttp3_read_data_callback`.
+   */
+  uint8_t more;
+} nghttp3_writev_hint;
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_writev_stream_hint` is similar to
+ * `nghttp3_conn_writev_stream2`, but if it returns stream data,
+ * it also stores the priority of the stream and whether it has more
+ * data to send into |*hint|.  If |*pstream_id| is -1, |*hint| is
+ * left untouched.
+ *
+ * .. version-added:: 1.19.0
+ */
+NGHTTP3_EXTERN nghttp3_ssize nghttp3_conn_writev_stream_hint_versioned(
+  nghttp3_conn *conn, int64_t *pstream_id, int *pfin, nghttp3_vec *vec,
+  size_t veccnt, nghttp3_tstamp ts, int hint_version,
+  nghttp3_writev_hint *hint);
+
 /**
  * @function
  *
@@ -3641,6 +4706,14 @@ NGHTTP3_EXTERN size_t nghttp3_put_uvarintlen(uint64_t n);
 #define nghttp3_settings_default(SETTINGS)                                     \
   nghttp3_settings_default_versioned(NGHTTP3_SETTINGS_VERSION, (SETTINGS))
 
+/*
+ * `nghttp3_preamble_new` is a wrapper around
+ * `nghttp3_preamble_new_versioned` to set the correct struct version.
+ */
+#define nghttp3_preamble_new(PPREAMBLE, SETTINGS, MEM)                         \
+  nghttp3_preamble_new_versioned((PPREAMBLE), NGHTTP3_SETTINGS_VERSION,        \
+                                 (SETTINGS), (MEM))
+
 /*
  * `nghttp3_conn_client_new` is a wrapper around
  * `nghttp3_conn_client_new_versioned` to set the correct struct
@@ -3661,6 +4734,17 @@ NGHTTP3_EXTERN size_t nghttp3_put_uvarintlen(uint64_t n);
                                     (CALLBACKS), NGHTTP3_SETTINGS_VERSION,     \
                                     (SETTINGS), (MEM), (USER_DATA))
 
+/*
+ * `nghttp3_conn_factory_new` is a wrapper around
+ * `nghttp3_conn_factory_new_versioned` to set the correct struct
+ * version.
+ */
+#define nghttp3_conn_factory_new(PFACTORY, SERVER, CALLBACKS, SETTINGS,        \
+                                 MAX_SHELLS, MEM)                              \
+  nghttp3_conn_factory_new_versioned(                                          \
+    (PFACTORY), (SERVER), NGHTTP3_CALLBACKS_VERSION, (CALLBACKS),              \
+    NGHTTP3_SETTINGS_VERSION, (SETTINGS), (MAX_SHELLS), (MEM))
+
 /*
  * `nghttp3_conn_set_server_stream_priority` is a wrapper around
  * `nghttp3_conn_set_server_stream_priority_versioned` to set the
@@ -3697,6 +4781,26 @@ NGHTTP3_EXTERN size_t nghttp3_put_uvarintlen(uint64_t n);
   nghttp3_pri_parse_priority_versioned(NGHTTP3_PRI_VERSION, (DEST), (VALUE),   \
                                        (LEN))
 
+/*
+ * `nghttp3_slab_mem_get_stat` is a wrapper around
+ * `nghttp3_slab_mem_get_stat_versioned` to set the correct struct
+ * version.
+ */
+#define nghttp3_slab_mem_get_stat(SLAB, DEST)                                  \
+  nghttp3_slab_mem_get_stat_versioned((SLAB), NGHTTP3_SLAB_MEM_STAT_VERSION,   \
+                                      (DEST))
+
+/*
+ * `nghttp3_conn_writev_stream_hint` is a wrapper around
+ * `nghttp3_conn_writev_stream_hint_versioned` to set the correct
+ * struct version.
+ */
+#define nghttp3_conn_writev_stream_hint(CONN, PSTREAM_ID, PFIN, VEC, VECCNT,   \
+                                        TS, HINT)                              \
+  nghttp3_conn_writev_stream_hint_versioned((CONN), (PSTREAM_ID), (PFIN),      \
+                                            (VEC), (VECCNT), (TS),             \
+                                            NGHTTP3_WRITEV_HINT_VERSION, (HINT))
+
 #ifdef __cplusplus
 }
 #endif /* defined(__cplusplus) */
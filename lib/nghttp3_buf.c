@@ -94,6 +94,8 @@ void nghttp3_typed_buf_init(nghttp3_typed_buf *tbuf, const nghttp3_buf *buf,
   tbuf->buf = *buf;
   tbuf->type = type;
   tbuf->buf.begin = tbuf->buf.pos;
+  tbuf->release = NULL;
+  tbuf->user_data = NULL;
 }
 
 void nghttp3_typed_buf_shared_init(nghttp3_typed_buf *tbuf,
@@ -101,4 +103,6 @@ void nghttp3_typed_buf_shared_init(nghttp3_typed_buf *tbuf,
   tbuf->buf = *chunk;
   tbuf->type = NGHTTP3_BUF_TYPE_SHARED;
   tbuf->buf.begin = tbuf->buf.pos = tbuf->buf.last;
+  tbuf->release = NULL;
+  tbuf->user_data = NULL;
 }
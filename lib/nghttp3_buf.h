@@ -69,11 +69,23 @@ typedef enum nghttp3_buf_type {
   /* NGHTTP3_BUF_TYPE_ALIEN_NO_ACK is like NGHTTP3_BUF_TYPE_ALIEN, but
      acked_data callback is not called. */
   NGHTTP3_BUF_TYPE_ALIEN_NO_ACK,
+  /* NGHTTP3_BUF_TYPE_ALIEN_RELEASE is like
+     NGHTTP3_BUF_TYPE_ALIEN_NO_ACK, but release callback is called
+     when the buffer is fully acknowledged or freed. */
+  NGHTTP3_BUF_TYPE_ALIEN_RELEASE,
+  /* NGHTTP3_BUF_TYPE_SHARED_ACK is like NGHTTP3_BUF_TYPE_SHARED, but
+     it contains the data copied from NGHTTP3_BUF_TYPE_ALIEN buffers.
+     When acknowledged, acked_data callback is called. */
+  NGHTTP3_BUF_TYPE_SHARED_ACK,
 } nghttp3_buf_type;
 
 typedef struct nghttp3_typed_buf {
   nghttp3_buf buf;
   nghttp3_buf_type type;
+  /* release and user_data are only used by
+     NGHTTP3_BUF_TYPE_ALIEN_RELEASE. */
+  nghttp3_data_buf_release release;
+  void *user_data;
 } nghttp3_typed_buf;
 
 void nghttp3_typed_buf_init(nghttp3_typed_buf *tbuf, const nghttp3_buf *buf,
@@ -66,6 +66,9 @@ size_t nghttp3_callbackslen_version(int callbacks_version) {
   switch (callbacks_version) {
   case NGHTTP3_CALLBACKS_VERSION:
     return sizeof(callbacks);
+  case NGHTTP3_CALLBACKS_V4:
+    return offsetof(nghttp3_callbacks, stream_close2) +
+           sizeof(callbacks.stream_close2);
   case NGHTTP3_CALLBACKS_V3:
     return offsetof(nghttp3_callbacks, recv_settings2) +
            sizeof(callbacks.recv_settings2);
@@ -34,8 +34,10 @@
 #include "nghttp3_conv.h"
 #include "nghttp3_http.h"
 #include "nghttp3_unreachable.h"
+#include "nghttp3_str.h"
 #include "nghttp3_settings.h"
 #include "nghttp3_callbacks.h"
+#include "nghttp3_preamble.h"
 
 nghttp3_objalloc_def(chunk, nghttp3_chunk, oplent)
 
@@ -137,6 +139,58 @@ static int conn_call_end_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
   return 0;
 }
 
+static int conn_call_stream_writable(nghttp3_conn *conn,
+                                     nghttp3_stream *stream) {
+  int rv;
+
+  if (!conn->callbacks.stream_writable) {
+    return 0;
+  }
+
+  rv = conn->callbacks.stream_writable(conn, stream->node.id, conn->user_data,
+                                       stream->user_data);
+  if (rv != 0) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_uni_stream_pending returns nonzero if local unidirectional
+ * |stream| has data to send.  |stream| may be NULL.
+ */
+static int conn_uni_stream_pending(const nghttp3_conn *conn,
+                                   const nghttp3_stream *stream) {
+  if (stream == NULL) {
+    return 0;
+  }
+
+  if (!nghttp3_stream_outq_write_done(stream) ||
+      nghttp3_ringbuf_len(&stream->frq)) {
+    return 1;
+  }
+
+  return stream == conn->tx.qdec &&
+         nghttp3_qpack_decoder_get_decoder_streamlen2(&conn->qdec) > 0;
+}
+
+/*
+ * conn_notify_uni_stream calls nghttp3_callbacks.stream_writable for
+ * local unidirectional |stream| if it has data to send now, and it
+ * had nothing to send before, which is indicated by |pending| == 0.
+ * |stream| may be NULL.
+ */
+static int conn_notify_uni_stream(nghttp3_conn *conn, nghttp3_stream *stream,
+                                  int pending) {
+  if (pending || !conn_uni_stream_pending(conn, stream) ||
+      nghttp3_stream_is_blocked(stream)) {
+    return 0;
+  }
+
+  return conn_call_stream_writable(conn, stream);
+}
+
 static int conn_call_stop_sending(nghttp3_conn *conn, nghttp3_stream *stream,
                                   uint64_t app_error_code) {
   int rv;
@@ -189,6 +243,75 @@ static int conn_call_deferred_consume(nghttp3_conn *conn,
   return 0;
 }
 
+/*
+ * conn_take_consumed removes |stream| from the list of streams which
+ * have unreported consumed bytes, and returns the number of those
+ * bytes.
+ */
+static size_t conn_take_consumed(nghttp3_conn *conn, nghttp3_stream *stream) {
+  size_t nconsumed = stream->rx.nconsumed;
+
+  if (nconsumed == 0) {
+    return 0;
+  }
+
+  if (stream->rx.consumed_prev) {
+    stream->rx.consumed_prev->rx.consumed_next = stream->rx.consumed_next;
+  } else {
+    assert(conn->rx.consumed_head == stream);
+
+    conn->rx.consumed_head = stream->rx.consumed_next;
+  }
+
+  if (stream->rx.consumed_next) {
+    stream->rx.consumed_next->rx.consumed_prev = stream->rx.consumed_prev;
+  }
+
+  stream->rx.consumed_prev = NULL;
+  stream->rx.consumed_next = NULL;
+  stream->rx.nconsumed = 0;
+
+  return nconsumed;
+}
+
+/*
+ * conn_consume handles |nconsumed| bytes consumed by |stream|.  If
+ * nghttp3_settings.consumed_report_threshold is 0, they are reported
+ * immediately.  Otherwise, they are accumulated until the threshold
+ * is reached or nghttp3_conn_flush_consumed is called.
+ */
+static int conn_consume(nghttp3_conn *conn, nghttp3_stream *stream,
+                        size_t nconsumed) {
+  size_t threshold = conn->local.settings.consumed_report_threshold;
+
+  if (nconsumed == 0) {
+    return 0;
+  }
+
+  if (threshold == 0) {
+    return conn_call_deferred_consume(conn, stream, nconsumed);
+  }
+
+  conn->rx.nconsumed += nconsumed;
+
+  if (stream->rx.nconsumed == 0) {
+    stream->rx.consumed_next = conn->rx.consumed_head;
+    if (conn->rx.consumed_head) {
+      conn->rx.consumed_head->rx.consumed_prev = stream;
+    }
+    conn->rx.consumed_head = stream;
+  }
+
+  stream->rx.nconsumed += nconsumed;
+
+  if (stream->rx.nconsumed < threshold) {
+    return 0;
+  }
+
+  return conn_call_deferred_consume(conn, stream,
+                                    conn_take_consumed(conn, stream));
+}
+
 static int conn_call_recv_settings(nghttp3_conn *conn) {
   int rv;
 
@@ -225,6 +348,52 @@ static int conn_call_recv_settings(nghttp3_conn *conn) {
   return 0;
 }
 
+/*
+ * conn_prime_qpack inserts |nva| of length |nvlen| into QPACK dynamic
+ * table, and queues the encoder stream instructions to QPACK encoder
+ * stream.
+ */
+static int conn_prime_qpack(nghttp3_conn *conn, const nghttp3_nv *nva,
+                            size_t nvlen) {
+  int rv;
+
+  assert(conn->tx.qenc);
+
+  rv = nghttp3_qpack_encoder_prime(&conn->qenc, &conn->tx.qpack.ebuf, nva,
+                                   nvlen);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return nghttp3_stream_write_qpack_encoder_stream(conn->tx.qenc,
+                                                   &conn->tx.qpack.ebuf);
+}
+
+/*
+ * conn_on_settings_recved is called when SETTINGS frame has been
+ * completely received.  It inserts the HTTP fields deferred by
+ * nghttp3_conn_prime_qpack now that the dynamic table capacity is
+ * known, and then calls recv_settings callback.
+ */
+static int conn_on_settings_recved(nghttp3_conn *conn) {
+  nghttp3_nv *nva = conn->tx.qpack.prime_nva;
+  int rv;
+
+  if (nva) {
+    rv = conn_prime_qpack(conn, nva, conn->tx.qpack.prime_nvlen);
+
+    nghttp3_nva_del(nva, conn->mem);
+    conn->tx.qpack.prime_nva = NULL;
+    conn->tx.qpack.prime_nvlen = 0;
+
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return conn_call_recv_settings(conn);
+}
+
 static int conn_call_recv_origin(nghttp3_conn *conn, const uint8_t *origin,
                                  size_t originlen) {
   if (!conn->callbacks.recv_origin) {
@@ -282,39 +451,91 @@ static int cycle_less(const nghttp3_pq_entry *lhsx,
   return rhs->cycle - lhs->cycle <= NGHTTP3_TNODE_MAX_CYCLE_GAP;
 }
 
-static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
-                    const nghttp3_callbacks *callbacks, int settings_version,
-                    const nghttp3_settings *settings, const nghttp3_mem *mem,
-                    void *user_data) {
-  nghttp3_conn *conn;
-  nghttp3_settings settings_latest;
-  nghttp3_callbacks callbacks_latest;
-  uint64_t map_seed;
+/*
+ * conn_shell_init initializes the members of |conn| that its shell
+ * retains.
+ */
+static void conn_shell_init(nghttp3_conn *conn, const nghttp3_mem *mem) {
   size_t i;
-  (void)callbacks_version;
 
-  settings = nghttp3_settings_convert_to_latest(&settings_latest,
-                                                settings_version, settings);
-  callbacks = nghttp3_callbacks_convert_to_latest(&callbacks_latest,
-                                                  callbacks_version, callbacks);
+  nghttp3_objalloc_init(&conn->out_chunk_objalloc,
+                        NGHTTP3_STREAM_MIN_CHUNK_SIZE * 16, mem);
+  nghttp3_objalloc_stream_init(&conn->stream_objalloc, 8, mem);
 
-  assert(settings->max_field_section_size <= NGHTTP3_VARINT_MAX);
-  assert(settings->qpack_max_dtable_capacity <= NGHTTP3_VARINT_MAX);
-  assert(settings->qpack_encoder_max_dtable_capacity <= NGHTTP3_VARINT_MAX);
-  assert(settings->qpack_blocked_streams <= NGHTTP3_VARINT_MAX);
+  nghttp3_map_init(&conn->streams, 0, mem);
 
-  if (mem == NULL) {
-    mem = nghttp3_mem_default();
+  nghttp3_pq_init(&conn->qpack_blocked_streams, ricnt_less, mem);
+
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    nghttp3_pq_init(&conn->sched[i].spq, cycle_less, mem);
   }
 
+  conn->mem = mem;
+}
+
+/*
+ * conn_shell_free frees the members of |conn| that its shell retains,
+ * and |conn| itself.
+ */
+static void conn_shell_free(nghttp3_conn *conn) {
+  size_t i;
+
+  nghttp3_buf_free(&conn->tx.qpack.ebuf, conn->mem);
+  nghttp3_buf_free(&conn->tx.qpack.rbuf, conn->mem);
+
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    nghttp3_pq_free(&conn->sched[i].spq);
+  }
+
+  nghttp3_pq_free(&conn->qpack_blocked_streams);
+
+  nghttp3_map_free(&conn->streams);
+
+  nghttp3_objalloc_free(&conn->stream_objalloc);
+  nghttp3_objalloc_free(&conn->out_chunk_objalloc);
+
+  nghttp3_mem_free(conn->mem, conn);
+}
+
+/*
+ * conn_shell_new allocates a new shell, and assigns it to |*pconn|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int conn_shell_new(nghttp3_conn **pconn, const nghttp3_mem *mem) {
+  nghttp3_conn *conn;
+
   conn = nghttp3_mem_calloc(mem, 1, sizeof(nghttp3_conn));
   if (conn == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
 
-  nghttp3_objalloc_init(&conn->out_chunk_objalloc,
-                        NGHTTP3_STREAM_MIN_CHUNK_SIZE * 16, mem);
-  nghttp3_objalloc_stream_init(&conn->stream_objalloc, 8, mem);
+  conn_shell_init(conn, mem);
+
+  *pconn = conn;
+
+  return 0;
+}
+
+/*
+ * conn_init initializes |conn| which is a fresh or recycled shell.
+ */
+static void conn_init(nghttp3_conn *conn, int server,
+                      const nghttp3_callbacks *callbacks,
+                      const nghttp3_settings *settings, void *user_data) {
+  const nghttp3_mem *mem = conn->mem;
+  uint64_t map_seed;
+  size_t i;
+
+  assert(settings->max_field_section_size <= NGHTTP3_VARINT_MAX);
+  assert(settings->qpack_max_dtable_capacity <= NGHTTP3_VARINT_MAX);
+  assert(settings->qpack_encoder_max_dtable_capacity <= NGHTTP3_VARINT_MAX);
+  assert(settings->qpack_blocked_streams <= NGHTTP3_VARINT_MAX);
+  assert(nghttp3_map_size(&conn->streams) == 0);
 
   if (callbacks->rand) {
     callbacks->rand((uint8_t *)&map_seed, sizeof(map_seed));
@@ -322,21 +543,25 @@ static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
     map_seed = 0;
   }
 
-  nghttp3_map_init(&conn->streams, map_seed, mem);
+  conn->streams.seed = map_seed;
 
   nghttp3_qpack_decoder_init(&conn->qdec, settings->qpack_max_dtable_capacity,
                              settings->qpack_blocked_streams, mem);
+  nghttp3_qpack_decoder_set_contiguous_dtable(
+    &conn->qdec, settings->qpack_decoder_contiguous_dtable);
+  nghttp3_qpack_decoder_set_value_fragment_size(
+    &conn->qdec, callbacks->recv_header_fragment
+                   ? settings->qpack_decoder_value_fragment_size
+                   : 0);
 
   nghttp3_qpack_encoder_init(
     &conn->qenc, settings->qpack_encoder_max_dtable_capacity, ++map_seed, mem);
   nghttp3_qpack_encoder_set_indexing_strat(&conn->qenc,
                                            settings->qpack_indexing_strat);
-
-  nghttp3_pq_init(&conn->qpack_blocked_streams, ricnt_less, mem);
-
-  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
-    nghttp3_pq_init(&conn->sched[i].spq, cycle_less, mem);
-  }
+  nghttp3_qpack_encoder_set_encoding_strat(&conn->qenc,
+                                           settings->qpack_encoding_strat);
+  nghttp3_qpack_encoder_set_crumble_cookie(
+    &conn->qenc, settings->qpack_encoder_crumble_cookie);
 
   nghttp3_idtr_init(&conn->remote.bidi.idtr, mem);
 
@@ -354,13 +579,85 @@ static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
     conn->local.settings.enable_connect_protocol = 0;
     conn->local.settings.origin_list = NULL;
   }
+  if (settings->urgency_weights) {
+    conn->flags |= NGHTTP3_CONN_FLAG_WEIGHTED_SCHED;
+
+    for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+      conn->sched[i].quantum =
+        nghttp3_max((uint64_t)settings->urgency_weights[i], (uint64_t)1) *
+        NGHTTP3_STREAM_MIN_WRITELEN;
+    }
+
+    /* The array is copied.  Do not keep the pointer to the memory
+       owned by an application. */
+    conn->local.settings.urgency_weights = NULL;
+  }
   conn->remote.settings.max_field_section_size = NGHTTP3_VARINT_MAX;
-  conn->mem = mem;
   conn->user_data = user_data;
   conn->server = server;
   conn->rx.goaway_id = NGHTTP3_VARINT_MAX + 1;
   conn->tx.goaway_id = NGHTTP3_VARINT_MAX + 1;
+  conn->tx.qdec_expiry = UINT64_MAX;
   conn->rx.max_stream_id_bidi = -4;
+}
+
+/*
+ * conn_check_preamble returns 0 if settings->preamble is unset, or it
+ * advertises the same values as the local settings that the endpoint
+ * created with |settings| sends.  Otherwise, it returns
+ * NGHTTP3_ERR_INVALID_ARGUMENT.
+ */
+static int conn_check_preamble(int server, const nghttp3_settings *settings) {
+  nghttp3_settings local_settings;
+
+  if (!settings->preamble) {
+    return 0;
+  }
+
+  if (!server) {
+    /* conn_init clears them for client. */
+    local_settings = *settings;
+    local_settings.enable_connect_protocol = 0;
+    local_settings.origin_list = NULL;
+    settings = &local_settings;
+  }
+
+  if (!nghttp3_preamble_match(settings->preamble, settings)) {
+    return NGHTTP3_ERR_INVALID_ARGUMENT;
+  }
+
+  return 0;
+}
+
+static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
+                    const nghttp3_callbacks *callbacks, int settings_version,
+                    const nghttp3_settings *settings, const nghttp3_mem *mem,
+                    void *user_data) {
+  nghttp3_conn *conn;
+  nghttp3_settings settings_latest;
+  nghttp3_callbacks callbacks_latest;
+  int rv;
+
+  settings = nghttp3_settings_convert_to_latest(&settings_latest,
+                                                settings_version, settings);
+  callbacks = nghttp3_callbacks_convert_to_latest(&callbacks_latest,
+                                                  callbacks_version, callbacks);
+
+  rv = conn_check_preamble(server, settings);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (mem == NULL) {
+    mem = nghttp3_mem_default();
+  }
+
+  rv = conn_shell_new(&conn, mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  conn_init(conn, server, callbacks, settings, user_data);
 
   *pconn = conn;
 
@@ -411,36 +708,194 @@ static int free_stream(void *data, void *ptr) {
   return 0;
 }
 
-void nghttp3_conn_del(nghttp3_conn *conn) {
+/*
+ * conn_release frees the resources of |conn| that its shell does not
+ * retain.  The streams are returned to the memory pools of |conn|.
+ */
+static void conn_release(nghttp3_conn *conn) {
+  nghttp3_nva_del(conn->tx.qpack.prime_nva, conn->mem);
+
+  nghttp3_idtr_free(&conn->remote.bidi.idtr);
+
+  nghttp3_qpack_encoder_free(&conn->qenc);
+  nghttp3_qpack_decoder_free(&conn->qdec);
+
+  nghttp3_map_each(&conn->streams, free_stream, NULL);
+
+  nghttp3_mem_free(conn->mem, conn->rx.originbuf);
+  nghttp3_mem_free(conn->mem, conn->rx.pri_fieldbuf);
+}
+
+/*
+ * conn_recycle turns |conn| back into a shell, and returns it to the
+ * pool of its factory.
+ */
+static void conn_recycle(nghttp3_conn *conn) {
+  nghttp3_conn_factory *factory = conn->factory;
+  nghttp3_objalloc out_chunk_objalloc = conn->out_chunk_objalloc;
+  nghttp3_objalloc stream_objalloc = conn->stream_objalloc;
+  nghttp3_map streams = conn->streams;
+  nghttp3_pq qpack_blocked_streams = conn->qpack_blocked_streams;
+  nghttp3_pq spq[NGHTTP3_URGENCY_LEVELS];
+  nghttp3_buf rbuf = conn->tx.qpack.rbuf;
+  nghttp3_buf ebuf = conn->tx.qpack.ebuf;
+  const nghttp3_mem *mem = conn->mem;
   size_t i;
 
+  conn_release(conn);
+
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    spq[i] = conn->sched[i].spq;
+  }
+
+  memset(conn, 0, sizeof(*conn));
+
+  conn->out_chunk_objalloc = out_chunk_objalloc;
+  conn->stream_objalloc = stream_objalloc;
+  conn->streams = streams;
+  nghttp3_map_clear(&conn->streams);
+  conn->qpack_blocked_streams = qpack_blocked_streams;
+  nghttp3_pq_clear(&conn->qpack_blocked_streams);
+
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    conn->sched[i].spq = spq[i];
+    nghttp3_pq_clear(&conn->sched[i].spq);
+  }
+
+  conn->tx.qpack.rbuf = rbuf;
+  nghttp3_buf_reset(&conn->tx.qpack.rbuf);
+  conn->tx.qpack.ebuf = ebuf;
+  nghttp3_buf_reset(&conn->tx.qpack.ebuf);
+  conn->mem = mem;
+
+  conn->shell_next = factory->shells;
+  factory->shells = conn;
+  ++factory->nshells;
+}
+
+void nghttp3_conn_del(nghttp3_conn *conn) {
   if (conn == NULL) {
     return;
   }
 
-  nghttp3_buf_free(&conn->tx.qpack.ebuf, conn->mem);
-  nghttp3_buf_free(&conn->tx.qpack.rbuf, conn->mem);
+  if (conn->factory && conn->factory->nshells < conn->factory->max_shells) {
+    conn_recycle(conn);
+    return;
+  }
 
-  nghttp3_idtr_free(&conn->remote.bidi.idtr);
+  conn_release(conn);
+  conn_shell_free(conn);
+}
 
-  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
-    nghttp3_pq_free(&conn->sched[i].spq);
+int nghttp3_conn_factory_new_versioned(
+  nghttp3_conn_factory **pfactory, int server, int callbacks_version,
+  const nghttp3_callbacks *callbacks, int settings_version,
+  const nghttp3_settings *settings, size_t max_shells,
+  const nghttp3_mem *mem) {
+  nghttp3_conn_factory *factory;
+  nghttp3_conn *conn;
+  nghttp3_settings settings_latest;
+  nghttp3_callbacks callbacks_latest;
+  size_t i;
+  int rv;
+
+  settings = nghttp3_settings_convert_to_latest(&settings_latest,
+                                                settings_version, settings);
+  callbacks = nghttp3_callbacks_convert_to_latest(&callbacks_latest,
+                                                  callbacks_version, callbacks);
+
+  assert(settings->max_field_section_size <= NGHTTP3_VARINT_MAX);
+  assert(settings->qpack_max_dtable_capacity <= NGHTTP3_VARINT_MAX);
+  assert(settings->qpack_encoder_max_dtable_capacity <= NGHTTP3_VARINT_MAX);
+  assert(settings->qpack_blocked_streams <= NGHTTP3_VARINT_MAX);
+
+  rv = conn_check_preamble(server, settings);
+  if (rv != 0) {
+    return rv;
   }
 
-  nghttp3_pq_free(&conn->qpack_blocked_streams);
+  if (mem == NULL) {
+    mem = nghttp3_mem_default();
+  }
 
-  nghttp3_qpack_encoder_free(&conn->qenc);
-  nghttp3_qpack_decoder_free(&conn->qdec);
+  factory = nghttp3_mem_calloc(mem, 1, sizeof(nghttp3_conn_factory));
+  if (factory == NULL) {
+    return NGHTTP3_ERR_NOMEM;
+  }
 
-  nghttp3_map_each(&conn->streams, free_stream, NULL);
-  nghttp3_map_free(&conn->streams);
+  factory->mem = mem;
+  factory->callbacks = *callbacks;
+  factory->settings = *settings;
+  if (settings->origin_list) {
+    factory->settings.origin_list = &factory->origin_list;
+    factory->origin_list = *settings->origin_list;
+  }
+  if (settings->urgency_weights) {
+    memcpy(factory->urgency_weights, settings->urgency_weights,
+           sizeof(factory->urgency_weights));
+    factory->settings.urgency_weights = factory->urgency_weights;
+  }
+  factory->server = server;
+  factory->max_shells = max_shells;
 
-  nghttp3_objalloc_free(&conn->stream_objalloc);
-  nghttp3_objalloc_free(&conn->out_chunk_objalloc);
+  for (i = 0; i < max_shells; ++i) {
+    rv = conn_shell_new(&conn, mem);
+    if (rv != 0) {
+      nghttp3_conn_factory_del(factory);
+      return rv;
+    }
 
-  nghttp3_mem_free(conn->mem, conn->rx.originbuf);
+    conn->shell_next = factory->shells;
+    factory->shells = conn;
+    ++factory->nshells;
+  }
 
-  nghttp3_mem_free(conn->mem, conn);
+  *pfactory = factory;
+
+  return 0;
+}
+
+void nghttp3_conn_factory_del(nghttp3_conn_factory *factory) {
+  nghttp3_conn *conn, *next;
+
+  if (factory == NULL) {
+    return;
+  }
+
+  for (conn = factory->shells; conn; conn = next) {
+    next = conn->shell_next;
+    conn_shell_free(conn);
+  }
+
+  nghttp3_mem_free(factory->mem, factory);
+}
+
+int nghttp3_conn_factory_conn_new(nghttp3_conn_factory *factory,
+                                  nghttp3_conn **pconn, void *user_data) {
+  nghttp3_conn *conn;
+  int rv;
+
+  if (factory->shells) {
+    conn = factory->shells;
+    factory->shells = conn->shell_next;
+    --factory->nshells;
+
+    conn->shell_next = NULL;
+  } else {
+    rv = conn_shell_new(&conn, factory->mem);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  conn_init(conn, factory->server, &factory->callbacks, &factory->settings,
+            user_data);
+
+  conn->factory = factory;
+
+  *pconn = conn;
+
+  return 0;
 }
 
 static int conn_bidi_idtr_open(nghttp3_conn *conn, int64_t stream_id) {
@@ -465,11 +920,12 @@ nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
                                    UINT64_MAX);
 }
 
-nghttp3_ssize nghttp3_conn_read_stream2(nghttp3_conn *conn, int64_t stream_id,
-                                        const uint8_t *src, size_t srclen,
-                                        int fin, nghttp3_tstamp ts) {
+static nghttp3_ssize conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
+                                      const uint8_t *src, size_t srclen,
+                                      int fin, nghttp3_tstamp ts) {
   nghttp3_stream *stream;
   size_t bidi_nproc;
+  nghttp3_ssize nconsumed;
   int rv;
 
   assert(stream_id >= 0);
@@ -560,11 +1016,74 @@ nghttp3_ssize nghttp3_conn_read_stream2(nghttp3_conn *conn, int64_t stream_id,
   }
 
   if (nghttp3_stream_uni(stream_id)) {
-    return nghttp3_conn_read_uni(conn, stream, src, srclen, fin, ts);
+    nconsumed = nghttp3_conn_read_uni(conn, stream, src, srclen, fin, ts);
+  } else {
+    nconsumed = nghttp3_conn_read_bidi(conn, &bidi_nproc, stream, src, srclen,
+                                       fin, ts);
+  }
+
+  if (nconsumed <= 0 || !conn->local.settings.consumed_report_threshold) {
+    return nconsumed;
+  }
+
+  /* stream is still alive here because a stream is only deleted
+     inside nghttp3_conn_read_uni when nothing is consumed. */
+  rv = conn_consume(conn, stream, (size_t)nconsumed);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return 0;
+}
+
+nghttp3_ssize nghttp3_conn_read_stream2(nghttp3_conn *conn, int64_t stream_id,
+                                        const uint8_t *src, size_t srclen,
+                                        int fin, nghttp3_tstamp ts) {
+  int qdec_pending = conn_uni_stream_pending(conn, conn->tx.qdec);
+  int qenc_pending = conn_uni_stream_pending(conn, conn->tx.qenc);
+  nghttp3_ssize nconsumed;
+  int rv;
+
+  nconsumed = conn_read_stream(conn, stream_id, src, srclen, fin, ts);
+  if (nconsumed < 0) {
+    return nconsumed;
+  }
+
+  /* QPACK decoder might have produced Section Acknowledgment or
+     Insert Count Increment. */
+  rv = conn_notify_uni_stream(conn, conn->tx.qdec, qdec_pending);
+  if (rv != 0) {
+    return rv;
+  }
+
+  /* The fields deferred by nghttp3_conn_prime_qpack might have been
+     inserted on receipt of SETTINGS frame. */
+  rv = conn_notify_uni_stream(conn, conn->tx.qenc, qenc_pending);
+  if (rv != 0) {
+    return rv;
   }
 
-  return nghttp3_conn_read_bidi(conn, &bidi_nproc, stream, src, srclen, fin,
-                                ts);
+  return nconsumed;
+}
+
+int nghttp3_conn_flush_consumed(nghttp3_conn *conn, uint64_t *pnconsumed) {
+  nghttp3_stream *stream;
+  int rv;
+
+  for (; conn->rx.consumed_head;) {
+    stream = conn->rx.consumed_head;
+
+    rv = conn_call_deferred_consume(conn, stream,
+                                    conn_take_consumed(conn, stream));
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  *pnconsumed = conn->rx.nconsumed;
+  conn->rx.nconsumed = 0;
+
+  return 0;
 }
 
 static nghttp3_ssize conn_read_type(nghttp3_conn *conn, nghttp3_stream *stream,
@@ -729,10 +1248,132 @@ static int frame_fin(const nghttp3_stream_read_state *rstate, size_t len) {
   return len >= rstate->left;
 }
 
-nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
-                                        nghttp3_stream *stream,
-                                        const uint8_t *src, size_t srclen,
-                                        nghttp3_tstamp ts) {
+/*
+ * conn_on_ctrl_frame_hd is called when the type and the length of a
+ * frame on control stream have been read into stream->rstate.  It
+ * validates the frame type and advances the stream read state.  If
+ * the frame must be ignored, it sets nonzero to |*pbusy|.
+ */
+static int conn_on_ctrl_frame_hd(nghttp3_conn *conn, nghttp3_stream *stream,
+                                 int *pbusy, nghttp3_tstamp ts) {
+  nghttp3_stream_read_state *rstate = &stream->rstate;
+  int rv;
+
+  if (!(conn->flags & NGHTTP3_CONN_FLAG_SETTINGS_RECVED)) {
+    if (rstate->fr.hd.type != NGHTTP3_FRAME_SETTINGS) {
+      return NGHTTP3_ERR_H3_MISSING_SETTINGS;
+    }
+    conn->flags |= NGHTTP3_CONN_FLAG_SETTINGS_RECVED;
+  } else if (rstate->fr.hd.type == NGHTTP3_FRAME_SETTINGS) {
+    return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
+  }
+
+  switch (rstate->fr.hd.type) {
+  case NGHTTP3_FRAME_SETTINGS:
+    /* SETTINGS frame might be empty. */
+    if (rstate->left == 0) {
+      rv = conn_on_settings_recved(conn);
+      if (rv != 0) {
+        return rv;
+      }
+
+      nghttp3_stream_read_state_reset(rstate);
+      break;
+    }
+    rstate->fr.settings.iv = &rstate->iv;
+    rstate->state = NGHTTP3_CTRL_STREAM_STATE_SETTINGS;
+    break;
+  case NGHTTP3_FRAME_GOAWAY:
+    if (rstate->left == 0) {
+      return NGHTTP3_ERR_H3_FRAME_ERROR;
+    }
+    rstate->state = NGHTTP3_CTRL_STREAM_STATE_GOAWAY;
+    break;
+  case NGHTTP3_FRAME_MAX_PUSH_ID:
+    if (!conn->server) {
+      return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
+    }
+    if (rstate->left == 0) {
+      return NGHTTP3_ERR_H3_FRAME_ERROR;
+    }
+    rstate->state = NGHTTP3_CTRL_STREAM_STATE_MAX_PUSH_ID;
+    break;
+  case NGHTTP3_FRAME_PRIORITY_UPDATE:
+    if (!conn->server) {
+      return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
+    }
+    if (rstate->left == 0) {
+      return NGHTTP3_ERR_H3_FRAME_ERROR;
+    }
+
+    /* We do not expect too frequent priority updates. */
+    if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
+      return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
+    }
+
+    rstate->state = NGHTTP3_CTRL_STREAM_STATE_PRIORITY_UPDATE_PRI_ELEM_ID;
+    break;
+  case NGHTTP3_FRAME_PRIORITY_UPDATE_PUSH_ID:
+    /* We do not support push */
+    return NGHTTP3_ERR_H3_ID_ERROR;
+  case NGHTTP3_FRAME_ORIGIN:
+    /* We do not expect too frequent ORIGIN frames. */
+    if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
+      return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
+    }
+
+    if (conn->server ||
+        (!conn->callbacks.recv_origin && !conn->callbacks.end_origin)) {
+      *pbusy = 1;
+      rstate->state = NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME;
+      break;
+    }
+
+    /* ORIGIN frame might be empty */
+    if (rstate->left == 0) {
+      rv = conn_call_end_origin(conn);
+      if (rv != 0) {
+        return rv;
+      }
+
+      nghttp3_stream_read_state_reset(rstate);
+
+      break;
+    }
+
+    conn_reset_rx_originlen(conn);
+
+    rstate->state = NGHTTP3_CTRL_STREAM_STATE_ORIGIN_ORIGIN_LEN;
+
+    break;
+  case NGHTTP3_FRAME_CANCEL_PUSH: /* We do not support push */
+  case NGHTTP3_FRAME_DATA:
+  case NGHTTP3_FRAME_HEADERS:
+  case NGHTTP3_FRAME_PUSH_PROMISE:
+  case NGHTTP3_H2_FRAME_PRIORITY:
+  case NGHTTP3_H2_FRAME_PING:
+  case NGHTTP3_H2_FRAME_WINDOW_UPDATE:
+  case NGHTTP3_H2_FRAME_CONTINUATION:
+    return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
+  default:
+    /* We do not expect too frequent unknown frames. */
+    if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
+      return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
+    }
+
+    /* TODO Handle reserved frame type */
+    *pbusy = 1;
+    rstate->state = NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME;
+    break;
+  }
+
+  return 0;
+}
+
+static nghttp3_ssize conn_read_control(nghttp3_conn *conn,
+                                       nghttp3_stream *stream,
+                                       const uint8_t *src, size_t srclen,
+                                       nghttp3_tstamp ts) {
   const uint8_t *p = src, *end = src + srclen;
   int rv;
   nghttp3_stream_read_state *rstate = &stream->rstate;
@@ -743,6 +1384,8 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
   size_t len;
   const uint8_t *pri_field_value = NULL;
   size_t pri_field_valuelen = 0;
+  const uint8_t *q;
+  uint64_t entry[2];
 
   assert(srclen);
 
@@ -751,6 +1394,25 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
     switch (rstate->state) {
     case NGHTTP3_CTRL_STREAM_STATE_FRAME_TYPE:
       assert(end - p > 0);
+
+      /* Fast path: frame type and length are entirely in the
+         buffer. */
+      if (rvint->left == 0) {
+        len = nghttp3_read_frame_hd(&rstate->fr.hd.type, &rstate->left, p,
+                                    end);
+        if (len) {
+          p += len;
+          nconsumed += len;
+
+          rv = conn_on_ctrl_frame_hd(conn, stream, &busy, ts);
+          if (rv != 0) {
+            return rv;
+          }
+
+          break;
+        }
+      }
+
       nread = nghttp3_read_varint(rvint, p, end, /* fin = */ 0);
       if (nread < 0) {
         return NGHTTP3_ERR_H3_GENERAL_PROTOCOL_ERROR;
@@ -777,126 +1439,24 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
       }
 
       p += nread;
-      nconsumed += (size_t)nread;
-      if (rvint->left) {
-        return (nghttp3_ssize)nconsumed;
-      }
-
-      rstate->left = rvint->acc;
-      nghttp3_varint_read_state_reset(rvint);
-
-      if (!(conn->flags & NGHTTP3_CONN_FLAG_SETTINGS_RECVED)) {
-        if (rstate->fr.hd.type != NGHTTP3_FRAME_SETTINGS) {
-          return NGHTTP3_ERR_H3_MISSING_SETTINGS;
-        }
-        conn->flags |= NGHTTP3_CONN_FLAG_SETTINGS_RECVED;
-      } else if (rstate->fr.hd.type == NGHTTP3_FRAME_SETTINGS) {
-        return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
-      }
-
-      switch (rstate->fr.hd.type) {
-      case NGHTTP3_FRAME_SETTINGS:
-        /* SETTINGS frame might be empty. */
-        if (rstate->left == 0) {
-          rv = conn_call_recv_settings(conn);
-          if (rv != 0) {
-            return rv;
-          }
-
-          nghttp3_stream_read_state_reset(rstate);
-          break;
-        }
-        rstate->fr.settings.iv = &rstate->iv;
-        rstate->state = NGHTTP3_CTRL_STREAM_STATE_SETTINGS;
-        break;
-      case NGHTTP3_FRAME_GOAWAY:
-        if (rstate->left == 0) {
-          return NGHTTP3_ERR_H3_FRAME_ERROR;
-        }
-        rstate->state = NGHTTP3_CTRL_STREAM_STATE_GOAWAY;
-        break;
-      case NGHTTP3_FRAME_MAX_PUSH_ID:
-        if (!conn->server) {
-          return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
-        }
-        if (rstate->left == 0) {
-          return NGHTTP3_ERR_H3_FRAME_ERROR;
-        }
-        rstate->state = NGHTTP3_CTRL_STREAM_STATE_MAX_PUSH_ID;
-        break;
-      case NGHTTP3_FRAME_PRIORITY_UPDATE:
-        if (!conn->server) {
-          return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
-        }
-        if (rstate->left == 0) {
-          return NGHTTP3_ERR_H3_FRAME_ERROR;
-        }
-
-        /* We do not expect too frequent priority updates. */
-        if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
-          return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
-        }
-
-        rstate->state = NGHTTP3_CTRL_STREAM_STATE_PRIORITY_UPDATE_PRI_ELEM_ID;
-        break;
-      case NGHTTP3_FRAME_PRIORITY_UPDATE_PUSH_ID:
-        /* We do not support push */
-        return NGHTTP3_ERR_H3_ID_ERROR;
-      case NGHTTP3_FRAME_ORIGIN:
-        /* We do not expect too frequent ORIGIN frames. */
-        if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
-          return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
-        }
-
-        if (conn->server ||
-            (!conn->callbacks.recv_origin && !conn->callbacks.end_origin)) {
-          busy = 1;
-          rstate->state = NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME;
-          break;
-        }
-
-        /* ORIGIN frame might be empty */
-        if (rstate->left == 0) {
-          rv = conn_call_end_origin(conn);
-          if (rv != 0) {
-            return rv;
-          }
-
-          nghttp3_stream_read_state_reset(rstate);
-
-          break;
-        }
-
-        conn_reset_rx_originlen(conn);
-
-        rstate->state = NGHTTP3_CTRL_STREAM_STATE_ORIGIN_ORIGIN_LEN;
+      nconsumed += (size_t)nread;
+      if (rvint->left) {
+        return (nghttp3_ssize)nconsumed;
+      }
 
-        break;
-      case NGHTTP3_FRAME_CANCEL_PUSH: /* We do not support push */
-      case NGHTTP3_FRAME_DATA:
-      case NGHTTP3_FRAME_HEADERS:
-      case NGHTTP3_FRAME_PUSH_PROMISE:
-      case NGHTTP3_H2_FRAME_PRIORITY:
-      case NGHTTP3_H2_FRAME_PING:
-      case NGHTTP3_H2_FRAME_WINDOW_UPDATE:
-      case NGHTTP3_H2_FRAME_CONTINUATION:
-        return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
-      default:
-        /* We do not expect too frequent unknown frames. */
-        if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
-          return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
-        }
+      rstate->left = rvint->acc;
+      nghttp3_varint_read_state_reset(rvint);
 
-        /* TODO Handle reserved frame type */
-        busy = 1;
-        rstate->state = NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME;
-        break;
+      rv = conn_on_ctrl_frame_hd(conn, stream, &busy, ts);
+      if (rv != 0) {
+        return rv;
       }
+
       break;
     case NGHTTP3_CTRL_STREAM_STATE_SETTINGS:
       for (;;) {
         if (rstate->left == 0) {
-          rv = conn_call_recv_settings(conn);
+          rv = conn_on_settings_recved(conn);
           if (rv != 0) {
             return rv;
           }
@@ -909,9 +1469,30 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
           return (nghttp3_ssize)nconsumed;
         }
 
-        /* Read Identifier */
         len = (size_t)nghttp3_min(rstate->left, (uint64_t)(end - p));
         assert(len > 0);
+
+        /* Fast path: both Identifier and Value are in the buffer. */
+        q = p;
+        if (nghttp3_get_uvarintv(entry, nghttp3_arraylen(entry), &q, p + len) ==
+            nghttp3_arraylen(entry)) {
+          nconsumed += (size_t)(q - p);
+          rstate->left -= (uint64_t)(q - p);
+          p = q;
+
+          rstate->fr.settings.iv[0].id = entry[0];
+          rstate->fr.settings.iv[0].value = entry[1];
+
+          rv =
+            nghttp3_conn_on_settings_entry_received(conn, &rstate->fr.settings);
+          if (rv != 0) {
+            return rv;
+          }
+
+          continue;
+        }
+
+        /* Read Identifier */
         nread = nghttp3_read_varint(rvint, p, p + len, frame_fin(rstate, len));
         if (nread < 0) {
           return NGHTTP3_ERR_H3_FRAME_ERROR;
@@ -1014,7 +1595,7 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
         break;
       }
 
-      rv = conn_call_recv_settings(conn);
+      rv = conn_on_settings_recved(conn);
       if (rv != 0) {
         return rv;
       }
@@ -1127,6 +1708,14 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
         break;
       }
 
+      if (rstate->left > NGHTTP3_PRI_FIELDBUFLEN) {
+        /* Ignore too long Priority Field Value regardless of how it
+           is split into the input buffers. */
+        busy = 1;
+        rstate->state = NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME;
+        break;
+      }
+
       conn->rx.pri_fieldbuflen = 0;
 
       rstate->state = NGHTTP3_CTRL_STREAM_STATE_PRIORITY_UPDATE;
@@ -1137,27 +1726,26 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
 
       /* Fall through */
     case NGHTTP3_CTRL_STREAM_STATE_PRIORITY_UPDATE:
-      /* We need to buffer Priority Field Value because it might be
-         fragmented. */
       len = (size_t)nghttp3_min(rstate->left, (uint64_t)(end - p));
       assert(len > 0);
       if (conn->rx.pri_fieldbuflen == 0 && rstate->left == len) {
-        /* Everything is in the input buffer.  Apply same length
-           limit we impose when buffering the field. */
-        if (len > sizeof(conn->rx.pri_fieldbuf)) {
-          busy = 1;
-          rstate->state = NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME;
-          break;
-        }
-
+        /* Everything is in the input buffer.  Parse it in place. */
         pri_field_value = p;
         pri_field_valuelen = len;
-      } else if (len + conn->rx.pri_fieldbuflen >
-                 sizeof(conn->rx.pri_fieldbuf)) {
-        busy = 1;
-        rstate->state = NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME;
-        break;
       } else {
+        assert(conn->rx.pri_fieldbuflen + rstate->left <=
+               NGHTTP3_PRI_FIELDBUFLEN);
+
+        /* We need to buffer Priority Field Value because it is
+           fragmented. */
+        if (conn->rx.pri_fieldbuf == NULL) {
+          conn->rx.pri_fieldbuf =
+            nghttp3_mem_malloc(conn->mem, NGHTTP3_PRI_FIELDBUFLEN);
+          if (conn->rx.pri_fieldbuf == NULL) {
+            return NGHTTP3_ERR_NOMEM;
+          }
+        }
+
         memcpy(conn->rx.pri_fieldbuf + conn->rx.pri_fieldbuflen, p, len);
         conn->rx.pri_fieldbuflen += len;
 
@@ -1339,18 +1927,47 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
   return (nghttp3_ssize)nconsumed;
 }
 
+/*
+ * conn_cancel_priority_update removes |stream| from the list of
+ * streams which have pending priority update.
+ */
+static void conn_cancel_priority_update(nghttp3_conn *conn,
+                                        nghttp3_stream *stream) {
+  nghttp3_stream **pp;
+
+  if (!(stream->flags & NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING)) {
+    return;
+  }
+
+  for (pp = &conn->rx.pri_update_head; *pp != stream;) {
+    pp = &(*pp)->rx.pri_update_next;
+  }
+
+  *pp = stream->rx.pri_update_next;
+
+  stream->rx.pri_update_next = NULL;
+  stream->flags &= (uint16_t)~NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING;
+}
+
 static int conn_delete_stream(nghttp3_conn *conn, nghttp3_stream *stream,
                               uint32_t flags, uint64_t rx_app_error_code,
                               uint64_t tx_app_error_code) {
   int rv;
   uint64_t app_error_code;
+  size_t nconsumed = nghttp3_stream_get_buffered_datalen(stream);
+
+  if (conn->local.settings.consumed_report_threshold) {
+    conn->rx.nconsumed += nconsumed;
+    nconsumed += conn_take_consumed(conn, stream);
+  }
 
-  rv = conn_call_deferred_consume(conn, stream,
-                                  nghttp3_stream_get_buffered_datalen(stream));
+  rv = conn_call_deferred_consume(conn, stream, nconsumed);
   if (rv != 0) {
     return rv;
   }
 
+  conn_cancel_priority_update(conn, stream);
+
   if (stream->qpack_blocked_pe.index != NGHTTP3_PQ_BAD_INDEX) {
     nghttp3_conn_qpack_blocked_streams_remove(conn, stream);
 
@@ -1430,7 +2047,7 @@ static int conn_process_blocked_stream_data(nghttp3_conn *conn,
 
     buf->pos += nproc;
 
-    rv = conn_call_deferred_consume(conn, stream, (size_t)nconsumed);
+    rv = conn_consume(conn, stream, (size_t)nconsumed);
     if (rv != 0) {
       return rv;
     }
@@ -1511,6 +2128,126 @@ static int conn_update_stream_priority(nghttp3_conn *conn,
   return 0;
 }
 
+/*
+ * conn_on_req_frame_hd is called when the type and the length of a
+ * frame on request stream have been read into stream->rstate.  It
+ * validates the frame type and advances the stream read state.  If
+ * the frame must be ignored, it sets nonzero to |*pbusy|.
+ */
+static int conn_on_req_frame_hd(nghttp3_conn *conn, nghttp3_stream *stream,
+                                int *pbusy, nghttp3_tstamp ts) {
+  nghttp3_stream_read_state *rstate = &stream->rstate;
+  int rv;
+
+  switch (rstate->fr.hd.type) {
+  case NGHTTP3_FRAME_DATA:
+    rv = nghttp3_stream_transit_rx_http_state(stream,
+                                              NGHTTP3_HTTP_EVENT_DATA_BEGIN);
+    if (rv != 0) {
+      return rv;
+    }
+    /* DATA frame might be empty. */
+    if (rstate->left == 0) {
+      rv = nghttp3_stream_transit_rx_http_state(stream,
+                                                NGHTTP3_HTTP_EVENT_DATA_END);
+      assert(0 == rv);
+
+      nghttp3_stream_read_state_reset(rstate);
+      break;
+    }
+    rstate->state = NGHTTP3_REQ_STREAM_STATE_DATA;
+    break;
+  case NGHTTP3_FRAME_HEADERS:
+    rv = nghttp3_stream_transit_rx_http_state(stream,
+                                              NGHTTP3_HTTP_EVENT_HEADERS_BEGIN);
+    if (rv != 0) {
+      return rv;
+    }
+    if (rstate->left == 0) {
+      rv = nghttp3_stream_empty_headers_allowed(stream);
+      if (rv != 0) {
+        return rv;
+      }
+
+      rv = nghttp3_stream_transit_rx_http_state(stream,
+                                                NGHTTP3_HTTP_EVENT_HEADERS_END);
+      assert(0 == rv);
+
+      nghttp3_stream_read_state_reset(rstate);
+      break;
+    }
+
+    switch (stream->rx.hstate) {
+    case NGHTTP3_HTTP_STATE_REQ_HEADERS_BEGIN:
+    case NGHTTP3_HTTP_STATE_RESP_HEADERS_BEGIN:
+      rv = conn_call_begin_headers(conn, stream);
+      break;
+    case NGHTTP3_HTTP_STATE_REQ_TRAILERS_BEGIN:
+    case NGHTTP3_HTTP_STATE_RESP_TRAILERS_BEGIN:
+      rv = conn_call_begin_trailers(conn, stream);
+      break;
+    default:
+      nghttp3_unreachable();
+    }
+
+    if (rv != 0) {
+      return rv;
+    }
+
+    rstate->state = NGHTTP3_REQ_STREAM_STATE_HEADERS;
+    break;
+  case NGHTTP3_FRAME_PUSH_PROMISE: /* We do not support push */
+  case NGHTTP3_FRAME_CANCEL_PUSH:
+  case NGHTTP3_FRAME_SETTINGS:
+  case NGHTTP3_FRAME_GOAWAY:
+  case NGHTTP3_FRAME_MAX_PUSH_ID:
+  case NGHTTP3_FRAME_PRIORITY_UPDATE:
+  case NGHTTP3_FRAME_PRIORITY_UPDATE_PUSH_ID:
+  case NGHTTP3_H2_FRAME_PRIORITY:
+  case NGHTTP3_H2_FRAME_PING:
+  case NGHTTP3_H2_FRAME_WINDOW_UPDATE:
+  case NGHTTP3_H2_FRAME_CONTINUATION:
+    return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
+  default:
+    /* We do not expect too frequent unknown frames. */
+    if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
+      return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
+    }
+
+    /* TODO Handle reserved frame type */
+    *pbusy = 1;
+    rstate->state = NGHTTP3_REQ_STREAM_STATE_IGN_FRAME;
+    break;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_call_recv_datav passes |*pdatavcnt| DATA frame payload
+ * fragments in |datav| to nghttp3_callbacks.recv_datav, and resets
+ * |*pdatavcnt| to 0.
+ */
+static int conn_call_recv_datav(nghttp3_conn *conn, nghttp3_stream *stream,
+                                const nghttp3_vec *datav, size_t *pdatavcnt) {
+  size_t datavcnt = *pdatavcnt;
+  int rv;
+
+  if (datavcnt == 0) {
+    return 0;
+  }
+
+  *pdatavcnt = 0;
+
+  rv = conn->callbacks.recv_datav(conn, stream->node.id, datav, datavcnt,
+                                  conn->user_data, stream->user_data);
+  if (rv != 0) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
 nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
                                      nghttp3_stream *stream, const uint8_t *src,
                                      size_t srclen, int fin,
@@ -1523,6 +2260,8 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
   size_t nconsumed = 0;
   int busy = 0;
   size_t len;
+  nghttp3_vec datav[NGHTTP3_CONN_MAX_RECV_DATAV];
+  size_t datavcnt = 0;
 
   if (stream->flags & NGHTTP3_STREAM_FLAG_SHUT_RD) {
     *pnproc = srclen;
@@ -1549,6 +2288,32 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
     switch (rstate->state) {
     case NGHTTP3_REQ_STREAM_STATE_FRAME_TYPE:
       assert(end - p > 0);
+
+      /* Fast path: frame type and length are entirely in the
+         buffer. */
+      if (rvint->left == 0) {
+        len = nghttp3_read_frame_hd(&rstate->fr.hd.type, &rstate->left, p,
+                                    end);
+        if (len) {
+          p += len;
+          nconsumed += len;
+
+          if (rstate->fr.hd.type != NGHTTP3_FRAME_DATA) {
+            rv = conn_call_recv_datav(conn, stream, datav, &datavcnt);
+            if (rv != 0) {
+              return rv;
+            }
+          }
+
+          rv = conn_on_req_frame_hd(conn, stream, &busy, ts);
+          if (rv != 0) {
+            return rv;
+          }
+
+          break;
+        }
+      }
+
       nread = nghttp3_read_varint(rvint, p, end, fin);
       if (nread < 0) {
         return NGHTTP3_ERR_H3_GENERAL_PROTOCOL_ERROR;
@@ -1583,92 +2348,43 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
       rstate->left = rvint->acc;
       nghttp3_varint_read_state_reset(rvint);
 
-      switch (rstate->fr.hd.type) {
-      case NGHTTP3_FRAME_DATA:
-        rv = nghttp3_stream_transit_rx_http_state(
-          stream, NGHTTP3_HTTP_EVENT_DATA_BEGIN);
+      if (rstate->fr.hd.type != NGHTTP3_FRAME_DATA) {
+        rv = conn_call_recv_datav(conn, stream, datav, &datavcnt);
         if (rv != 0) {
           return rv;
         }
-        /* DATA frame might be empty. */
-        if (rstate->left == 0) {
-          rv = nghttp3_stream_transit_rx_http_state(
-            stream, NGHTTP3_HTTP_EVENT_DATA_END);
-          assert(0 == rv);
+      }
 
-          nghttp3_stream_read_state_reset(rstate);
-          break;
-        }
-        rstate->state = NGHTTP3_REQ_STREAM_STATE_DATA;
-        break;
-      case NGHTTP3_FRAME_HEADERS:
-        rv = nghttp3_stream_transit_rx_http_state(
-          stream, NGHTTP3_HTTP_EVENT_HEADERS_BEGIN);
+      rv = conn_on_req_frame_hd(conn, stream, &busy, ts);
+      if (rv != 0) {
+        return rv;
+      }
+
+      break;
+    case NGHTTP3_REQ_STREAM_STATE_DATA:
+      len = (size_t)nghttp3_min(rstate->left, (uint64_t)(end - p));
+      if (conn->callbacks.recv_datav) {
+        rv = nghttp3_http_on_data_chunk(stream, len);
         if (rv != 0) {
           return rv;
         }
-        if (rstate->left == 0) {
-          rv = nghttp3_stream_empty_headers_allowed(stream);
+
+        if (datavcnt == nghttp3_arraylen(datav)) {
+          rv = conn_call_recv_datav(conn, stream, datav, &datavcnt);
           if (rv != 0) {
             return rv;
           }
-
-          rv = nghttp3_stream_transit_rx_http_state(
-            stream, NGHTTP3_HTTP_EVENT_HEADERS_END);
-          assert(0 == rv);
-
-          nghttp3_stream_read_state_reset(rstate);
-          break;
-        }
-
-        switch (stream->rx.hstate) {
-        case NGHTTP3_HTTP_STATE_REQ_HEADERS_BEGIN:
-        case NGHTTP3_HTTP_STATE_RESP_HEADERS_BEGIN:
-          rv = conn_call_begin_headers(conn, stream);
-          break;
-        case NGHTTP3_HTTP_STATE_REQ_TRAILERS_BEGIN:
-        case NGHTTP3_HTTP_STATE_RESP_TRAILERS_BEGIN:
-          rv = conn_call_begin_trailers(conn, stream);
-          break;
-        default:
-          nghttp3_unreachable();
         }
 
+        datav[datavcnt++] = (nghttp3_vec){
+          .base = (uint8_t *)p,
+          .len = len,
+        };
+      } else {
+        rv = nghttp3_conn_on_data(conn, stream, p, len);
         if (rv != 0) {
           return rv;
         }
-
-        rstate->state = NGHTTP3_REQ_STREAM_STATE_HEADERS;
-        break;
-      case NGHTTP3_FRAME_PUSH_PROMISE: /* We do not support push */
-      case NGHTTP3_FRAME_CANCEL_PUSH:
-      case NGHTTP3_FRAME_SETTINGS:
-      case NGHTTP3_FRAME_GOAWAY:
-      case NGHTTP3_FRAME_MAX_PUSH_ID:
-      case NGHTTP3_FRAME_PRIORITY_UPDATE:
-      case NGHTTP3_FRAME_PRIORITY_UPDATE_PUSH_ID:
-      case NGHTTP3_H2_FRAME_PRIORITY:
-      case NGHTTP3_H2_FRAME_PING:
-      case NGHTTP3_H2_FRAME_WINDOW_UPDATE:
-      case NGHTTP3_H2_FRAME_CONTINUATION:
-        return NGHTTP3_ERR_H3_FRAME_UNEXPECTED;
-      default:
-        /* We do not expect too frequent unknown frames. */
-        if (conn_glitch_ratelim_drain(conn, 1, ts) != 0) {
-          return NGHTTP3_ERR_H3_EXCESSIVE_LOAD;
-        }
-
-        /* TODO Handle reserved frame type */
-        busy = 1;
-        rstate->state = NGHTTP3_REQ_STREAM_STATE_IGN_FRAME;
-        break;
-      }
-      break;
-    case NGHTTP3_REQ_STREAM_STATE_DATA:
-      len = (size_t)nghttp3_min(rstate->left, (uint64_t)(end - p));
-      rv = nghttp3_conn_on_data(conn, stream, p, len);
-      if (rv != 0) {
-        return rv;
       }
       p += len;
       rstate->left -= len;
@@ -1778,6 +2494,11 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
       nghttp3_stream_read_state_reset(rstate);
       break;
     case NGHTTP3_REQ_STREAM_STATE_IGN_REST:
+      rv = conn_call_recv_datav(conn, stream, datav, &datavcnt);
+      if (rv != 0) {
+        return rv;
+      }
+
       nconsumed += (size_t)(end - p);
       *pnproc = (size_t)(end - src);
       return (nghttp3_ssize)nconsumed;
@@ -1785,6 +2506,11 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
   }
 
 almost_done:
+  rv = conn_call_recv_datav(conn, stream, datav, &datavcnt);
+  if (rv != 0) {
+    return rv;
+  }
+
   if (fin) {
     switch (rstate->state) {
     case NGHTTP3_REQ_STREAM_STATE_FRAME_TYPE:
@@ -1840,6 +2566,106 @@ static nghttp3_pq *conn_get_sched_pq(nghttp3_conn *conn, nghttp3_tnode *tnode) {
   return &conn->sched[tnode->pri.urgency].spq;
 }
 
+/*
+ * conn_stash_cookie keeps cookie field line |nv| in |stream| so that
+ * it is joined with the other cookie field lines in the same field
+ * section.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int conn_stash_cookie(nghttp3_conn *conn, nghttp3_stream *stream,
+                             const nghttp3_qpack_nv *nv) {
+  nghttp3_buf *buf = &stream->rx.cookie.buf;
+  size_t need;
+  int rv;
+
+  if (stream->rx.cookie.name == NULL) {
+    nghttp3_rcbuf_incref(nv->name);
+    nghttp3_rcbuf_incref(nv->value);
+
+    stream->rx.cookie.name = nv->name;
+    stream->rx.cookie.value = nv->value;
+    stream->rx.cookie.flags = nv->flags;
+
+    return 0;
+  }
+
+  need = nghttp3_buf_len(buf) + sizeof("; ") - 1 + nv->value->len;
+  if (nghttp3_buf_len(buf) == 0) {
+    need += stream->rx.cookie.value->len;
+  }
+
+  if (nghttp3_buf_cap(buf) < need) {
+    rv = nghttp3_buf_reserve(buf, nghttp3_max(need, nghttp3_buf_cap(buf) * 2),
+                             conn->mem);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  if (nghttp3_buf_len(buf) == 0) {
+    buf->last = nghttp3_cpymem(buf->last, stream->rx.cookie.value->base,
+                               stream->rx.cookie.value->len);
+  }
+
+  *buf->last++ = ';';
+  *buf->last++ = ' ';
+  buf->last = nghttp3_cpymem(buf->last, nv->value->base, nv->value->len);
+
+  stream->rx.cookie.flags |= nv->flags;
+
+  return 0;
+}
+
+/*
+ * conn_emit_cookie passes the cookie field lines kept in |stream| to
+ * |recv_header| as a single header field.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ * NGHTTP3_ERR_CALLBACK_FAILURE
+ *     User callback failed.
+ */
+static int conn_emit_cookie(nghttp3_conn *conn, nghttp3_stream *stream,
+                            nghttp3_recv_header recv_header) {
+  nghttp3_buf *buf = &stream->rx.cookie.buf;
+  nghttp3_rcbuf *value = NULL;
+  int rv = 0;
+
+  if (recv_header) {
+    if (nghttp3_buf_len(buf)) {
+      rv = nghttp3_rcbuf_new2(&value, buf->pos, nghttp3_buf_len(buf),
+                              conn->mem);
+      if (rv != 0) {
+        goto fin;
+      }
+    }
+
+    rv = recv_header(conn, stream->node.id, NGHTTP3_QPACK_TOKEN_COOKIE,
+                     stream->rx.cookie.name,
+                     value ? value : stream->rx.cookie.value,
+                     stream->rx.cookie.flags, conn->user_data,
+                     stream->user_data);
+    if (rv != 0) {
+      rv = NGHTTP3_ERR_CALLBACK_FAILURE;
+    }
+
+    nghttp3_rcbuf_decref(value);
+  }
+
+fin:
+  nghttp3_stream_cookie_reset(stream);
+
+  return rv;
+}
+
 static nghttp3_ssize conn_decode_headers(nghttp3_conn *conn,
                                          nghttp3_stream *stream,
                                          const uint8_t *src, size_t srclen,
@@ -1854,6 +2680,7 @@ static nghttp3_ssize conn_decode_headers(nghttp3_conn *conn,
   nghttp3_http_state *http;
   int request = 0;
   int trailers = 0;
+  int last;
 
   switch (stream->rx.hstate) {
   case NGHTTP3_HTTP_STATE_REQ_HEADERS_BEGIN:
@@ -1894,21 +2721,61 @@ static nghttp3_ssize conn_decode_headers(nghttp3_conn *conn,
         return NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED;
       }
 
-      stream->flags |= NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED;
-      rv = nghttp3_conn_qpack_blocked_streams_push(conn, stream);
+      stream->flags |= NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED;
+      rv = nghttp3_conn_qpack_blocked_streams_push(conn, stream);
+      if (rv != 0) {
+        return rv;
+      }
+      break;
+    }
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_FINAL) {
+      nghttp3_qpack_stream_context_reset(&stream->qpack_sctx);
+
+      if (stream->rx.cookie.name) {
+        rv = conn_emit_cookie(conn, stream, recv_header);
+        if (rv != 0) {
+          return rv;
+        }
+      }
+
+      break;
+    }
+
+    if (nread == 0) {
+      break;
+    }
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT) {
+      last = (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) != 0;
+
+      rv = nghttp3_http_on_header_fragment(http, &nv, last);
+      switch (rv) {
+      case NGHTTP3_ERR_MALFORMED_HTTP_HEADER:
+        break;
+      case NGHTTP3_ERR_REMOVE_HTTP_HEADER:
+        rv = 0;
+        break;
+      case 0:
+        rv = conn->callbacks.recv_header_fragment(
+          conn, stream->node.id, nv.token, nv.name, nv.value, nv.flags, last,
+          conn->user_data, stream->user_data);
+        if (rv != 0) {
+          rv = NGHTTP3_ERR_CALLBACK_FAILURE;
+        }
+        break;
+      default:
+        nghttp3_unreachable();
+      }
+
+      nghttp3_rcbuf_decref(nv.name);
+      nghttp3_rcbuf_decref(nv.value);
+
       if (rv != 0) {
         return rv;
       }
-      break;
-    }
-
-    if (flags & NGHTTP3_QPACK_DECODE_FLAG_FINAL) {
-      nghttp3_qpack_stream_context_reset(&stream->qpack_sctx);
-      break;
-    }
 
-    if (nread == 0) {
-      break;
+      continue;
     }
 
     if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
@@ -1922,6 +2789,12 @@ static nghttp3_ssize conn_decode_headers(nghttp3_conn *conn,
         rv = 0;
         break;
       case 0:
+        if (nv.token == NGHTTP3_QPACK_TOKEN_COOKIE &&
+            conn->local.settings.qpack_decoder_join_cookie) {
+          rv = conn_stash_cookie(conn, stream, &nv);
+          break;
+        }
+
         if (recv_header) {
           rv = recv_header(conn, stream->node.id, nv.token, nv.name, nv.value,
                            nv.flags, conn->user_data, stream->user_data);
@@ -2051,6 +2924,36 @@ int nghttp3_conn_on_settings_entry_received(nghttp3_conn *conn,
   return 0;
 }
 
+/*
+ * conn_apply_priority_updates applies the priorities received in
+ * PRIORITY_UPDATE frames to the streams, rescheduling each of them
+ * at most once.
+ */
+static int conn_apply_priority_updates(nghttp3_conn *conn) {
+  nghttp3_stream *stream;
+  int rv;
+
+  for (; conn->rx.pri_update_head;) {
+    stream = conn->rx.pri_update_head;
+    conn->rx.pri_update_head = stream->rx.pri_update_next;
+
+    stream->rx.pri_update_next = NULL;
+    stream->flags &=
+      (uint16_t)~NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING;
+
+    if (stream->flags & NGHTTP3_STREAM_FLAG_SERVER_PRIORITY_SET) {
+      continue;
+    }
+
+    rv = conn_update_stream_priority(conn, stream, &stream->rx.pri_update);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
 static int
 conn_on_priority_update_stream(nghttp3_conn *conn,
                                const nghttp3_frame_priority_update *fr) {
@@ -2103,7 +3006,15 @@ conn_on_priority_update_stream(nghttp3_conn *conn,
 
   stream->flags |= NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_RECVED;
 
-  return conn_update_stream_priority(conn, stream, &fr->pri);
+  stream->rx.pri_update = fr->pri;
+
+  if (!(stream->flags & NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING)) {
+    stream->flags |= NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING;
+    stream->rx.pri_update_next = conn->rx.pri_update_head;
+    conn->rx.pri_update_head = stream;
+  }
+
+  return 0;
 }
 
 int nghttp3_conn_on_priority_update(nghttp3_conn *conn,
@@ -2114,6 +3025,25 @@ int nghttp3_conn_on_priority_update(nghttp3_conn *conn,
   return conn_on_priority_update_stream(conn, fr);
 }
 
+nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
+                                        nghttp3_stream *stream,
+                                        const uint8_t *src, size_t srclen,
+                                        nghttp3_tstamp ts) {
+  nghttp3_ssize nconsumed = conn_read_control(conn, stream, src, srclen, ts);
+  int rv;
+
+  if (nconsumed < 0) {
+    return nconsumed;
+  }
+
+  rv = conn_apply_priority_updates(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return nconsumed;
+}
+
 static int conn_stream_acked_data(nghttp3_stream *stream, int64_t stream_id,
                                   uint64_t datalen, void *user_data) {
   nghttp3_conn *conn = stream->conn;
@@ -2170,6 +3100,27 @@ nghttp3_stream *nghttp3_conn_find_stream(const nghttp3_conn *conn,
   return nghttp3_map_find(&conn->streams, (nghttp3_map_key_type)stream_id);
 }
 
+/*
+ * conn_write_preamble queues the serialized control stream preamble
+ * |preamble| to |stream|.  The buffer is shared with the other
+ * connections, and it is not copied.
+ */
+static int conn_write_preamble(nghttp3_conn *conn, nghttp3_stream *stream,
+                               const nghttp3_preamble *preamble) {
+  nghttp3_buf buf;
+  nghttp3_typed_buf tbuf;
+
+  assert(nghttp3_preamble_match(preamble, &conn->local.settings));
+  assert(!preamble->origin || conn->server);
+  (void)conn;
+
+  nghttp3_buf_wrap_init(&buf, preamble->data.base, preamble->data.len);
+  buf.last = buf.end;
+  nghttp3_typed_buf_init(&tbuf, &buf, NGHTTP3_BUF_TYPE_ALIEN_NO_ACK);
+
+  return nghttp3_stream_outq_add(stream, &tbuf);
+}
+
 int nghttp3_conn_bind_control_stream(nghttp3_conn *conn, int64_t stream_id) {
   nghttp3_stream *stream;
   nghttp3_frame *fr;
@@ -2193,6 +3144,10 @@ int nghttp3_conn_bind_control_stream(nghttp3_conn *conn, int64_t stream_id) {
 
   conn->tx.ctrl = stream;
 
+  if (conn->local.settings.preamble) {
+    return conn_write_preamble(conn, stream, conn->local.settings.preamble);
+  }
+
   rv = nghttp3_stream_write_stream_type(stream);
   if (rv != 0) {
     return rv;
@@ -2307,9 +3262,67 @@ static nghttp3_ssize conn_writev_stream(nghttp3_conn *conn, int64_t *pstream_id,
   return (nghttp3_ssize)n;
 }
 
-nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
+/*
+ * conn_qpack_decoder_stream_due returns nonzero if the pending QPACK
+ * decoder instructions should be written to QPACK decoder stream at
+ * the current timestamp |ts|.  Otherwise, it arms conn->tx.qdec_expiry
+ * if it has not been armed, and returns 0.
+ */
+static int conn_qpack_decoder_stream_due(nghttp3_conn *conn,
+                                         nghttp3_tstamp ts) {
+  nghttp3_duration delay = conn->local.settings.qpack_decoder_ack_delay;
+  size_t len = nghttp3_qpack_decoder_get_decoder_streamlen2(&conn->qdec);
+
+  if (len == 0) {
+    return 0;
+  }
+
+  if (delay == 0 || len >= NGHTTP3_QPACK_DECODER_STREAM_BATCHLEN ||
+      nghttp3_qpack_decoder_unblocks_encoder(&conn->qdec)) {
+    return 1;
+  }
+
+  if (conn->tx.qdec_expiry == UINT64_MAX) {
+    if (delay >= UINT64_MAX - ts) {
+      return 1;
+    }
+
+    conn->tx.qdec_expiry = ts + delay;
+
+    return 0;
+  }
+
+  return ts >= conn->tx.qdec_expiry;
+}
+
+/*
+ * conn_get_writev_hint stores the priority of |stream| and whether it
+ * has more data to send after |nwrite| bytes into |*hint|.
+ */
+static void conn_get_writev_hint(const nghttp3_stream *stream,
+                                 uint64_t nwrite, nghttp3_writev_hint *hint) {
+  if (nghttp3_stream_uni(stream->node.id)) {
+    hint->pri = (nghttp3_pri){
+      .urgency = NGHTTP3_URGENCY_HIGH,
+    };
+    hint->more = stream->unsent_bytes > nwrite;
+
+    return;
+  }
+
+  hint->pri = stream->node.pri;
+  hint->more =
+    !(stream->flags &
+      (NGHTTP3_STREAM_FLAG_FC_BLOCKED | NGHTTP3_STREAM_FLAG_SHUT_WR)) &&
+    (stream->unsent_bytes > nwrite ||
+     (nghttp3_ringbuf_len(&stream->frq) &&
+      !(stream->flags & NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED)));
+}
+
+static nghttp3_ssize conn_writev_streams(nghttp3_conn *conn,
                                          int64_t *pstream_id, int *pfin,
-                                         nghttp3_vec *vec, size_t veccnt) {
+                                         nghttp3_vec *vec, size_t veccnt,
+                                         nghttp3_tstamp ts) {
   nghttp3_ssize ncnt;
   nghttp3_stream *stream;
   int rv;
@@ -2330,9 +3343,13 @@ nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
   }
 
   if (conn->tx.qdec && !nghttp3_stream_is_blocked(conn->tx.qdec)) {
-    rv = nghttp3_stream_write_qpack_decoder_stream(conn->tx.qdec);
-    if (rv != 0) {
-      return rv;
+    if (conn_qpack_decoder_stream_due(conn, ts)) {
+      rv = nghttp3_stream_write_qpack_decoder_stream(conn->tx.qdec);
+      if (rv != 0) {
+        return rv;
+      }
+
+      conn->tx.qdec_expiry = UINT64_MAX;
     }
 
     ncnt =
@@ -2368,11 +3385,100 @@ nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
   return ncnt;
 }
 
+nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
+                                         int64_t *pstream_id, int *pfin,
+                                         nghttp3_vec *vec, size_t veccnt) {
+  /* UINT64_MAX is never earlier than conn->tx.qdec_expiry, so that
+     nothing is held back. */
+  return nghttp3_conn_writev_stream2(conn, pstream_id, pfin, vec, veccnt,
+                                     UINT64_MAX);
+}
+
+nghttp3_ssize nghttp3_conn_writev_stream2(nghttp3_conn *conn,
+                                          int64_t *pstream_id, int *pfin,
+                                          nghttp3_vec *vec, size_t veccnt,
+                                          nghttp3_tstamp ts) {
+  return conn_writev_streams(conn, pstream_id, pfin, vec, veccnt, ts);
+}
+
+nghttp3_ssize nghttp3_conn_writev_stream_hint_versioned(
+  nghttp3_conn *conn, int64_t *pstream_id, int *pfin, nghttp3_vec *vec,
+  size_t veccnt, nghttp3_tstamp ts, int hint_version,
+  nghttp3_writev_hint *hint) {
+  nghttp3_ssize ncnt;
+  nghttp3_stream *stream;
+  (void)hint_version;
+
+  ncnt = conn_writev_streams(conn, pstream_id, pfin, vec, veccnt, ts);
+  if (ncnt < 0 || hint == NULL || *pstream_id == -1) {
+    return ncnt;
+  }
+
+  stream = nghttp3_conn_find_stream(conn, *pstream_id);
+
+  assert(stream);
+
+  conn_get_writev_hint(stream, nghttp3_vec_len(vec, (size_t)ncnt), hint);
+
+  return ncnt;
+}
+
+nghttp3_tstamp nghttp3_conn_get_expiry(const nghttp3_conn *conn) {
+  return conn->tx.qdec_expiry;
+}
+
+/*
+ * conn_get_next_tx_stream_weighted returns the stream to send next
+ * by serving non-empty urgency levels in deficit round robin.
+ */
+static nghttp3_stream *conn_get_next_tx_stream_weighted(nghttp3_conn *conn) {
+  size_t i, n;
+  nghttp3_tnode *tnode;
+  nghttp3_pq *pq;
+  int nonempty = 0;
+
+  /* deficit is at least -quantum, so that every non-empty level gets
+     positive deficit within 2 rounds. */
+  for (n = 0; n <= 2 * NGHTTP3_URGENCY_LEVELS; ++n) {
+    i = conn->sched_level;
+    pq = &conn->sched[i].spq;
+
+    if (nghttp3_pq_empty(pq)) {
+      conn->sched[i].deficit = 0;
+    } else {
+      nonempty = 1;
+
+      if (conn->sched[i].deficit > 0) {
+        tnode = nghttp3_struct_of(nghttp3_pq_top(pq), nghttp3_tnode, pe);
+
+        return nghttp3_struct_of(tnode, nghttp3_stream, node);
+      }
+    }
+
+    conn->sched_level = (i + 1) % NGHTTP3_URGENCY_LEVELS;
+
+    if (!nghttp3_pq_empty(&conn->sched[conn->sched_level].spq)) {
+      conn->sched[conn->sched_level].deficit +=
+        (int64_t)conn->sched[conn->sched_level].quantum;
+    }
+
+    if (n == NGHTTP3_URGENCY_LEVELS - 1 && !nonempty) {
+      return NULL;
+    }
+  }
+
+  nghttp3_unreachable();
+}
+
 nghttp3_stream *nghttp3_conn_get_next_tx_stream(nghttp3_conn *conn) {
   size_t i;
   nghttp3_tnode *tnode;
   nghttp3_pq *pq;
 
+  if (conn->flags & NGHTTP3_CONN_FLAG_WEIGHTED_SCHED) {
+    return conn_get_next_tx_stream_weighted(conn);
+  }
+
   for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
     pq = &conn->sched[i].spq;
     if (nghttp3_pq_empty(pq)) {
@@ -2387,6 +3493,25 @@ nghttp3_stream *nghttp3_conn_get_next_tx_stream(nghttp3_conn *conn) {
   return NULL;
 }
 
+/*
+ * conn_charge_sched_level subtracts |n| bytes written to |stream|
+ * from the deficit of its urgency level.
+ */
+static void conn_charge_sched_level(nghttp3_conn *conn,
+                                    nghttp3_stream *stream, size_t n) {
+  uint32_t urgency = stream->node.pri.urgency;
+  int64_t floor;
+
+  assert(urgency < NGHTTP3_URGENCY_LEVELS);
+
+  floor = -(int64_t)conn->sched[urgency].quantum;
+
+  conn->sched[urgency].deficit -= (int64_t)n;
+  if (conn->sched[urgency].deficit < floor) {
+    conn->sched[urgency].deficit = floor;
+  }
+}
+
 int nghttp3_conn_add_write_offset(nghttp3_conn *conn, int64_t stream_id,
                                   size_t n) {
   nghttp3_stream *stream = nghttp3_conn_find_stream(conn, stream_id);
@@ -2403,6 +3528,10 @@ int nghttp3_conn_add_write_offset(nghttp3_conn *conn, int64_t stream_id,
     return 0;
   }
 
+  if (conn->flags & NGHTTP3_CONN_FLAG_WEIGHTED_SCHED) {
+    conn_charge_sched_level(conn, stream, n);
+  }
+
   if (!nghttp3_stream_require_schedule(stream)) {
     nghttp3_conn_unschedule_stream(conn, stream);
     return 0;
@@ -2443,8 +3572,10 @@ int nghttp3_conn_update_ack_offset(nghttp3_conn *conn, int64_t stream_id,
 
 static int conn_submit_headers_data(nghttp3_conn *conn, nghttp3_stream *stream,
                                     const nghttp3_nv *nva, size_t nvlen,
-                                    const nghttp3_data_reader *dr) {
+                                    const nghttp3_data_reader *dr,
+                                    const nghttp3_data_buf_reader *bdr) {
   int rv;
+  int scheduled;
   nghttp3_nv *nnva;
   nghttp3_frame *fr;
 
@@ -2465,7 +3596,7 @@ static int conn_submit_headers_data(nghttp3_conn *conn, nghttp3_stream *stream,
     .nvlen = nvlen,
   };
 
-  if (dr) {
+  if (dr || bdr) {
     rv = nghttp3_stream_frq_emplace(stream, &fr);
     if (rv != 0) {
       return rv;
@@ -2473,12 +3604,26 @@ static int conn_submit_headers_data(nghttp3_conn *conn, nghttp3_stream *stream,
 
     fr->data = (nghttp3_frame_data){
       .type = NGHTTP3_FRAME_DATA,
-      .dr = *dr,
     };
+
+    if (dr) {
+      fr->data.dr = *dr;
+    } else {
+      fr->data.bdr = *bdr;
+    }
   }
 
   if (nghttp3_stream_require_schedule(stream)) {
-    return nghttp3_conn_schedule_stream(conn, stream);
+    scheduled = nghttp3_tnode_is_scheduled(stream_get_sched_node(stream));
+
+    rv = nghttp3_conn_schedule_stream(conn, stream);
+    if (rv != 0) {
+      return rv;
+    }
+
+    if (!scheduled) {
+      return conn_call_stream_writable(conn, stream);
+    }
   }
 
   return 0;
@@ -2502,11 +3647,18 @@ int nghttp3_conn_schedule_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
 
 int nghttp3_conn_ensure_stream_scheduled(nghttp3_conn *conn,
                                          nghttp3_stream *stream) {
+  int rv;
+
   if (nghttp3_tnode_is_scheduled(stream_get_sched_node(stream))) {
     return 0;
   }
 
-  return nghttp3_conn_schedule_stream(conn, stream);
+  rv = nghttp3_conn_schedule_stream(conn, stream);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return conn_call_stream_writable(conn, stream);
 }
 
 void nghttp3_conn_unschedule_stream(nghttp3_conn *conn,
@@ -2516,10 +3668,11 @@ void nghttp3_conn_unschedule_stream(nghttp3_conn *conn,
   nghttp3_tnode_unschedule(node, conn_get_sched_pq(conn, node));
 }
 
-int nghttp3_conn_submit_request(nghttp3_conn *conn, int64_t stream_id,
-                                const nghttp3_nv *nva, size_t nvlen,
-                                const nghttp3_data_reader *dr,
-                                void *stream_user_data) {
+static int conn_submit_request(nghttp3_conn *conn, int64_t stream_id,
+                               const nghttp3_nv *nva, size_t nvlen,
+                               const nghttp3_data_reader *dr,
+                               const nghttp3_data_buf_reader *bdr,
+                               void *stream_user_data) {
   nghttp3_stream *stream;
   int rv;
 
@@ -2550,11 +3703,29 @@ int nghttp3_conn_submit_request(nghttp3_conn *conn, int64_t stream_id,
 
   nghttp3_http_record_request_method(stream, nva, nvlen);
 
-  if (dr == NULL) {
+  if (dr == NULL && bdr == NULL) {
     stream->flags |= NGHTTP3_STREAM_FLAG_WRITE_END_STREAM;
   }
 
-  return conn_submit_headers_data(conn, stream, nva, nvlen, dr);
+  return conn_submit_headers_data(conn, stream, nva, nvlen, dr, bdr);
+}
+
+int nghttp3_conn_submit_request(nghttp3_conn *conn, int64_t stream_id,
+                                const nghttp3_nv *nva, size_t nvlen,
+                                const nghttp3_data_reader *dr,
+                                void *stream_user_data) {
+  return conn_submit_request(conn, stream_id, nva, nvlen, dr, NULL,
+                             stream_user_data);
+}
+
+int nghttp3_conn_submit_request_buf(nghttp3_conn *conn, int64_t stream_id,
+                                    const nghttp3_nv *nva, size_t nvlen,
+                                    const nghttp3_data_buf_reader *dr,
+                                    void *stream_user_data) {
+  assert(dr == NULL || dr->read_data_buf);
+
+  return conn_submit_request(conn, stream_id, nva, nvlen, NULL, dr,
+                             stream_user_data);
 }
 
 int nghttp3_conn_submit_info(nghttp3_conn *conn, int64_t stream_id,
@@ -2571,12 +3742,13 @@ int nghttp3_conn_submit_info(nghttp3_conn *conn, int64_t stream_id,
     return NGHTTP3_ERR_STREAM_NOT_FOUND;
   }
 
-  return conn_submit_headers_data(conn, stream, nva, nvlen, NULL);
+  return conn_submit_headers_data(conn, stream, nva, nvlen, NULL, NULL);
 }
 
-int nghttp3_conn_submit_response(nghttp3_conn *conn, int64_t stream_id,
-                                 const nghttp3_nv *nva, size_t nvlen,
-                                 const nghttp3_data_reader *dr) {
+static int conn_submit_response(nghttp3_conn *conn, int64_t stream_id,
+                                const nghttp3_nv *nva, size_t nvlen,
+                                const nghttp3_data_reader *dr,
+                                const nghttp3_data_buf_reader *bdr) {
   nghttp3_stream *stream;
 
   /* TODO Verify that it is allowed to send response now. */
@@ -2588,11 +3760,25 @@ int nghttp3_conn_submit_response(nghttp3_conn *conn, int64_t stream_id,
     return NGHTTP3_ERR_STREAM_NOT_FOUND;
   }
 
-  if (dr == NULL) {
+  if (dr == NULL && bdr == NULL) {
     stream->flags |= NGHTTP3_STREAM_FLAG_WRITE_END_STREAM;
   }
 
-  return conn_submit_headers_data(conn, stream, nva, nvlen, dr);
+  return conn_submit_headers_data(conn, stream, nva, nvlen, dr, bdr);
+}
+
+int nghttp3_conn_submit_response(nghttp3_conn *conn, int64_t stream_id,
+                                 const nghttp3_nv *nva, size_t nvlen,
+                                 const nghttp3_data_reader *dr) {
+  return conn_submit_response(conn, stream_id, nva, nvlen, dr, NULL);
+}
+
+int nghttp3_conn_submit_response_buf(nghttp3_conn *conn, int64_t stream_id,
+                                     const nghttp3_nv *nva, size_t nvlen,
+                                     const nghttp3_data_buf_reader *dr) {
+  assert(dr == NULL || dr->read_data_buf);
+
+  return conn_submit_response(conn, stream_id, nva, nvlen, NULL, dr);
 }
 
 int nghttp3_conn_submit_trailers(nghttp3_conn *conn, int64_t stream_id,
@@ -2613,15 +3799,18 @@ int nghttp3_conn_submit_trailers(nghttp3_conn *conn, int64_t stream_id,
 
   stream->flags |= NGHTTP3_STREAM_FLAG_WRITE_END_STREAM;
 
-  return conn_submit_headers_data(conn, stream, nva, nvlen, NULL);
+  return conn_submit_headers_data(conn, stream, nva, nvlen, NULL, NULL);
 }
 
 int nghttp3_conn_submit_shutdown_notice(nghttp3_conn *conn) {
   nghttp3_frame *fr;
   int rv;
+  int pending;
 
   assert(conn->tx.ctrl);
 
+  pending = conn_uni_stream_pending(conn, conn->tx.ctrl);
+
   rv = nghttp3_stream_frq_emplace(conn->tx.ctrl, &fr);
   if (rv != 0) {
     return rv;
@@ -2638,15 +3827,18 @@ int nghttp3_conn_submit_shutdown_notice(nghttp3_conn *conn) {
   conn->tx.goaway_id = fr->goaway.id;
   conn->flags |= NGHTTP3_CONN_FLAG_GOAWAY_QUEUED;
 
-  return 0;
+  return conn_notify_uni_stream(conn, conn->tx.ctrl, pending);
 }
 
 int nghttp3_conn_shutdown(nghttp3_conn *conn) {
   nghttp3_frame *fr;
   int rv;
+  int pending;
 
   assert(conn->tx.ctrl);
 
+  pending = conn_uni_stream_pending(conn, conn->tx.ctrl);
+
   rv = nghttp3_stream_frq_emplace(conn->tx.ctrl, &fr);
   if (rv != 0) {
     return rv;
@@ -2665,7 +3857,7 @@ int nghttp3_conn_shutdown(nghttp3_conn *conn) {
   conn->flags |=
     NGHTTP3_CONN_FLAG_GOAWAY_QUEUED | NGHTTP3_CONN_FLAG_SHUTDOWN_COMMENCED;
 
-  return 0;
+  return conn_notify_uni_stream(conn, conn->tx.ctrl, pending);
 }
 
 int nghttp3_conn_reject_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
@@ -2711,19 +3903,26 @@ void nghttp3_conn_shutdown_stream_write(nghttp3_conn *conn, int64_t stream_id) {
 
 int nghttp3_conn_unblock_stream(nghttp3_conn *conn, int64_t stream_id) {
   nghttp3_stream *stream = nghttp3_conn_find_stream(conn, stream_id);
+  int blocked;
 
   if (stream == NULL) {
     return 0;
   }
 
+  blocked = nghttp3_stream_is_blocked(stream);
+
   stream->flags &= (uint16_t)~NGHTTP3_STREAM_FLAG_FC_BLOCKED;
 
-  if (nghttp3_client_stream_bidi(stream->node.id) &&
-      nghttp3_stream_require_schedule(stream)) {
-    return nghttp3_conn_ensure_stream_scheduled(conn, stream);
+  if (nghttp3_client_stream_bidi(stream->node.id)) {
+    if (nghttp3_stream_require_schedule(stream)) {
+      return nghttp3_conn_ensure_stream_scheduled(conn, stream);
+    }
+
+    return 0;
   }
 
-  return 0;
+  /* Pretend that stream had nothing to send if it was blocked. */
+  return conn_notify_uni_stream(conn, stream, !blocked);
 }
 
 int nghttp3_conn_is_stream_writable(nghttp3_conn *conn, int64_t stream_id) {
@@ -2773,6 +3972,8 @@ int nghttp3_conn_close_stream2(nghttp3_conn *conn, uint32_t flags,
                                int64_t stream_id, uint64_t rx_app_error_code,
                                uint64_t tx_app_error_code) {
   nghttp3_stream *stream = nghttp3_conn_find_stream(conn, stream_id);
+  int pending;
+  int rv;
 
   if (stream == NULL) {
     return NGHTTP3_ERR_STREAM_NOT_FOUND;
@@ -2783,14 +3984,24 @@ int nghttp3_conn_close_stream2(nghttp3_conn *conn, uint32_t flags,
     return NGHTTP3_ERR_H3_CLOSED_CRITICAL_STREAM;
   }
 
+  pending = conn_uni_stream_pending(conn, conn->tx.qdec);
+
   nghttp3_conn_unschedule_stream(conn, stream);
 
-  return conn_delete_stream(conn, stream, flags, rx_app_error_code,
-                            tx_app_error_code);
+  rv = conn_delete_stream(conn, stream, flags, rx_app_error_code,
+                          tx_app_error_code);
+  if (rv != 0) {
+    return rv;
+  }
+
+  /* QPACK decoder might have produced Stream Cancellation. */
+  return conn_notify_uni_stream(conn, conn->tx.qdec, pending);
 }
 
 int nghttp3_conn_shutdown_stream_read(nghttp3_conn *conn, int64_t stream_id) {
   nghttp3_stream *stream;
+  int pending;
+  int rv;
 
   assert(stream_id >= 0);
   assert(stream_id <= (int64_t)NGHTTP3_MAX_VARINT);
@@ -2808,7 +4019,14 @@ int nghttp3_conn_shutdown_stream_read(nghttp3_conn *conn, int64_t stream_id) {
     stream->flags |= NGHTTP3_STREAM_FLAG_SHUT_RD;
   }
 
-  return nghttp3_qpack_decoder_cancel_stream(&conn->qdec, stream_id);
+  pending = conn_uni_stream_pending(conn, conn->tx.qdec);
+
+  rv = nghttp3_qpack_decoder_cancel_stream(&conn->qdec, stream_id);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return conn_notify_uni_stream(conn, conn->tx.qdec, pending);
 }
 
 int nghttp3_conn_qpack_blocked_streams_push(nghttp3_conn *conn,
@@ -2840,6 +4058,45 @@ void nghttp3_conn_set_max_client_streams_bidi(nghttp3_conn *conn,
   conn->remote.bidi.max_client_streams = max_streams;
 }
 
+void nghttp3_conn_set_path_estimate(nghttp3_conn *conn, nghttp3_duration rtt,
+                                    uint32_t loss_ppm) {
+  nghttp3_qpack_encoder_set_path_estimate(&conn->qenc, rtt, loss_ppm);
+}
+
+int nghttp3_conn_prime_qpack(nghttp3_conn *conn, const nghttp3_nv *nva,
+                             size_t nvlen) {
+  int rv;
+  int pending;
+
+  if (!conn->tx.qenc || conn->tx.qpack.prime_nva) {
+    return NGHTTP3_ERR_INVALID_STATE;
+  }
+
+  if (nvlen == 0) {
+    return 0;
+  }
+
+  if (!(conn->flags & NGHTTP3_CONN_FLAG_SETTINGS_RECVED)) {
+    rv = nghttp3_nva_copy(&conn->tx.qpack.prime_nva, nva, nvlen, conn->mem);
+    if (rv != 0) {
+      return rv;
+    }
+
+    conn->tx.qpack.prime_nvlen = nvlen;
+
+    return 0;
+  }
+
+  pending = conn_uni_stream_pending(conn, conn->tx.qenc);
+
+  rv = conn_prime_qpack(conn, nva, nvlen);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return conn_notify_uni_stream(conn, conn->tx.qenc, pending);
+}
+
 void nghttp3_conn_set_max_concurrent_streams(nghttp3_conn *conn,
                                              size_t max_concurrent_streams) {
   nghttp3_qpack_decoder_set_max_concurrent_streams(&conn->qdec,
@@ -2946,6 +4203,7 @@ int nghttp3_conn_set_client_stream_priority(nghttp3_conn *conn,
   nghttp3_stream *stream;
   nghttp3_frame *fr;
   int rv;
+  int pending;
   uint8_t *buf = NULL;
 
   assert(!conn->server);
@@ -2970,6 +4228,8 @@ int nghttp3_conn_set_client_stream_priority(nghttp3_conn *conn,
     memcpy(buf, data, datalen);
   }
 
+  pending = conn_uni_stream_pending(conn, conn->tx.ctrl);
+
   rv = nghttp3_stream_frq_emplace(conn->tx.ctrl, &fr);
   if (rv != 0) {
     nghttp3_mem_free(conn->mem, buf);
@@ -2983,7 +4243,7 @@ int nghttp3_conn_set_client_stream_priority(nghttp3_conn *conn,
     .datalen = datalen,
   };
 
-  return 0;
+  return conn_notify_uni_stream(conn, conn->tx.ctrl, pending);
 }
 
 int nghttp3_conn_set_server_stream_priority_versioned(nghttp3_conn *conn,
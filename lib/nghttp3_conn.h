@@ -47,6 +47,22 @@
    blocked streams for QPACK encoder. */
 #define NGHTTP3_QPACK_ENCODER_MAX_BLOCK_STREAMS 100
 
+/* NGHTTP3_QPACK_DECODER_STREAM_BATCHLEN is the number of bytes of
+   pending QPACK decoder instructions that are sent without waiting
+   for nghttp3_settings.qpack_decoder_ack_delay. */
+#define NGHTTP3_QPACK_DECODER_STREAM_BATCHLEN 64
+
+/* NGHTTP3_PRI_FIELDBUFLEN is the maximum length of Priority Field
+   Value in PRIORITY_UPDATE frame.  Longer one is ignored.  It is also
+   the size of the buffer that holds the value when it spans multiple
+   input buffers. */
+#define NGHTTP3_PRI_FIELDBUFLEN 1024
+
+/* NGHTTP3_CONN_MAX_RECV_DATAV is the maximum number of DATA frame
+   payload fragments which are passed to nghttp3_recv_datav at
+   once. */
+#define NGHTTP3_CONN_MAX_RECV_DATAV 16
+
 /* NGHTTP3_CONN_FLAG_NONE indicates that no flag is set. */
 #define NGHTTP3_CONN_FLAG_NONE 0x0000U
 /* NGHTTP3_CONN_FLAG_SETTINGS_RECVED is set when SETTINGS frame has
@@ -70,6 +86,10 @@
 /* NGHTTP3_CONN_FLAG_GOAWAY_QUEUED indicates that GOAWAY frame has
    been submitted for transmission. */
 #define NGHTTP3_CONN_FLAG_GOAWAY_QUEUED 0x0040U
+/* NGHTTP3_CONN_FLAG_WEIGHTED_SCHED indicates that urgency levels are
+   served in deficit round robin using
+   nghttp3_settings.urgency_weights. */
+#define NGHTTP3_CONN_FLAG_WEIGHTED_SCHED 0x0080U
 
 typedef struct nghttp3_chunk {
   nghttp3_opl_entry oplent;
@@ -88,7 +108,17 @@ struct nghttp3_conn {
   nghttp3_ratelim glitch_rlim;
   struct {
     nghttp3_pq spq;
+    /* quantum is the number of bytes added to deficit each time
+       this level gets its turn.  It is only used if
+       NGHTTP3_CONN_FLAG_WEIGHTED_SCHED is set. */
+    uint64_t quantum;
+    /* deficit is the number of bytes that this level can still send
+       in the current turn. */
+    int64_t deficit;
   } sched[NGHTTP3_URGENCY_LEVELS];
+  /* sched_level is the urgency level which currently has the turn
+     if NGHTTP3_CONN_FLAG_WEIGHTED_SCHED is set. */
+  size_t sched_level;
   const nghttp3_mem *mem;
   void *user_data;
   int server;
@@ -132,9 +162,6 @@ struct nghttp3_conn {
 
     union {
       struct {
-        /* pri_fieldbuf is a buffer to store incoming Priority Field Value
-           in PRIORITY_UPDATE frame. */
-        uint8_t pri_fieldbuf[8];
         /* pri_fieldlen is the number of bytes written into
            pri_fieldbuf. */
         size_t pri_fieldbuflen;
@@ -160,19 +187,82 @@ struct nghttp3_conn {
     uint8_t *originbuf;
     /* originbuflen is the length of bytes written to originbuf. */
     size_t originbuflen;
+    /* pri_fieldbuf points to the buffer of length
+       NGHTTP3_PRI_FIELDBUFLEN that contains Priority Field Value in
+       PRIORITY_UPDATE frame that is not fully available in a single
+       input buffer.  If it is fully available, it is parsed in place
+       regardless of its length. */
+    uint8_t *pri_fieldbuf;
+    /* pri_update_head is the head of the list of streams which have
+       the priority received in PRIORITY_UPDATE frame, but not applied
+       yet.  They are applied at the end of
+       nghttp3_conn_read_control so that multiple updates to a stream
+       in a single input cause only one reschedule. */
+    nghttp3_stream *pri_update_head;
+    /* consumed_head is the head of the list of streams which have
+       consumed bytes not reported yet.  It is only used if
+       nghttp3_settings.consumed_report_threshold is nonzero. */
+    nghttp3_stream *consumed_head;
+    /* nconsumed is the number of bytes consumed by all streams since
+       the last call of nghttp3_conn_flush_consumed. */
+    uint64_t nconsumed;
   } rx;
 
   struct {
     struct {
       nghttp3_buf rbuf;
       nghttp3_buf ebuf;
+      /* prime_nva is a copy of HTTP fields passed to
+         nghttp3_conn_prime_qpack before SETTINGS frame is received.
+         They are inserted into dynamic table when SETTINGS frame
+         arrives. */
+      nghttp3_nv *prime_nva;
+      /* prime_nvlen is the length of prime_nva. */
+      size_t prime_nvlen;
     } qpack;
     nghttp3_stream *ctrl;
     nghttp3_stream *qenc;
     nghttp3_stream *qdec;
     /* goaway_id is the latest ID sent in GOAWAY frame. */
     int64_t goaway_id;
+    /* qdec_expiry is the time when QPACK decoder instructions held
+       back by nghttp3_conn_writev_stream2 must be sent.  It is
+       UINT64_MAX if nothing is held back. */
+    nghttp3_tstamp qdec_expiry;
   } tx;
+
+  /* factory is the nghttp3_conn_factory that created this object.
+     If it is not NULL, this object is returned to factory when it is
+     deleted. */
+  nghttp3_conn_factory *factory;
+  /* shell_next points to the next shell in the pool of factory. */
+  nghttp3_conn *shell_next;
+};
+
+/*
+ * nghttp3_conn_factory keeps the settings and callbacks shared by the
+ * connections it creates, and the pool of connection shells.  A shell
+ * is an allocated nghttp3_conn that retains its memory pools, stream
+ * map, priority queues, and QPACK buffers across connections.
+ */
+struct nghttp3_conn_factory {
+  const nghttp3_mem *mem;
+  nghttp3_callbacks callbacks;
+  /* origin_list is the shallow copy of nghttp3_settings.origin_list.
+     settings.origin_list may point to the address of this field. */
+  nghttp3_vec origin_list;
+  /* urgency_weights is the copy of nghttp3_settings.urgency_weights.
+     settings.urgency_weights may point to this field. */
+  uint32_t urgency_weights[NGHTTP3_URGENCY_LEVELS];
+  nghttp3_settings settings;
+  int server;
+  /* shells is the singly linked list of the pooled shells. */
+  nghttp3_conn *shells;
+  /* nshells is the number of shells in shells. */
+  size_t nshells;
+  /* max_shells is the maximum number of shells that this object
+     pools. */
+  size_t max_shells;
 };
 
 nghttp3_stream *nghttp3_conn_find_stream(const nghttp3_conn *conn,
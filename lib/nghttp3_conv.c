@@ -29,47 +29,57 @@
 #include <assert.h>
 
 #include "nghttp3_str.h"
-#include "nghttp3_unreachable.h"
 
 const uint8_t *nghttp3_get_uvarint(uint64_t *dest, const uint8_t *p) {
-  uint16_t n16;
-  uint32_t n32;
-  uint64_t n64;
-
-  switch (*p >> 6) {
-  case 0:
-    *dest = *p++;
-    return p;
-  case 1:
-    memcpy(&n16, p, 2);
-    n16 = ntohs(n16);
-    n16 &= 0x3FFFU;
-    *dest = n16;
-
-    return p + 2;
-  case 2:
-    memcpy(&n32, p, 4);
-    n32 = ntohl(n32);
-    n32 &= 0x3FFFFFFFU;
-    *dest = n32;
-
-    return p + 4;
-  case 3:
-    memcpy(&n64, p, 8);
-    n64 = nghttp3_ntohl64(n64);
-    n64 &= 0x3FFFFFFFFFFFFFFFU;
-    *dest = n64;
-
-    return p + 8;
-  default:
-    nghttp3_unreachable();
-  }
+  size_t len = nghttp3_get_uvarintlen(p);
+  uint64_t n = 0;
+  uint8_t *q = (uint8_t *)&n + (sizeof(n) - len);
+
+  /* Place the integer at the tail of n in network byte order so that
+     all 4 lengths are handled by the same instructions. */
+  memcpy(q, p, len);
+  *q &= 0x3FU;
+
+  *dest = nghttp3_ntohl64(n);
+
+  return p + len;
 }
 
 size_t nghttp3_get_uvarintlen(const uint8_t *p) {
   return (size_t)(1U << (*p >> 6));
 }
 
+size_t nghttp3_get_uvarintv(uint64_t *dest, size_t n, const uint8_t **pp,
+                            const uint8_t *end) {
+  const uint8_t *p = *pp;
+  uint64_t v;
+  size_t len, i;
+
+  for (i = 0; i < n && p != end; ++i) {
+    len = nghttp3_get_uvarintlen(p);
+    if ((size_t)(end - p) < len) {
+      break;
+    }
+
+    if ((size_t)(end - p) < sizeof(v)) {
+      p = nghttp3_get_uvarint(&dest[i], p);
+      continue;
+    }
+
+    /* At least 8 bytes are available.  Load them at once, and shift
+       out the bytes that belong to the next integer. */
+    memcpy(&v, p, sizeof(v));
+    v = nghttp3_ntohl64(v) >> (64 - 8 * len);
+    dest[i] = v & ((1ULL << (8 * len - 2)) - 1);
+
+    p += len;
+  }
+
+  *pp = p;
+
+  return i;
+}
+
 const uint8_t *nghttp3_get_varint(int64_t *dest, const uint8_t *p) {
   uint64_t n;
 
@@ -94,40 +104,30 @@ uint8_t *nghttp3_put_uint16be(uint8_t *p, uint16_t n) {
   return nghttp3_cpymem(p, (const uint8_t *)&n, sizeof(n));
 }
 
-uint8_t *nghttp3_put_uvarint(uint8_t *p, uint64_t n) {
-  uint8_t *rv;
-  if (n < 64) {
-    *p++ = (uint8_t)n;
-    return p;
-  }
-  if (n < 16384) {
-    rv = nghttp3_put_uint16be(p, (uint16_t)n);
-    *p |= 0x40U;
-    return rv;
-  }
-  if (n < 1073741824) {
-    rv = nghttp3_put_uint32be(p, (uint32_t)n);
-    *p |= 0x80U;
-    return rv;
-  }
+/*
+ * put_uvarintlen_log2 returns the base-2 logarithm of the number of
+ * bytes required to encode |n| in variable-length unsigned integer
+ * encoding.  It is also the 2-bit length prefix.
+ */
+static size_t put_uvarintlen_log2(uint64_t n) {
   assert(n < 4611686018427387904ULL);
-  rv = nghttp3_put_uint64be(p, n);
-  *p |= 0xC0U;
-  return rv;
+
+  return (size_t)(n >= 64) + (size_t)(n >= 16384) +
+         (size_t)(n >= 1073741824);
+}
+
+uint8_t *nghttp3_put_uvarint(uint8_t *p, uint64_t n) {
+  size_t k = put_uvarintlen_log2(n);
+  size_t len = (size_t)1 << k;
+
+  n |= (uint64_t)k << (8 * len - 2);
+  n = nghttp3_htonl64(n << (64 - 8 * len));
+
+  return nghttp3_cpymem(p, (const uint8_t *)&n, len);
 }
 
 size_t nghttp3_put_uvarintlen(uint64_t n) {
-  if (n < 64) {
-    return 1;
-  }
-  if (n < 16384) {
-    return 2;
-  }
-  if (n < 1073741824) {
-    return 4;
-  }
-  assert(n < 4611686018427387904ULL);
-  return 8;
+  return (size_t)1 << put_uvarintlen_log2(n);
 }
 
 uint64_t nghttp3_ord_stream_id(int64_t stream_id) {
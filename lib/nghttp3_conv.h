@@ -113,6 +113,16 @@ uint8_t *nghttp3_put_uint32be(uint8_t *p, uint32_t n);
  */
 uint8_t *nghttp3_put_uint16be(uint8_t *p, uint16_t n);
 
+/*
+ * nghttp3_get_uvarintv decodes at most |n| variable-length unsigned
+ * integers from the buffer [*pp, end), and stores them in |dest| in
+ * host byte order.  It stops at the first integer that is not fully
+ * contained in the buffer.  It advances |*pp| past the decoded
+ * integers, and returns the number of integers decoded.
+ */
+size_t nghttp3_get_uvarintv(uint64_t *dest, size_t n, const uint8_t **pp,
+                            const uint8_t *end);
+
 /*
  * nghttp3_ord_stream_id returns the ordinal number of |stream_id|.
  */
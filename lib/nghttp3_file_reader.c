@@ -0,0 +1,209 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp3_file_reader.h"
+
+#include <assert.h>
+
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif /* defined(HAVE_UNISTD_H) */
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif /* defined(HAVE_SYS_MMAN_H) */
+
+#ifdef HAVE_POSIX_FADVISE
+#  include <fcntl.h>
+#endif /* defined(HAVE_POSIX_FADVISE) */
+
+#include "nghttp3_mem.h"
+#include "nghttp3_macro.h"
+#include "nghttp3_stream.h"
+#include "nghttp3_unreachable.h"
+
+#ifdef HAVE_SYS_MMAN_H
+int nghttp3_file_reader_new(nghttp3_file_reader **preader, int fd,
+                            uint64_t offset, uint64_t len,
+                            const nghttp3_mem *mem) {
+  nghttp3_file_reader *reader;
+  long pagesize;
+
+  assert(len <= UINT64_MAX - offset);
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  if (pagesize <= 0) {
+    return NGHTTP3_ERR_INVALID_STATE;
+  }
+
+  if (mem == NULL) {
+    mem = nghttp3_mem_default();
+  }
+
+  reader = nghttp3_mem_malloc(mem, sizeof(*reader));
+  if (reader == NULL) {
+    return NGHTTP3_ERR_NOMEM;
+  }
+
+  *reader = (nghttp3_file_reader){
+    .mem = mem,
+    .fd = fd,
+    .offset = offset,
+    .end = offset + len,
+    .pagesize = (size_t)pagesize,
+    .windowlen = (NGHTTP3_FILE_READER_WINDOWLEN + (size_t)pagesize - 1) /
+                 (size_t)pagesize * (size_t)pagesize,
+    .nref = 1,
+  };
+
+  *preader = reader;
+
+  return 0;
+}
+
+static void file_reader_decref(nghttp3_file_reader *reader) {
+  assert(reader->nref);
+
+  if (--reader->nref == 0) {
+    nghttp3_mem_free(reader->mem, reader);
+  }
+}
+
+void nghttp3_file_reader_del(nghttp3_file_reader *reader) {
+  if (reader == NULL) {
+    return;
+  }
+
+  file_reader_decref(reader);
+}
+
+static void file_reader_window_release(void *user_data) {
+  nghttp3_file_reader_window *win = user_data;
+  nghttp3_file_reader *reader = win->reader;
+
+  munmap(win->map, win->maplen);
+  nghttp3_mem_free(reader->mem, win);
+
+  file_reader_decref(reader);
+}
+
+nghttp3_ssize nghttp3_file_reader_read(nghttp3_file_reader *reader,
+                                       nghttp3_data_buf *buf, size_t bufcnt,
+                                       uint32_t *pflags) {
+  nghttp3_file_reader_window *win;
+  uint64_t aligned;
+  size_t pad, len, maplen;
+  void *map;
+
+  assert(bufcnt);
+
+  if (reader->offset == reader->end) {
+    *pflags |= NGHTTP3_DATA_FLAG_EOF;
+
+    return 0;
+  }
+
+  aligned = reader->offset & ~(uint64_t)(reader->pagesize - 1);
+  pad = (size_t)(reader->offset - aligned);
+  len = (size_t)nghttp3_min(reader->end - reader->offset,
+                            (uint64_t)(reader->windowlen - pad));
+  maplen = pad + len;
+
+  map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, reader->fd, (off_t)aligned);
+  if (map == MAP_FAILED) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  win = nghttp3_mem_malloc(reader->mem, sizeof(*win));
+  if (win == NULL) {
+    munmap(map, maplen);
+
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  /* The window is sent from the beginning to the end, and it is
+     needed soon after the stream runs out of the unsent data. */
+  posix_madvise(map, maplen, POSIX_MADV_SEQUENTIAL);
+  posix_madvise(map, maplen, POSIX_MADV_WILLNEED);
+
+  *win = (nghttp3_file_reader_window){
+    .reader = reader,
+    .map = map,
+    .maplen = maplen,
+  };
+
+  ++reader->nref;
+
+  buf[0] = (nghttp3_data_buf){
+    .base = (uint8_t *)map + pad,
+    .len = len,
+    .release = file_reader_window_release,
+    .user_data = win,
+  };
+
+  reader->offset += len;
+
+  if (reader->offset == reader->end) {
+    *pflags |= NGHTTP3_DATA_FLAG_EOF;
+
+    return 1;
+  }
+
+#ifdef HAVE_POSIX_FADVISE
+  /* Prefetch the next window while this window is being sent, so
+     that it is in the page cache when it is mapped. */
+  posix_fadvise(reader->fd, (off_t)reader->offset,
+                (off_t)nghttp3_min(reader->end - reader->offset,
+                                   (uint64_t)reader->windowlen),
+                POSIX_FADV_WILLNEED);
+#endif /* defined(HAVE_POSIX_FADVISE) */
+
+  return 1;
+}
+#else  /* !defined(HAVE_SYS_MMAN_H) */
+int nghttp3_file_reader_new(nghttp3_file_reader **preader, int fd,
+                            uint64_t offset, uint64_t len,
+                            const nghttp3_mem *mem) {
+  (void)preader;
+  (void)fd;
+  (void)offset;
+  (void)len;
+  (void)mem;
+
+  return NGHTTP3_ERR_INVALID_STATE;
+}
+
+void nghttp3_file_reader_del(nghttp3_file_reader *reader) { (void)reader; }
+
+nghttp3_ssize nghttp3_file_reader_read(nghttp3_file_reader *reader,
+                                       nghttp3_data_buf *buf, size_t bufcnt,
+                                       uint32_t *pflags) {
+  (void)reader;
+  (void)buf;
+  (void)bufcnt;
+  (void)pflags;
+
+  nghttp3_unreachable();
+}
+#endif /* !defined(HAVE_SYS_MMAN_H) */
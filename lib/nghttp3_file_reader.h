@@ -0,0 +1,67 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP3_FILE_READER_H
+#define NGHTTP3_FILE_READER_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* defined(HAVE_CONFIG_H) */
+
+#include <nghttp3/nghttp3.h>
+
+/* NGHTTP3_FILE_READER_WINDOWLEN is the length of the file that is
+   mapped by a single nghttp3_file_reader_read call.  It is rounded
+   up to the multiple of page size.  It is larger than
+   NGHTTP3_MIN_UNSENT_BYTES so that a single window satisfies the
+   stream that asks for more data. */
+#define NGHTTP3_FILE_READER_WINDOWLEN (4 * NGHTTP3_MIN_UNSENT_BYTES)
+
+struct nghttp3_file_reader {
+  const nghttp3_mem *mem;
+  int fd;
+  /* offset is the file offset where the next window starts. */
+  uint64_t offset;
+  /* end is the file offset where the range ends. */
+  uint64_t end;
+  /* pagesize is the page size of the system. */
+  size_t pagesize;
+  /* windowlen is NGHTTP3_FILE_READER_WINDOWLEN rounded up to
+     pagesize. */
+  size_t windowlen;
+  /* nref is the number of references to this object.  The owner and
+     each mapped window hold a reference. */
+  size_t nref;
+};
+
+/*
+ * nghttp3_file_reader_window is a mapped region of a file.
+ */
+typedef struct nghttp3_file_reader_window {
+  nghttp3_file_reader *reader;
+  void *map;
+  size_t maplen;
+} nghttp3_file_reader_window;
+
+#endif /* !defined(NGHTTP3_FILE_READER_H) */
@@ -42,6 +42,49 @@ size_t nghttp3_frame_write_hd_len(uint64_t type, uint64_t payloadlen) {
   return nghttp3_put_uvarintlen(type) + nghttp3_put_uvarintlen(payloadlen);
 }
 
+void nghttp3_frame_settings_local_init(nghttp3_frame_settings *fr,
+                                       nghttp3_settings_entry *ents,
+                                       const nghttp3_settings *local_settings) {
+  *fr = (nghttp3_frame_settings){
+    .type = NGHTTP3_FRAME_SETTINGS,
+    .niv = 3,
+    .iv = ents,
+  };
+
+  ents[0] = (nghttp3_settings_entry){
+    .id = NGHTTP3_SETTINGS_ID_MAX_FIELD_SECTION_SIZE,
+    .value = local_settings->max_field_section_size,
+  };
+  ents[1] = (nghttp3_settings_entry){
+    .id = NGHTTP3_SETTINGS_ID_QPACK_MAX_TABLE_CAPACITY,
+    .value = local_settings->qpack_max_dtable_capacity,
+  };
+  ents[2] = (nghttp3_settings_entry){
+    .id = NGHTTP3_SETTINGS_ID_QPACK_BLOCKED_STREAMS,
+    .value = local_settings->qpack_blocked_streams,
+  };
+
+  if (local_settings->h3_datagram) {
+    ents[fr->niv] = (nghttp3_settings_entry){
+      .id = NGHTTP3_SETTINGS_ID_H3_DATAGRAM,
+      .value = 1,
+    };
+
+    ++fr->niv;
+  }
+
+  if (local_settings->enable_connect_protocol) {
+    ents[fr->niv] = (nghttp3_settings_entry){
+      .id = NGHTTP3_SETTINGS_ID_ENABLE_CONNECT_PROTOCOL,
+      .value = 1,
+    };
+
+    ++fr->niv;
+  }
+
+  assert(fr->niv <= NGHTTP3_FRAME_SETTINGS_MAX_LOCAL_NIV);
+}
+
 uint8_t *nghttp3_frame_write_settings(uint8_t *p,
                                       const nghttp3_frame_settings *fr,
                                       uint64_t payloadlen) {
@@ -63,6 +63,9 @@ typedef struct nghttp3_frame_data {
   /* dr is set when sending DATA frame.  It is not used on
      reception. */
   nghttp3_data_reader dr;
+  /* bdr is set instead of dr if the body is provided by
+     nghttp3_data_buf_reader. */
+  nghttp3_data_buf_reader bdr;
 } nghttp3_frame_data;
 
 typedef struct nghttp3_frame_headers {
@@ -158,6 +161,20 @@ uint8_t *nghttp3_frame_write_hd(uint8_t *dest, uint64_t type,
  */
 size_t nghttp3_frame_write_hd_len(uint64_t type, uint64_t payloadlen);
 
+/* NGHTTP3_FRAME_SETTINGS_MAX_LOCAL_NIV is the maximum number of
+   settings entries that nghttp3_frame_settings_local_init produces. */
+#define NGHTTP3_FRAME_SETTINGS_MAX_LOCAL_NIV 16
+
+/*
+ * nghttp3_frame_settings_local_init initializes SETTINGS frame |fr|
+ * to advertise |local_settings|.  The entries are stored in |ents|
+ * which must have room for at least
+ * NGHTTP3_FRAME_SETTINGS_MAX_LOCAL_NIV entries.
+ */
+void nghttp3_frame_settings_local_init(nghttp3_frame_settings *fr,
+                                       nghttp3_settings_entry *ents,
+                                       const nghttp3_settings *local_settings);
+
 /*
  * nghttp3_frame_write_settings writes SETTINGS frame |fr| to |dest|.
  * This function assumes that |dest| has enough space to write |fr|.
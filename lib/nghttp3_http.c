@@ -37,6 +37,7 @@
 #include "nghttp3_conv.h"
 #include "nghttp3_unreachable.h"
 #include "nghttp3_str.h"
+#include "nghttp3_rcbuf.h"
 #include "sfparse/sfparse.h"
 
 /*
@@ -316,6 +317,16 @@ static int check_path(const uint8_t *value, size_t len) {
   return 1;
 }
 
+/*
+ * http_check_header_value returns nonzero if |value| is a valid HTTP
+ * field value.  If QPACK decoder has already validated |value| while
+ * decoding it, this function does not scan it again.
+ */
+static int http_check_header_value(const nghttp3_rcbuf *value) {
+  return (value->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE) ||
+         nghttp3_check_header_value(value->base, value->len);
+}
+
 static int http_request_on_header(nghttp3_http_state *http,
                                   const nghttp3_qpack_nv *nv, int trailers,
                                   int connect_protocol) {
@@ -380,7 +391,7 @@ static int http_request_on_header(nghttp3_http_state *http,
     break;
   case NGHTTP3_QPACK_TOKEN__PROTOCOL:
     if (!connect_protocol ||
-        !nghttp3_check_header_value(nv->value->base, nv->value->len) ||
+        !http_check_header_value(nv->value) ||
         !check_pseudo_header(http, nv, NGHTTP3_HTTP_FLAG__PROTOCOL)) {
       return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
     }
@@ -423,7 +434,7 @@ static int http_request_on_header(nghttp3_http_state *http,
     }
     break;
   case NGHTTP3_QPACK_TOKEN_PRIORITY:
-    if (!nghttp3_check_header_value(nv->value->base, nv->value->len)) {
+    if (!http_check_header_value(nv->value)) {
       http->flags &= ~NGHTTP3_HTTP_FLAG_PRIORITY;
       http->flags |= NGHTTP3_HTTP_FLAG_BAD_PRIORITY;
 
@@ -452,7 +463,7 @@ static int http_request_on_header(nghttp3_http_state *http,
       return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
     }
 
-    if (!nghttp3_check_header_value(nv->value->base, nv->value->len)) {
+    if (!http_check_header_value(nv->value)) {
       return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
     }
   }
@@ -525,7 +536,7 @@ static int http_response_on_header(nghttp3_http_state *http,
       return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
     }
 
-    if (!nghttp3_check_header_value(nv->value->base, nv->value->len)) {
+    if (!http_check_header_value(nv->value)) {
       return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
     }
   }
@@ -552,12 +563,14 @@ int nghttp3_http_on_header(nghttp3_http_state *http, const nghttp3_qpack_nv *nv,
   } else {
     http->flags |= NGHTTP3_HTTP_FLAG_PSEUDO_HEADER_DISALLOWED;
 
-    switch (http_check_nonempty_header_name(nv->name->base, nv->name->len)) {
-    case 0:
-      return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
-    case -1:
-      /* header field name must be lower-cased without exception */
-      return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
+    if (!(nv->name->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_NAME)) {
+      switch (http_check_nonempty_header_name(nv->name->base, nv->name->len)) {
+      case 0:
+        return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
+      case -1:
+        /* header field name must be lower-cased without exception */
+        return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
+      }
     }
   }
 
@@ -570,6 +583,34 @@ int nghttp3_http_on_header(nghttp3_http_state *http, const nghttp3_qpack_nv *nv,
   return http_response_on_header(http, nv, trailers);
 }
 
+int nghttp3_http_on_header_fragment(nghttp3_http_state *http,
+                                    const nghttp3_qpack_nv *nv, int last) {
+  http->flags |= NGHTTP3_HTTP_FLAG_PSEUDO_HEADER_DISALLOWED;
+
+  if (nv->name->len == 0) {
+    return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
+  }
+
+  assert(nv->name->base[0] != ':');
+
+  if (!(nv->name->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_NAME)) {
+    switch (http_check_nonempty_header_name(nv->name->base, nv->name->len)) {
+    case 0:
+      return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
+    case -1:
+      return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
+    }
+  }
+
+  /* The preceding fragments have already been delivered, and the
+     field cannot be removed any longer. */
+  if (last && !(nv->value->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE)) {
+    return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
+  }
+
+  return 0;
+}
+
 int nghttp3_http_on_request_headers(nghttp3_http_state *http) {
   if (!(http->flags & NGHTTP3_HTTP_FLAG__PROTOCOL) &&
       (http->flags & NGHTTP3_HTTP_FLAG_METH_CONNECT)) {
@@ -101,6 +101,25 @@ typedef struct nghttp3_http_state nghttp3_http_state;
 int nghttp3_http_on_header(nghttp3_http_state *http, const nghttp3_qpack_nv *nv,
                            int request, int trailers, int connect_protocol);
 
+/*
+ * nghttp3_http_on_header_fragment is called when a fragment of a
+ * large HTTP header field value |nv| is received for |http|.  The
+ * name of |nv| is neither a pseudo header field nor a header field
+ * that HTTP messaging interprets.  |last| is nonzero if |nv| contains
+ * the last fragment of the value.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_MALFORMED_HTTP_HEADER
+ *     Invalid HTTP header field was received.
+ * NGHTTP3_ERR_REMOVE_HTTP_HEADER
+ *     Invalid HTTP header field was received but it can be treated as
+ *     if it was not received because of compatibility reasons.
+ */
+int nghttp3_http_on_header_fragment(nghttp3_http_state *http,
+                                    const nghttp3_qpack_nv *nv, int last);
+
 /*
  * This function is called when request header is received.  This
  * function performs validation and returns 0 if it succeeds, or one
@@ -0,0 +1,136 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp3_preamble.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "nghttp3_settings.h"
+#include "nghttp3_frame.h"
+#include "nghttp3_stream.h"
+#include "nghttp3_mem.h"
+
+int nghttp3_preamble_new_versioned(nghttp3_preamble **ppreamble,
+                                   int settings_version,
+                                   const nghttp3_settings *settings,
+                                   const nghttp3_mem *mem) {
+  nghttp3_settings settings_latest;
+  nghttp3_settings_entry ents[NGHTTP3_FRAME_SETTINGS_MAX_LOCAL_NIV];
+  nghttp3_frame_settings fr;
+  nghttp3_frame_origin ofr;
+  nghttp3_preamble *preamble;
+  uint64_t payloadlen, opayloadlen = 0;
+  size_t len, olen = 0;
+  uint8_t *p;
+
+  settings = nghttp3_settings_convert_to_latest(&settings_latest,
+                                                settings_version, settings);
+
+  if (mem == NULL) {
+    mem = nghttp3_mem_default();
+  }
+
+  nghttp3_frame_settings_local_init(&fr, ents, settings);
+
+  len = nghttp3_put_uvarintlen(NGHTTP3_STREAM_TYPE_CONTROL) +
+        nghttp3_frame_write_settings_len(&payloadlen, &fr);
+
+  if (settings->origin_list) {
+    ofr = (nghttp3_frame_origin){
+      .type = NGHTTP3_FRAME_ORIGIN,
+      .origin_list = *settings->origin_list,
+    };
+
+    olen = nghttp3_frame_write_origin_len(&opayloadlen, &ofr);
+  }
+
+  preamble = nghttp3_mem_malloc(mem, sizeof(*preamble) + len + olen);
+  if (preamble == NULL) {
+    return NGHTTP3_ERR_NOMEM;
+  }
+
+  *preamble = (nghttp3_preamble){
+    .mem = mem,
+    .max_field_section_size = settings->max_field_section_size,
+    .qpack_max_dtable_capacity = settings->qpack_max_dtable_capacity,
+    .qpack_blocked_streams = settings->qpack_blocked_streams,
+    .enable_connect_protocol = settings->enable_connect_protocol,
+    .h3_datagram = settings->h3_datagram,
+    .origin = settings->origin_list != NULL,
+  };
+
+  p = (uint8_t *)(preamble + 1);
+
+  preamble->data.base = p;
+
+  p = nghttp3_put_uvarint(p, NGHTTP3_STREAM_TYPE_CONTROL);
+  p = nghttp3_frame_write_settings(p, &fr, payloadlen);
+
+  if (preamble->origin) {
+    p = nghttp3_frame_write_origin(p, &ofr, opayloadlen);
+
+    preamble->origin_list.base = p - ofr.origin_list.len;
+    preamble->origin_list.len = ofr.origin_list.len;
+  }
+
+  preamble->data.len = (size_t)(p - preamble->data.base);
+
+  assert(preamble->data.len == len + olen);
+
+  *ppreamble = preamble;
+
+  return 0;
+}
+
+void nghttp3_preamble_del(nghttp3_preamble *preamble) {
+  if (preamble == NULL) {
+    return;
+  }
+
+  nghttp3_mem_free(preamble->mem, preamble);
+}
+
+int nghttp3_preamble_match(const nghttp3_preamble *preamble,
+                           const nghttp3_settings *settings) {
+  if (preamble->max_field_section_size != settings->max_field_section_size ||
+      preamble->qpack_max_dtable_capacity !=
+        settings->qpack_max_dtable_capacity ||
+      preamble->qpack_blocked_streams != settings->qpack_blocked_streams ||
+      !preamble->enable_connect_protocol !=
+        !settings->enable_connect_protocol ||
+      !preamble->h3_datagram != !settings->h3_datagram ||
+      preamble->origin != (settings->origin_list != NULL)) {
+    return 0;
+  }
+
+  if (!preamble->origin) {
+    return 1;
+  }
+
+  return preamble->origin_list.len == settings->origin_list->len &&
+         (preamble->origin_list.len == 0 ||
+          memcmp(preamble->origin_list.base, settings->origin_list->base,
+                 preamble->origin_list.len) == 0);
+}
@@ -0,0 +1,59 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP3_PREAMBLE_H
+#define NGHTTP3_PREAMBLE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* defined(HAVE_CONFIG_H) */
+
+#include <nghttp3/nghttp3.h>
+
+struct nghttp3_preamble {
+  const nghttp3_mem *mem;
+  /* The following fields are the values of nghttp3_settings that
+     are advertised in data. */
+  uint64_t max_field_section_size;
+  size_t qpack_max_dtable_capacity;
+  size_t qpack_blocked_streams;
+  uint8_t enable_connect_protocol;
+  uint8_t h3_datagram;
+  /* origin is nonzero if data includes ORIGIN frame. */
+  uint8_t origin;
+  /* origin_list is the payload of ORIGIN frame in data. */
+  nghttp3_vec origin_list;
+  /* data is the serialized preamble.  It is allocated together with
+     this object. */
+  nghttp3_vec data;
+};
+
+/*
+ * nghttp3_preamble_match returns nonzero if |preamble| advertises the
+ * same values as |settings|.
+ */
+int nghttp3_preamble_match(const nghttp3_preamble *preamble,
+                           const nghttp3_settings *settings);
+
+#endif /* !defined(NGHTTP3_PREAMBLE_H) */
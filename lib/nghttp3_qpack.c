@@ -34,12 +34,23 @@
 #include "nghttp3_debug.h"
 #include "nghttp3_unreachable.h"
 
+/* NGHTTP3_QPACK_ENCODER_MAX_BLOCKING_COST is the expected delay per
+   field section that encoder tolerates when it references dynamic
+   table entries which are not acknowledged yet. */
+#define NGHTTP3_QPACK_ENCODER_MAX_BLOCKING_COST NGHTTP3_MILLISECONDS
+
 /* NGHTTP3_QPACK_MAX_QPACK_STREAMS is the maximum number of concurrent
    nghttp3_qpack_stream object to handle a client which never cancel
    or acknowledge header block.  After this limit, encoder stops using
    dynamic table. */
 #define NGHTTP3_QPACK_MAX_QPACK_STREAMS 2000
 
+/* NGHTTP3_QPACK_ENCODER_EXPECTED_REUSE is the number of times a field
+   is expected to be sent again after it is inserted into dynamic
+   table.  It is used by NGHTTP3_QPACK_ENCODING_STRAT_COMPACT to
+   amortize the cost of insertion. */
+#define NGHTTP3_QPACK_ENCODER_EXPECTED_REUSE 2
+
 /* Make scalar initialization form of nghttp3_qpack_static_entry */
 #define MAKE_STATIC_ENT(I, T, H)                                               \
   {                                                                            \
@@ -176,12 +187,14 @@ static nghttp3_qpack_static_entry token_stable[] = {
         .base = (uint8_t *)(N),                                                \
         .len = nghttp3_strlen_lit((N)),                                        \
         .ref = -1,                                                             \
+        .flags = NGHTTP3_RCBUF_FLAG_VALID_FIELD_NAME,                          \
       },                                                                       \
     .value =                                                                   \
       {                                                                        \
         .base = (uint8_t *)(V),                                                \
         .len = nghttp3_strlen_lit((V)),                                        \
         .ref = -1,                                                             \
+        .flags = NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE,                         \
       },                                                                       \
     .token = T,                                                                \
   }
@@ -917,6 +930,10 @@ void nghttp3_qpack_encoder_init(nghttp3_qpack_encoder *encoder,
   encoder->last_max_dtable_update = 0;
   encoder->uninterrupted_decoderlen = 0;
   encoder->indexing_strat = NGHTTP3_QPACK_INDEXING_STRAT_NONE;
+  encoder->encoding_strat = NGHTTP3_QPACK_ENCODING_STRAT_FAST;
+  encoder->crumble_cookie = 0;
+  encoder->rtt = 0;
+  encoder->loss_ppm = 0;
   encoder->flags = NGHTTP3_QPACK_ENCODER_FLAG_NONE;
 
   nghttp3_qpack_read_state_reset(&encoder->rstate);
@@ -966,6 +983,45 @@ void nghttp3_qpack_encoder_set_indexing_strat(
   encoder->indexing_strat = strat;
 }
 
+void nghttp3_qpack_encoder_set_encoding_strat(
+  nghttp3_qpack_encoder *encoder, nghttp3_qpack_encoding_strat strat) {
+  encoder->encoding_strat = strat;
+}
+
+void nghttp3_qpack_encoder_set_crumble_cookie(nghttp3_qpack_encoder *encoder,
+                                              int enable) {
+  encoder->crumble_cookie = enable != 0;
+}
+
+void nghttp3_qpack_encoder_set_path_estimate(nghttp3_qpack_encoder *encoder,
+                                             nghttp3_duration rtt,
+                                             uint32_t loss_ppm) {
+  encoder->rtt = rtt;
+  encoder->loss_ppm = nghttp3_min(loss_ppm, (uint32_t)1000000);
+}
+
+/*
+ * qpack_encoder_blocking_risky returns nonzero if referencing
+ * unacknowledged dynamic table entries is expected to delay a field
+ * section more than NGHTTP3_QPACK_ENCODER_MAX_BLOCKING_COST.  If the
+ * encoder stream data carrying the entries is lost, the decoder
+ * cannot decode the field section until it is retransmitted, which
+ * takes roughly 1.5 round-trip time.
+ */
+static int qpack_encoder_blocking_risky(const nghttp3_qpack_encoder *encoder) {
+  uint64_t cost;
+
+  if (encoder->loss_ppm == 0) {
+    return 0;
+  }
+
+  /* Scale rtt to microseconds first to avoid overflow. */
+  cost = (encoder->rtt + encoder->rtt / 2) / NGHTTP3_MICROSECONDS *
+         encoder->loss_ppm / 1000;
+
+  return cost > NGHTTP3_QPACK_ENCODER_MAX_BLOCKING_COST;
+}
+
 uint64_t
 nghttp3_qpack_encoder_get_min_cnt(const nghttp3_qpack_encoder *encoder) {
   assert(!nghttp3_pq_empty(&encoder->min_cnts));
@@ -1136,6 +1192,71 @@ static int reserve_buf(nghttp3_buf *buf, size_t extra_size,
   return nghttp3_buf_reserve(buf, n, mem);
 }
 
+/*
+ * qpack_encoder_encode_cookie encodes cookie header field |nv|.  The
+ * value of |nv| is split into crumbs delimited by ";" and optional
+ * following white spaces, and each non-empty crumb is encoded as a
+ * separate field line.  If the value contains no ";" or no non-empty
+ * crumb, |nv| is encoded as is.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int qpack_encoder_encode_cookie(nghttp3_qpack_encoder *encoder,
+                                       uint64_t *pmax_cnt, uint64_t *pmin_cnt,
+                                       nghttp3_buf *rbuf, nghttp3_buf *ebuf,
+                                       const nghttp3_nv *nv, uint64_t base,
+                                       int allow_blocking) {
+  nghttp3_nv crumb = *nv;
+  const uint8_t *p = nv->value, *end = nv->value + nv->valuelen, *q;
+  size_t ncrumbs = 0;
+  int rv;
+
+  if (nv->valuelen == 0 || memchr(p, ';', nv->valuelen) == NULL) {
+    return nghttp3_qpack_encoder_encode_nv(encoder, pmax_cnt, pmin_cnt, rbuf,
+                                           ebuf, nv, base, allow_blocking);
+  }
+
+  for (;;) {
+    for (; p != end && (*p == ' ' || *p == '\t'); ++p)
+      ;
+
+    q = memchr(p, ';', (size_t)(end - p));
+    if (q == NULL) {
+      q = end;
+    }
+
+    if (q != p) {
+      crumb.value = p;
+      crumb.valuelen = (size_t)(q - p);
+
+      rv = nghttp3_qpack_encoder_encode_nv(encoder, pmax_cnt, pmin_cnt, rbuf,
+                                           ebuf, &crumb, base, allow_blocking);
+      if (rv != 0) {
+        return rv;
+      }
+
+      ++ncrumbs;
+    }
+
+    if (q == end) {
+      break;
+    }
+
+    p = q + 1;
+  }
+
+  if (ncrumbs == 0) {
+    return nghttp3_qpack_encoder_encode_nv(encoder, pmax_cnt, pmin_cnt, rbuf,
+                                           ebuf, nv, base, allow_blocking);
+  }
+
+  return 0;
+}
+
 int nghttp3_qpack_encoder_encode(nghttp3_qpack_encoder *encoder,
                                  nghttp3_buf *pbuf, nghttp3_buf *rbuf,
                                  nghttp3_buf *ebuf, int64_t stream_id,
@@ -1166,15 +1287,23 @@ int nghttp3_qpack_encoder_encode(nghttp3_qpack_encoder *encoder,
   blocked_stream =
     stream && nghttp3_qpack_encoder_stream_is_blocked(encoder, stream);
   allow_blocking =
-    blocked_stream || encoder->ctx.max_blocked_streams >
-                        nghttp3_ksl_len(&encoder->blocked_streams);
+    blocked_stream || (encoder->ctx.max_blocked_streams >
+                         nghttp3_ksl_len(&encoder->blocked_streams) &&
+                       !qpack_encoder_blocking_risky(encoder));
 
   DEBUGF("qpack::encode: stream %ld blocked=%d allow_blocking=%d\n", stream_id,
          blocked_stream, allow_blocking);
 
   for (i = 0; i < nvlen; ++i) {
-    rv = nghttp3_qpack_encoder_encode_nv(encoder, &max_cnt, &min_cnt, rbuf,
-                                         ebuf, &nva[i], base, allow_blocking);
+    if (encoder->crumble_cookie &&
+        qpack_lookup_token(nva[i].name, nva[i].namelen) ==
+          NGHTTP3_QPACK_TOKEN_COOKIE) {
+      rv = qpack_encoder_encode_cookie(encoder, &max_cnt, &min_cnt, rbuf, ebuf,
+                                       &nva[i], base, allow_blocking);
+    } else {
+      rv = nghttp3_qpack_encoder_encode_nv(encoder, &max_cnt, &min_cnt, rbuf,
+                                           ebuf, &nva[i], base, allow_blocking);
+    }
     if (rv != 0) {
       goto fail;
     }
@@ -1452,6 +1581,234 @@ static int qpack_context_check_draining(nghttp3_qpack_context *ctx,
   return ctx->dtable_sum - ent->sum > safe;
 }
 
+/*
+ * qpack_encoder_hash_name returns the hash of nv->name.  |token| is a
+ * token of nv->name.  |static_entry| is nonzero if |token| has an
+ * entry in static table.
+ */
+static uint32_t qpack_encoder_hash_name(const nghttp3_nv *nv, int32_t token,
+                                        int static_entry) {
+  if (static_entry) {
+    return token_stable[token].hash;
+  }
+
+  switch (token) {
+  case NGHTTP3_QPACK_TOKEN_HOST:
+    return 2952701295U;
+  case NGHTTP3_QPACK_TOKEN_TE:
+    return 1011170994U;
+  case NGHTTP3_QPACK_TOKEN__PROTOCOL:
+    return 1128642621U;
+  case NGHTTP3_QPACK_TOKEN_PRIORITY:
+    return 2498028297U;
+  default:
+    return qpack_hash_name(nv);
+  }
+}
+
+/*
+ * qpack_str_encoded_len returns the number of bytes required to
+ * encode a string |s| of length |n| as a string literal.  |prefix| is
+ * a prefix of variable integer encoding for its length.  Huffman
+ * encoding is used if it makes the string shorter.
+ */
+static size_t qpack_str_encoded_len(const uint8_t *s, size_t n,
+                                    size_t prefix) {
+  size_t hlen = nghttp3_qpack_huffman_encode_count(s, n);
+
+  if (hlen < n) {
+    n = hlen;
+  }
+
+  return nghttp3_qpack_put_varint_len(n, prefix) + n;
+}
+
+/*
+ * qpack_dynamic_name_ref_len returns the number of bytes required to
+ * encode the index of Literal Field Line With Name Reference which
+ * refers to the dynamic table entry at |absidx|.  |base| is Base.
+ */
+static size_t qpack_dynamic_name_ref_len(uint64_t absidx, uint64_t base) {
+  if (absidx < base) {
+    return nghttp3_qpack_put_varint_len(base - absidx - 1, 4);
+  }
+
+  return nghttp3_qpack_put_varint_len(absidx - base, 3);
+}
+
+/*
+ * qpack_encoder_encode_nv_compact is a part of
+ * nghttp3_qpack_encoder_encode_nv for
+ * NGHTTP3_QPACK_ENCODING_STRAT_COMPACT.  It is called when |nv| has
+ * no exact match in static or dynamic table.  |token| is a token of
+ * nv->name, and |hash| is its hash.  |sres| and |dres| are the
+ * results of static and dynamic table lookup respectively.
+ * |just_index| is nonzero if |nv| can be inserted into dynamic
+ * table.
+ *
+ * It estimates the encoded size of each representation and chooses
+ * the smallest one.  Inserting |nv| into dynamic table costs the
+ * insert instruction on encoder stream, but each reuse costs just an
+ * Indexed Field Line, which is assumed to be 1 byte.  |nv| is inserted
+ * if it pays off after NGHTTP3_QPACK_ENCODER_EXPECTED_REUSE reuses.
+ * If dynamic table already has nv->name with a different value, the
+ * values of the field are assumed to vary, and |nv| is not expected
+ * to be reused.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int qpack_encoder_encode_nv_compact(
+  nghttp3_qpack_encoder *encoder, uint64_t *pmax_cnt, uint64_t *pmin_cnt,
+  nghttp3_buf *rbuf, nghttp3_buf *ebuf, const nghttp3_nv *nv, int32_t token,
+  uint32_t hash, const nghttp3_qpack_lookup_result *sres,
+  const nghttp3_qpack_lookup_result *dres, uint64_t base, int just_index,
+  int allow_blocking) {
+  nghttp3_qpack_name_ref line_ref = NGHTTP3_QPACK_NAME_REF_LITERAL;
+  nghttp3_qpack_name_ref ins_ref = NGHTTP3_QPACK_NAME_REF_LITERAL;
+  size_t vlen = qpack_str_encoded_len(nv->value, nv->valuelen, 7);
+  size_t line_len = SIZE_MAX, ins_len = SIZE_MAX, ref_len, len;
+  size_t reuse;
+  uint64_t min_cnt = *pmin_cnt;
+  nghttp3_qpack_entry *new_ent;
+  int rv;
+
+  /* Choose the smallest representation which does not insert |nv|.
+     Value is encoded in the same way in all of them. */
+  if (sres->index != -1) {
+    line_ref = NGHTTP3_QPACK_NAME_REF_STATIC;
+    line_len = nghttp3_qpack_put_varint_len((uint64_t)sres->index, 4);
+  }
+
+  if (dres->index != -1) {
+    len = qpack_dynamic_name_ref_len((uint64_t)dres->index, base);
+    if (len < line_len) {
+      line_ref = NGHTTP3_QPACK_NAME_REF_DYNAMIC;
+      line_len = len;
+    }
+  }
+
+  /* A literal name takes at least 2 bytes. */
+  if (line_len > 2) {
+    len = qpack_str_encoded_len(nv->name, nv->namelen, 3);
+    if (len < line_len) {
+      line_ref = NGHTTP3_QPACK_NAME_REF_LITERAL;
+      line_len = len;
+    }
+  }
+
+  line_len += vlen;
+
+  if (just_index) {
+    if (sres->index != -1) {
+      ins_ref = NGHTTP3_QPACK_NAME_REF_STATIC;
+      ins_len = nghttp3_qpack_put_varint_len((uint64_t)sres->index, 6);
+    }
+
+    if (dres->index != -1) {
+      len = nghttp3_qpack_put_varint_len(
+        encoder->ctx.next_absidx - (uint64_t)dres->index - 1, 6);
+      if (len < ins_len) {
+        ins_ref = NGHTTP3_QPACK_NAME_REF_DYNAMIC;
+        ins_len = len;
+      }
+    }
+
+    if (ins_len > 2) {
+      len = qpack_str_encoded_len(nv->name, nv->namelen, 5);
+      if (len < ins_len) {
+        ins_ref = NGHTTP3_QPACK_NAME_REF_LITERAL;
+        ins_len = len;
+      }
+    }
+
+    ins_len += vlen;
+
+    /* The field line refers to the new entry with post-base index if
+       blocking is allowed.  Otherwise, it cannot refer to the entry
+       until it is acknowledged. */
+    ref_len = allow_blocking ? nghttp3_qpack_put_varint_len(
+                                 encoder->ctx.next_absidx - base, 4)
+                             : line_len;
+    reuse = dres->index == -1 ? NGHTTP3_QPACK_ENCODER_EXPECTED_REUSE : 0;
+
+    if (ins_len + ref_len + reuse > line_len * (reuse + 1)) {
+      just_index = 0;
+    }
+  }
+
+  if (just_index) {
+    /* Do not evict the entry which is referred to by the insert
+       instruction or the field line. */
+    if (!allow_blocking && (ins_ref == NGHTTP3_QPACK_NAME_REF_DYNAMIC ||
+                            line_ref == NGHTTP3_QPACK_NAME_REF_DYNAMIC)) {
+      min_cnt = nghttp3_min((uint64_t)dres->index + 1, min_cnt);
+    }
+
+    if (!qpack_encoder_can_index_nv(encoder, nv, min_cnt)) {
+      just_index = 0;
+    }
+  }
+
+  if (just_index) {
+    switch (ins_ref) {
+    case NGHTTP3_QPACK_NAME_REF_STATIC:
+      rv = nghttp3_qpack_encoder_write_static_insert(encoder, ebuf,
+                                                     (size_t)sres->index, nv);
+      if (rv != 0) {
+        return rv;
+      }
+      rv = nghttp3_qpack_encoder_dtable_static_add(encoder, (size_t)sres->index,
+                                                   nv, hash);
+      break;
+    case NGHTTP3_QPACK_NAME_REF_DYNAMIC:
+      rv = nghttp3_qpack_encoder_write_dynamic_insert(encoder, ebuf,
+                                                      (size_t)dres->index, nv);
+      if (rv != 0) {
+        return rv;
+      }
+      rv = nghttp3_qpack_encoder_dtable_dynamic_add(
+        encoder, (size_t)dres->index, nv, hash);
+      break;
+    default:
+      rv = nghttp3_qpack_encoder_dtable_literal_add(encoder, nv, token, hash);
+      if (rv != 0) {
+        return rv;
+      }
+      rv = nghttp3_qpack_encoder_write_literal_insert(encoder, ebuf, nv);
+    }
+    if (rv != 0) {
+      return rv;
+    }
+
+    if (allow_blocking) {
+      new_ent = nghttp3_qpack_context_dtable_top(&encoder->ctx);
+      *pmax_cnt = nghttp3_max(*pmax_cnt, new_ent->absidx + 1);
+      *pmin_cnt = nghttp3_min(*pmin_cnt, new_ent->absidx + 1);
+
+      return nghttp3_qpack_encoder_write_dynamic_indexed(encoder, rbuf,
+                                                         new_ent->absidx, base);
+    }
+  }
+
+  switch (line_ref) {
+  case NGHTTP3_QPACK_NAME_REF_STATIC:
+    return nghttp3_qpack_encoder_write_static_indexed_name(
+      encoder, rbuf, (size_t)sres->index, nv);
+  case NGHTTP3_QPACK_NAME_REF_DYNAMIC:
+    *pmax_cnt = nghttp3_max(*pmax_cnt, (uint64_t)(dres->index + 1));
+    *pmin_cnt = nghttp3_min(*pmin_cnt, (uint64_t)(dres->index + 1));
+
+    return nghttp3_qpack_encoder_write_dynamic_indexed_name(
+      encoder, rbuf, (size_t)dres->index, base, nv);
+  default:
+    return nghttp3_qpack_encoder_write_literal(encoder, rbuf, nv);
+  }
+}
+
 int nghttp3_qpack_encoder_encode_nv(nghttp3_qpack_encoder *encoder,
                                     uint64_t *pmax_cnt, uint64_t *pmin_cnt,
                                     nghttp3_buf *rbuf, nghttp3_buf *ebuf,
@@ -1486,26 +1843,7 @@ int nghttp3_qpack_encoder_encode_nv(nghttp3_qpack_encoder *encoder,
     }
   }
 
-  if (static_entry) {
-    hash = token_stable[token].hash;
-  } else {
-    switch (token) {
-    case NGHTTP3_QPACK_TOKEN_HOST:
-      hash = 2952701295U;
-      break;
-    case NGHTTP3_QPACK_TOKEN_TE:
-      hash = 1011170994U;
-      break;
-    case NGHTTP3_QPACK_TOKEN__PROTOCOL:
-      hash = 1128642621U;
-      break;
-    case NGHTTP3_QPACK_TOKEN_PRIORITY:
-      hash = 2498028297U;
-      break;
-    default:
-      hash = qpack_hash_name(nv);
-    }
-  }
+  hash = qpack_encoder_hash_name(nv, token, static_entry);
 
   if (nghttp3_map_size(&encoder->streams) < NGHTTP3_QPACK_MAX_QPACK_STREAMS) {
     dres = nghttp3_qpack_encoder_lookup_dtable(
@@ -1540,6 +1878,12 @@ int nghttp3_qpack_encoder_encode_nv(nghttp3_qpack_encoder *encoder,
       encoder, rbuf, (size_t)dres.index, base);
   }
 
+  if (encoder->encoding_strat == NGHTTP3_QPACK_ENCODING_STRAT_COMPACT) {
+    return qpack_encoder_encode_nv_compact(encoder, pmax_cnt, pmin_cnt, rbuf,
+                                           ebuf, nv, token, hash, &sres, &dres,
+                                           base, just_index, allow_blocking);
+  }
+
   if (sres.index != -1) {
     if (just_index && qpack_encoder_can_index_nv(encoder, nv, *pmin_cnt)) {
       rv = nghttp3_qpack_encoder_write_static_insert(encoder, ebuf,
@@ -1627,6 +1971,131 @@ int nghttp3_qpack_encoder_encode_nv(nghttp3_qpack_encoder *encoder,
   return nghttp3_qpack_encoder_write_literal(encoder, rbuf, nv);
 }
 
+/*
+ * qpack_encoder_prime_nv inserts |nv| into dynamic table and writes
+ * the insert instruction to |ebuf| unless it is already in static or
+ * dynamic table, or it must not be indexed.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int qpack_encoder_prime_nv(nghttp3_qpack_encoder *encoder,
+                                  nghttp3_buf *ebuf, const nghttp3_nv *nv) {
+  nghttp3_nv tnv = *nv;
+  uint32_t hash;
+  int32_t token;
+  nghttp3_qpack_lookup_result sres = {
+    .index = -1,
+    .pb_index = -1,
+  };
+  nghttp3_qpack_lookup_result dres;
+  int static_entry;
+  int rv;
+
+  /* An application explicitly asks to index |nv|, but never index
+     the sensitive fields. */
+  tnv.flags |= NGHTTP3_NV_FLAG_TRY_INDEX;
+
+  token = qpack_lookup_token(nv->name, nv->namelen);
+  static_entry = token != -1 && (size_t)token < nghttp3_arraylen(token_stable);
+
+  if (qpack_encoder_decide_indexing_mode(encoder, &tnv, token) !=
+      NGHTTP3_QPACK_INDEXING_MODE_STORE) {
+    return 0;
+  }
+
+  if (static_entry) {
+    sres = nghttp3_qpack_lookup_stable(nv, token,
+                                       NGHTTP3_QPACK_INDEXING_MODE_STORE);
+    if (sres.name_value_match) {
+      return 0;
+    }
+  }
+
+  hash = qpack_encoder_hash_name(nv, token, static_entry);
+
+  dres = nghttp3_qpack_encoder_lookup_dtable(
+    encoder, nv, token, hash, NGHTTP3_QPACK_INDEXING_MODE_STORE,
+    encoder->krcnt, /* allow_blocking = */ 1);
+  if (dres.index != -1 && dres.name_value_match) {
+    return 0;
+  }
+
+  if (sres.index != -1) {
+    if (!qpack_encoder_can_index_nv(encoder, nv, UINT64_MAX)) {
+      return 0;
+    }
+
+    rv = nghttp3_qpack_encoder_write_static_insert(encoder, ebuf,
+                                                   (size_t)sres.index, nv);
+    if (rv != 0) {
+      return rv;
+    }
+
+    return nghttp3_qpack_encoder_dtable_static_add(encoder, (size_t)sres.index,
+                                                   nv, hash);
+  }
+
+  if (dres.index != -1) {
+    /* Do not evict the entry which the new entry refers to. */
+    if (!qpack_encoder_can_index_nv(encoder, nv, (uint64_t)dres.index + 1)) {
+      return 0;
+    }
+
+    rv = nghttp3_qpack_encoder_write_dynamic_insert(encoder, ebuf,
+                                                    (size_t)dres.index, nv);
+    if (rv != 0) {
+      return rv;
+    }
+
+    return nghttp3_qpack_encoder_dtable_dynamic_add(encoder, (size_t)dres.index,
+                                                    nv, hash);
+  }
+
+  if (!qpack_encoder_can_index_nv(encoder, nv, UINT64_MAX)) {
+    return 0;
+  }
+
+  rv = nghttp3_qpack_encoder_dtable_literal_add(encoder, nv, token, hash);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return nghttp3_qpack_encoder_write_literal_insert(encoder, ebuf, nv);
+}
+
+int nghttp3_qpack_encoder_prime(nghttp3_qpack_encoder *encoder,
+                                nghttp3_buf *ebuf, const nghttp3_nv *nva,
+                                size_t nvlen) {
+  size_t i;
+  int rv;
+
+  if (encoder->ctx.bad) {
+    return NGHTTP3_ERR_QPACK_FATAL;
+  }
+
+  rv = nghttp3_qpack_encoder_process_dtable_update(encoder, ebuf);
+  if (rv != 0) {
+    goto fail;
+  }
+
+  for (i = 0; i < nvlen; ++i) {
+    rv = qpack_encoder_prime_nv(encoder, ebuf, &nva[i]);
+    if (rv != 0) {
+      goto fail;
+    }
+  }
+
+  return 0;
+
+fail:
+  encoder->ctx.bad = 1;
+  return rv;
+}
+
 nghttp3_qpack_lookup_result
 nghttp3_qpack_lookup_stable(const nghttp3_nv *nv, int32_t token,
                             nghttp3_qpack_indexing_mode indexing_mode) {
@@ -2698,6 +3167,10 @@ void nghttp3_qpack_read_state_reset(nghttp3_qpack_read_state *rstate) {
   rstate->never = 0;
   rstate->dynamic = 0;
   rstate->huffman_encoded = 0;
+  rstate->field_chars = NGHTTP3_FIELD_CHAR_FLAG_ALL;
+  rstate->token = -1;
+  rstate->fragment_offset = 0;
+  rstate->trailing_ws = 0;
 }
 
 void nghttp3_qpack_decoder_init(nghttp3_qpack_decoder *decoder,
@@ -2710,17 +3183,112 @@ void nghttp3_qpack_decoder_init(nghttp3_qpack_decoder *decoder,
   decoder->state = NGHTTP3_QPACK_ES_STATE_OPCODE;
   decoder->opcode = 0;
   decoder->written_icnt = 0;
+  decoder->unblock = 0;
   decoder->max_concurrent_streams = 0;
   decoder->uninterrupted_encoderlen = 0;
+  decoder->value_fragment_size = 0;
 
   nghttp3_qpack_read_state_reset(&decoder->rstate);
   nghttp3_buf_init(&decoder->dbuf);
-}
 
-void nghttp3_qpack_decoder_free(nghttp3_qpack_decoder *decoder) {
-  nghttp3_buf_free(&decoder->dbuf, decoder->ctx.mem);
-  nghttp3_qpack_read_state_free(&decoder->rstate);
-  qpack_context_free(&decoder->ctx);
+  decoder->arena.block = NULL;
+  decoder->arena.buf = NULL;
+  decoder->arena.len = 0;
+  decoder->arena.head = 0;
+  decoder->arena.tail = 0;
+  decoder->arena.free_list = NULL;
+  decoder->arena.enabled = 0;
+}
+
+/*
+ * qpack_arena_block_decref decrements the reference count of |block|,
+ * and frees it if the count drops to 0.
+ */
+static void qpack_arena_block_decref(nghttp3_qpack_arena_block *block) {
+  assert(block->nref);
+
+  if (--block->nref == 0) {
+    nghttp3_mem_free(block->mem, block);
+  }
+}
+
+/*
+ * qpack_decoder_arena_free frees the dynamic table entries and the
+ * circular buffer used by the contiguous dynamic table layout.  An
+ * entry whose name or value is still referenced by the application
+ * is not freed here.  Instead, it takes a reference to the buffer,
+ * and it is freed along with the buffer when the last reference goes
+ * away.
+ */
+static void qpack_decoder_arena_free(nghttp3_qpack_decoder *decoder) {
+  nghttp3_qpack_context *ctx = &decoder->ctx;
+  const nghttp3_mem *mem = ctx->mem;
+  nghttp3_qpack_entry *ent;
+  nghttp3_qpack_arena_entry *aent;
+  size_t len;
+
+  if (decoder->arena.enabled) {
+    while ((len = nghttp3_ringbuf_len(&ctx->dtable))) {
+      ent =
+        *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&ctx->dtable, len - 1);
+      nghttp3_ringbuf_pop_back(&ctx->dtable);
+
+      aent = nghttp3_struct_of(ent, nghttp3_qpack_arena_entry, ent);
+
+      if (aent->name.ref <= 1 && aent->value.ref <= 1) {
+        nghttp3_mem_free(mem, aent);
+        continue;
+      }
+
+      aent->block = decoder->arena.block;
+      ++aent->block->nref;
+
+      /* Do not touch |aent| after the last nghttp3_rcbuf_decref. */
+      if (aent->ent.nv.name == &aent->name) {
+        nghttp3_rcbuf_decref(&aent->name);
+      }
+
+      nghttp3_rcbuf_decref(&aent->value);
+    }
+  }
+
+  for (; decoder->arena.free_list;) {
+    aent = decoder->arena.free_list;
+    decoder->arena.free_list = aent->next;
+
+    nghttp3_mem_free(mem, aent);
+  }
+
+  if (decoder->arena.block) {
+    qpack_arena_block_decref(decoder->arena.block);
+  }
+}
+
+void nghttp3_qpack_decoder_free(nghttp3_qpack_decoder *decoder) {
+  nghttp3_buf_free(&decoder->dbuf, decoder->ctx.mem);
+  nghttp3_qpack_read_state_free(&decoder->rstate);
+  qpack_decoder_arena_free(decoder);
+  qpack_context_free(&decoder->ctx);
+}
+
+void nghttp3_qpack_decoder_set_contiguous_dtable(nghttp3_qpack_decoder *decoder,
+                                                 int enable) {
+  if (nghttp3_ringbuf_len(&decoder->ctx.dtable)) {
+    return;
+  }
+
+  decoder->arena.enabled = enable != 0;
+}
+
+void nghttp3_qpack_decoder_set_value_fragment_size(
+  nghttp3_qpack_decoder *decoder, size_t size) {
+  if (size == 0) {
+    decoder->value_fragment_size = 0;
+    return;
+  }
+
+  decoder->value_fragment_size =
+    nghttp3_max(size, (size_t)NGHTTP3_QPACK_MIN_VALUE_FRAGMENT_SIZE);
 }
 
 /*
@@ -2757,6 +3325,10 @@ static nghttp3_ssize qpack_read_huffman_string(nghttp3_qpack_read_state *rstate,
     return NGHTTP3_ERR_QPACK_FATAL;
   }
 
+  if (fin) {
+    rstate->field_chars &= rstate->huffman_ctx.field_chars;
+  }
+
   dest->last += nwrite;
   rstate->left -= len;
   return (nghttp3_ssize)len;
@@ -2768,7 +3340,8 @@ static nghttp3_ssize qpack_read_string(nghttp3_qpack_read_state *rstate,
   size_t len = (size_t)(end - begin);
   size_t n = (size_t)nghttp3_min((uint64_t)len, rstate->left);
 
-  dest->last = nghttp3_cpymem(dest->last, begin, n);
+  dest->last =
+    nghttp3_cpymem_field_chars(dest->last, begin, n, &rstate->field_chars);
 
   rstate->left -= n;
   return (nghttp3_ssize)n;
@@ -2802,14 +3375,45 @@ static void qpack_read_state_check_huffman(nghttp3_qpack_read_state *rstate,
   rstate->huffman_encoded = (b & (1 << rstate->prefix)) != 0;
 }
 
+static int qpack_is_ws(uint8_t c) { return c == ' ' || c == '\t'; }
+
+/*
+ * qpack_read_state_terminate_name finishes rstate->name.  It marks
+ * the name as valid if rstate->field_chars, which has been
+ * accumulated while the name is decoded, says so.  This saves HTTP
+ * layer from scanning the name again.
+ */
 static void qpack_read_state_terminate_name(nghttp3_qpack_read_state *rstate) {
+  nghttp3_rcbuf *name = rstate->name;
+
   *rstate->namebuf.last = '\0';
-  rstate->name->len = nghttp3_buf_len(&rstate->namebuf);
+  name->len = nghttp3_buf_len(&rstate->namebuf);
+
+  if (name->len && (rstate->field_chars & NGHTTP3_FIELD_CHAR_FLAG_NAME)) {
+    name->flags |= NGHTTP3_RCBUF_FLAG_VALID_FIELD_NAME;
+  }
+
+  rstate->field_chars = NGHTTP3_FIELD_CHAR_FLAG_ALL;
 }
 
+/*
+ * qpack_read_state_terminate_value finishes rstate->value.  Like
+ * qpack_read_state_terminate_name, it marks the value as valid if it
+ * passes nghttp3_check_header_value.
+ */
 static void qpack_read_state_terminate_value(nghttp3_qpack_read_state *rstate) {
+  nghttp3_rcbuf *value = rstate->value;
+
   *rstate->valuebuf.last = '\0';
-  rstate->value->len = nghttp3_buf_len(&rstate->valuebuf);
+  value->len = nghttp3_buf_len(&rstate->valuebuf);
+
+  if ((rstate->field_chars & NGHTTP3_FIELD_CHAR_FLAG_VALUE) &&
+      (value->len == 0 || (!qpack_is_ws(value->base[0]) &&
+                           !qpack_is_ws(value->base[value->len - 1])))) {
+    value->flags |= NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE;
+  }
+
+  rstate->field_chars = NGHTTP3_FIELD_CHAR_FLAG_ALL;
 }
 
 nghttp3_ssize nghttp3_qpack_decoder_read_encoder(nghttp3_qpack_decoder *decoder,
@@ -2904,7 +3508,9 @@ nghttp3_ssize nghttp3_qpack_decoder_read_encoder(nghttp3_qpack_decoder *decoder,
         rv = nghttp3_qpack_decoder_set_max_dtable_capacity(
           decoder, (size_t)decoder->rstate.left);
         if (rv != 0) {
-          rv = NGHTTP3_ERR_QPACK_ENCODER_STREAM_ERROR;
+          if (rv == NGHTTP3_ERR_INVALID_ARGUMENT) {
+            rv = NGHTTP3_ERR_QPACK_ENCODER_STREAM_ERROR;
+          }
           goto fail;
         }
 
@@ -3156,12 +3762,324 @@ fail:
   return rv;
 }
 
-int nghttp3_qpack_decoder_set_max_dtable_capacity(
-  nghttp3_qpack_decoder *decoder, size_t max_dtable_capacity) {
+/*
+ * qpack_decoder_arena_entry_detach copies the bytes of |aent| out of
+ * the circular buffer if its name or value is referenced by other
+ * than the dynamic table, so that they survive the eviction of
+ * |aent|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int qpack_decoder_arena_entry_detach(nghttp3_qpack_decoder *decoder,
+                                            nghttp3_qpack_arena_entry *aent) {
+  const uint8_t *src;
+  uint8_t *p;
+
+  if (aent->name.ref <= 1 && aent->value.ref <= 1) {
+    return 0;
+  }
+
+  p = nghttp3_mem_malloc(decoder->ctx.mem, aent->len);
+  if (p == NULL) {
+    return NGHTTP3_ERR_NOMEM;
+  }
+
+  src = decoder->arena.buf + aent->offset;
+
+  memcpy(p, src, aent->len);
+
+  if (aent->ent.nv.name == &aent->name) {
+    aent->name.base = p + (aent->name.base - src);
+  }
+
+  aent->value.base = p + (aent->value.base - src);
+  aent->detached = p;
+
+  return 0;
+}
+
+/*
+ * qpack_decoder_dtable_pop evicts the oldest entry from dynamic
+ * table.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int qpack_decoder_dtable_pop(nghttp3_qpack_decoder *decoder) {
+  nghttp3_qpack_context *ctx = &decoder->ctx;
   nghttp3_qpack_entry *ent;
-  size_t i;
+  nghttp3_qpack_arena_entry *aent;
+  size_t i = nghttp3_ringbuf_len(&ctx->dtable);
+  int rv;
+
+  assert(i);
+
+  ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&ctx->dtable, i - 1);
+
+  if (!decoder->arena.enabled) {
+    ctx->dtable_size -= table_space(ent->nv.name->len, ent->nv.value->len);
+
+    nghttp3_ringbuf_pop_back(&ctx->dtable);
+    nghttp3_qpack_entry_free(ent);
+    nghttp3_mem_free(ctx->mem, ent);
+
+    return 0;
+  }
+
+  aent = nghttp3_struct_of(ent, nghttp3_qpack_arena_entry, ent);
+
+  rv = qpack_decoder_arena_entry_detach(decoder, aent);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ctx->dtable_size -= table_space(ent->nv.name->len, ent->nv.value->len);
+
+  nghttp3_ringbuf_pop_back(&ctx->dtable);
+
+  if (i == 1) {
+    decoder->arena.head = 0;
+    decoder->arena.tail = 0;
+  } else {
+    ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&ctx->dtable, i - 2);
+    decoder->arena.head =
+      nghttp3_struct_of(ent, nghttp3_qpack_arena_entry, ent)->offset;
+  }
+
+  if (!aent->detached) {
+    aent->next = decoder->arena.free_list;
+    decoder->arena.free_list = aent;
+
+    return 0;
+  }
+
+  /* |aent| is freed by qpack_arena_entry_release when the last
+     reference goes away.  Do not touch |aent| after the last
+     nghttp3_rcbuf_decref. */
+  if (aent->ent.nv.name == &aent->name) {
+    nghttp3_rcbuf_decref(&aent->name);
+  }
+
+  nghttp3_rcbuf_decref(&aent->value);
+
+  return 0;
+}
+
+/*
+ * qpack_arena_entry_release frees |aent| if its name and value are
+ * both unreferenced.
+ */
+static void qpack_arena_entry_release(nghttp3_qpack_arena_entry *aent) {
+  const nghttp3_mem *mem = aent->value.mem;
+
+  if (aent->name.ref || aent->value.ref) {
+    return;
+  }
+
+  nghttp3_mem_free(mem, aent->detached);
+
+  if (aent->block) {
+    qpack_arena_block_decref(aent->block);
+  }
+
+  nghttp3_mem_free(mem, aent);
+}
+
+static void qpack_arena_entry_name_release(nghttp3_rcbuf *rcbuf) {
+  qpack_arena_entry_release(
+    nghttp3_struct_of(rcbuf, nghttp3_qpack_arena_entry, name));
+}
+
+static void qpack_arena_entry_value_release(nghttp3_rcbuf *rcbuf) {
+  qpack_arena_entry_release(
+    nghttp3_struct_of(rcbuf, nghttp3_qpack_arena_entry, value));
+}
+
+/*
+ * qpack_decoder_arena_alloc reserves |n| contiguous bytes in the
+ * circular buffer, and returns the offset to them.  It assumes that
+ * dynamic table has room for an entry which needs |n| bytes.
+ * Because the length of buffer is twice the maximum dynamic table
+ * capacity, the bytes never have to wrap around the end of buffer.
+ */
+static size_t qpack_decoder_arena_alloc(nghttp3_qpack_decoder *decoder,
+                                        size_t n) {
+  size_t offset;
+
+  if (decoder->arena.tail >= decoder->arena.head) {
+    if (decoder->arena.len - decoder->arena.tail >= n) {
+      offset = decoder->arena.tail;
+    } else {
+      assert(decoder->arena.head > n);
+      offset = 0;
+    }
+  } else {
+    assert(decoder->arena.head - decoder->arena.tail > n);
+    offset = decoder->arena.tail;
+  }
+
+  decoder->arena.tail = offset + n;
+
+  return offset;
+}
+
+/*
+ * qpack_decoder_dtable_arena_add adds |qnv| to dynamic table using
+ * the contiguous dynamic table layout.  The name and value of |qnv|
+ * are copied into the circular buffer.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int qpack_decoder_dtable_arena_add(nghttp3_qpack_decoder *decoder,
+                                          const nghttp3_qpack_nv *qnv) {
   nghttp3_qpack_context *ctx = &decoder->ctx;
   const nghttp3_mem *mem = ctx->mem;
+  nghttp3_qpack_arena_entry *aent;
+  nghttp3_qpack_entry **p;
+  int static_name = nghttp3_rcbuf_is_static(qnv->name);
+  size_t space = table_space(qnv->name->len, qnv->value->len);
+  size_t n = qnv->value->len + 1;
+  uint8_t *dest;
+  int rv;
+
+  assert(space <= ctx->max_dtable_capacity);
+
+  if (!static_name) {
+    n += qnv->name->len + 1;
+  }
+
+  if (decoder->arena.block == NULL) {
+    decoder->arena.block =
+      nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_arena_block) +
+                                ctx->hard_max_dtable_capacity * 2);
+    if (decoder->arena.block == NULL) {
+      return NGHTTP3_ERR_NOMEM;
+    }
+
+    decoder->arena.block->mem = mem;
+    decoder->arena.block->nref = 1;
+    decoder->arena.buf = (uint8_t *)(decoder->arena.block + 1);
+    decoder->arena.len = ctx->hard_max_dtable_capacity * 2;
+  }
+
+  if (decoder->arena.free_list) {
+    aent = decoder->arena.free_list;
+    decoder->arena.free_list = aent->next;
+  } else {
+    aent = nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_arena_entry));
+    if (aent == NULL) {
+      return NGHTTP3_ERR_NOMEM;
+    }
+  }
+
+  while (ctx->dtable_size + space > ctx->max_dtable_capacity) {
+    rv = qpack_decoder_dtable_pop(decoder);
+    if (rv != 0) {
+      goto fail;
+    }
+  }
+
+  if (nghttp3_ringbuf_full(&ctx->dtable)) {
+    rv = nghttp3_ringbuf_reserve(
+      &ctx->dtable, nghttp3_max(128, nghttp3_ringbuf_len(&ctx->dtable) * 2));
+    if (rv != 0) {
+      goto fail;
+    }
+  }
+
+  aent->offset = qpack_decoder_arena_alloc(decoder, n);
+  aent->len = n;
+  aent->detached = NULL;
+  aent->block = NULL;
+
+  dest = decoder->arena.buf + aent->offset;
+
+  if (static_name) {
+    aent->name = (nghttp3_rcbuf){0};
+    aent->ent.nv.name = qnv->name;
+  } else {
+    aent->name = (nghttp3_rcbuf){
+      .mem = mem,
+      .base = dest,
+      .len = qnv->name->len,
+      .ref = 1,
+      .flags = qnv->name->flags,
+      .release = qpack_arena_entry_name_release,
+    };
+    aent->ent.nv.name = &aent->name;
+
+    dest = nghttp3_cpymem(dest, qnv->name->base, qnv->name->len);
+    *dest++ = '\0';
+  }
+
+  aent->value = (nghttp3_rcbuf){
+    .mem = mem,
+    .base = dest,
+    .len = qnv->value->len,
+    .ref = 1,
+    .flags = qnv->value->flags,
+    .release = qpack_arena_entry_value_release,
+  };
+  aent->ent.nv.value = &aent->value;
+
+  dest = nghttp3_cpymem(dest, qnv->value->base, qnv->value->len);
+  *dest = '\0';
+
+  aent->ent.nv.token = qnv->token;
+  aent->ent.nv.flags = qnv->flags;
+  aent->ent.map_next = NULL;
+  aent->ent.sum = ctx->dtable_sum;
+  aent->ent.absidx = ctx->next_absidx++;
+  aent->ent.hash = 0;
+
+  p = nghttp3_ringbuf_push_front(&ctx->dtable);
+  *p = &aent->ent;
+
+  ctx->dtable_size += space;
+  ctx->dtable_sum += space;
+
+  return 0;
+
+fail:
+  aent->next = decoder->arena.free_list;
+  decoder->arena.free_list = aent;
+
+  return rv;
+}
+
+/*
+ * qpack_decoder_dtable_add adds |qnv| to dynamic table.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+static int qpack_decoder_dtable_add(nghttp3_qpack_decoder *decoder,
+                                    nghttp3_qpack_nv *qnv) {
+  if (decoder->arena.enabled) {
+    return qpack_decoder_dtable_arena_add(decoder, qnv);
+  }
+
+  return nghttp3_qpack_context_dtable_add(&decoder->ctx, qnv, NULL, 0);
+}
+
+int nghttp3_qpack_decoder_set_max_dtable_capacity(
+  nghttp3_qpack_decoder *decoder, size_t max_dtable_capacity) {
+  nghttp3_qpack_context *ctx = &decoder->ctx;
+  int rv;
 
   if (max_dtable_capacity > decoder->ctx.hard_max_dtable_capacity) {
     return NGHTTP3_ERR_INVALID_ARGUMENT;
@@ -3170,15 +4088,10 @@ int nghttp3_qpack_decoder_set_max_dtable_capacity(
   ctx->max_dtable_capacity = max_dtable_capacity;
 
   while (ctx->dtable_size > max_dtable_capacity) {
-    i = nghttp3_ringbuf_len(&ctx->dtable);
-    assert(i);
-    ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&ctx->dtable, i - 1);
-
-    ctx->dtable_size -= table_space(ent->nv.name->len, ent->nv.value->len);
-
-    nghttp3_ringbuf_pop_back(&ctx->dtable);
-    nghttp3_qpack_entry_free(ent);
-    nghttp3_mem_free(mem, ent);
+    rv = qpack_decoder_dtable_pop(decoder);
+    if (rv != 0) {
+      return rv;
+    }
   }
 
   return 0;
@@ -3214,7 +4127,7 @@ int nghttp3_qpack_decoder_dtable_static_add(nghttp3_qpack_decoder *decoder) {
   qnv.token = shd->token;
   qnv.flags = NGHTTP3_NV_FLAG_NONE;
 
-  rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  rv = qpack_decoder_dtable_add(decoder, &qnv);
 
   nghttp3_rcbuf_decref(qnv.value);
   decoder->rstate.value = NULL;
@@ -3241,7 +4154,7 @@ int nghttp3_qpack_decoder_dtable_dynamic_add(nghttp3_qpack_decoder *decoder) {
 
   nghttp3_rcbuf_incref(qnv.name);
 
-  rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  rv = qpack_decoder_dtable_add(decoder, &qnv);
 
   nghttp3_rcbuf_decref(qnv.value);
   decoder->rstate.value = NULL;
@@ -3269,7 +4182,7 @@ int nghttp3_qpack_decoder_dtable_duplicate_add(nghttp3_qpack_decoder *decoder) {
   nghttp3_rcbuf_incref(qnv.name);
   nghttp3_rcbuf_incref(qnv.value);
 
-  rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  rv = qpack_decoder_dtable_add(decoder, &qnv);
 
   nghttp3_rcbuf_decref(qnv.value);
   nghttp3_rcbuf_decref(qnv.name);
@@ -3295,7 +4208,7 @@ int nghttp3_qpack_decoder_dtable_literal_add(nghttp3_qpack_decoder *decoder) {
   qnv.token = qpack_lookup_token(qnv.name->base, qnv.name->len);
   qnv.flags = NGHTTP3_NV_FLAG_NONE;
 
-  rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  rv = qpack_decoder_dtable_add(decoder, &qnv);
 
   nghttp3_rcbuf_decref(qnv.value);
   decoder->rstate.value = NULL;
@@ -3344,21 +4257,482 @@ uint64_t nghttp3_qpack_stream_context_get_ricnt2(
   return sctx->ricnt;
 }
 
-nghttp3_ssize
-nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
-                                   nghttp3_qpack_stream_context *sctx,
-                                   nghttp3_qpack_nv *nv, uint8_t *pflags,
-                                   const uint8_t *src, size_t srclen, int fin) {
-  const uint8_t *p = src, *end = src ? src + srclen : src;
-  int rv;
-  int busy = 0;
-  nghttp3_ssize nread;
-  int rfin;
-  const nghttp3_mem *mem = decoder->ctx.mem;
-  size_t huff_declen;
+/*
+ * qpack_get_prefix_int decodes an integer with |prefix| bits prefix
+ * from the buffer [begin, end), and stores it in |*dest|.  It
+ * returns the number of bytes read.  It returns 0 if the integer is
+ * not fully contained in the buffer, or it overflows.  Unlike
+ * qpack_read_varint, it does not keep any state across calls.
+ */
+static size_t qpack_get_prefix_int(uint64_t *dest, const uint8_t *begin,
+                                   const uint8_t *end, size_t prefix) {
+  uint64_t k = (uint8_t)((1 << prefix) - 1);
+  uint64_t n = (*begin) & k;
+  uint64_t add;
+  const uint8_t *p = begin + 1;
+  size_t shift = 0;
 
-  if (decoder->ctx.bad) {
-    return NGHTTP3_ERR_QPACK_FATAL;
+  if (n != k) {
+    *dest = n;
+    return 1;
+  }
+
+  for (; p != end; ++p, shift += 7) {
+    add = (*p) & 0x7FU;
+
+    if (shift > 62 || (NGHTTP3_QPACK_INT_MAX >> shift) < add) {
+      return 0;
+    }
+
+    add <<= shift;
+
+    if (NGHTTP3_QPACK_INT_MAX - add < n) {
+      return 0;
+    }
+
+    n += add;
+
+    if (((*p) & (1 << 7)) == 0) {
+      *dest = n;
+      return (size_t)(p + 1 - begin);
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * qpack_get_string_prefix decodes the H bit and the length of a
+ * string literal with |prefix| bits length prefix from the buffer
+ * [begin, end).  It returns the number of bytes of H bit and length
+ * if they and the string itself are fully contained in the buffer,
+ * and the string does not exceed |maxlen| after decoding.
+ * Otherwise, it returns 0.
+ */
+static size_t qpack_get_string_prefix(int *phuffman, uint64_t *plen,
+                                      const uint8_t *begin, const uint8_t *end,
+                                      size_t prefix, size_t maxlen) {
+  size_t n = qpack_get_prefix_int(plen, begin, end, prefix);
+
+  if (n == 0 || *plen > maxlen || (uint64_t)(end - begin) - n < *plen) {
+    return 0;
+  }
+
+  *phuffman = ((*begin) & (1 << prefix)) != 0;
+
+  if (*phuffman &&
+      nghttp3_qpack_huffman_estimate_decode_length((size_t)*plen) > maxlen) {
+    return 0;
+  }
+
+  return n;
+}
+
+/*
+ * qpack_read_state_decode_string decodes the string literal
+ * [src, src + srclen) into newly allocated |*prcbuf|, and
+ * initializes |buf| to point to it.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ * NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED
+ *     Could not decode huffman string.
+ */
+static int qpack_read_state_decode_string(nghttp3_qpack_read_state *rstate,
+                                          nghttp3_rcbuf **prcbuf,
+                                          nghttp3_buf *buf, const uint8_t *src,
+                                          size_t srclen, int huffman,
+                                          const nghttp3_mem *mem) {
+  nghttp3_ssize nread;
+  int rv;
+
+  if (!huffman) {
+    rv = nghttp3_rcbuf_new(prcbuf, srclen + 1, mem);
+    if (rv != 0) {
+      return rv;
+    }
+
+    nghttp3_buf_wrap_init(buf, (*prcbuf)->base, (*prcbuf)->len);
+    buf->last =
+      nghttp3_cpymem_field_chars(buf->last, src, srclen, &rstate->field_chars);
+
+    return 0;
+  }
+
+  rv = nghttp3_rcbuf_new(
+    prcbuf, nghttp3_qpack_huffman_estimate_decode_length(srclen) + 1, mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  nghttp3_buf_wrap_init(buf, (*prcbuf)->base, (*prcbuf)->len);
+
+  nghttp3_qpack_huffman_decode_context_init(&rstate->huffman_ctx);
+  rstate->left = srclen;
+
+  nread = qpack_read_huffman_string(rstate, buf, src, src + srclen);
+  if (nread < 0) {
+    assert(NGHTTP3_ERR_QPACK_FATAL == nread);
+    return NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED;
+  }
+
+  assert(rstate->left == 0);
+
+  return 0;
+}
+
+/*
+ * qpack_value_fragmentable returns nonzero if the value of a field
+ * whose name is |name| and token is |token| can be delivered in
+ * fragments.  The values of pseudo header fields and the header
+ * fields that HTTP layer interprets must be delivered at once.
+ */
+static int qpack_value_fragmentable(const nghttp3_rcbuf *name, int32_t token) {
+  if (name->len == 0 || name->base[0] == ':') {
+    return 0;
+  }
+
+  switch (token) {
+  case NGHTTP3_QPACK_TOKEN_CONTENT_LENGTH:
+  case NGHTTP3_QPACK_TOKEN_HOST:
+  case NGHTTP3_QPACK_TOKEN_CONNECTION:
+  case NGHTTP3_QPACK_TOKEN_KEEP_ALIVE:
+  case NGHTTP3_QPACK_TOKEN_PROXY_CONNECTION:
+  case NGHTTP3_QPACK_TOKEN_TRANSFER_ENCODING:
+  case NGHTTP3_QPACK_TOKEN_UPGRADE:
+  case NGHTTP3_QPACK_TOKEN_TE:
+  case NGHTTP3_QPACK_TOKEN_PRIORITY:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+/*
+ * qpack_decoder_start_value_fragment decides whether the value of
+ * the field line being decoded is delivered in fragments.  If so,
+ * sctx->rstate.name holds a reference to the name, and
+ * sctx->rstate.token is the token of the name.
+ *
+ * This function returns 1 if the value is delivered in fragments, 0
+ * if it is not, or one of the following negative error codes:
+ *
+ * NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED
+ *     The index of the name is invalid.
+ */
+static int
+qpack_decoder_start_value_fragment(nghttp3_qpack_decoder *decoder,
+                                   nghttp3_qpack_stream_context *sctx) {
+  nghttp3_qpack_read_state *rstate = &sctx->rstate;
+  const nghttp3_qpack_static_header *shd;
+  nghttp3_qpack_entry *ent;
+  nghttp3_rcbuf *name;
+  int32_t token;
+
+  switch (sctx->opcode) {
+  case NGHTTP3_QPACK_RS_OPCODE_LITERAL:
+    name = rstate->name;
+    token = qpack_lookup_token(name->base, name->len);
+
+    break;
+  default:
+    if (rstate->dynamic) {
+      if (qpack_decoder_validate_index(decoder, rstate) != 0) {
+        return NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED;
+      }
+
+      ent = nghttp3_qpack_context_dtable_get(&decoder->ctx, rstate->absidx);
+      name = ent->nv.name;
+      token = ent->nv.token;
+    } else {
+      shd = &stable[rstate->absidx];
+      name = (nghttp3_rcbuf *)&shd->name;
+      token = shd->token;
+    }
+
+    break;
+  }
+
+  if (!qpack_value_fragmentable(name, token)) {
+    return 0;
+  }
+
+  if (sctx->opcode != NGHTTP3_QPACK_RS_OPCODE_LITERAL) {
+    nghttp3_rcbuf_incref(name);
+    rstate->name = name;
+  }
+
+  rstate->token = token;
+  rstate->fragment_offset = 0;
+  rstate->trailing_ws = 0;
+
+  if (rstate->huffman_encoded) {
+    nghttp3_qpack_huffman_decode_context_init(&rstate->huffman_ctx);
+  }
+
+  return 1;
+}
+
+/*
+ * qpack_read_state_value_fragment_full returns nonzero if the
+ * fragment being decoded has no room for more input.  Because a
+ * single byte of huffman encoded string is decoded into at most 2
+ * bytes, it needs 2 bytes of room to proceed.
+ */
+static int
+qpack_read_state_value_fragment_full(const nghttp3_qpack_read_state *rstate) {
+  /* 1 byte is reserved for the terminal NULL. */
+  size_t room = nghttp3_buf_left(&rstate->valuebuf) - 1;
+
+  return rstate->huffman_encoded ? room < 2 : room == 0;
+}
+
+/*
+ * qpack_read_value_fragment decodes the value in buffer [begin, end)
+ * into the current fragment as much as it fits.
+ *
+ * This function returns the number of bytes read, or one of the
+ * following negative error codes:
+ *
+ * NGHTTP3_ERR_QPACK_FATAL
+ *     Could not decode huffman string.
+ */
+static nghttp3_ssize
+qpack_read_value_fragment(nghttp3_qpack_read_state *rstate,
+                          const uint8_t *begin, const uint8_t *end) {
+  size_t room = nghttp3_buf_left(&rstate->valuebuf) - 1;
+  size_t n = (size_t)(end - begin);
+
+  if (rstate->huffman_encoded) {
+    n = nghttp3_min(n, room / 2);
+
+    return qpack_read_huffman_string(rstate, &rstate->valuebuf, begin,
+                                     begin + n);
+  }
+
+  n = nghttp3_min(n, room);
+
+  return qpack_read_string(rstate, &rstate->valuebuf, begin, begin + n);
+}
+
+/*
+ * qpack_read_state_terminate_value_fragment finishes the fragment in
+ * rstate->value.  |last| is nonzero if it is the last fragment of the
+ * value.  Like qpack_read_state_terminate_value, the last fragment is
+ * marked as valid if the whole value passes
+ * nghttp3_check_header_value.
+ */
+static void
+qpack_read_state_terminate_value_fragment(nghttp3_qpack_read_state *rstate,
+                                          int last) {
+  nghttp3_rcbuf *value = rstate->value;
+
+  *rstate->valuebuf.last = '\0';
+  value->len = nghttp3_buf_len(&rstate->valuebuf);
+
+  if (value->len) {
+    if (rstate->fragment_offset == 0 && qpack_is_ws(value->base[0])) {
+      rstate->field_chars &= (uint8_t)~NGHTTP3_FIELD_CHAR_FLAG_VALUE;
+    }
+
+    rstate->trailing_ws = qpack_is_ws(value->base[value->len - 1]);
+    rstate->fragment_offset += value->len;
+  }
+
+  if (!last) {
+    return;
+  }
+
+  if ((rstate->field_chars & NGHTTP3_FIELD_CHAR_FLAG_VALUE) &&
+      !rstate->trailing_ws) {
+    value->flags |= NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE;
+  }
+
+  rstate->field_chars = NGHTTP3_FIELD_CHAR_FLAG_ALL;
+}
+
+/*
+ * qpack_decoder_emit_value_fragment assigns the fragment of the value
+ * in sctx->rstate.value to |nv|.  |last| is nonzero if it is the last
+ * fragment of the value.
+ */
+static void
+qpack_decoder_emit_value_fragment(nghttp3_qpack_stream_context *sctx,
+                                  nghttp3_qpack_nv *nv, int last) {
+  DEBUGF("qpack::decode: Emit value fragment name=%*s len=%zu last=%d\n",
+         (int)sctx->rstate.name->len, sctx->rstate.name->base,
+         sctx->rstate.value->len, last);
+
+  nv->name = sctx->rstate.name;
+  nv->value = sctx->rstate.value;
+  nv->token = sctx->rstate.token;
+  nv->flags =
+    sctx->rstate.never ? NGHTTP3_NV_FLAG_NEVER_INDEX : NGHTTP3_NV_FLAG_NONE;
+
+  if (last) {
+    sctx->rstate.name = NULL;
+  } else {
+    nghttp3_rcbuf_incref(nv->name);
+  }
+
+  sctx->rstate.value = NULL;
+}
+
+/*
+ * qpack_decoder_read_field_line decodes a field line representation
+ * in one go if it is entirely contained in the buffer [begin, end).
+ * sctx->opcode and sctx->rstate must be initialized from its first
+ * byte.  On success, it emits the field in |nv|, resets
+ * sctx->rstate, and returns the number of bytes read.  If the
+ * representation is fragmented, or it is not a plain case, it
+ * returns 0 without consuming any input so that the caller can
+ * fallback to the resumable state machine, which produces the exact
+ * error if any.
+ *
+ * Otherwise, it returns one of the following negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ * NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED
+ *     Could not interpret field line representation.
+ */
+static nghttp3_ssize
+qpack_decoder_read_field_line(nghttp3_qpack_decoder *decoder,
+                              nghttp3_qpack_stream_context *sctx,
+                              nghttp3_qpack_nv *nv, const uint8_t *begin,
+                              const uint8_t *end) {
+  nghttp3_qpack_read_state *rstate = &sctx->rstate;
+  const nghttp3_mem *mem = decoder->ctx.mem;
+  const uint8_t *p = begin;
+  const uint8_t *name = NULL, *value;
+  uint64_t idx = 0, namelen = 0, valuelen;
+  int name_huffman = 0, value_huffman;
+  size_t n;
+  int rv;
+
+  switch (sctx->opcode) {
+  case NGHTTP3_QPACK_RS_OPCODE_LITERAL:
+    n = qpack_get_string_prefix(&name_huffman, &namelen, p, end,
+                                rstate->prefix, NGHTTP3_QPACK_MAX_NAMELEN);
+    if (n == 0) {
+      return 0;
+    }
+
+    name = p + n;
+    p = name + namelen;
+
+    break;
+  default:
+    n = qpack_get_prefix_int(&idx, p, end, rstate->prefix);
+    if (n == 0) {
+      return 0;
+    }
+
+    p += n;
+
+    rstate->left = idx;
+
+    switch (sctx->opcode) {
+    case NGHTTP3_QPACK_RS_OPCODE_INDEXED:
+    case NGHTTP3_QPACK_RS_OPCODE_INDEXED_NAME:
+      rv = nghttp3_qpack_decoder_brel2abs(decoder, sctx);
+      break;
+    default:
+      rv = nghttp3_qpack_decoder_pbrel2abs(decoder, sctx);
+    }
+
+    if (rv != 0) {
+      return rv;
+    }
+
+    switch (sctx->opcode) {
+    case NGHTTP3_QPACK_RS_OPCODE_INDEXED:
+    case NGHTTP3_QPACK_RS_OPCODE_INDEXED_PB:
+      nghttp3_qpack_decoder_emit_indexed(decoder, sctx, nv);
+      nghttp3_qpack_read_state_reset(rstate);
+
+      return p - begin;
+    default:
+      break;
+    }
+
+    break;
+  }
+
+  if (p == end) {
+    goto fallback;
+  }
+
+  n = qpack_get_string_prefix(&value_huffman, &valuelen, p, end, 7,
+                              NGHTTP3_QPACK_MAX_VALUELEN);
+  if (n == 0 || (decoder->value_fragment_size &&
+                 valuelen > decoder->value_fragment_size)) {
+    goto fallback;
+  }
+
+  value = p + n;
+  p = value + valuelen;
+
+  if (name) {
+    rv = qpack_read_state_decode_string(rstate, &rstate->name, &rstate->namebuf,
+                                        name, (size_t)namelen, name_huffman,
+                                        mem);
+    if (rv != 0) {
+      return rv;
+    }
+
+    qpack_read_state_terminate_name(rstate);
+  }
+
+  rv = qpack_read_state_decode_string(rstate, &rstate->value,
+                                      &rstate->valuebuf, value,
+                                      (size_t)valuelen, value_huffman, mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  qpack_read_state_terminate_value(rstate);
+
+  if (name) {
+    nghttp3_qpack_decoder_emit_literal(decoder, sctx, nv);
+  } else {
+    rv = nghttp3_qpack_decoder_emit_indexed_name(decoder, sctx, nv);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  nghttp3_qpack_read_state_reset(rstate);
+
+  return p - begin;
+
+fallback:
+  /* The index has been validated, but the value is not available.
+     Let the state machine read the index again. */
+  rstate->left = 0;
+  rstate->absidx = 0;
+
+  return 0;
+}
+
+nghttp3_ssize
+nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
+                                   nghttp3_qpack_stream_context *sctx,
+                                   nghttp3_qpack_nv *nv, uint8_t *pflags,
+                                   const uint8_t *src, size_t srclen, int fin) {
+  const uint8_t *p = src, *end = src ? src + srclen : src;
+  int rv;
+  int busy = 0;
+  nghttp3_ssize nread;
+  int rfin;
+  const nghttp3_mem *mem = decoder->ctx.mem;
+  size_t huff_declen;
+
+  if (decoder->ctx.bad) {
+    return NGHTTP3_ERR_QPACK_FATAL;
   }
 
   *pflags = NGHTTP3_QPACK_DECODE_FLAG_NONE;
@@ -3493,6 +4867,25 @@ nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
         sctx->rstate.prefix = 3;
         sctx->state = NGHTTP3_QPACK_RS_STATE_READ_INDEX;
       }
+
+      /* Fast path: the whole field line representation is in the
+         buffer. */
+      nread = qpack_decoder_read_field_line(decoder, sctx, nv, p, end);
+      if (nread < 0) {
+        rv = (int)nread;
+        goto fail;
+      }
+
+      if (nread) {
+        p += nread;
+
+        *pflags |= NGHTTP3_QPACK_DECODE_FLAG_EMIT;
+
+        sctx->state = NGHTTP3_QPACK_RS_STATE_OPCODE;
+
+        return p - src;
+      }
+
       break;
     case NGHTTP3_QPACK_RS_STATE_READ_INDEX:
       nread = qpack_read_varint(&rfin, &sctx->rstate, p, end);
@@ -3664,6 +5057,19 @@ nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
         goto fail;
       }
 
+      if (decoder->value_fragment_size &&
+          sctx->rstate.left > decoder->value_fragment_size) {
+        rv = qpack_decoder_start_value_fragment(decoder, sctx);
+        if (rv < 0) {
+          goto fail;
+        }
+
+        if (rv == 1) {
+          sctx->state = NGHTTP3_QPACK_RS_STATE_READ_VALUE_FRAGMENT;
+          break;
+        }
+      }
+
       if (sctx->rstate.huffman_encoded) {
         huff_declen = nghttp3_qpack_huffman_estimate_decode_length(
           (size_t)sctx->rstate.left);
@@ -3765,6 +5171,51 @@ nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
       sctx->state = NGHTTP3_QPACK_RS_STATE_OPCODE;
       nghttp3_qpack_read_state_reset(&sctx->rstate);
 
+      return p - src;
+    case NGHTTP3_QPACK_RS_STATE_READ_VALUE_FRAGMENT:
+      if (sctx->rstate.value == NULL) {
+        rv = nghttp3_rcbuf_new(&sctx->rstate.value,
+                               decoder->value_fragment_size + 1, mem);
+        if (rv != 0) {
+          goto fail;
+        }
+
+        nghttp3_buf_wrap_init(&sctx->rstate.valuebuf,
+                              sctx->rstate.value->base,
+                              sctx->rstate.value->len);
+      }
+
+      nread = qpack_read_value_fragment(&sctx->rstate, p, end);
+      if (nread < 0) {
+        assert(NGHTTP3_ERR_QPACK_FATAL == nread);
+        rv = NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED;
+        goto fail;
+      }
+
+      p += nread;
+
+      if (sctx->rstate.left == 0) {
+        qpack_read_state_terminate_value_fragment(&sctx->rstate, 1);
+        qpack_decoder_emit_value_fragment(sctx, nv, 1);
+
+        *pflags |=
+          NGHTTP3_QPACK_DECODE_FLAG_EMIT | NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT;
+
+        sctx->state = NGHTTP3_QPACK_RS_STATE_OPCODE;
+        nghttp3_qpack_read_state_reset(&sctx->rstate);
+
+        return p - src;
+      }
+
+      if (!qpack_read_state_value_fragment_full(&sctx->rstate)) {
+        break;
+      }
+
+      qpack_read_state_terminate_value_fragment(&sctx->rstate, 0);
+      qpack_decoder_emit_value_fragment(sctx, nv, 0);
+
+      *pflags |= NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT;
+
       return p - src;
     case NGHTTP3_QPACK_RS_STATE_BLOCKED:
       if (sctx->ricnt > decoder->ctx.next_absidx) {
@@ -3833,6 +5284,7 @@ int nghttp3_qpack_decoder_write_section_ack(
 
   if (decoder->written_icnt < sctx->ricnt) {
     decoder->written_icnt = sctx->ricnt;
+    decoder->unblock = 1;
   }
 
   return 0;
@@ -3884,6 +5336,13 @@ void nghttp3_qpack_decoder_write_decoder(nghttp3_qpack_decoder *decoder,
   }
 
   nghttp3_buf_reset(&decoder->dbuf);
+
+  decoder->unblock = 0;
+}
+
+int nghttp3_qpack_decoder_unblocks_encoder(
+  const nghttp3_qpack_decoder *decoder) {
+  return decoder->unblock;
 }
 
 int nghttp3_qpack_decoder_cancel_stream(nghttp3_qpack_decoder *decoder,
@@ -48,6 +48,9 @@
 /* NGHTTP3_QPACK_MAX_VALUELEN is the maximum (estimated uncompressed)
    length of header value this library can decode. */
 #define NGHTTP3_QPACK_MAX_VALUELEN 65536
+/* NGHTTP3_QPACK_MIN_VALUE_FRAGMENT_SIZE is the minimum size of a
+   fragment of header value. */
+#define NGHTTP3_QPACK_MIN_VALUE_FRAGMENT_SIZE 16
 /* NGHTTP3_QPACK_MAX_ENCODERLEN is the maximum encoder stream length
    that a decoder accepts without completely processing a single field
    section. */
@@ -71,6 +74,20 @@ typedef enum nghttp3_qpack_indexing_mode {
   NGHTTP3_QPACK_INDEXING_MODE_NEVER,
 } nghttp3_qpack_indexing_mode;
 
+/* nghttp3_qpack_name_ref is the way a field line or an insert
+   instruction refers to the name of a field. */
+typedef enum nghttp3_qpack_name_ref {
+  /* NGHTTP3_QPACK_NAME_REF_LITERAL means that the name is encoded as
+     a string literal. */
+  NGHTTP3_QPACK_NAME_REF_LITERAL,
+  /* NGHTTP3_QPACK_NAME_REF_STATIC means that the name refers to an
+     entry in static table. */
+  NGHTTP3_QPACK_NAME_REF_STATIC,
+  /* NGHTTP3_QPACK_NAME_REF_DYNAMIC means that the name refers to an
+     entry in dynamic table. */
+  NGHTTP3_QPACK_NAME_REF_DYNAMIC,
+} nghttp3_qpack_name_ref;
+
 typedef struct nghttp3_qpack_entry nghttp3_qpack_entry;
 
 struct nghttp3_qpack_entry {
@@ -88,6 +105,57 @@ struct nghttp3_qpack_entry {
   uint32_t hash;
 };
 
+/*
+ * nghttp3_qpack_arena_block is the header of the circular buffer
+ * used by the contiguous dynamic table layout.  The bytes of the
+ * buffer immediately follow this object.  It is freed when the last
+ * reference to it is dropped.
+ */
+typedef struct nghttp3_qpack_arena_block {
+  /* mem is the memory allocator that allocates memory for this
+     object. */
+  const nghttp3_mem *mem;
+  /* nref is the reference count.  nghttp3_qpack_decoder holds one
+     reference, and each entry which outlives the decoder holds
+     one. */
+  size_t nref;
+} nghttp3_qpack_arena_block;
+
+typedef struct nghttp3_qpack_arena_entry nghttp3_qpack_arena_entry;
+
+/*
+ * nghttp3_qpack_arena_entry is a decoder dynamic table entry used
+ * when the contiguous dynamic table layout is enabled.  Its name and
+ * value are stored in nghttp3_qpack_decoder.arena.buf, and name and
+ * value below point to them.
+ */
+struct nghttp3_qpack_arena_entry {
+  nghttp3_qpack_entry ent;
+  /* name is the name of this entry unless it is in static table, in
+     which case ent.nv.name points to the static table entry, and
+     this field is not used. */
+  nghttp3_rcbuf name;
+  /* value is the value of this entry. */
+  nghttp3_rcbuf value;
+  /* next points to the next free object in
+     nghttp3_qpack_decoder.arena.free_list. */
+  nghttp3_qpack_arena_entry *next;
+  /* offset is the offset in nghttp3_qpack_decoder.arena.buf where
+     the bytes of this entry start. */
+  size_t offset;
+  /* len is the number of bytes that this entry occupies in
+     nghttp3_qpack_decoder.arena.buf. */
+  size_t len;
+  /* detached is the buffer that the bytes of this entry are copied
+     to when this entry is evicted while name or value is still
+     referenced. */
+  uint8_t *detached;
+  /* block, if not NULL, is the buffer which this entry keeps alive
+     because name or value is still referenced after the decoder is
+     freed. */
+  nghttp3_qpack_arena_block *block;
+};
+
 /* The entry used for static table. */
 typedef struct nghttp3_qpack_static_entry {
   uint64_t absidx;
@@ -193,6 +261,19 @@ typedef struct nghttp3_qpack_read_state {
   int never;
   int dynamic;
   int huffman_encoded;
+  /* field_chars is the bitwise AND of NGHTTP3_FIELD_CHAR_FLAG_* flags
+     of the characters of the name or value being decoded. */
+  uint8_t field_chars;
+  /* The following fields are only used when a value is delivered in
+     fragments. */
+  /* token is the token of the name. */
+  int32_t token;
+  /* fragment_offset is the number of bytes of the value delivered in
+     the preceding fragments. */
+  uint64_t fragment_offset;
+  /* trailing_ws is nonzero if the last byte of the value delivered so
+     far is a white space. */
+  int trailing_ws;
 } nghttp3_qpack_read_state;
 
 void nghttp3_qpack_read_state_free(nghttp3_qpack_read_state *rstate);
@@ -264,6 +345,17 @@ struct nghttp3_qpack_encoder {
   /* indexing_strat is the indexing strategy for fields not defined in
      nghttp3_qpack_token. */
   nghttp3_qpack_indexing_strat indexing_strat;
+  /* encoding_strat is the strategy to choose the representation of
+     a field line. */
+  nghttp3_qpack_encoding_strat encoding_strat;
+  /* crumble_cookie is nonzero if cookie header field is split into
+     crumbs before encoding. */
+  int crumble_cookie;
+  /* rtt is the smoothed round-trip time supplied by application. */
+  nghttp3_duration rtt;
+  /* loss_ppm is the packet loss rate in parts per million supplied
+     by application. */
+  uint32_t loss_ppm;
   /* flags is bitwise OR of zero or more of
      NGHTTP3_QPACK_ENCODER_FLAG_*. */
   uint8_t flags;
@@ -754,6 +846,7 @@ typedef enum nghttp3_qpack_request_stream_state {
   NGHTTP3_QPACK_RS_STATE_READ_VALUELEN,
   NGHTTP3_QPACK_RS_STATE_READ_VALUE_HUFFMAN,
   NGHTTP3_QPACK_RS_STATE_READ_VALUE,
+  NGHTTP3_QPACK_RS_STATE_READ_VALUE_FRAGMENT,
   NGHTTP3_QPACK_RS_STATE_BLOCKED,
 } nghttp3_qpack_request_stream_state;
 
@@ -780,6 +873,9 @@ struct nghttp3_qpack_decoder {
   nghttp3_buf dbuf;
   /* written_icnt is Insert Count written to decoder stream so far. */
   uint64_t written_icnt;
+  /* unblock is nonzero if dbuf contains a Section Acknowledgment
+     which increases Known Received Count of encoder. */
+  int unblock;
   /* max_concurrent_streams is the number of concurrent streams that a
      remote endpoint can open, including both bidirectional and
      unidirectional streams which potentially receives QPACK encoded
@@ -788,6 +884,32 @@ struct nghttp3_qpack_decoder {
   /* uninterrupted_encoderlen is the number of bytes read from encoder
      stream without completing a single field section. */
   size_t uninterrupted_encoderlen;
+  /* value_fragment_size, if nonzero, is the maximum length of a
+     fragment of a literal field value.  A value longer than this is
+     delivered in fragments. */
+  size_t value_fragment_size;
+  /* arena is the circular buffer for the contiguous dynamic table
+     layout. */
+  struct {
+    /* block is the reference counted object which owns buf.  It is
+       allocated when the first entry is inserted. */
+    nghttp3_qpack_arena_block *block;
+    /* buf is the circular buffer which stores the names and values
+       of dynamic table entries. */
+    uint8_t *buf;
+    /* len is the length of buf. */
+    size_t len;
+    /* head is the offset to the oldest entry in buf. */
+    size_t head;
+    /* tail is the offset just past the newest entry in buf. */
+    size_t tail;
+    /* free_list is the list of nghttp3_qpack_arena_entry objects
+       which can be reused. */
+    nghttp3_qpack_arena_entry *free_list;
+    /* enabled is nonzero if the contiguous dynamic table layout is
+       enabled. */
+    int enabled;
+  } arena;
 };
 
 /*
@@ -996,4 +1118,14 @@ void nghttp3_qpack_decoder_emit_literal(const nghttp3_qpack_decoder *decoder,
 int nghttp3_qpack_decoder_write_section_ack(
   nghttp3_qpack_decoder *decoder, const nghttp3_qpack_stream_context *sctx);
 
+/*
+ * nghttp3_qpack_decoder_unblocks_encoder returns nonzero if the
+ * pending decoder stream contains a Section Acknowledgment that
+ * increases Known Received Count of encoder.  Such instruction
+ * should be sent without delay because encoder might wait for it to
+ * unblock streams or to evict entries.
+ */
+int nghttp3_qpack_decoder_unblocks_encoder(
+  const nghttp3_qpack_decoder *decoder);
+
 #endif /* !defined(NGHTTP3_QPACK_H) */
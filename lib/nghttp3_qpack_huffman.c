@@ -30,6 +30,7 @@
 #include <stdio.h>
 
 #include "nghttp3_conv.h"
+#include "nghttp3_str.h"
 
 size_t nghttp3_qpack_huffman_encode_count(const uint8_t *src, size_t len) {
   size_t i;
@@ -81,6 +82,7 @@ void nghttp3_qpack_huffman_decode_context_init(
   nghttp3_qpack_huffman_decode_context *ctx) {
   *ctx = (nghttp3_qpack_huffman_decode_context){
     .flags = NGHTTP3_QPACK_HUFFMAN_FLAG_ACCEPTED,
+    .field_chars = NGHTTP3_FIELD_CHAR_FLAG_ALL,
   };
 }
 
@@ -94,6 +96,7 @@ nghttp3_qpack_huffman_decode(nghttp3_qpack_huffman_decode_context *ctx,
     .fstate = ctx->fstate,
     .flags = ctx->flags,
   };
+  uint8_t field_chars = ctx->field_chars;
   uint8_t c;
 
   /* We use the decoding algorithm described in
@@ -105,16 +108,19 @@ nghttp3_qpack_huffman_decode(nghttp3_qpack_huffman_decode_context *ctx,
     t = qpack_huffman_decode_table[t.fstate][c >> 4];
     if (t.flags & NGHTTP3_QPACK_HUFFMAN_FLAG_SYM) {
       *p++ = t.sym;
+      field_chars &= nghttp3_field_char_tbl[t.sym];
     }
 
     t = qpack_huffman_decode_table[t.fstate][c & 0xFU];
     if (t.flags & NGHTTP3_QPACK_HUFFMAN_FLAG_SYM) {
       *p++ = t.sym;
+      field_chars &= nghttp3_field_char_tbl[t.sym];
     }
   }
 
   ctx->fstate = t.fstate;
   ctx->flags = t.flags;
+  ctx->field_chars = field_chars;
 
   if (fin && !(ctx->flags & NGHTTP3_QPACK_HUFFMAN_FLAG_ACCEPTED)) {
     return NGHTTP3_ERR_QPACK_FATAL;
@@ -71,6 +71,9 @@ typedef struct nghttp3_qpack_huffman_decode_context {
   /* fstate is the current huffman decoding state. */
   uint16_t fstate;
   uint8_t flags;
+  /* field_chars is the bitwise AND of NGHTTP3_FIELD_CHAR_FLAG_* flags
+     of all decoded symbols so far. */
+  uint8_t field_chars;
 } nghttp3_qpack_huffman_decode_context;
 
 extern const nghttp3_qpack_huffman_decode_node qpack_huffman_decode_table[][16];
@@ -87,6 +90,8 @@ void nghttp3_qpack_huffman_decode_context_init(
  * of huffman string.  The decoded string is written to the buffer
  * pointed by |dest|.  This function assumes that the buffer pointed
  * by |dest| contains enough memory to store decoded byte string.
+ * While decoding, |ctx| accumulates NGHTTP3_FIELD_CHAR_FLAG_* flags
+ * of the decoded symbols in ctx->field_chars.
  *
  * This function returns the number of bytes written to |dest|, or one
  * of the following negative error codes:
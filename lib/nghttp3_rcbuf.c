@@ -45,6 +45,8 @@ int nghttp3_rcbuf_new(nghttp3_rcbuf **rcbuf_ptr, size_t size,
   (*rcbuf_ptr)->base = p + sizeof(nghttp3_rcbuf);
   (*rcbuf_ptr)->len = size;
   (*rcbuf_ptr)->ref = 1;
+  (*rcbuf_ptr)->flags = NGHTTP3_RCBUF_FLAG_NONE;
+  (*rcbuf_ptr)->release = NULL;
 
   return 0;
 }
@@ -75,6 +77,11 @@ int nghttp3_rcbuf_new2(nghttp3_rcbuf **rcbuf_ptr, const uint8_t *src,
  * Frees |rcbuf| itself, regardless of its reference cout.
  */
 void nghttp3_rcbuf_del(nghttp3_rcbuf *rcbuf) {
+  if (rcbuf->release) {
+    rcbuf->release(rcbuf);
+    return;
+  }
+
   nghttp3_mem_free(rcbuf->mem, rcbuf);
 }
 
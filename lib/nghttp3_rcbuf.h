@@ -32,6 +32,23 @@
 
 #include <nghttp3/nghttp3.h>
 
+/* NGHTTP3_RCBUF_FLAG_NONE indicates that no flag is set. */
+#define NGHTTP3_RCBUF_FLAG_NONE 0x00U
+/* NGHTTP3_RCBUF_FLAG_VALID_FIELD_NAME indicates that the buffer is
+   known to contain only the characters allowed in regular HTTP field
+   name.  It is only consulted for the names that do not start with
+   ':'. */
+#define NGHTTP3_RCBUF_FLAG_VALID_FIELD_NAME 0x01U
+/* NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE indicates that the buffer is
+   known to be a valid HTTP field value as per
+   nghttp3_check_header_value. */
+#define NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE 0x02U
+/*
+ * nghttp3_rcbuf_release is a callback function which is called
+ * instead of freeing |rcbuf| when its reference count drops to 0.
+ */
+typedef void (*nghttp3_rcbuf_release)(nghttp3_rcbuf *rcbuf);
+
 struct nghttp3_rcbuf {
   /* mem is the memory allocator that allocates memory for this
      object. */
@@ -42,6 +59,12 @@ struct nghttp3_rcbuf {
   size_t len;
   /* Reference count */
   int32_t ref;
+  /* flags is bitwise OR of zero or more of NGHTTP3_RCBUF_FLAG_*. */
+  uint8_t flags;
+  /* release, if not NULL, is called to dispose of this object in
+     place of nghttp3_mem_free.  It is used when the object is
+     embedded in another structure. */
+  nghttp3_rcbuf_release release;
 };
 
 /*
@@ -74,7 +97,8 @@ int nghttp3_rcbuf_new2(nghttp3_rcbuf **rcbuf_ptr, const uint8_t *src,
                        size_t srclen, const nghttp3_mem *mem);
 
 /*
- * Frees |rcbuf| itself, regardless of its reference cout.
+ * Frees |rcbuf| itself, regardless of its reference cout.  If
+ * |rcbuf|->release is not NULL, it is called instead.
  */
 void nghttp3_rcbuf_del(nghttp3_rcbuf *rcbuf);
 
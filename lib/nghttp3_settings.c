@@ -42,6 +42,7 @@ void nghttp3_settings_default_versioned(int settings_version,
 
   switch (settings_version) {
   case NGHTTP3_SETTINGS_VERSION:
+  case NGHTTP3_SETTINGS_V4:
   case NGHTTP3_SETTINGS_V3:
     settings->glitch_ratelim_burst = NGHTTP3_DEFAULT_GLITCH_RATELIM_BURST;
     settings->glitch_ratelim_rate = NGHTTP3_DEFAULT_GLITCH_RATELIM_RATE;
@@ -91,6 +92,9 @@ size_t nghttp3_settingslen_version(int settings_version) {
   switch (settings_version) {
   case NGHTTP3_SETTINGS_VERSION:
     return sizeof(settings);
+  case NGHTTP3_SETTINGS_V4:
+    return offsetof(nghttp3_settings, qpack_indexing_strat) +
+           sizeof(settings.qpack_indexing_strat);
   case NGHTTP3_SETTINGS_V3:
     return offsetof(nghttp3_settings, glitch_ratelim_rate) +
            sizeof(settings.glitch_ratelim_rate);
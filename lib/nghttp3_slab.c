@@ -0,0 +1,276 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp3_slab.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "nghttp3_mem.h"
+#include "nghttp3_macro.h"
+
+/*
+ * slab_class_sizes is the list of size classes.  The small classes
+ * are dense because most allocations are small: rcbufs, QPACK
+ * entries, and ringbuf storage of a few elements.  The large classes
+ * cover ksl blocks and the blocks of nghttp3_objalloc.
+ */
+static const size_t slab_class_sizes[] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 2048, 4096,
+};
+
+static size_t slab_class_index(const nghttp3_slab_mem *slab, size_t size) {
+  if (size <= 1024) {
+    return slab->lookup[(size + 0xFU) >> 4];
+  }
+
+  if (size <= 2048) {
+    return NGHTTP3_SLAB_NUM_CLASS - 2;
+  }
+
+  if (size <= NGHTTP3_SLAB_MAX_CLASS_SIZE) {
+    return NGHTTP3_SLAB_NUM_CLASS - 1;
+  }
+
+  return NGHTTP3_SLAB_LARGE;
+}
+
+static void *slab_malloc(size_t size, void *user_data) {
+  nghttp3_slab_mem *slab = user_data;
+  nghttp3_slab_class *cls;
+  nghttp3_slab_hd *hd;
+  nghttp3_opl_entry *oplent;
+  size_t idx = slab_class_index(slab, size);
+  void *p;
+  int rv;
+
+  if (idx == NGHTTP3_SLAB_LARGE) {
+    if (size > SIZE_MAX - sizeof(nghttp3_slab_hd)) {
+      return NULL;
+    }
+
+    hd = nghttp3_mem_malloc(slab->parent, sizeof(nghttp3_slab_hd) + size);
+    if (hd == NULL) {
+      return NULL;
+    }
+
+    hd->cls = NGHTTP3_SLAB_LARGE;
+    hd->size = size;
+
+    ++slab->stat.nlarge_alloc;
+    slab->stat.inuse_bytes += size;
+
+    return hd + 1;
+  }
+
+  cls = &slab->classes[idx];
+
+  oplent = nghttp3_opl_pop(&cls->opl);
+  if (oplent) {
+    hd = nghttp3_struct_of(oplent, nghttp3_slab_hd, oplent);
+  } else {
+    if (nghttp3_buf_left(&cls->balloc.buf) < cls->chunklen) {
+      ++slab->stat.nslab;
+      slab->stat.slab_bytes += cls->balloc.blklen;
+    }
+
+    rv = nghttp3_balloc_get(&cls->balloc, &p, cls->chunklen);
+    if (rv != 0) {
+      --slab->stat.nslab;
+      slab->stat.slab_bytes -= cls->balloc.blklen;
+
+      return NULL;
+    }
+
+    hd = p;
+  }
+
+  hd->cls = idx;
+  hd->size = size;
+
+  ++slab->stat.nalloc;
+  slab->stat.inuse_bytes += slab_class_sizes[idx];
+
+  return hd + 1;
+}
+
+static void slab_free(void *ptr, void *user_data) {
+  nghttp3_slab_mem *slab = user_data;
+  nghttp3_slab_hd *hd;
+  size_t idx;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = (nghttp3_slab_hd *)ptr - 1;
+  idx = hd->cls;
+
+  ++slab->stat.nfree;
+
+  if (idx == NGHTTP3_SLAB_LARGE) {
+    slab->stat.inuse_bytes -= hd->size;
+    nghttp3_mem_free(slab->parent, hd);
+
+    return;
+  }
+
+  assert(idx < NGHTTP3_SLAB_NUM_CLASS);
+
+  slab->stat.inuse_bytes -= slab_class_sizes[idx];
+  nghttp3_opl_push(&slab->classes[idx].opl, &hd->oplent);
+}
+
+static void *slab_calloc(size_t nmemb, size_t size, void *user_data) {
+  void *p;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  p = slab_malloc(nmemb * size, user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memset(p, 0, nmemb * size);
+
+  return p;
+}
+
+static void *slab_realloc(void *ptr, size_t size, void *user_data) {
+  nghttp3_slab_mem *slab = user_data;
+  nghttp3_slab_hd *hd, *nhd;
+  size_t idx;
+  void *p;
+
+  if (ptr == NULL) {
+    return slab_malloc(size, user_data);
+  }
+
+  hd = (nghttp3_slab_hd *)ptr - 1;
+  idx = slab_class_index(slab, size);
+
+  if (hd->cls == NGHTTP3_SLAB_LARGE) {
+    if (idx == NGHTTP3_SLAB_LARGE) {
+      nhd = nghttp3_mem_realloc(slab->parent, hd,
+                                sizeof(nghttp3_slab_hd) + size);
+      if (nhd == NULL) {
+        return NULL;
+      }
+
+      slab->stat.inuse_bytes -= nhd->size;
+      slab->stat.inuse_bytes += size;
+      nhd->size = size;
+
+      return nhd + 1;
+    }
+  } else if (hd->cls == idx) {
+    hd->size = size;
+
+    return ptr;
+  }
+
+  p = slab_malloc(size, user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memcpy(p, ptr, nghttp3_min(hd->size, size));
+
+  slab_free(ptr, user_data);
+
+  return p;
+}
+
+int nghttp3_slab_mem_new(nghttp3_slab_mem **pslab, const nghttp3_mem *mem) {
+  nghttp3_slab_mem *slab;
+  nghttp3_slab_class *cls;
+  size_t i, j, chunklen;
+
+  if (mem == NULL) {
+    mem = nghttp3_mem_default();
+  }
+
+  slab = nghttp3_mem_calloc(mem, 1, sizeof(*slab));
+  if (slab == NULL) {
+    return NGHTTP3_ERR_NOMEM;
+  }
+
+  slab->mem = (nghttp3_mem){
+    .user_data = slab,
+    .malloc = slab_malloc,
+    .free = slab_free,
+    .calloc = slab_calloc,
+    .realloc = slab_realloc,
+  };
+  slab->parent = mem;
+
+  for (i = 0; i < NGHTTP3_SLAB_NUM_CLASS; ++i) {
+    cls = &slab->classes[i];
+    chunklen = sizeof(nghttp3_slab_hd) + slab_class_sizes[i];
+
+    cls->chunklen = chunklen;
+    nghttp3_balloc_init(&cls->balloc, NGHTTP3_SLAB_LEN / chunklen * chunklen,
+                        mem);
+    nghttp3_opl_init(&cls->opl);
+  }
+
+  for (i = 0, j = 0; i < nghttp3_arraylen(slab->lookup); ++i) {
+    for (; slab_class_sizes[j] < i * 16; ++j)
+      ;
+
+    slab->lookup[i] = (uint8_t)j;
+  }
+
+  *pslab = slab;
+
+  return 0;
+}
+
+void nghttp3_slab_mem_del(nghttp3_slab_mem *slab) {
+  size_t i;
+
+  if (slab == NULL) {
+    return;
+  }
+
+  for (i = 0; i < NGHTTP3_SLAB_NUM_CLASS; ++i) {
+    nghttp3_balloc_free(&slab->classes[i].balloc);
+  }
+
+  nghttp3_mem_free(slab->parent, slab);
+}
+
+const nghttp3_mem *nghttp3_slab_mem_get_mem(nghttp3_slab_mem *slab) {
+  return &slab->mem;
+}
+
+void nghttp3_slab_mem_get_stat_versioned(const nghttp3_slab_mem *slab,
+                                         int stat_version,
+                                         nghttp3_slab_mem_stat *dest) {
+  (void)stat_version;
+
+  *dest = slab->stat;
+}
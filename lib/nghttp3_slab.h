@@ -0,0 +1,101 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP3_SLAB_H
+#define NGHTTP3_SLAB_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* defined(HAVE_CONFIG_H) */
+
+#include <nghttp3/nghttp3.h>
+
+#include "nghttp3_balloc.h"
+#include "nghttp3_opl.h"
+
+/*
+ * NGHTTP3_SLAB_NUM_CLASS is the number of size classes.
+ */
+#define NGHTTP3_SLAB_NUM_CLASS 14
+
+/*
+ * NGHTTP3_SLAB_MAX_CLASS_SIZE is the largest size class.  The
+ * allocations larger than this are passed through to the underlying
+ * allocator.
+ */
+#define NGHTTP3_SLAB_MAX_CLASS_SIZE 4096
+
+/*
+ * NGHTTP3_SLAB_LEN is the maximum size of a slab.  The actual size
+ * is rounded down to the multiple of the chunk size of the class.
+ */
+#define NGHTTP3_SLAB_LEN 65536
+
+/*
+ * NGHTTP3_SLAB_LARGE is the size class index that indicates that the
+ * allocation is passed through to the underlying allocator.
+ */
+#define NGHTTP3_SLAB_LARGE NGHTTP3_SLAB_NUM_CLASS
+
+/*
+ * nghttp3_slab_hd is the header that precedes each allocation.  Its
+ * size is 16 bytes so that the returned pointer keeps the alignment
+ * of the slab.
+ */
+typedef union nghttp3_slab_hd {
+  struct {
+    /* cls is the index of the size class, or NGHTTP3_SLAB_LARGE. */
+    size_t cls;
+    /* size is the requested size if cls is NGHTTP3_SLAB_LARGE. */
+    size_t size;
+  };
+  /* oplent links the chunk in the free list of its class. */
+  nghttp3_opl_entry oplent;
+  uint8_t pad[16];
+} nghttp3_slab_hd;
+
+/*
+ * nghttp3_slab_class is a size class.  A chunk is reused from opl if
+ * it is not empty, and carved out of balloc otherwise.
+ */
+typedef struct nghttp3_slab_class {
+  nghttp3_balloc balloc;
+  nghttp3_opl opl;
+  /* chunklen is the size of chunk including nghttp3_slab_hd. */
+  size_t chunklen;
+} nghttp3_slab_class;
+
+struct nghttp3_slab_mem {
+  /* mem is the nghttp3_mem that this object exposes. */
+  nghttp3_mem mem;
+  /* parent is the underlying allocator. */
+  const nghttp3_mem *parent;
+  nghttp3_slab_class classes[NGHTTP3_SLAB_NUM_CLASS];
+  /* lookup maps (size + 15) / 16 to the size class index for size
+     <= 1024. */
+  uint8_t lookup[1024 / 16 + 1];
+  nghttp3_slab_mem_stat stat;
+};
+
+#endif /* !defined(NGHTTP3_SLAB_H) */
@@ -108,3 +108,87 @@ void nghttp3_downcase(uint8_t *s, size_t len) {
     s[i] = nghttp3_downcase_byte(s[i]);
   }
 }
+
+const uint8_t nghttp3_field_char_tbl[] = {
+  0x00 /* NUL  */, 0x00 /* SOH  */, 0x00 /* STX  */, 0x00 /* ETX  */,
+  0x00 /* EOT  */, 0x00 /* ENQ  */, 0x00 /* ACK  */, 0x00 /* BEL  */,
+  0x00 /* BS   */, 0x01 /* HT   */, 0x00 /* LF   */, 0x00 /* VT   */,
+  0x00 /* FF   */, 0x00 /* CR   */, 0x00 /* SO   */, 0x00 /* SI   */,
+  0x00 /* DLE  */, 0x00 /* DC1  */, 0x00 /* DC2  */, 0x00 /* DC3  */,
+  0x00 /* DC4  */, 0x00 /* NAK  */, 0x00 /* SYN  */, 0x00 /* ETB  */,
+  0x00 /* CAN  */, 0x00 /* EM   */, 0x00 /* SUB  */, 0x00 /* ESC  */,
+  0x00 /* FS   */, 0x00 /* GS   */, 0x00 /* RS   */, 0x00 /* US   */,
+  0x01 /* SPC  */, 0x03 /* !    */, 0x01 /* "    */, 0x03 /* #    */,
+  0x03 /* $    */, 0x03 /* %    */, 0x03 /* &    */, 0x03 /* '    */,
+  0x01 /* (    */, 0x01 /* )    */, 0x03 /* *    */, 0x03 /* +    */,
+  0x01 /* ,    */, 0x03 /* -    */, 0x03 /* .    */, 0x01 /* /    */,
+  0x03 /* 0    */, 0x03 /* 1    */, 0x03 /* 2    */, 0x03 /* 3    */,
+  0x03 /* 4    */, 0x03 /* 5    */, 0x03 /* 6    */, 0x03 /* 7    */,
+  0x03 /* 8    */, 0x03 /* 9    */, 0x01 /* :    */, 0x01 /* ;    */,
+  0x01 /* <    */, 0x01 /* =    */, 0x01 /* >    */, 0x01 /* ?    */,
+  0x01 /* @    */, 0x01 /* A    */, 0x01 /* B    */, 0x01 /* C    */,
+  0x01 /* D    */, 0x01 /* E    */, 0x01 /* F    */, 0x01 /* G    */,
+  0x01 /* H    */, 0x01 /* I    */, 0x01 /* J    */, 0x01 /* K    */,
+  0x01 /* L    */, 0x01 /* M    */, 0x01 /* N    */, 0x01 /* O    */,
+  0x01 /* P    */, 0x01 /* Q    */, 0x01 /* R    */, 0x01 /* S    */,
+  0x01 /* T    */, 0x01 /* U    */, 0x01 /* V    */, 0x01 /* W    */,
+  0x01 /* X    */, 0x01 /* Y    */, 0x01 /* Z    */, 0x01 /* [    */,
+  0x01 /* \    */, 0x01 /* ]    */, 0x03 /* ^    */, 0x03 /* _    */,
+  0x03 /* `    */, 0x03 /* a    */, 0x03 /* b    */, 0x03 /* c    */,
+  0x03 /* d    */, 0x03 /* e    */, 0x03 /* f    */, 0x03 /* g    */,
+  0x03 /* h    */, 0x03 /* i    */, 0x03 /* j    */, 0x03 /* k    */,
+  0x03 /* l    */, 0x03 /* m    */, 0x03 /* n    */, 0x03 /* o    */,
+  0x03 /* p    */, 0x03 /* q    */, 0x03 /* r    */, 0x03 /* s    */,
+  0x03 /* t    */, 0x03 /* u    */, 0x03 /* v    */, 0x03 /* w    */,
+  0x03 /* x    */, 0x03 /* y    */, 0x03 /* z    */, 0x01 /* {    */,
+  0x03 /* |    */, 0x01 /* }    */, 0x03 /* ~    */, 0x00 /* DEL  */,
+  0x01 /* 0x80 */, 0x01 /* 0x81 */, 0x01 /* 0x82 */, 0x01 /* 0x83 */,
+  0x01 /* 0x84 */, 0x01 /* 0x85 */, 0x01 /* 0x86 */, 0x01 /* 0x87 */,
+  0x01 /* 0x88 */, 0x01 /* 0x89 */, 0x01 /* 0x8A */, 0x01 /* 0x8B */,
+  0x01 /* 0x8C */, 0x01 /* 0x8D */, 0x01 /* 0x8E */, 0x01 /* 0x8F */,
+  0x01 /* 0x90 */, 0x01 /* 0x91 */, 0x01 /* 0x92 */, 0x01 /* 0x93 */,
+  0x01 /* 0x94 */, 0x01 /* 0x95 */, 0x01 /* 0x96 */, 0x01 /* 0x97 */,
+  0x01 /* 0x98 */, 0x01 /* 0x99 */, 0x01 /* 0x9A */, 0x01 /* 0x9B */,
+  0x01 /* 0x9C */, 0x01 /* 0x9D */, 0x01 /* 0x9E */, 0x01 /* 0x9F */,
+  0x01 /* 0xA0 */, 0x01 /* 0xA1 */, 0x01 /* 0xA2 */, 0x01 /* 0xA3 */,
+  0x01 /* 0xA4 */, 0x01 /* 0xA5 */, 0x01 /* 0xA6 */, 0x01 /* 0xA7 */,
+  0x01 /* 0xA8 */, 0x01 /* 0xA9 */, 0x01 /* 0xAA */, 0x01 /* 0xAB */,
+  0x01 /* 0xAC */, 0x01 /* 0xAD */, 0x01 /* 0xAE */, 0x01 /* 0xAF */,
+  0x01 /* 0xB0 */, 0x01 /* 0xB1 */, 0x01 /* 0xB2 */, 0x01 /* 0xB3 */,
+  0x01 /* 0xB4 */, 0x01 /* 0xB5 */, 0x01 /* 0xB6 */, 0x01 /* 0xB7 */,
+  0x01 /* 0xB8 */, 0x01 /* 0xB9 */, 0x01 /* 0xBA */, 0x01 /* 0xBB */,
+  0x01 /* 0xBC */, 0x01 /* 0xBD */, 0x01 /* 0xBE */, 0x01 /* 0xBF */,
+  0x01 /* 0xC0 */, 0x01 /* 0xC1 */, 0x01 /* 0xC2 */, 0x01 /* 0xC3 */,
+  0x01 /* 0xC4 */, 0x01 /* 0xC5 */, 0x01 /* 0xC6 */, 0x01 /* 0xC7 */,
+  0x01 /* 0xC8 */, 0x01 /* 0xC9 */, 0x01 /* 0xCA */, 0x01 /* 0xCB */,
+  0x01 /* 0xCC */, 0x01 /* 0xCD */, 0x01 /* 0xCE */, 0x01 /* 0xCF */,
+  0x01 /* 0xD0 */, 0x01 /* 0xD1 */, 0x01 /* 0xD2 */, 0x01 /* 0xD3 */,
+  0x01 /* 0xD4 */, 0x01 /* 0xD5 */, 0x01 /* 0xD6 */, 0x01 /* 0xD7 */,
+  0x01 /* 0xD8 */, 0x01 /* 0xD9 */, 0x01 /* 0xDA */, 0x01 /* 0xDB */,
+  0x01 /* 0xDC */, 0x01 /* 0xDD */, 0x01 /* 0xDE */, 0x01 /* 0xDF */,
+  0x01 /* 0xE0 */, 0x01 /* 0xE1 */, 0x01 /* 0xE2 */, 0x01 /* 0xE3 */,
+  0x01 /* 0xE4 */, 0x01 /* 0xE5 */, 0x01 /* 0xE6 */, 0x01 /* 0xE7 */,
+  0x01 /* 0xE8 */, 0x01 /* 0xE9 */, 0x01 /* 0xEA */, 0x01 /* 0xEB */,
+  0x01 /* 0xEC */, 0x01 /* 0xED */, 0x01 /* 0xEE */, 0x01 /* 0xEF */,
+  0x01 /* 0xF0 */, 0x01 /* 0xF1 */, 0x01 /* 0xF2 */, 0x01 /* 0xF3 */,
+  0x01 /* 0xF4 */, 0x01 /* 0xF5 */, 0x01 /* 0xF6 */, 0x01 /* 0xF7 */,
+  0x01 /* 0xF8 */, 0x01 /* 0xF9 */, 0x01 /* 0xFA */, 0x01 /* 0xFB */,
+  0x01 /* 0xFC */, 0x01 /* 0xFD */, 0x01 /* 0xFE */, 0x01 /* 0xFF */,
+};
+
+uint8_t *nghttp3_cpymem_field_chars(uint8_t *dest, const uint8_t *src,
+                                    size_t n, uint8_t *pfield_chars) {
+  const uint8_t *end = src + n;
+  uint8_t field_chars = *pfield_chars;
+  uint8_t c;
+
+  for (; src != end;) {
+    c = *src++;
+    field_chars &= nghttp3_field_char_tbl[c];
+    *dest++ = c;
+  }
+
+  *pfield_chars = field_chars;
+
+  return dest;
+}
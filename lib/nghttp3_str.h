@@ -47,4 +47,30 @@ static inline uint8_t nghttp3_downcase_byte(uint8_t c) {
   return nghttp3_downcase_tbl[c];
 }
 
+/* NGHTTP3_FIELD_CHAR_FLAG_VALUE indicates that a character is
+   allowed in HTTP field value. */
+#define NGHTTP3_FIELD_CHAR_FLAG_VALUE 0x01U
+/* NGHTTP3_FIELD_CHAR_FLAG_NAME indicates that a character is allowed
+   in regular HTTP field name.  Upper case characters are not
+   allowed. */
+#define NGHTTP3_FIELD_CHAR_FLAG_NAME 0x02U
+/* NGHTTP3_FIELD_CHAR_FLAG_ALL is a bitwise OR of all
+   NGHTTP3_FIELD_CHAR_FLAG_* flags. */
+#define NGHTTP3_FIELD_CHAR_FLAG_ALL                                            \
+  (NGHTTP3_FIELD_CHAR_FLAG_VALUE | NGHTTP3_FIELD_CHAR_FLAG_NAME)
+
+/* nghttp3_field_char_tbl maps a character to the bitwise OR of
+   NGHTTP3_FIELD_CHAR_FLAG_* flags that it satisfies. */
+extern const uint8_t nghttp3_field_char_tbl[];
+
+/*
+ * nghttp3_cpymem_field_chars behaves like nghttp3_cpymem, but it also
+ * takes bitwise AND of nghttp3_field_char_tbl of each copied byte
+ * with |*pfield_chars|, so that the caller can tell whether the
+ * copied string is a valid HTTP field name or value without
+ * scanning it again.
+ */
+uint8_t *nghttp3_cpymem_field_chars(uint8_t *dest, const uint8_t *src,
+                                    size_t n, uint8_t *pfield_chars);
+
 #endif /* !defined(NGHTTP3_STR_H) */
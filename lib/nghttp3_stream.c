@@ -94,8 +94,17 @@ static void delete_outq(nghttp3_ringbuf *outq, const nghttp3_mem *mem) {
 
   for (i = 0; i < len; ++i) {
     tbuf = nghttp3_ringbuf_get(outq, i);
-    if (tbuf->type == NGHTTP3_BUF_TYPE_PRIVATE) {
+    switch (tbuf->type) {
+    case NGHTTP3_BUF_TYPE_PRIVATE:
       nghttp3_buf_free(&tbuf->buf, mem);
+      break;
+    case NGHTTP3_BUF_TYPE_ALIEN_RELEASE:
+      if (tbuf->release) {
+        tbuf->release(tbuf->user_data);
+      }
+      break;
+    default:
+      break;
     }
   }
 
@@ -161,6 +170,7 @@ void nghttp3_stream_del(nghttp3_stream *stream) {
   }
 
   nghttp3_qpack_stream_context_free(&stream->qpack_sctx);
+  nghttp3_stream_cookie_reset(stream);
   delete_chunks(&stream->inq, stream->mem);
   delete_outq(&stream->outq, stream->mem);
   delete_out_chunks(&stream->chunks, stream->out_chunk_objalloc, stream->mem);
@@ -170,6 +180,17 @@ void nghttp3_stream_del(nghttp3_stream *stream) {
   nghttp3_objalloc_stream_release(stream->stream_objalloc, stream);
 }
 
+void nghttp3_stream_cookie_reset(nghttp3_stream *stream) {
+  nghttp3_rcbuf_decref(stream->rx.cookie.name);
+  nghttp3_rcbuf_decref(stream->rx.cookie.value);
+  nghttp3_buf_free(&stream->rx.cookie.buf, stream->mem);
+
+  stream->rx.cookie.name = NULL;
+  stream->rx.cookie.value = NULL;
+  nghttp3_buf_init(&stream->rx.cookie.buf);
+  stream->rx.cookie.flags = NGHTTP3_NV_FLAG_NONE;
+}
+
 void nghttp3_varint_read_state_reset(nghttp3_varint_read_state *rvint) {
   *rvint = (nghttp3_varint_read_state){0};
 }
@@ -222,6 +243,24 @@ nghttp3_ssize nghttp3_read_varint(nghttp3_varint_read_state *rvint,
   return (nghttp3_ssize)len;
 }
 
+size_t nghttp3_read_frame_hd(uint64_t *ptype, uint64_t *plen,
+                             const uint8_t *begin, const uint8_t *end) {
+  const uint8_t *p = begin;
+  uint64_t hd[2];
+
+  assert(begin != end);
+
+  if (nghttp3_get_uvarintv(hd, nghttp3_arraylen(hd), &p, end) !=
+      nghttp3_arraylen(hd)) {
+    return 0;
+  }
+
+  *ptype = hd[0];
+  *plen = hd[1];
+
+  return (size_t)(p - begin);
+}
+
 int nghttp3_stream_frq_emplace(nghttp3_stream *stream, nghttp3_frame **pfr) {
   nghttp3_ringbuf *frq = &stream->frq;
   int rv;
@@ -332,45 +371,11 @@ int nghttp3_stream_write_settings(nghttp3_stream *stream,
   int rv;
   nghttp3_buf *chunk;
   nghttp3_typed_buf tbuf;
-  nghttp3_settings_entry ents[16];
-  nghttp3_frame_settings fr = {
-    .type = NGHTTP3_FRAME_SETTINGS,
-    .niv = 3,
-    .iv = ents,
-  };
-  const nghttp3_settings *local_settings = infr->local_settings;
+  nghttp3_settings_entry ents[NGHTTP3_FRAME_SETTINGS_MAX_LOCAL_NIV];
+  nghttp3_frame_settings fr;
   uint64_t payloadlen;
 
-  ents[0] = (nghttp3_settings_entry){
-    .id = NGHTTP3_SETTINGS_ID_MAX_FIELD_SECTION_SIZE,
-    .value = local_settings->max_field_section_size,
-  };
-  ents[1] = (nghttp3_settings_entry){
-    .id = NGHTTP3_SETTINGS_ID_QPACK_MAX_TABLE_CAPACITY,
-    .value = local_settings->qpack_max_dtable_capacity,
-  };
-  ents[2] = (nghttp3_settings_entry){
-    .id = NGHTTP3_SETTINGS_ID_QPACK_BLOCKED_STREAMS,
-    .value = local_settings->qpack_blocked_streams,
-  };
-
-  if (local_settings->h3_datagram) {
-    ents[fr.niv] = (nghttp3_settings_entry){
-      .id = NGHTTP3_SETTINGS_ID_H3_DATAGRAM,
-      .value = 1,
-    };
-
-    ++fr.niv;
-  }
-
-  if (local_settings->enable_connect_protocol) {
-    ents[fr.niv] = (nghttp3_settings_entry){
-      .id = NGHTTP3_SETTINGS_ID_ENABLE_CONNECT_PROTOCOL,
-      .value = 1,
-    };
-
-    ++fr.niv;
-  }
+  nghttp3_frame_settings_local_init(&fr, ents, infr->local_settings);
 
   len = nghttp3_frame_write_settings_len(&payloadlen, &fr);
 
@@ -562,43 +567,143 @@ int nghttp3_stream_write_header_block(nghttp3_stream *stream,
     nghttp3_buf_reset(rbuf);
   }
 
-  if (ebuflen > NGHTTP3_STREAM_MAX_COPY_THRES) {
+  if (ebuflen) {
     assert(qenc_stream);
 
-    nghttp3_typed_buf_init(&tbuf, ebuf, NGHTTP3_BUF_TYPE_PRIVATE);
-    rv = nghttp3_stream_outq_add(qenc_stream, &tbuf);
+    rv = nghttp3_stream_write_qpack_encoder_stream(qenc_stream, ebuf);
     if (rv != 0) {
       return rv;
     }
-    nghttp3_buf_init(ebuf);
-  } else if (ebuflen) {
-    assert(qenc_stream);
+  }
 
-    rv = nghttp3_stream_ensure_chunk(qenc_stream, ebuflen);
-    if (rv != 0) {
-      return rv;
-    }
+  assert(0 == nghttp3_buf_len(&pbuf));
+  assert(0 == nghttp3_buf_len(rbuf));
+  assert(0 == nghttp3_buf_len(ebuf));
 
-    chunk = nghttp3_stream_get_chunk(qenc_stream);
-    nghttp3_typed_buf_shared_init(&tbuf, chunk);
+  return 0;
+}
 
-    chunk->last = nghttp3_cpymem(chunk->last, ebuf->pos, ebuflen);
-    tbuf.buf.last = chunk->last;
+int nghttp3_stream_write_qpack_encoder_stream(nghttp3_stream *stream,
+                                              nghttp3_buf *ebuf) {
+  size_t ebuflen = nghttp3_buf_len(ebuf);
+  nghttp3_buf *chunk;
+  nghttp3_typed_buf tbuf;
+  int rv;
 
-    rv = nghttp3_stream_outq_add(qenc_stream, &tbuf);
+  if (ebuflen > NGHTTP3_STREAM_MAX_COPY_THRES) {
+    nghttp3_typed_buf_init(&tbuf, ebuf, NGHTTP3_BUF_TYPE_PRIVATE);
+    rv = nghttp3_stream_outq_add(stream, &tbuf);
     if (rv != 0) {
       return rv;
     }
-    nghttp3_buf_reset(ebuf);
+    nghttp3_buf_init(ebuf);
+
+    return 0;
   }
 
-  assert(0 == nghttp3_buf_len(&pbuf));
-  assert(0 == nghttp3_buf_len(rbuf));
-  assert(0 == nghttp3_buf_len(ebuf));
+  if (ebuflen == 0) {
+    return 0;
+  }
+
+  rv = nghttp3_stream_ensure_chunk(stream, ebuflen);
+  if (rv != 0) {
+    return rv;
+  }
+
+  chunk = nghttp3_stream_get_chunk(stream);
+  nghttp3_typed_buf_shared_init(&tbuf, chunk);
+
+  chunk->last = nghttp3_cpymem(chunk->last, ebuf->pos, ebuflen);
+  tbuf.buf.last = chunk->last;
+
+  rv = nghttp3_stream_outq_add(stream, &tbuf);
+  if (rv != 0) {
+    return rv;
+  }
+  nghttp3_buf_reset(ebuf);
 
   return 0;
 }
 
+/*
+ * stream_release_data_bufs calls release callback of each buffer in
+ * |dbuf| of length |n|.
+ */
+static void stream_release_data_bufs(const nghttp3_data_buf *dbuf, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    if (dbuf[i].release) {
+      dbuf[i].release(dbuf[i].user_data);
+    }
+  }
+}
+
+/*
+ * stream_read_data calls the read callback of |fr|, and stores the
+ * data in |vec|.  If |fr| uses nghttp3_data_buf_reader, the buffers
+ * are also stored in |dbuf|.  |vec| and |dbuf| must have at least
+ * |veccnt| elements.
+ */
+static nghttp3_ssize stream_read_data(nghttp3_stream *stream,
+                                      const nghttp3_frame_data *fr,
+                                      nghttp3_vec *vec,
+                                      nghttp3_data_buf *dbuf, size_t veccnt,
+                                      uint32_t *pflags) {
+  nghttp3_conn *conn = stream->conn;
+  nghttp3_ssize sveccnt;
+  size_t i;
+
+  if (fr->bdr.read_data_buf == NULL) {
+    assert(fr->dr.read_data);
+
+    return fr->dr.read_data(conn, stream->node.id, vec, veccnt, pflags,
+                            conn->user_data, stream->user_data);
+  }
+
+  sveccnt = fr->bdr.read_data_buf(conn, stream->node.id, dbuf, veccnt, pflags,
+                                  conn->user_data, stream->user_data);
+  if (sveccnt < 0) {
+    return sveccnt;
+  }
+
+  for (i = 0; i < (size_t)sveccnt; ++i) {
+    vec[i] = (nghttp3_vec){
+      .base = dbuf[i].base,
+      .len = dbuf[i].len,
+    };
+  }
+
+  return sveccnt;
+}
+
+/*
+ * stream_coalesce_data copies |v| into the chunk, and adds it to
+ * outq as |type|.  If the previous outq entry has the same type, and
+ * ends where the copied data starts, the copied data is appended to
+ * it.
+ */
+static int stream_coalesce_data(nghttp3_stream *stream, const nghttp3_vec *v,
+                                nghttp3_buf_type type) {
+  nghttp3_typed_buf tbuf;
+  nghttp3_buf *chunk;
+  int rv;
+
+  rv = nghttp3_stream_ensure_chunk(stream, v->len);
+  if (rv != 0) {
+    return rv;
+  }
+
+  chunk = nghttp3_stream_get_chunk(stream);
+  nghttp3_typed_buf_shared_init(&tbuf, chunk);
+  tbuf.type = type;
+
+  chunk->last = nghttp3_cpymem(chunk->last, v->base, v->len);
+  tbuf.buf.last = chunk->last;
+
+  return nghttp3_stream_outq_add(stream, &tbuf);
+}
+
 int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
                               const nghttp3_frame_data *fr) {
   int rv;
@@ -606,23 +711,29 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
   nghttp3_typed_buf tbuf;
   nghttp3_buf buf;
   nghttp3_buf *chunk;
-  nghttp3_read_data_callback read_data = fr->dr.read_data;
   nghttp3_conn *conn = stream->conn;
   uint64_t datalen;
   uint32_t flags = 0;
-  nghttp3_vec vec[8];
+  nghttp3_vec vec[NGHTTP3_STREAM_MAX_READ_DATA_VECCNT];
+  nghttp3_data_buf dbufarr[NGHTTP3_STREAM_MAX_READ_DATA_VECCNT];
+  nghttp3_data_buf *dbuf = NULL;
   nghttp3_vec *v;
   nghttp3_ssize sveccnt;
-  size_t i;
+  size_t i, nbuf, veccnt, coalesce_threshold, min_len;
 
   assert(!(stream->flags & NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED));
-  assert(read_data);
   assert(conn);
 
   *peof = 0;
 
-  sveccnt = read_data(conn, stream->node.id, vec, nghttp3_arraylen(vec), &flags,
-                      conn->user_data, stream->user_data);
+  veccnt = conn->local.settings.read_data_veccnt;
+  if (veccnt == 0) {
+    veccnt = NGHTTP3_STREAM_DEFAULT_READ_DATA_VECCNT;
+  } else if (veccnt > NGHTTP3_STREAM_MAX_READ_DATA_VECCNT) {
+    veccnt = NGHTTP3_STREAM_MAX_READ_DATA_VECCNT;
+  }
+
+  sveccnt = stream_read_data(stream, fr, vec, dbufarr, veccnt, &flags);
   if (sveccnt < 0) {
     if (sveccnt == NGHTTP3_ERR_WOULDBLOCK) {
       stream->flags |= NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED;
@@ -631,9 +742,45 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
     return NGHTTP3_ERR_CALLBACK_FAILURE;
   }
 
-  rv = nghttp3_vec_len_uvarint(&datalen, vec, (size_t)sveccnt);
+  nbuf = (size_t)sveccnt;
+
+  if (fr->bdr.read_data_buf) {
+    dbuf = dbufarr;
+  }
+
+  rv = nghttp3_vec_len_uvarint(&datalen, vec, nbuf);
   if (rv == -1) {
-    return NGHTTP3_ERR_STREAM_DATA_OVERFLOW;
+    rv = NGHTTP3_ERR_STREAM_DATA_OVERFLOW;
+    goto fail;
+  }
+
+  min_len = conn->local.settings.data_frame_min_len;
+
+  /* Keep reading data into the same DATA frame until it gets large
+     enough, or an application has nothing more to give right
+     now. */
+  for (; sveccnt > 0 && datalen < min_len && !(flags & NGHTTP3_DATA_FLAG_EOF) &&
+         nbuf < nghttp3_arraylen(vec);) {
+    sveccnt = stream_read_data(
+      stream, fr, vec + nbuf, dbufarr + nbuf,
+      nghttp3_min(veccnt, nghttp3_arraylen(vec) - nbuf), &flags);
+    if (sveccnt < 0) {
+      if (sveccnt != NGHTTP3_ERR_WOULDBLOCK) {
+        rv = NGHTTP3_ERR_CALLBACK_FAILURE;
+        goto fail;
+      }
+
+      stream->flags |= NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED;
+      break;
+    }
+
+    nbuf += (size_t)sveccnt;
+
+    rv = nghttp3_vec_len_uvarint(&datalen, vec, nbuf);
+    if (rv == -1) {
+      rv = NGHTTP3_ERR_STREAM_DATA_OVERFLOW;
+      goto fail;
+    }
   }
 
   assert(datalen || flags & NGHTTP3_DATA_FLAG_EOF);
@@ -643,6 +790,10 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
     if (!(flags & NGHTTP3_DATA_FLAG_NO_END_STREAM)) {
       stream->flags |= NGHTTP3_STREAM_FLAG_WRITE_END_STREAM;
       if (datalen == 0) {
+        if (dbuf) {
+          stream_release_data_bufs(dbuf, nbuf);
+        }
+
         if (nghttp3_stream_outq_write_done(stream)) {
           /* If this is the last data and its is 0 length, we don't
              need send DATA frame.  We rely on the non-emptiness of
@@ -657,6 +808,10 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
     }
 
     if (datalen == 0) {
+      if (dbuf) {
+        stream_release_data_bufs(dbuf, nbuf);
+      }
+
       /* We are going to send more frames, but no DATA frame this
          time. */
       return 0;
@@ -667,7 +822,7 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
 
   rv = nghttp3_stream_ensure_chunk(stream, len);
   if (rv != 0) {
-    return rv;
+    goto fail;
   }
 
   chunk = nghttp3_stream_get_chunk(stream);
@@ -680,26 +835,63 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
 
   rv = nghttp3_stream_outq_add(stream, &tbuf);
   if (rv != 0) {
-    return rv;
+    goto fail;
   }
 
   assert(datalen);
 
-  for (i = 0; i < (size_t)sveccnt; ++i) {
+  coalesce_threshold = nghttp3_min(conn->local.settings.data_coalesce_threshold,
+                                   (size_t)NGHTTP3_STREAM_MIN_CHUNK_SIZE);
+
+  for (i = 0; i < nbuf; ++i) {
     v = &vec[i];
     if (v->len == 0) {
+      if (dbuf) {
+        stream_release_data_bufs(&dbuf[i], 1);
+      }
+      continue;
+    }
+
+    if (v->len <= coalesce_threshold) {
+      rv = stream_coalesce_data(stream, v, dbuf ? NGHTTP3_BUF_TYPE_SHARED
+                                                : NGHTTP3_BUF_TYPE_SHARED_ACK);
+      if (dbuf) {
+        stream_release_data_bufs(&dbuf[i], rv == 0 ? 1 : nbuf - i);
+      }
+      if (rv != 0) {
+        return rv;
+      }
       continue;
     }
+
     nghttp3_buf_wrap_init(&buf, v->base, v->len);
     buf.last = buf.end;
-    nghttp3_typed_buf_init(&tbuf, &buf, NGHTTP3_BUF_TYPE_ALIEN);
+
+    if (dbuf) {
+      nghttp3_typed_buf_init(&tbuf, &buf, NGHTTP3_BUF_TYPE_ALIEN_RELEASE);
+      tbuf.release = dbuf[i].release;
+      tbuf.user_data = dbuf[i].user_data;
+    } else {
+      nghttp3_typed_buf_init(&tbuf, &buf, NGHTTP3_BUF_TYPE_ALIEN);
+    }
+
     rv = nghttp3_stream_outq_add(stream, &tbuf);
     if (rv != 0) {
+      if (dbuf) {
+        stream_release_data_bufs(&dbuf[i], nbuf - i);
+      }
       return rv;
     }
   }
 
   return 0;
+
+fail:
+  if (dbuf) {
+    stream_release_data_bufs(dbuf, nbuf);
+  }
+
+  return rv;
 }
 
 int nghttp3_stream_write_qpack_decoder_stream(nghttp3_stream *stream) {
@@ -753,7 +945,9 @@ int nghttp3_stream_outq_add(nghttp3_stream *stream,
 
   if (len) {
     dest = nghttp3_ringbuf_get(outq, len - 1);
-    if (dest->type == tbuf->type && dest->type == NGHTTP3_BUF_TYPE_SHARED &&
+    if (dest->type == tbuf->type &&
+        (dest->type == NGHTTP3_BUF_TYPE_SHARED ||
+         dest->type == NGHTTP3_BUF_TYPE_SHARED_ACK) &&
         dest->buf.end == tbuf->buf.end && dest->buf.last == tbuf->buf.pos) {
       /* If we have already written last entry, adjust outq_idx and
          offset so that this entry is eligible to send. */
@@ -927,7 +1121,13 @@ static void stream_pop_outq_entry(nghttp3_stream *stream,
   case NGHTTP3_BUF_TYPE_ALIEN:
   case NGHTTP3_BUF_TYPE_ALIEN_NO_ACK:
     break;
+  case NGHTTP3_BUF_TYPE_ALIEN_RELEASE:
+    if (tbuf->release) {
+      tbuf->release(tbuf->user_data);
+    }
+    break;
   case NGHTTP3_BUF_TYPE_SHARED:
+  case NGHTTP3_BUF_TYPE_SHARED_ACK:
     assert(nghttp3_ringbuf_len(chunks));
 
     chunk = nghttp3_ringbuf_get(chunks, 0);
@@ -962,9 +1162,11 @@ int nghttp3_stream_update_ack_offset(nghttp3_stream *stream, uint64_t offset) {
     tbuf = nghttp3_ringbuf_get(outq, 0);
     buflen = (size_t)(tbuf->buf.last - tbuf->buf.begin);
 
-    /* For NGHTTP3_BUF_TYPE_ALIEN, we never add 0 length buffer. */
-    if (tbuf->type == NGHTTP3_BUF_TYPE_ALIEN && stream->ack_offset < offset &&
-        stream->callbacks.acked_data) {
+    /* For NGHTTP3_BUF_TYPE_ALIEN and NGHTTP3_BUF_TYPE_SHARED_ACK, we
+       never add 0 length buffer. */
+    if ((tbuf->type == NGHTTP3_BUF_TYPE_ALIEN ||
+         tbuf->type == NGHTTP3_BUF_TYPE_SHARED_ACK) &&
+        stream->ack_offset < offset && stream->callbacks.acked_data) {
       nack =
         nghttp3_min(offset, stream->ack_base + buflen) - stream->ack_offset;
 
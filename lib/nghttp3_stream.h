@@ -41,6 +41,14 @@
 
 #define NGHTTP3_STREAM_MIN_CHUNK_SIZE 256
 
+/* NGHTTP3_STREAM_DEFAULT_READ_DATA_VECCNT is the default number of
+   nghttp3_vec that read_data callback is asked to fill. */
+#define NGHTTP3_STREAM_DEFAULT_READ_DATA_VECCNT 8
+
+/* NGHTTP3_STREAM_MAX_READ_DATA_VECCNT is the maximum number of
+   nghttp3_vec that read_data callback is asked to fill. */
+#define NGHTTP3_STREAM_MAX_READ_DATA_VECCNT 64
+
 /* NGHTTP3_MIN_UNSENT_BYTES is the minimum unsent bytes which is large
    enough to fill outgoing single QUIC packet or TLS record in case of
    QMux (Cut 2 bytes for QMux record length). */
@@ -116,6 +124,10 @@ typedef struct nghttp3_stream_read_state {
 /* NGHTTP3_STREAM_FLAG_READ_EOF indicates that remote endpoint sent
    fin. */
 #define NGHTTP3_STREAM_FLAG_READ_EOF 0x0020U
+/* NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING indicates that the
+   priority received in PRIORITY_UPDATE frame is waiting to be
+   applied. */
+#define NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING 0x0040U
 /* NGHTTP3_STREAM_FLAG_SHUT_WR indicates that any further write
    operation to a stream is prohibited. */
 #define NGHTTP3_STREAM_FLAG_SHUT_WR 0x0100U
@@ -234,6 +246,34 @@ struct nghttp3_stream {
       struct {
         nghttp3_stream_http_state hstate;
         nghttp3_http_state http;
+        /* cookie holds the cookie field lines received in the
+           current field section if
+           nghttp3_settings.qpack_decoder_join_cookie is enabled. */
+        struct {
+          /* name is the name of the first cookie field line. */
+          nghttp3_rcbuf *name;
+          /* value is the value of the first cookie field line. */
+          nghttp3_rcbuf *value;
+          /* buf contains the values joined with "; " if more than
+             one cookie field line is received. */
+          nghttp3_buf buf;
+          /* flags is bitwise OR of the flags of the field lines. */
+          uint8_t flags;
+        } cookie;
+        /* nconsumed is the number of bytes consumed by this stream,
+           but not reported to an application yet.  The stream is
+           linked into conn->rx.consumed_head if, and only if this
+           field is nonzero. */
+        size_t nconsumed;
+        nghttp3_stream *consumed_prev;
+        nghttp3_stream *consumed_next;
+        /* pri_update is the priority received in PRIORITY_UPDATE
+           frame.  It is only valid if
+           NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING is set. */
+        nghttp3_pri pri_update;
+        /* pri_update_next points to the next stream in
+           conn->rx.pri_update_head. */
+        nghttp3_stream *pri_update_next;
       } rx;
 
       uint16_t flags;
@@ -253,6 +293,12 @@ int nghttp3_stream_new(nghttp3_stream **pstream, int64_t stream_id,
 
 void nghttp3_stream_del(nghttp3_stream *stream);
 
+/*
+ * nghttp3_stream_cookie_reset releases the cookie field lines kept in
+ * |stream| for joining.
+ */
+void nghttp3_stream_cookie_reset(nghttp3_stream *stream);
+
 void nghttp3_varint_read_state_reset(nghttp3_varint_read_state *rvint);
 
 void nghttp3_stream_read_state_reset(nghttp3_stream_read_state *rstate);
@@ -261,6 +307,17 @@ nghttp3_ssize nghttp3_read_varint(nghttp3_varint_read_state *rvint,
                                   const uint8_t *begin, const uint8_t *end,
                                   int fin);
 
+/*
+ * nghttp3_read_frame_hd reads frame type and length from the buffer
+ * [begin, end) if both of them are fully contained in the buffer.
+ * It stores frame type in |*ptype| and length in |*plen|, and returns
+ * the number of bytes read.  Otherwise, it returns 0 without
+ * modifying |*ptype| and |*plen|.  |begin| must not be equal to
+ * |end|.
+ */
+size_t nghttp3_read_frame_hd(uint64_t *ptype, uint64_t *plen,
+                             const uint8_t *begin, const uint8_t *end);
+
 /*
  * nghttp3_stream_frq_emplace adds new space for nghttp3_frame to
  * stream->frq, and assigns the pointer to the space to |*pfr| if it
@@ -296,6 +353,20 @@ int nghttp3_stream_write_header_block(nghttp3_stream *stream,
                                       uint64_t frame_type,
                                       const nghttp3_nv *nva, size_t nvlen);
 
+/*
+ * nghttp3_stream_write_qpack_encoder_stream queues the QPACK encoder
+ * stream instructions in |ebuf| to |stream|, which must be QPACK
+ * encoder stream.  |ebuf| is emptied when this function succeeds.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+int nghttp3_stream_write_qpack_encoder_stream(nghttp3_stream *stream,
+                                              nghttp3_buf *ebuf);
+
 int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
                               const nghttp3_frame_data *fr);
 
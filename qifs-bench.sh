@@ -0,0 +1,9 @@
+#!/bin/bash
+set -e
+
+for f in qifs/qifs/*.qif; do
+    echo $f
+    examples/qpack bench "$f" "$@"
+    echo $f immediate-ack
+    examples/qpack bench "$f" -a "$@"
+done
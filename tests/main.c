@@ -40,11 +40,13 @@
 #include "nghttp3_settings_test.h"
 #include "nghttp3_callbacks_test.h"
 #include "nghttp3_str_test.h"
+#include "nghttp3_slab_test.h"
 
 int main(int argc, char **argv) {
   const MunitSuite suites[] = {
-    qpack_suite,    conn_suite,      stream_suite, tnode_suite, http_suite,
-    settings_suite, callbacks_suite, str_suite,    {0},
+    qpack_suite,    conn_suite, stream_suite, tnode_suite,
+    http_suite,     conv_suite, settings_suite, callbacks_suite,
+    str_suite,      slab_suite, {0},
   };
   const MunitSuite suite = {
     .prefix = "",
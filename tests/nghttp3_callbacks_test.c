@@ -259,8 +259,48 @@ static int recv_settings2(nghttp3_conn *conn,
   return 0;
 }
 
+static int recv_header_fragment(nghttp3_conn *conn, int64_t stream_id,
+                                int32_t token, nghttp3_rcbuf *name,
+                                nghttp3_rcbuf *value, uint8_t flags, int fin,
+                                void *conn_user_data, void *stream_user_data) {
+  (void)conn;
+  (void)stream_id;
+  (void)token;
+  (void)name;
+  (void)value;
+  (void)flags;
+  (void)fin;
+  (void)conn_user_data;
+  (void)stream_user_data;
+
+  return 0;
+}
+
+static int recv_datav(nghttp3_conn *conn, int64_t stream_id,
+                      const nghttp3_vec *datav, size_t datavcnt,
+                      void *conn_user_data, void *stream_user_data) {
+  (void)conn;
+  (void)stream_id;
+  (void)datav;
+  (void)datavcnt;
+  (void)conn_user_data;
+  (void)stream_user_data;
+
+  return 0;
+}
+
+static int stream_writable(nghttp3_conn *conn, int64_t stream_id,
+                           void *conn_user_data, void *stream_user_data) {
+  (void)conn;
+  (void)stream_id;
+  (void)conn_user_data;
+  (void)stream_user_data;
+
+  return 0;
+}
+
 void test_nghttp3_callbacks_convert_to_latest(void) {
-  const int srcver = NGHTTP3_CALLBACKS_V3;
+  const int srcver = NGHTTP3_CALLBACKS_V4;
   static const nghttp3_callbacks srcbuf = {
     .acked_stream_data = acked_stream_data,
     .stream_close = stream_close,
@@ -281,6 +321,7 @@ void test_nghttp3_callbacks_convert_to_latest(void) {
     .end_origin = end_origin,
     .rand = randcb,
     .recv_settings2 = recv_settings2,
+    .stream_close2 = stream_close2,
   };
   nghttp3_callbacks *src, callbacksbuf;
   const nghttp3_callbacks *dest;
@@ -316,11 +357,14 @@ void test_nghttp3_callbacks_convert_to_latest(void) {
   assert_ptr_equal(srcbuf.end_origin, dest->end_origin);
   assert_ptr_equal(srcbuf.rand, dest->rand);
   assert_ptr_equal(srcbuf.recv_settings2, dest->recv_settings2);
-  assert_null(dest->stream_close2);
+  assert_ptr_equal(srcbuf.stream_close2, dest->stream_close2);
+  assert_null(dest->recv_header_fragment);
+  assert_null(dest->recv_datav);
+  assert_null(dest->stream_writable);
 }
 
 void test_nghttp3_callbacks_convert_to_old(void) {
-  const int destver = NGHTTP3_CALLBACKS_V3;
+  const int destver = NGHTTP3_CALLBACKS_V4;
   static const nghttp3_callbacks src = {
     .acked_stream_data = acked_stream_data,
     .stream_close = stream_close,
@@ -342,6 +386,9 @@ void test_nghttp3_callbacks_convert_to_old(void) {
     .rand = randcb,
     .recv_settings2 = recv_settings2,
     .stream_close2 = stream_close2,
+    .recv_header_fragment = recv_header_fragment,
+    .recv_datav = recv_datav,
+    .stream_writable = stream_writable,
   };
   nghttp3_callbacks *dest, destbuf = {0};
   size_t destlen;
@@ -375,5 +422,8 @@ void test_nghttp3_callbacks_convert_to_old(void) {
   assert_ptr_equal(src.end_origin, destbuf.end_origin);
   assert_ptr_equal(src.rand, destbuf.rand);
   assert_ptr_equal(src.recv_settings2, destbuf.recv_settings2);
-  assert_null(destbuf.stream_close2);
+  assert_ptr_equal(src.stream_close2, destbuf.stream_close2);
+  assert_null(destbuf.recv_header_fragment);
+  assert_null(destbuf.recv_datav);
+  assert_null(destbuf.stream_writable);
 }
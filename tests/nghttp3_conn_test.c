@@ -36,6 +36,7 @@
 #include "nghttp3_http.h"
 #include "nghttp3_str.h"
 #include "nghttp3_settings.h"
+#include "nghttp3_file_reader.h"
 
 static const MunitTest tests[] = {
   munit_void_test(test_nghttp3_conn_read_control),
@@ -53,7 +54,14 @@ static const MunitTest tests[] = {
   munit_void_test(test_nghttp3_conn_http_error),
   munit_void_test(test_nghttp3_conn_qpack_blocked_stream),
   munit_void_test(test_nghttp3_conn_qpack_decoder_cancel_stream),
+  munit_void_test(test_nghttp3_conn_qpack_decoder_ack_delay),
+  munit_void_test(test_nghttp3_conn_prime_qpack),
+  munit_void_test(test_nghttp3_conn_join_cookie),
+  munit_void_test(test_nghttp3_conn_recv_header_fragment),
   munit_void_test(test_nghttp3_conn_just_fin),
+  munit_void_test(test_nghttp3_conn_preamble),
+  munit_void_test(test_nghttp3_conn_factory),
+  munit_void_test(test_nghttp3_conn_factory_urgency_weights),
   munit_void_test(test_nghttp3_conn_submit_response_read_blocked),
   munit_void_test(test_nghttp3_conn_submit_info),
   munit_void_test(test_nghttp3_conn_recv_uni),
@@ -63,10 +71,19 @@ static const MunitTest tests[] = {
   munit_void_test(test_nghttp3_conn_priority_update),
   munit_void_test(test_nghttp3_conn_request_priority),
   munit_void_test(test_nghttp3_conn_set_stream_priority),
+  munit_void_test(test_nghttp3_conn_weighted_sched),
+  munit_void_test(test_nghttp3_conn_writev_stream_hint),
+  munit_void_test(test_nghttp3_conn_stream_writable),
   munit_void_test(test_nghttp3_conn_shutdown_stream_read),
+  munit_void_test(test_nghttp3_conn_recv_datav),
+  munit_void_test(test_nghttp3_conn_flush_consumed),
   munit_void_test(test_nghttp3_conn_stream_data_overflow),
   munit_void_test(test_nghttp3_conn_get_frame_payload_left),
   munit_void_test(test_nghttp3_conn_update_ack_offset),
+  munit_void_test(test_nghttp3_conn_submit_request_buf),
+  munit_void_test(test_nghttp3_conn_coalesce_data),
+  munit_void_test(test_nghttp3_conn_data_frame_min_len),
+  munit_void_test(test_nghttp3_conn_file_reader),
   munit_void_test(test_nghttp3_conn_set_client_stream_priority),
   munit_void_test(test_nghttp3_conn_rx_http_state),
   munit_void_test(test_nghttp3_conn_push),
@@ -124,6 +141,7 @@ typedef struct {
     int64_t id;
   } shutdown_cb;
   struct {
+    size_t ncalled;
     size_t consumed_total;
   } deferred_consume_cb;
   struct {
@@ -137,6 +155,27 @@ typedef struct {
   struct {
     size_t ncalled;
   } recv_trailer_cb;
+  struct {
+    size_t ncalled;
+    uint8_t value[256];
+    size_t valuelen;
+  } recv_cookie_cb;
+  struct {
+    size_t ncalled;
+    size_t nfin;
+    uint8_t value[1024];
+    size_t valuelen;
+  } recv_header_fragment_cb;
+  struct {
+    size_t ncalled;
+    size_t datavcnt[4];
+    size_t datalen;
+    size_t ntrailer;
+  } recv_datav_cb;
+  struct {
+    size_t ncalled;
+    int64_t stream_id;
+  } stream_writable_cb;
   struct {
     const nghttp3_vec *origin_list;
     size_t origin_listlen;
@@ -199,6 +238,63 @@ static int recv_header(nghttp3_conn *conn, int64_t stream_id, int32_t token,
   return 0;
 }
 
+static int recv_cookie_header(nghttp3_conn *conn, int64_t stream_id,
+                              int32_t token, nghttp3_rcbuf *name,
+                              nghttp3_rcbuf *value, uint8_t flags,
+                              void *user_data, void *stream_user_data) {
+  userdata *ud = user_data;
+  nghttp3_vec v = nghttp3_rcbuf_get_buf(value);
+  (void)conn;
+  (void)stream_id;
+  (void)name;
+  (void)flags;
+  (void)stream_user_data;
+
+  if (token != NGHTTP3_QPACK_TOKEN_COOKIE) {
+    return 0;
+  }
+
+  ++ud->recv_cookie_cb.ncalled;
+
+  assert_size(sizeof(ud->recv_cookie_cb.value), >=, v.len);
+
+  memcpy(ud->recv_cookie_cb.value, v.base, v.len);
+  ud->recv_cookie_cb.valuelen = v.len;
+
+  return 0;
+}
+
+static int recv_header_fragment(nghttp3_conn *conn, int64_t stream_id,
+                                int32_t token, nghttp3_rcbuf *name,
+                                nghttp3_rcbuf *value, uint8_t flags, int fin,
+                                void *user_data, void *stream_user_data) {
+  userdata *ud = user_data;
+  nghttp3_vec v = nghttp3_rcbuf_get_buf(value);
+  (void)conn;
+  (void)stream_id;
+  (void)token;
+  (void)name;
+  (void)flags;
+  (void)stream_user_data;
+
+  ++ud->recv_header_fragment_cb.ncalled;
+
+  if (fin) {
+    ++ud->recv_header_fragment_cb.nfin;
+  }
+
+  assert_size(sizeof(ud->recv_header_fragment_cb.value) -
+                ud->recv_header_fragment_cb.valuelen,
+              >=, v.len);
+
+  memcpy(ud->recv_header_fragment_cb.value +
+           ud->recv_header_fragment_cb.valuelen,
+         v.base, v.len);
+  ud->recv_header_fragment_cb.valuelen += v.len;
+
+  return 0;
+}
+
 static int end_headers(nghttp3_conn *conn, int64_t stream_id, int fin,
                        void *user_data, void *stream_user_data) {
   (void)conn;
@@ -227,6 +323,40 @@ static int recv_trailer(nghttp3_conn *conn, int64_t stream_id, int32_t token,
   return 0;
 }
 
+static int recv_datav(nghttp3_conn *conn, int64_t stream_id,
+                      const nghttp3_vec *datav, size_t datavcnt,
+                      void *user_data, void *stream_user_data) {
+  userdata *ud = user_data;
+  size_t i;
+  (void)conn;
+  (void)stream_id;
+  (void)stream_user_data;
+
+  assert_size(nghttp3_arraylen(ud->recv_datav_cb.datavcnt), >,
+              ud->recv_datav_cb.ncalled);
+
+  ud->recv_datav_cb.datavcnt[ud->recv_datav_cb.ncalled++] = datavcnt;
+  ud->recv_datav_cb.ntrailer = ud->recv_trailer_cb.ncalled;
+
+  for (i = 0; i < datavcnt; ++i) {
+    ud->recv_datav_cb.datalen += datav[i].len;
+  }
+
+  return 0;
+}
+
+static int stream_writable(nghttp3_conn *conn, int64_t stream_id,
+                           void *user_data, void *stream_user_data) {
+  userdata *ud = user_data;
+  (void)conn;
+  (void)stream_user_data;
+
+  ++ud->stream_writable_cb.ncalled;
+  ud->stream_writable_cb.stream_id = stream_id;
+
+  return 0;
+}
+
 static nghttp3_ssize empty_read_data(nghttp3_conn *conn, int64_t stream_id,
                                      nghttp3_vec *vec, size_t veccnt,
                                      uint32_t *pflags, void *user_data,
@@ -378,6 +508,78 @@ static nghttp3_ssize stream_data_almost_overflow_read_data(
 }
 #endif /* SIZE_MAX > UINT32_MAX */
 
+static void count_release(void *user_data) { ++*(size_t *)user_data; }
+
+static nghttp3_ssize buf_read_data(nghttp3_conn *conn, int64_t stream_id,
+                                   nghttp3_data_buf *buf, size_t bufcnt,
+                                   uint32_t *pflags, void *user_data,
+                                   void *stream_user_data) {
+  (void)conn;
+  (void)stream_id;
+  (void)bufcnt;
+  (void)user_data;
+
+  buf[0] = (nghttp3_data_buf){
+    .base = nulldata,
+    .len = 100,
+    .release = count_release,
+    .user_data = stream_user_data,
+  };
+  buf[1] = (nghttp3_data_buf){
+    .base = nulldata,
+    .release = count_release,
+    .user_data = stream_user_data,
+  };
+  buf[2] = (nghttp3_data_buf){
+    .base = nulldata + 100,
+    .len = 200,
+    .release = count_release,
+    .user_data = stream_user_data,
+  };
+
+  *pflags = NGHTTP3_DATA_FLAG_EOF;
+
+  return 3;
+}
+
+static nghttp3_ssize small_read_data(nghttp3_conn *conn, int64_t stream_id,
+                                     nghttp3_vec *vec, size_t veccnt,
+                                     uint32_t *pflags, void *user_data,
+                                     void *stream_user_data) {
+  size_t i;
+
+  (void)conn;
+  (void)stream_id;
+  (void)user_data;
+  (void)stream_user_data;
+
+  assert_size(16, ==, veccnt);
+
+  for (i = 0; i < veccnt; ++i) {
+    vec[i] = (nghttp3_vec){
+      .base = nulldata,
+      .len = i < 10 ? 5 : 3,
+    };
+  }
+
+  vec[10].len = 1000;
+
+  *pflags = NGHTTP3_DATA_FLAG_EOF;
+
+  return (nghttp3_ssize)veccnt;
+}
+
+static nghttp3_ssize file_read_data(nghttp3_conn *conn, int64_t stream_id,
+                                    nghttp3_data_buf *buf, size_t bufcnt,
+                                    uint32_t *pflags, void *user_data,
+                                    void *stream_user_data) {
+  (void)conn;
+  (void)stream_id;
+  (void)user_data;
+
+  return nghttp3_file_reader_read(stream_user_data, buf, bufcnt, pflags);
+}
+
 static int stop_sending(nghttp3_conn *conn, int64_t stream_id,
                         uint64_t app_error_code, void *user_data,
                         void *stream_user_data) {
@@ -428,6 +630,7 @@ static int deferred_consume(nghttp3_conn *conn, int64_t stream_id,
   (void)stream_user_data;
   (void)stream_id;
 
+  ++ud->deferred_consume_cb.ncalled;
   ud->deferred_consume_cb.consumed_total += consumed;
 
   return 0;
@@ -3959,148 +4162,862 @@ void test_nghttp3_conn_qpack_decoder_cancel_stream(void) {
   nghttp3_conn_del(conn);
 }
 
-void test_nghttp3_conn_just_fin(void) {
+void test_nghttp3_conn_qpack_decoder_ack_delay(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
   nghttp3_conn *conn;
+  nghttp3_settings settings;
+  nghttp3_qpack_stream_context sctx;
   nghttp3_vec vec[256];
   nghttp3_ssize sveccnt;
-  int rv;
   int64_t stream_id;
-  nghttp3_data_reader dr;
   int fin;
-  userdata ud = {0};
+  size_t i;
+  int rv;
   conn_options opts;
 
+  nghttp3_settings_default(&settings);
+  settings.qpack_decoder_ack_delay = 10 * NGHTTP3_MILLISECONDS;
+
+  /* Stream Cancellation is held back until the delay expires. */
   opts = (conn_options){
-    .user_data = &ud,
+    .settings = &settings,
   };
 
   setup_default_client_with_options(&conn, opts);
   conn_write_initial_streams(conn);
 
-  /* No DATA frame header */
-  dr.read_data = step_read_data;
-  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
-                                   &dr, NULL);
+  assert_uint64(UINT64_MAX, ==, nghttp3_conn_get_expiry(conn));
+
+  rv = nghttp3_qpack_decoder_cancel_stream(&conn->qdec, 0);
 
   assert_int(0, ==, rv);
 
-  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
-                                       nghttp3_arraylen(vec));
+  sveccnt = nghttp3_conn_writev_stream2(conn, &stream_id, &fin, vec,
+                                        nghttp3_arraylen(vec), 0);
 
-  assert_ptrdiff(1, ==, sveccnt);
-  assert_int64(0, ==, stream_id);
-  assert_true(fin);
+  assert_ptrdiff(0, ==, sveccnt);
+  assert_int64(-1, ==, stream_id);
+  assert_uint64(10 * NGHTTP3_MILLISECONDS, ==, nghttp3_conn_get_expiry(conn));
 
-  rv = nghttp3_conn_add_write_offset(
-    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  rv = nghttp3_qpack_decoder_cancel_stream(&conn->qdec, 4);
 
   assert_int(0, ==, rv);
 
-  /* Just fin */
-  ud.data.nblock = 1;
-  dr.read_data = block_then_step_read_data;
+  sveccnt = nghttp3_conn_writev_stream2(conn, &stream_id, &fin, vec,
+                                        nghttp3_arraylen(vec),
+                                        10 * NGHTTP3_MILLISECONDS - 1);
 
-  rv = nghttp3_conn_submit_request(conn, 4, req_nva, nghttp3_arraylen(req_nva),
-                                   &dr, NULL);
+  assert_ptrdiff(0, ==, sveccnt);
+  assert_int64(-1, ==, stream_id);
+  assert_uint64(10 * NGHTTP3_MILLISECONDS, ==, nghttp3_conn_get_expiry(conn));
 
-  assert_int(0, ==, rv);
+  sveccnt = nghttp3_conn_writev_stream2(conn, &stream_id, &fin, vec,
+                                        nghttp3_arraylen(vec),
+                                        10 * NGHTTP3_MILLISECONDS);
 
-  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
-                                       nghttp3_arraylen(vec));
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_int64(conn->tx.qdec->node.id, ==, stream_id);
+  assert_uint64(2, ==, nghttp3_vec_len(vec, (size_t)sveccnt));
+  assert_uint64(UINT64_MAX, ==, nghttp3_conn_get_expiry(conn));
+
+  nghttp3_conn_del(conn);
+
+  /* Large enough instructions are sent without delay. */
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+
+  for (i = 0; i < NGHTTP3_QPACK_DECODER_STREAM_BATCHLEN; ++i) {
+    rv = nghttp3_qpack_decoder_cancel_stream(&conn->qdec, (int64_t)i * 4);
+
+    assert_int(0, ==, rv);
+  }
+
+  sveccnt = nghttp3_conn_writev_stream2(conn, &stream_id, &fin, vec,
+                                        nghttp3_arraylen(vec), 0);
 
   assert_ptrdiff(1, ==, sveccnt);
-  assert_int64(4, ==, stream_id);
-  assert_false(fin);
+  assert_int64(conn->tx.qdec->node.id, ==, stream_id);
+  assert_uint64(UINT64_MAX, ==, nghttp3_conn_get_expiry(conn));
 
-  rv = nghttp3_conn_add_write_offset(
-    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  nghttp3_conn_del(conn);
+
+  /* Section Acknowledgment which increases Known Received Count is
+     sent without delay. */
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+
+  nghttp3_qpack_stream_context_init(&sctx, 0, mem);
+  sctx.ricnt = 1;
+
+  rv = nghttp3_qpack_decoder_write_section_ack(&conn->qdec, &sctx);
 
   assert_int(0, ==, rv);
 
-  /* Resume stream 4 because it was blocked */
-  nghttp3_conn_resume_stream(conn, 4);
+  sveccnt = nghttp3_conn_writev_stream2(conn, &stream_id, &fin, vec,
+                                        nghttp3_arraylen(vec), 0);
 
-  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
-                                       nghttp3_arraylen(vec));
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_int64(conn->tx.qdec->node.id, ==, stream_id);
 
-  assert_ptrdiff(0, ==, sveccnt);
-  assert_int64(4, ==, stream_id);
-  assert_true(fin);
+  nghttp3_qpack_stream_context_free(&sctx);
+  nghttp3_conn_del(conn);
 
-  rv = nghttp3_conn_add_write_offset(
-    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  /* nghttp3_conn_writev_stream never holds back instructions. */
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+
+  rv = nghttp3_qpack_decoder_cancel_stream(&conn->qdec, 0);
 
   assert_int(0, ==, rv);
 
   sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
                                        nghttp3_arraylen(vec));
 
-  assert_ptrdiff(0, ==, sveccnt);
-  assert_int64(-1, ==, stream_id);
-  assert_false(fin);
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_int64(conn->tx.qdec->node.id, ==, stream_id);
 
   nghttp3_conn_del(conn);
 }
 
-void test_nghttp3_conn_submit_response_read_blocked(void) {
+void test_nghttp3_conn_prime_qpack(void) {
+  const nghttp3_nv nva[] = {
+    MAKE_NV(":authority", "example.com"),
+    MAKE_NV("user-agent", "nghttp3"),
+    MAKE_NV("x-custom", "foo"),
+    MAKE_NV("authorization", "secret"),
+    MAKE_NV(":method", "GET"),
+  };
+  const nghttp3_nv nva2[] = {
+    MAKE_NV("x-custom", "foo"),
+    MAKE_NV("x-custom", "bar"),
+  };
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_callbacks callbacks = {0};
+  nghttp3_settings settings;
   nghttp3_conn *conn;
-  nghttp3_stream *stream;
-  int rv;
+  nghttp3_settings_entry ents[1];
+  nghttp3_frame fr;
+  uint8_t rawbuf[1024];
+  nghttp3_buf buf;
   nghttp3_vec vec[256];
-  int fin;
+  nghttp3_ssize sveccnt, nconsumed;
   int64_t stream_id;
-  nghttp3_ssize sveccnt;
-  static const nghttp3_data_reader dr = {step_then_block_read_data};
-  userdata ud;
-  conn_options opts;
+  int fin;
+  int rv;
 
-  /* Make sure that flushing serialized data while
-     NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED is set does not cause any
-     error */
-  opts = (conn_options){
-    .user_data = &ud,
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  buf.last = nghttp3_put_uvarint(buf.last, NGHTTP3_STREAM_TYPE_CONTROL);
+
+  fr.settings = (nghttp3_frame_settings){
+    .type = NGHTTP3_FRAME_SETTINGS,
+    .niv = 1,
+    .iv = ents,
+  };
+  ents[0] = (nghttp3_settings_entry){
+    .id = NGHTTP3_SETTINGS_ID_QPACK_MAX_TABLE_CAPACITY,
+    .value = 4096,
   };
 
-  setup_default_server_with_options(&conn, opts);
-  conn_write_initial_streams(conn);
-  conn->remote.bidi.max_client_streams = 1;
+  nghttp3_write_frame(&buf, &fr);
 
-  nghttp3_conn_create_stream(conn, &stream, 0);
+  setup_default_client(&conn);
+  conn_write_initial_streams(conn);
 
-  ud.data.left = 1000;
-  ud.data.step = 1000;
-  rv = nghttp3_conn_submit_response(conn, 0, resp_nva,
-                                    nghttp3_arraylen(resp_nva), &dr);
+  /* Fields are deferred until SETTINGS arrives. */
+  rv = nghttp3_conn_prime_qpack(conn, nva, nghttp3_arraylen(nva));
 
   assert_int(0, ==, rv);
+  assert_not_null(conn->tx.qpack.prime_nva);
+  assert_size(nghttp3_arraylen(nva), ==, conn->tx.qpack.prime_nvlen);
+  assert_size(0, ==, nghttp3_ringbuf_len(&conn->qenc.ctx.dtable));
 
-  for (;;) {
-    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
-                                         nghttp3_arraylen(vec));
+  rv = nghttp3_conn_prime_qpack(conn, nva, nghttp3_arraylen(nva));
 
-    assert_ptrdiff(0, <=, sveccnt);
+  assert_int(NGHTTP3_ERR_INVALID_STATE, ==, rv);
 
-    if (sveccnt <= 0) {
-      break;
-    }
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
 
-    rv = nghttp3_conn_add_write_offset(conn, stream_id, 1);
+  assert_ptrdiff(0, ==, sveccnt);
 
-    assert_int(0, ==, rv);
-  }
+  nconsumed = nghttp3_conn_read_stream2(conn, 3, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 0, 0);
 
-  nghttp3_conn_del(conn);
-}
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, nconsumed);
+  assert_null(conn->tx.qpack.prime_nva);
+  assert_size(0, ==, conn->tx.qpack.prime_nvlen);
+  /* authorization is never indexed, and :method GET is in static
+     table. */
+  assert_size(3, ==, nghttp3_ringbuf_len(&conn->qenc.ctx.dtable));
 
-void test_nghttp3_conn_submit_info(void) {
-  nghttp3_conn *conn;
-  static const nghttp3_nv nva[] = {
-    MAKE_NV("foo", "bar"),
-  };
-  nghttp3_stream *stream;
-  int rv;
-  nghttp3_vec vec[256];
-  int fin;
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(0, <, sveccnt);
+  assert_int64(conn->tx.qenc->node.id, ==, stream_id);
+  assert_false(fin);
+
+  /* After SETTINGS, fields are inserted immediately.  The field
+     already in dynamic table is skipped. */
+  rv = nghttp3_conn_prime_qpack(conn, nva2, nghttp3_arraylen(nva2));
+
+  assert_int(0, ==, rv);
+  assert_null(conn->tx.qpack.prime_nva);
+  assert_size(4, ==, nghttp3_ringbuf_len(&conn->qenc.ctx.dtable));
+
+  nghttp3_conn_del(conn);
+
+  /* QPACK encoder stream must be bound first. */
+  nghttp3_settings_default(&settings);
+
+  rv = nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, NULL);
+
+  assert_int(0, ==, rv);
+
+  rv = nghttp3_conn_prime_qpack(conn, nva, nghttp3_arraylen(nva));
+
+  assert_int(NGHTTP3_ERR_INVALID_STATE, ==, rv);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_join_cookie(void) {
+  const nghttp3_nv nva[] = {
+    MAKE_NV(":method", "GET"),
+    MAKE_NV(":scheme", "https"),
+    MAKE_NV(":authority", "example.com"),
+    MAKE_NV(":path", "/"),
+    MAKE_NV("cookie", "a=1; b=2"),
+    MAKE_NV("user-agent", "nghttp3"),
+    MAKE_NV("cookie", "c=3"),
+  };
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_callbacks callbacks = {
+    .recv_header = recv_cookie_header,
+  };
+  nghttp3_settings settings;
+  nghttp3_conn *conn;
+  nghttp3_frame fr;
+  uint8_t rawbuf[1024];
+  nghttp3_buf buf;
+  nghttp3_qpack_encoder qenc;
+  nghttp3_ssize sconsumed;
+  userdata ud;
+  conn_options opts;
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  nghttp3_qpack_encoder_init(&qenc, 0, NGHTTP3_TEST_MAP_SEED, mem);
+  nghttp3_qpack_encoder_set_crumble_cookie(&qenc, 1);
+
+  fr.headers = (nghttp3_frame_headers){
+    .type = NGHTTP3_FRAME_HEADERS,
+    .nva = (nghttp3_nv *)nva,
+    .nvlen = nghttp3_arraylen(nva),
+  };
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  /* Cookie field lines are passed separately by default. */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_settings_default(&settings);
+
+  opts = (conn_options){
+    .callbacks = &callbacks,
+    .settings = &settings,
+    .user_data = &ud,
+  };
+
+  setup_default_server_with_options(&conn, opts);
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+  assert_size(3, ==, ud.recv_cookie_cb.ncalled);
+  assert_memn_equal("c=3", nghttp3_strlen_lit("c=3"), ud.recv_cookie_cb.value,
+                    ud.recv_cookie_cb.valuelen);
+
+  nghttp3_conn_del(conn);
+
+  /* Cookie field lines are joined. */
+  memset(&ud, 0, sizeof(ud));
+  settings.qpack_decoder_join_cookie = 1;
+
+  setup_default_server_with_options(&conn, opts);
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+  assert_size(1, ==, ud.recv_cookie_cb.ncalled);
+  assert_memn_equal("a=1; b=2; c=3", nghttp3_strlen_lit("a=1; b=2; c=3"),
+                    ud.recv_cookie_cb.value, ud.recv_cookie_cb.valuelen);
+
+  nghttp3_conn_del(conn);
+
+  /* A single cookie field line is passed as is. */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  nghttp3_qpack_encoder_set_crumble_cookie(&qenc, 0);
+
+  fr.headers.nvlen = 5;
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  setup_default_server_with_options(&conn, opts);
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+  assert_size(1, ==, ud.recv_cookie_cb.ncalled);
+  assert_memn_equal("a=1; b=2", nghttp3_strlen_lit("a=1; b=2"),
+                    ud.recv_cookie_cb.value, ud.recv_cookie_cb.valuelen);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+void test_nghttp3_conn_recv_header_fragment(void) {
+  uint8_t value[600];
+  nghttp3_nv nva[] = {
+    MAKE_NV(":method", "GET"),
+    MAKE_NV(":scheme", "https"),
+    MAKE_NV(":authority", "example.com"),
+    MAKE_NV(":path", "/"),
+    MAKE_NV("x-large", ""),
+    MAKE_NV("user-agent", "nghttp3"),
+  };
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_callbacks callbacks = {
+    .recv_header_fragment = recv_header_fragment,
+  };
+  nghttp3_settings settings;
+  nghttp3_conn *conn;
+  nghttp3_frame fr;
+  uint8_t rawbuf[1024];
+  nghttp3_buf buf;
+  nghttp3_qpack_encoder qenc;
+  nghttp3_ssize sconsumed;
+  userdata ud;
+  conn_options opts;
+  size_t i;
+
+  for (i = 0; i < sizeof(value); ++i) {
+    value[i] = i & 1 ? '}' : '{';
+  }
+
+  nva[4].value = value;
+  nva[4].valuelen = sizeof(value);
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  nghttp3_qpack_encoder_init(&qenc, 0, NGHTTP3_TEST_MAP_SEED, mem);
+
+  fr.headers = (nghttp3_frame_headers){
+    .type = NGHTTP3_FRAME_HEADERS,
+    .nva = nva,
+    .nvlen = nghttp3_arraylen(nva),
+  };
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  nghttp3_settings_default(&settings);
+  settings.qpack_decoder_value_fragment_size = 100;
+
+  opts = (conn_options){
+    .callbacks = &callbacks,
+    .settings = &settings,
+    .user_data = &ud,
+  };
+
+  /* A large value is delivered in fragments. */
+  memset(&ud, 0, sizeof(ud));
+
+  setup_default_server_with_options(&conn, opts);
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+  assert_size(6, ==, ud.recv_header_fragment_cb.ncalled);
+  assert_size(1, ==, ud.recv_header_fragment_cb.nfin);
+  assert_memn_equal(value, sizeof(value), ud.recv_header_fragment_cb.value,
+                    ud.recv_header_fragment_cb.valuelen);
+
+  nghttp3_conn_del(conn);
+
+  /* Fragmentation is disabled. */
+  memset(&ud, 0, sizeof(ud));
+  settings.qpack_decoder_value_fragment_size = 0;
+
+  setup_default_server_with_options(&conn, opts);
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+  assert_size(0, ==, ud.recv_header_fragment_cb.ncalled);
+
+  nghttp3_conn_del(conn);
+
+  /* A large value which ends with white space is malformed. */
+  memset(&ud, 0, sizeof(ud));
+  settings.qpack_decoder_value_fragment_size = 100;
+  value[sizeof(value) - 1] = ' ';
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  setup_default_server_with_options(&conn, opts);
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff(NGHTTP3_ERR_MALFORMED_HTTP_HEADER, ==, sconsumed);
+  assert_size(5, ==, ud.recv_header_fragment_cb.ncalled);
+  assert_size(0, ==, ud.recv_header_fragment_cb.nfin);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+void test_nghttp3_conn_just_fin(void) {
+  nghttp3_conn *conn;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  nghttp3_data_reader dr;
+  int fin;
+  userdata ud = {0};
+  conn_options opts;
+
+  opts = (conn_options){
+    .user_data = &ud,
+  };
+
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+
+  /* No DATA frame header */
+  dr.read_data = step_read_data;
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
+                                   &dr, NULL);
+
+  assert_int(0, ==, rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_int64(0, ==, stream_id);
+  assert_true(fin);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  assert_int(0, ==, rv);
+
+  /* Just fin */
+  ud.data.nblock = 1;
+  dr.read_data = block_then_step_read_data;
+
+  rv = nghttp3_conn_submit_request(conn, 4, req_nva, nghttp3_arraylen(req_nva),
+                                   &dr, NULL);
+
+  assert_int(0, ==, rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_int64(4, ==, stream_id);
+  assert_false(fin);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  assert_int(0, ==, rv);
+
+  /* Resume stream 4 because it was blocked */
+  nghttp3_conn_resume_stream(conn, 4);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(0, ==, sveccnt);
+  assert_int64(4, ==, stream_id);
+  assert_true(fin);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  assert_int(0, ==, rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(0, ==, sveccnt);
+  assert_int64(-1, ==, stream_id);
+  assert_false(fin);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_preamble(void) {
+  static const uint8_t origin[] = "\x0\x13"
+                                  "https://example.com";
+  const nghttp3_vec origin_list = {
+    .base = (uint8_t *)origin,
+    .len = nghttp3_strlen_lit(origin),
+  };
+  nghttp3_callbacks callbacks = {0};
+  nghttp3_conn *conn;
+  nghttp3_conn_factory *factory;
+  nghttp3_settings settings;
+  nghttp3_preamble *preamble;
+  nghttp3_vec vec[16];
+  nghttp3_ssize sveccnt;
+  int64_t stream_id;
+  int fin;
+  uint8_t expected[256];
+  size_t expectedlen = 0;
+  const uint8_t *shared;
+  conn_options opts;
+  nghttp3_ssize i;
+  int rv;
+
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+  settings.h3_datagram = 1;
+  settings.origin_list = &origin_list;
+
+  opts = (conn_options){
+    .settings = &settings,
+  };
+
+  /* Serialize the preamble without sharing it. */
+  setup_default_server_with_options(&conn, opts);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(1, <, sveccnt);
+  assert_int64(conn->tx.ctrl->node.id, ==, stream_id);
+
+  for (i = 0; i < sveccnt; ++i) {
+    memcpy(expected + expectedlen, vec[i].base, vec[i].len);
+    expectedlen += vec[i].len;
+  }
+
+  nghttp3_conn_del(conn);
+
+  rv = nghttp3_preamble_new(&preamble, &settings, NULL);
+
+  assert_int(0, ==, rv);
+
+  settings.preamble = preamble;
+
+  /* The connections send the same bytes from the shared buffer. */
+  setup_default_server_with_options(&conn, opts);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_int64(conn->tx.ctrl->node.id, ==, stream_id);
+  assert_false(fin);
+  assert_memn_equal(expected, expectedlen, vec[0].base, vec[0].len);
+
+  shared = vec[0].base;
+
+  rv = nghttp3_conn_add_write_offset(conn, stream_id, vec[0].len);
+
+  assert_int(0, ==, rv);
+
+  rv = nghttp3_conn_add_ack_offset(conn, stream_id, vec[0].len);
+
+  assert_int(0, ==, rv);
+
+  nghttp3_conn_del(conn);
+
+  setup_default_server_with_options(&conn, opts);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_ptr_equal(shared, vec[0].base);
+  assert_size(expectedlen, ==, vec[0].len);
+
+  nghttp3_conn_del(conn);
+
+  /* The preamble which advertises the different values is
+     rejected. */
+  settings.qpack_blocked_streams = 99;
+
+  rv = nghttp3_conn_server_new(&conn, &callbacks, &settings, NULL, NULL);
+
+  assert_int(NGHTTP3_ERR_INVALID_ARGUMENT, ==, rv);
+
+  rv = nghttp3_conn_factory_new(&factory, /* server = */ 1, &callbacks,
+                                &settings, 1, NULL);
+
+  assert_int(NGHTTP3_ERR_INVALID_ARGUMENT, ==, rv);
+
+  /* Client does not send ORIGIN frame. */
+  settings.qpack_blocked_streams = 100;
+
+  rv = nghttp3_conn_client_new(&conn, &callbacks, &settings, NULL, NULL);
+
+  assert_int(NGHTTP3_ERR_INVALID_ARGUMENT, ==, rv);
+
+  rv = nghttp3_conn_factory_new(&factory, /* server = */ 0, &callbacks,
+                                &settings, 1, NULL);
+
+  assert_int(NGHTTP3_ERR_INVALID_ARGUMENT, ==, rv);
+
+  nghttp3_preamble_del(preamble);
+}
+
+static void conn_factory_read_request(nghttp3_conn *conn) {
+  const nghttp3_nv nva[] = {
+    MAKE_NV(":method", "GET"),
+    MAKE_NV(":scheme", "https"),
+    MAKE_NV(":authority", "example.com"),
+    MAKE_NV(":path", "/"),
+  };
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  uint8_t rawbuf[1024];
+  nghttp3_buf buf;
+  nghttp3_frame fr;
+  nghttp3_qpack_encoder qenc;
+  nghttp3_ssize sconsumed;
+  int rv;
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  nghttp3_qpack_encoder_init(&qenc, 0, NGHTTP3_TEST_MAP_SEED, mem);
+
+  fr.headers = (nghttp3_frame_headers){
+    .type = NGHTTP3_FRAME_HEADERS,
+    .nva = (nghttp3_nv *)nva,
+    .nvlen = nghttp3_arraylen(nva),
+  };
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  rv = nghttp3_conn_bind_control_stream(conn, 3);
+
+  assert_int(0, ==, rv);
+
+  rv = nghttp3_conn_bind_qpack_streams(conn, 7, 11);
+
+  assert_int(0, ==, rv);
+
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+  assert_not_null(nghttp3_conn_find_stream(conn, 0));
+
+  conn_write_initial_streams(conn);
+
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+void test_nghttp3_conn_factory(void) {
+  nghttp3_conn_factory *factory;
+  nghttp3_conn *conn, *conn2, *shell;
+  nghttp3_callbacks callbacks = {
+    .begin_headers = begin_headers,
+    .recv_header = recv_header,
+    .end_headers = end_headers,
+  };
+  nghttp3_settings settings;
+  userdata ud, ud2;
+  int rv;
+
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+
+  rv = nghttp3_conn_factory_new(&factory, /* server = */ 1, &callbacks,
+                                &settings, 1, NULL);
+
+  assert_int(0, ==, rv);
+  assert_size(1, ==, factory->nshells);
+
+  shell = factory->shells;
+
+  /* The pooled shell is used. */
+  rv = nghttp3_conn_factory_conn_new(factory, &conn, &ud);
+
+  assert_int(0, ==, rv);
+  assert_ptr_equal(shell, conn);
+  assert_size(0, ==, factory->nshells);
+  assert_ptr_equal(&ud, conn->user_data);
+  assert_true(conn->server);
+  assert_size(4096, ==, conn->local.settings.qpack_max_dtable_capacity);
+
+  conn_factory_read_request(conn);
+
+  /* The shell is returned to the pool. */
+  nghttp3_conn_del(conn);
+
+  assert_size(1, ==, factory->nshells);
+  assert_ptr_equal(shell, factory->shells);
+
+  /* The recycled shell is reset. */
+  rv = nghttp3_conn_factory_conn_new(factory, &conn, &ud2);
+
+  assert_int(0, ==, rv);
+  assert_ptr_equal(shell, conn);
+  assert_ptr_equal(&ud2, conn->user_data);
+  assert_null(conn->tx.ctrl);
+  assert_null(conn->tx.qenc);
+  assert_null(conn->tx.qdec);
+  assert_size(0, ==, nghttp3_map_size(&conn->streams));
+  assert_int64(-4, ==, conn->rx.max_stream_id_bidi);
+  assert_uint64(NGHTTP3_VARINT_MAX, ==,
+                conn->remote.settings.max_field_section_size);
+
+  conn_factory_read_request(conn);
+
+  /* The pool is empty, and a new shell is allocated. */
+  rv = nghttp3_conn_factory_conn_new(factory, &conn2, &ud);
+
+  assert_int(0, ==, rv);
+  assert_true(shell != conn2);
+
+  conn_factory_read_request(conn2);
+
+  nghttp3_conn_del(conn2);
+
+  assert_size(1, ==, factory->nshells);
+  assert_ptr_equal(conn2, factory->shells);
+
+  /* The pool is full, and the connection is freed. */
+  nghttp3_conn_del(conn);
+
+  assert_size(1, ==, factory->nshells);
+  assert_ptr_equal(conn2, factory->shells);
+
+  nghttp3_conn_factory_del(factory);
+}
+
+void test_nghttp3_conn_factory_urgency_weights(void) {
+  nghttp3_conn_factory *factory;
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks = {0};
+  nghttp3_settings settings;
+  uint32_t weights[NGHTTP3_URGENCY_LEVELS];
+  userdata ud;
+  size_t i;
+  int rv;
+
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    weights[i] = (uint32_t)(i + 1);
+  }
+
+  nghttp3_settings_default(&settings);
+  settings.urgency_weights = weights;
+
+  rv = nghttp3_conn_factory_new(&factory, /* server = */ 1, &callbacks,
+                                &settings, 1, NULL);
+
+  assert_int(0, ==, rv);
+
+  /* The weights are copied, and the array does not have to outlive
+     the call. */
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    weights[i] = 100;
+  }
+
+  for (i = 0; i < 2; ++i) {
+    rv = nghttp3_conn_factory_conn_new(factory, &conn, &ud);
+
+    assert_int(0, ==, rv);
+    assert_true(conn->flags & NGHTTP3_CONN_FLAG_WEIGHTED_SCHED);
+    assert_null(conn->local.settings.urgency_weights);
+    assert_uint64(1 * NGHTTP3_STREAM_MIN_WRITELEN, ==, conn->sched[0].quantum);
+    assert_uint64(NGHTTP3_URGENCY_LEVELS * NGHTTP3_STREAM_MIN_WRITELEN, ==,
+                  conn->sched[NGHTTP3_URGENCY_LEVELS - 1].quantum);
+
+    nghttp3_conn_del(conn);
+  }
+
+  nghttp3_conn_factory_del(factory);
+}
+
+void test_nghttp3_conn_submit_response_read_blocked(void) {
+  nghttp3_conn *conn;
+  nghttp3_stream *stream;
+  int rv;
+  nghttp3_vec vec[256];
+  int fin;
+  int64_t stream_id;
+  nghttp3_ssize sveccnt;
+  static const nghttp3_data_reader dr = {step_then_block_read_data};
+  userdata ud;
+  conn_options opts;
+
+  /* Make sure that flushing serialized data while
+     NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED is set does not cause any
+     error */
+  opts = (conn_options){
+    .user_data = &ud,
+  };
+
+  setup_default_server_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+  conn->remote.bidi.max_client_streams = 1;
+
+  nghttp3_conn_create_stream(conn, &stream, 0);
+
+  ud.data.left = 1000;
+  ud.data.step = 1000;
+  rv = nghttp3_conn_submit_response(conn, 0, resp_nva,
+                                    nghttp3_arraylen(resp_nva), &dr);
+
+  assert_int(0, ==, rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    assert_ptrdiff(0, <=, sveccnt);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(conn, stream_id, 1);
+
+    assert_int(0, ==, rv);
+  }
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_submit_info(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_nv nva[] = {
+    MAKE_NV("foo", "bar"),
+  };
+  nghttp3_stream *stream;
+  int rv;
+  nghttp3_vec vec[256];
+  int fin;
   int64_t stream_id;
   nghttp3_ssize sveccnt;
 
@@ -4659,9 +5576,14 @@ void test_nghttp3_conn_priority_update(void) {
   };
   size_t i;
   uint64_t payloadlen;
+  uint8_t pri_value[NGHTTP3_PRI_FIELDBUFLEN + 1];
 
   nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
 
+  memcpy(pri_value, "u=1,", strlen("u=1,"));
+  memset(pri_value + strlen("u=1,"), 'a',
+         sizeof(pri_value) - strlen("u=1,"));
+
   /* Receive PRIORITY_UPDATE and stream has not been created yet */
   setup_default_server(&conn);
   nghttp3_conn_set_max_client_streams_bidi(conn, 1);
@@ -4809,6 +5731,52 @@ void test_nghttp3_conn_priority_update(void) {
 
   nghttp3_conn_del(conn);
 
+  /* Receive multiple PRIORITY_UPDATE frames for a stream in a single
+     input.  Only the last one takes effect. */
+  nghttp3_buf_reset(&buf);
+  setup_default_server(&conn);
+  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+
+  rv = nghttp3_conn_create_stream(conn, &stream, 0);
+
+  assert_int(0, ==, rv);
+
+  buf.last = nghttp3_put_uvarint(buf.last, NGHTTP3_STREAM_TYPE_CONTROL);
+
+  fr.settings = (nghttp3_frame_settings){
+    .type = NGHTTP3_FRAME_SETTINGS,
+  };
+
+  nghttp3_write_frame(&buf, &fr);
+
+  fr.priority_update = (nghttp3_frame_priority_update){
+    .type = NGHTTP3_FRAME_PRIORITY_UPDATE,
+    .data = (uint8_t *)"u=6",
+    .datalen = strlen("u=6"),
+  };
+
+  nghttp3_write_frame(&buf, &fr);
+
+  fr.priority_update = (nghttp3_frame_priority_update){
+    .type = NGHTTP3_FRAME_PRIORITY_UPDATE,
+    .data = (uint8_t *)"u=2,i",
+    .datalen = strlen("u=2,i"),
+  };
+
+  nghttp3_write_frame(&buf, &fr);
+
+  nconsumed = nghttp3_conn_read_stream2(conn, 2, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 0, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, nconsumed);
+  assert_true(stream->flags & NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_RECVED);
+  assert_false(stream->flags & NGHTTP3_STREAM_FLAG_PRIORITY_UPDATE_PENDING);
+  assert_null(conn->rx.pri_update_head);
+  assert_uint32(2, ==, stream->node.pri.urgency);
+  assert_uint8(1, ==, stream->node.pri.inc);
+
+  nghttp3_conn_del(conn);
+
   /* Receive PRIORITY_UPDATE against non-existent push_promise */
   nghttp3_buf_reset(&buf);
   setup_default_server(&conn);
@@ -4837,8 +5805,8 @@ void test_nghttp3_conn_priority_update(void) {
 
   nghttp3_conn_del(conn);
 
-  /* Receive PRIORITY_UPDATE and its Priority Field Value is larger
-     than buffer */
+  /* Receive fragmented PRIORITY_UPDATE and its Priority Field Value
+     is larger than buffer */
   nghttp3_buf_reset(&buf);
   setup_default_server(&conn);
   nghttp3_conn_set_max_client_streams_bidi(conn, 1);
@@ -4858,10 +5826,10 @@ void test_nghttp3_conn_priority_update(void) {
   };
 
   nghttp3_frame_write_priority_update_len(&payloadlen, &fr.priority_update);
-  buf.last = nghttp3_frame_write_priority_update(buf.last, &fr.priority_update,
-                                                 payloadlen + 10);
-  memset(buf.last, ' ', 10);
-  buf.last += 10;
+  buf.last = nghttp3_frame_write_priority_update(
+    buf.last, &fr.priority_update, payloadlen + NGHTTP3_PRI_FIELDBUFLEN);
+  memset(buf.last, ' ', NGHTTP3_PRI_FIELDBUFLEN);
+  buf.last += NGHTTP3_PRI_FIELDBUFLEN;
 
   /* Make sure boundary check works when frame is fragmented. */
   nconsumed =
@@ -4870,8 +5838,7 @@ void test_nghttp3_conn_priority_update(void) {
   stream = nghttp3_conn_find_stream(conn, 2);
 
   assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf) - 10, ==, nconsumed);
-  assert_int(NGHTTP3_CTRL_STREAM_STATE_PRIORITY_UPDATE, ==,
-             stream->rstate.state);
+  assert_int(NGHTTP3_CTRL_STREAM_STATE_IGN_FRAME, ==, stream->rstate.state);
 
   nconsumed = nghttp3_conn_read_stream2(conn, 2, buf.pos + nconsumed, 10,
                                         /* fin = */ 0, 0);
@@ -4882,40 +5849,57 @@ void test_nghttp3_conn_priority_update(void) {
 
   nghttp3_conn_del(conn);
 
-  /* Ignore PRIORITY_UPDATE frame that has priority field longer than
-     buffer size.  */
-  nghttp3_buf_reset(&buf);
-  setup_default_server(&conn);
-  nghttp3_conn_set_max_client_streams_bidi(conn, 1);
+  /* PRIORITY_UPDATE frame that has priority field longer than
+     buffer size is ignored whether it is fragmented or not. */
+  for (i = 0; i < 2; ++i) {
+    nghttp3_buf_reset(&buf);
+    setup_default_server(&conn);
+    nghttp3_conn_set_max_client_streams_bidi(conn, 1);
 
-  buf.last = nghttp3_put_uvarint(buf.last, NGHTTP3_STREAM_TYPE_CONTROL);
+    buf.last = nghttp3_put_uvarint(buf.last, NGHTTP3_STREAM_TYPE_CONTROL);
 
-  fr.settings = (nghttp3_frame_settings){
-    .type = NGHTTP3_FRAME_SETTINGS,
-  };
+    fr.settings = (nghttp3_frame_settings){
+      .type = NGHTTP3_FRAME_SETTINGS,
+    };
 
-  nghttp3_write_frame(&buf, &fr);
+    nghttp3_write_frame(&buf, &fr);
 
-  fr.priority_update = (nghttp3_frame_priority_update){
-    .type = NGHTTP3_FRAME_PRIORITY_UPDATE,
-    .data = (uint8_t *)"u=1,aaaaa",
-    .datalen = strlen("u=1,aaaaa"),
-  };
+    fr.priority_update = (nghttp3_frame_priority_update){
+      .type = NGHTTP3_FRAME_PRIORITY_UPDATE,
+      .data = pri_value,
+      .datalen = NGHTTP3_PRI_FIELDBUFLEN + 1,
+    };
 
-  assert_size(sizeof(conn->rx.pri_fieldbuf), <, fr.priority_update.datalen);
+    nghttp3_write_frame(&buf, &fr);
 
-  nghttp3_write_frame(&buf, &fr);
+    if (i == 0) {
+      nconsumed = nghttp3_conn_read_stream2(
+        conn, 2, buf.pos, nghttp3_buf_len(&buf), /* fin = */ 0, 0);
 
-  nconsumed = nghttp3_conn_read_stream2(conn, 2, buf.pos, nghttp3_buf_len(&buf),
-                                        /* fin = */ 0, 0);
+      assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, nconsumed);
+    } else {
+      nconsumed = nghttp3_conn_read_stream2(
+        conn, 2, buf.pos, nghttp3_buf_len(&buf) / 2, /* fin = */ 0, 0);
 
-  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, nconsumed);
+      assert_ptrdiff((nghttp3_ssize)(nghttp3_buf_len(&buf) / 2), ==,
+                     nconsumed);
 
-  stream = nghttp3_conn_find_stream(conn, 0);
+      nconsumed = nghttp3_conn_read_stream2(
+        conn, 2, buf.pos + nconsumed,
+        nghttp3_buf_len(&buf) - (size_t)nconsumed, /* fin = */ 0, 0);
+
+      assert_ptrdiff(
+        (nghttp3_ssize)(nghttp3_buf_len(&buf) - nghttp3_buf_len(&buf) / 2),
+        ==, nconsumed);
+    }
+
+    stream = nghttp3_conn_find_stream(conn, 2);
 
-  assert_null(stream);
+    assert_int(NGHTTP3_CTRL_STREAM_STATE_FRAME_TYPE, ==, stream->rstate.state);
+    assert_null(nghttp3_conn_find_stream(conn, 0));
 
-  nghttp3_conn_del(conn);
+    nghttp3_conn_del(conn);
+  }
 
   /* Process PRIORITY_UPDATE frame that has priority field equal to
      buffer size.  */
@@ -4933,12 +5917,10 @@ void test_nghttp3_conn_priority_update(void) {
 
   fr.priority_update = (nghttp3_frame_priority_update){
     .type = NGHTTP3_FRAME_PRIORITY_UPDATE,
-    .data = (uint8_t *)"u=1,aaaa",
-    .datalen = strlen("u=1,aaaa"),
+    .data = pri_value,
+    .datalen = NGHTTP3_PRI_FIELDBUFLEN,
   };
 
-  assert_size(sizeof(conn->rx.pri_fieldbuf), ==, fr.priority_update.datalen);
-
   nghttp3_write_frame(&buf, &fr);
 
   nconsumed = nghttp3_conn_read_stream2(conn, 2, buf.pos, nghttp3_buf_len(&buf),
@@ -4970,8 +5952,8 @@ void test_nghttp3_conn_priority_update(void) {
 
   fr.priority_update = (nghttp3_frame_priority_update){
     .type = NGHTTP3_FRAME_PRIORITY_UPDATE,
-    .data = (uint8_t *)"u=1,aaaa",
-    .datalen = strlen("u=1,aaaa"),
+    .data = pri_value,
+    .datalen = NGHTTP3_PRI_FIELDBUFLEN,
   };
 
   nghttp3_write_frame(&buf, &fr);
@@ -5285,68 +6267,454 @@ void test_nghttp3_conn_set_stream_priority(void) {
 
   assert_int(0, ==, rv);
 
-  pri.urgency = 2;
-  pri.inc = 1;
+  pri.urgency = 2;
+  pri.inc = 1;
+
+#define NGHTTP3_PRI_DATA "u=2,i"
+  rv = nghttp3_conn_set_client_stream_priority(
+    conn, 0, (const uint8_t *)NGHTTP3_PRI_DATA, strlen(NGHTTP3_PRI_DATA));
+
+  assert_int(0, ==, rv);
+
+  stream = nghttp3_conn_find_stream(conn, 2);
+
+  for (i = 0; i < nghttp3_ringbuf_len(&stream->frq); ++i) {
+    fr = nghttp3_ringbuf_get(&stream->frq, i);
+    if (fr->hd.type != NGHTTP3_FRAME_PRIORITY_UPDATE) {
+      continue;
+    }
+
+    assert_size(strlen(NGHTTP3_PRI_DATA), ==, fr->priority_update.datalen);
+    assert_memory_equal(strlen(NGHTTP3_PRI_DATA), NGHTTP3_PRI_DATA,
+                        fr->priority_update.data);
+
+    break;
+  }
+#undef NGHTTP3_PRI_DATA
+
+  assert_size(nghttp3_ringbuf_len(&stream->frq), >, i);
+
+  nghttp3_conn_del(conn);
+
+  /* Updating priority of stream which does not exist is an error */
+  setup_default_client(&conn);
+
+  pri.urgency = 2;
+  pri.inc = 1;
+
+#define NGHTTP3_PRI_DATA "u=2,i"
+  rv = nghttp3_conn_set_client_stream_priority(
+    conn, 0, (const uint8_t *)NGHTTP3_PRI_DATA, strlen(NGHTTP3_PRI_DATA));
+#undef NGHTTP3_PRI_DATA
+
+  assert_int(NGHTTP3_ERR_STREAM_NOT_FOUND, ==, rv);
+
+  nghttp3_conn_del(conn);
+
+  /* Update stream priority by server */
+  setup_default_server(&conn);
+
+  rv = nghttp3_conn_create_stream(conn, &stream, 0);
+
+  assert_int(0, ==, rv);
+
+  pri.urgency = 4;
+  pri.inc = 0;
+
+  rv = nghttp3_conn_set_server_stream_priority(conn, 0, &pri);
+
+  assert_int(0, ==, rv);
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  assert_true(stream->flags & NGHTTP3_STREAM_FLAG_SERVER_PRIORITY_SET);
+  assert_true(nghttp3_pri_eq(&pri, &stream->node.pri));
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_weighted_sched(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_data_reader dr = {
+    .read_data = step_read_data,
+  };
+  static const uint32_t weights[NGHTTP3_URGENCY_LEVELS] = {3, 1, 1, 1,
+                                                           1, 1, 1, 1};
+  nghttp3_settings settings;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  uint64_t len, nwrite[2];
+  userdata ud = {0};
+  int fin;
+  size_t i, j;
+  nghttp3_stream *stream;
+  conn_options opts;
+
+  for (i = 0; i < 2; ++i) {
+    nghttp3_settings_default(&settings);
+    /* The first iteration uses strict priority. */
+    settings.urgency_weights = i == 0 ? NULL : weights;
+
+    opts = (conn_options){
+      .settings = &settings,
+      .user_data = &ud,
+    };
+
+    setup_default_client_with_options(&conn, opts);
+    conn_write_initial_streams(conn);
+
+    ud.data.left = SIZE_MAX;
+    ud.data.step = 1000;
+
+    rv = nghttp3_conn_submit_request(conn, 0, req_nva,
+                                     nghttp3_arraylen(req_nva), &dr, NULL);
+
+    assert_int(0, ==, rv);
+
+    rv = nghttp3_conn_submit_request(conn, 4, req_nva,
+                                     nghttp3_arraylen(req_nva), &dr, NULL);
+
+    assert_int(0, ==, rv);
+
+    /* Stream 0 is the most urgent, and stream 4 is the least
+       urgent. */
+    stream = nghttp3_conn_find_stream(conn, 0);
+    nghttp3_conn_unschedule_stream(conn, stream);
+    stream->node.pri.urgency = NGHTTP3_URGENCY_HIGH;
+    rv = nghttp3_conn_schedule_stream(conn, stream);
+
+    assert_int(0, ==, rv);
+
+    stream = nghttp3_conn_find_stream(conn, 4);
+    nghttp3_conn_unschedule_stream(conn, stream);
+    stream->node.pri.urgency = NGHTTP3_URGENCY_LOW;
+    rv = nghttp3_conn_schedule_stream(conn, stream);
+
+    assert_int(0, ==, rv);
+
+    nwrite[0] = nwrite[1] = 0;
+
+    for (j = 0; j < 200; ++j) {
+      sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec, 4);
+
+      assert_ptrdiff(0, <, sveccnt);
+
+      len = nghttp3_vec_len(vec, (size_t)sveccnt);
+
+      rv = nghttp3_conn_add_write_offset(conn, stream_id, (size_t)len);
+
+      assert_int(0, ==, rv);
+
+      nwrite[stream_id == 4] += len;
+    }
+
+    if (i == 0) {
+      assert_uint64(0, ==, nwrite[1]);
+    } else {
+      /* Both streams get the share proportional to their weights. */
+      assert_uint64(0, <, nwrite[1]);
+      assert_uint64(nwrite[0], >, nwrite[1] * 2);
+      assert_uint64(nwrite[0], <, nwrite[1] * 4);
+    }
+
+    nghttp3_conn_del(conn);
+  }
+}
+
+void test_nghttp3_conn_writev_stream_hint(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_data_reader dr = {
+    .read_data = step_read_data,
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  userdata ud = {0};
+  int fin;
+  nghttp3_stream *stream;
+  nghttp3_writev_hint hint;
+  conn_options opts = {
+    .user_data = &ud,
+  };
+
+  setup_default_client_with_options(&conn, opts);
+
+  ud.data.left = 2000;
+  ud.data.step = 1000;
+
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva,
+                                   nghttp3_arraylen(req_nva), &dr, NULL);
+
+  assert_int(0, ==, rv);
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+  nghttp3_conn_unschedule_stream(conn, stream);
+  stream->node.pri = (nghttp3_pri){
+    .urgency = 1,
+    .inc = 1,
+  };
+  rv = nghttp3_conn_schedule_stream(conn, stream);
+
+  assert_int(0, ==, rv);
+
+  /* Control stream is reported as the most urgent stream. */
+  hint = (nghttp3_writev_hint){
+    .pri.urgency = NGHTTP3_URGENCY_LOW,
+    .more = 1,
+  };
+
+  sveccnt = nghttp3_conn_writev_stream_hint(
+    conn, &stream_id, &fin, vec, nghttp3_arraylen(vec), 0, &hint);
+
+  assert_ptrdiff(0, <, sveccnt);
+  assert_int64(conn->tx.ctrl->node.id, ==, stream_id);
+  assert_uint32(NGHTTP3_URGENCY_HIGH, ==, hint.pri.urgency);
+  assert_uint8(0, ==, hint.pri.inc);
+  assert_uint8(0, ==, hint.more);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  assert_int(0, ==, rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream_hint(
+      conn, &stream_id, &fin, vec, nghttp3_arraylen(vec), 0, &hint);
+
+    assert_ptrdiff(0, <, sveccnt);
+
+    if (stream_id == 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+      conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    assert_int(0, ==, rv);
+  }
+
+  /* Request stream has more data than a single vector. */
+  sveccnt = nghttp3_conn_writev_stream_hint(conn, &stream_id, &fin, vec, 1,
+                                            0, &hint);
+
+  assert_ptrdiff(1, ==, sveccnt);
+  assert_int64(0, ==, stream_id);
+  assert_uint32(1, ==, hint.pri.urgency);
+  assert_uint8(1, ==, hint.pri.inc);
+  assert_uint8(1, ==, hint.more);
+
+  rv = nghttp3_conn_add_write_offset(conn, stream_id, (size_t)vec[0].len);
+
+  assert_int(0, ==, rv);
+
+  /* The rest of request stream is returned at once. */
+  sveccnt = nghttp3_conn_writev_stream_hint(
+    conn, &stream_id, &fin, vec, nghttp3_arraylen(vec), 0, &hint);
+
+  assert_ptrdiff(0, <, sveccnt);
+  assert_int64(0, ==, stream_id);
+  assert_true(fin);
+  assert_uint8(0, ==, hint.more);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  assert_int(0, ==, rv);
+
+  /* hint is left untouched if there is nothing to write. */
+  hint.more = 1;
+
+  sveccnt = nghttp3_conn_writev_stream_hint(
+    conn, &stream_id, &fin, vec, nghttp3_arraylen(vec), 0, &hint);
+
+  assert_ptrdiff(0, ==, sveccnt);
+  assert_int64(-1, ==, stream_id);
+  assert_uint8(1, ==, hint.more);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_stream_writable(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_callbacks callbacks = {
+    .stream_writable = stream_writable,
+  };
+  static const nghttp3_data_reader dr = {
+    .read_data = block_then_step_read_data,
+  };
+  static const uint8_t pri_value[] = "u=1";
+  const nghttp3_nv prime_nva[] = {
+    MAKE_NV("x-custom", "foo"),
+    MAKE_NV("x-custom", "bar"),
+  };
+  nghttp3_settings_entry ents[1];
+  nghttp3_frame fr;
+  uint8_t rawbuf[1024];
+  nghttp3_buf buf;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt, nconsumed;
+  int rv;
+  int64_t stream_id;
+  userdata ud = {0};
+  int fin;
+  conn_options opts = {
+    .callbacks = &callbacks,
+    .user_data = &ud,
+  };
+
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+
+  assert_size(0, ==, ud.stream_writable_cb.ncalled);
+
+  ud.data.nblock = 1;
+  ud.data.left = 1000;
+  ud.data.step = 1000;
+
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva,
+                                   nghttp3_arraylen(req_nva), &dr, NULL);
+
+  assert_int(0, ==, rv);
+  assert_size(1, ==, ud.stream_writable_cb.ncalled);
+  assert_int64(0, ==, ud.stream_writable_cb.stream_id);
+
+  /* HEADERS is sent, and then read_data blocks. */
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_int64(0, ==, stream_id);
+  assert_ptrdiff(1, ==, sveccnt);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  assert_int(0, ==, rv);
+
+  rv = nghttp3_conn_resume_stream(conn, 0);
+
+  assert_int(0, ==, rv);
+  assert_size(2, ==, ud.stream_writable_cb.ncalled);
+
+  /* Resuming scheduled stream does not call the callback. */
+  rv = nghttp3_conn_resume_stream(conn, 0);
+
+  assert_int(0, ==, rv);
+  assert_size(2, ==, ud.stream_writable_cb.ncalled);
+
+  nghttp3_conn_block_stream(conn, 0);
+  rv = nghttp3_conn_unblock_stream(conn, 0);
+
+  assert_int(0, ==, rv);
+  assert_size(3, ==, ud.stream_writable_cb.ncalled);
+  assert_int64(0, ==, ud.stream_writable_cb.stream_id);
+
+  /* Control stream */
+  rv = nghttp3_conn_submit_shutdown_notice(conn);
+
+  assert_int(0, ==, rv);
+  assert_size(4, ==, ud.stream_writable_cb.ncalled);
+  assert_int64(conn->tx.ctrl->node.id, ==, ud.stream_writable_cb.stream_id);
+
+  rv = nghttp3_conn_shutdown(conn);
+
+  assert_int(0, ==, rv);
+  assert_size(4, ==, ud.stream_writable_cb.ncalled);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_int64(conn->tx.ctrl->node.id, ==, stream_id);
+  assert_ptrdiff(0, <, sveccnt);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  assert_int(0, ==, rv);
+
+  /* Blocked control stream is notified when it is unblocked. */
+  nghttp3_conn_block_stream(conn, conn->tx.ctrl->node.id);
 
-#define NGHTTP3_PRI_DATA "u=2,i"
-  rv = nghttp3_conn_set_client_stream_priority(
-    conn, 0, (const uint8_t *)NGHTTP3_PRI_DATA, strlen(NGHTTP3_PRI_DATA));
+  rv = nghttp3_conn_set_client_stream_priority(conn, 0, pri_value,
+                                               sizeof(pri_value) - 1);
 
   assert_int(0, ==, rv);
+  assert_size(4, ==, ud.stream_writable_cb.ncalled);
 
-  stream = nghttp3_conn_find_stream(conn, 2);
+  rv = nghttp3_conn_unblock_stream(conn, conn->tx.ctrl->node.id);
 
-  for (i = 0; i < nghttp3_ringbuf_len(&stream->frq); ++i) {
-    fr = nghttp3_ringbuf_get(&stream->frq, i);
-    if (fr->hd.type != NGHTTP3_FRAME_PRIORITY_UPDATE) {
-      continue;
-    }
+  assert_int(0, ==, rv);
+  assert_size(5, ==, ud.stream_writable_cb.ncalled);
+  assert_int64(conn->tx.ctrl->node.id, ==, ud.stream_writable_cb.stream_id);
 
-    assert_size(strlen(NGHTTP3_PRI_DATA), ==, fr->priority_update.datalen);
-    assert_memory_equal(strlen(NGHTTP3_PRI_DATA), NGHTTP3_PRI_DATA,
-                        fr->priority_update.data);
+  /* QPACK decoder stream */
+  rv = nghttp3_conn_shutdown_stream_read(conn, 0);
 
-    break;
-  }
-#undef NGHTTP3_PRI_DATA
+  assert_int(0, ==, rv);
+  assert_size(6, ==, ud.stream_writable_cb.ncalled);
+  assert_int64(conn->tx.qdec->node.id, ==, ud.stream_writable_cb.stream_id);
 
-  assert_size(nghttp3_ringbuf_len(&stream->frq), >, i);
+  rv = nghttp3_conn_shutdown_stream_read(conn, 4);
+
+  assert_int(0, ==, rv);
+  assert_size(6, ==, ud.stream_writable_cb.ncalled);
 
   nghttp3_conn_del(conn);
 
-  /* Updating priority of stream which does not exist is an error */
-  setup_default_client(&conn);
+  /* QPACK encoder stream */
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
 
-  pri.urgency = 2;
-  pri.inc = 1;
+  buf.last = nghttp3_put_uvarint(buf.last, NGHTTP3_STREAM_TYPE_CONTROL);
 
-#define NGHTTP3_PRI_DATA "u=2,i"
-  rv = nghttp3_conn_set_client_stream_priority(
-    conn, 0, (const uint8_t *)NGHTTP3_PRI_DATA, strlen(NGHTTP3_PRI_DATA));
-#undef NGHTTP3_PRI_DATA
+  fr.settings = (nghttp3_frame_settings){
+    .type = NGHTTP3_FRAME_SETTINGS,
+    .niv = 1,
+    .iv = ents,
+  };
+  ents[0] = (nghttp3_settings_entry){
+    .id = NGHTTP3_SETTINGS_ID_QPACK_MAX_TABLE_CAPACITY,
+    .value = 4096,
+  };
 
-  assert_int(NGHTTP3_ERR_STREAM_NOT_FOUND, ==, rv);
+  nghttp3_write_frame(&buf, &fr);
 
-  nghttp3_conn_del(conn);
+  ud = (userdata){0};
 
-  /* Update stream priority by server */
-  setup_default_server(&conn);
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
 
-  rv = nghttp3_conn_create_stream(conn, &stream, 0);
+  /* Priming is deferred until SETTINGS arrives. */
+  rv = nghttp3_conn_prime_qpack(conn, prime_nva, 1);
 
   assert_int(0, ==, rv);
+  assert_size(0, ==, ud.stream_writable_cb.ncalled);
 
-  pri.urgency = 4;
-  pri.inc = 0;
+  nconsumed = nghttp3_conn_read_stream2(conn, 3, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 0, 0);
 
-  rv = nghttp3_conn_set_server_stream_priority(conn, 0, &pri);
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, nconsumed);
+  assert_size(1, ==, ud.stream_writable_cb.ncalled);
+  assert_int64(conn->tx.qenc->node.id, ==, ud.stream_writable_cb.stream_id);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_int64(conn->tx.qenc->node.id, ==, stream_id);
+  assert_ptrdiff(0, <, sveccnt);
+
+  rv = nghttp3_conn_add_write_offset(
+    conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
 
   assert_int(0, ==, rv);
 
-  stream = nghttp3_conn_find_stream(conn, 0);
+  /* After SETTINGS, priming inserts the fields immediately. */
+  rv = nghttp3_conn_prime_qpack(conn, prime_nva + 1, 1);
 
-  assert_true(stream->flags & NGHTTP3_STREAM_FLAG_SERVER_PRIORITY_SET);
-  assert_true(nghttp3_pri_eq(&pri, &stream->node.pri));
+  assert_int(0, ==, rv);
+  assert_size(2, ==, ud.stream_writable_cb.ncalled);
+  assert_int64(conn->tx.qenc->node.id, ==, ud.stream_writable_cb.stream_id);
 
   nghttp3_conn_del(conn);
 }
@@ -5434,30 +6802,275 @@ void test_nghttp3_conn_shutdown_stream_read(void) {
   sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
                                         /* fin = */ 1, 0);
 
-  assert_ptrdiff(1, ==, sconsumed);
+  assert_ptrdiff(1, ==, sconsumed);
+
+  consumed_total += (size_t)sconsumed;
+
+  nghttp3_buf_reset(&buf);
+  buf.last = nghttp3_put_uvarint(buf.last, NGHTTP3_STREAM_TYPE_QPACK_ENCODER);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 7, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 0, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+
+  sconsumed = nghttp3_conn_read_stream2(
+    conn, 7, ebuf.pos, nghttp3_buf_len(&ebuf), /* fin = */ 0, 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&ebuf), ==, sconsumed);
+  /* Make sure that Section Acknowledgement is not written. */
+  assert_size(1, ==, nghttp3_buf_len(&conn->qdec.dbuf));
+  assert_size(indatalen, ==,
+              consumed_total + ud.deferred_consume_cb.consumed_total);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+}
+
+void test_nghttp3_conn_recv_datav(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  static const nghttp3_callbacks callbacks = {
+    .recv_trailer = recv_trailer,
+    .recv_datav = recv_datav,
+  };
+  static const nghttp3_nv trailer_nva[] = {
+    MAKE_NV("alpha", "bravo"),
+  };
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf;
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  size_t i;
+  userdata ud;
+  conn_options opts;
+  int rv;
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  nghttp3_qpack_encoder_init(&qenc, 0, NGHTTP3_TEST_MAP_SEED, mem);
+
+  fr.headers = (nghttp3_frame_headers){
+    .type = NGHTTP3_FRAME_HEADERS,
+    .nva = (nghttp3_nv *)resp_nva,
+    .nvlen = nghttp3_arraylen(resp_nva),
+  };
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  for (i = 0; i < 20; ++i) {
+    nghttp3_write_frame_data(&buf, 3);
+  }
+
+  fr.headers = (nghttp3_frame_headers){
+    .type = NGHTTP3_FRAME_HEADERS,
+    .nva = (nghttp3_nv *)trailer_nva,
+    .nvlen = nghttp3_arraylen(trailer_nva),
+  };
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  memset(&ud, 0, sizeof(ud));
+
+  opts = (conn_options){
+    .callbacks = &callbacks,
+    .user_data = &ud,
+  };
+
+  setup_default_client_with_options(&conn, opts);
+
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
+                                   NULL, NULL);
+
+  assert_int(0, ==, rv);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 1, 0);
+
+  assert_ptrdiff((nghttp3_ssize)(nghttp3_buf_len(&buf) - 60), ==, sconsumed);
+  assert_size(2, ==, ud.recv_datav_cb.ncalled);
+  assert_size(NGHTTP3_CONN_MAX_RECV_DATAV, ==, ud.recv_datav_cb.datavcnt[0]);
+  assert_size(20 - NGHTTP3_CONN_MAX_RECV_DATAV, ==,
+              ud.recv_datav_cb.datavcnt[1]);
+  assert_size(60, ==, ud.recv_datav_cb.datalen);
+  /* DATA is delivered before trailers. */
+  assert_size(0, ==, ud.recv_datav_cb.ntrailer);
+  assert_size(1, ==, ud.recv_trailer_cb.ncalled);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+void test_nghttp3_conn_flush_consumed(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  static const nghttp3_callbacks callbacks = {
+    .deferred_consume = deferred_consume,
+  };
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf;
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  size_t i, hdlen, expected;
+  uint64_t nconsumed;
+  userdata ud;
+  conn_options opts;
+  int rv;
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  nghttp3_qpack_encoder_init(&qenc, 0, NGHTTP3_TEST_MAP_SEED, mem);
+
+  fr.headers = (nghttp3_frame_headers){
+    .type = NGHTTP3_FRAME_HEADERS,
+    .nva = (nghttp3_nv *)resp_nva,
+    .nvlen = nghttp3_arraylen(resp_nva),
+  };
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  hdlen = nghttp3_buf_len(&buf);
+
+  for (i = 0; i < 3; ++i) {
+    nghttp3_write_frame_data(&buf, 10);
+  }
+
+  /* The payload of DATA frames is not counted as consumed. */
+  expected = nghttp3_buf_len(&buf) - 30;
+
+  nghttp3_settings_default(&settings);
+
+  opts = (conn_options){
+    .callbacks = &callbacks,
+    .settings = &settings,
+    .user_data = &ud,
+  };
+
+  /* Without aggregation, the consumed bytes are returned
+     immediately. */
+  memset(&ud, 0, sizeof(ud));
+  setup_default_client_with_options(&conn, opts);
+
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
+                                   NULL, NULL);
+
+  assert_int(0, ==, rv);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 0, 0);
+
+  assert_ptrdiff((nghttp3_ssize)expected, ==, sconsumed);
+
+  rv = nghttp3_conn_flush_consumed(conn, &nconsumed);
+
+  assert_int(0, ==, rv);
+  assert_uint64(0, ==, nconsumed);
+  assert_size(0, ==, ud.deferred_consume_cb.ncalled);
+
+  nghttp3_conn_del(conn);
+
+  /* The consumed bytes are accumulated until
+     nghttp3_conn_flush_consumed is called. */
+  settings.consumed_report_threshold = 1000;
+
+  memset(&ud, 0, sizeof(ud));
+  setup_default_client_with_options(&conn, opts);
+
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
+                                   NULL, NULL);
+
+  assert_int(0, ==, rv);
+
+  for (i = 0; i < nghttp3_buf_len(&buf); i += 7) {
+    sconsumed = nghttp3_conn_read_stream2(
+      conn, 0, buf.pos + i, nghttp3_min((size_t)7, nghttp3_buf_len(&buf) - i),
+      /* fin = */ 0, 0);
+
+    assert_ptrdiff(0, ==, sconsumed);
+  }
+
+  assert_size(0, ==, ud.deferred_consume_cb.ncalled);
+
+  rv = nghttp3_conn_flush_consumed(conn, &nconsumed);
+
+  assert_int(0, ==, rv);
+  assert_uint64(expected, ==, nconsumed);
+  assert_size(1, ==, ud.deferred_consume_cb.ncalled);
+  assert_size(expected, ==, ud.deferred_consume_cb.consumed_total);
+
+  rv = nghttp3_conn_flush_consumed(conn, &nconsumed);
+
+  assert_int(0, ==, rv);
+  assert_uint64(0, ==, nconsumed);
+  assert_size(1, ==, ud.deferred_consume_cb.ncalled);
+
+  nghttp3_conn_del(conn);
+
+  /* The accumulated bytes are reported when the stream is
+     closed. */
+  memset(&ud, 0, sizeof(ud));
+  setup_default_client_with_options(&conn, opts);
+
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
+                                   NULL, NULL);
+
+  assert_int(0, ==, rv);
+
+  sconsumed = nghttp3_conn_read_stream2(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                        /* fin = */ 0, 0);
+
+  assert_ptrdiff(0, ==, sconsumed);
+
+  rv = nghttp3_conn_close_stream(conn, 0, NGHTTP3_H3_NO_ERROR);
+
+  assert_int(0, ==, rv);
+  assert_size(1, ==, ud.deferred_consume_cb.ncalled);
+  assert_size(expected, ==, ud.deferred_consume_cb.consumed_total);
+
+  rv = nghttp3_conn_flush_consumed(conn, &nconsumed);
+
+  assert_int(0, ==, rv);
+  assert_uint64(expected, ==, nconsumed);
+  assert_size(1, ==, ud.deferred_consume_cb.ncalled);
+
+  nghttp3_conn_del(conn);
+
+  /* The stream level credit is reported once the threshold is
+     reached. */
+  settings.consumed_report_threshold = hdlen;
+
+  memset(&ud, 0, sizeof(ud));
+  setup_default_client_with_options(&conn, opts);
 
-  consumed_total += (size_t)sconsumed;
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
+                                   NULL, NULL);
 
-  nghttp3_buf_reset(&buf);
-  buf.last = nghttp3_put_uvarint(buf.last, NGHTTP3_STREAM_TYPE_QPACK_ENCODER);
+  assert_int(0, ==, rv);
 
-  sconsumed = nghttp3_conn_read_stream2(conn, 7, buf.pos, nghttp3_buf_len(&buf),
-                                        /* fin = */ 0, 0);
+  sconsumed =
+    nghttp3_conn_read_stream2(conn, 0, buf.pos, hdlen - 1, /* fin = */ 0, 0);
 
-  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&buf), ==, sconsumed);
+  assert_ptrdiff(0, ==, sconsumed);
+  assert_size(0, ==, ud.deferred_consume_cb.ncalled);
 
   sconsumed = nghttp3_conn_read_stream2(
-    conn, 7, ebuf.pos, nghttp3_buf_len(&ebuf), /* fin = */ 0, 0);
+    conn, 0, buf.pos + hdlen - 1, nghttp3_buf_len(&buf) - (hdlen - 1),
+    /* fin = */ 0, 0);
 
-  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&ebuf), ==, sconsumed);
-  /* Make sure that Section Acknowledgement is not written. */
-  assert_size(1, ==, nghttp3_buf_len(&conn->qdec.dbuf));
-  assert_size(indatalen, ==,
-              consumed_total + ud.deferred_consume_cb.consumed_total);
+  assert_ptrdiff(0, ==, sconsumed);
+  assert_size(1, ==, ud.deferred_consume_cb.ncalled);
+  assert_size(expected, ==, ud.deferred_consume_cb.consumed_total);
+
+  rv = nghttp3_conn_flush_consumed(conn, &nconsumed);
+
+  assert_int(0, ==, rv);
+  assert_uint64(expected, ==, nconsumed);
+  assert_size(1, ==, ud.deferred_consume_cb.ncalled);
 
   nghttp3_conn_del(conn);
   nghttp3_qpack_encoder_free(&qenc);
-  nghttp3_buf_free(&ebuf, mem);
 }
 
 void test_nghttp3_conn_stream_data_overflow(void) {
@@ -5709,6 +7322,369 @@ void test_nghttp3_conn_update_ack_offset(void) {
   nghttp3_conn_del(conn);
 }
 
+void test_nghttp3_conn_submit_request_buf(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_callbacks callbacks = {
+    .acked_stream_data = acked_stream_data,
+  };
+  static const nghttp3_data_buf_reader dr = {
+    .read_data_buf = buf_read_data,
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  uint64_t len;
+  nghttp3_stream *stream;
+  userdata ud = {0};
+  int fin;
+  size_t nreleased = 0, nreleased2 = 0;
+  conn_options opts;
+
+  opts = (conn_options){
+    .callbacks = &callbacks,
+    .user_data = &ud,
+  };
+
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+
+  rv = nghttp3_conn_submit_request_buf(
+    conn, 0, req_nva, nghttp3_arraylen(req_nva), &dr, &nreleased);
+
+  assert_int(0, ==, rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_int64(0, ==, stream_id);
+  assert_ptrdiff(3, ==, sveccnt);
+  assert_true(fin);
+  assert_size(100, ==, vec[1].len);
+  assert_size(200, ==, vec[2].len);
+  /* 0 length buffer is released immediately. */
+  assert_size(1, ==, nreleased);
+
+  len = nghttp3_vec_len(vec, (size_t)sveccnt);
+
+  rv = nghttp3_conn_add_write_offset(conn, 0, (size_t)len);
+
+  assert_int(0, ==, rv);
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  /* Partially acknowledged buffer is not released. */
+  rv = nghttp3_conn_update_ack_offset(conn, 0, vec[0].len + 99);
+
+  assert_int(0, ==, rv);
+  assert_size(1, ==, nreleased);
+
+  rv = nghttp3_conn_update_ack_offset(conn, 0, vec[0].len + 100);
+
+  assert_int(0, ==, rv);
+  assert_size(2, ==, nreleased);
+
+  rv = nghttp3_conn_update_ack_offset(conn, 0, len);
+
+  assert_int(0, ==, rv);
+  assert_size(3, ==, nreleased);
+  assert_size(0, ==, nghttp3_ringbuf_len(&stream->outq));
+  assert_size(0, ==, ud.ack.ncalled);
+
+  /* Buffers which are not acknowledged are released when stream is
+     freed. */
+  rv = nghttp3_conn_submit_request_buf(
+    conn, 4, req_nva, nghttp3_arraylen(req_nva), &dr, &nreleased2);
+
+  assert_int(0, ==, rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_int64(4, ==, stream_id);
+  assert_ptrdiff(3, ==, sveccnt);
+
+  len = nghttp3_vec_len(vec, (size_t)sveccnt);
+
+  rv = nghttp3_conn_add_write_offset(conn, 4, (size_t)len);
+
+  assert_int(0, ==, rv);
+
+  rv = nghttp3_conn_update_ack_offset(conn, 4, vec[0].len + 100);
+
+  assert_int(0, ==, rv);
+  assert_size(2, ==, nreleased2);
+
+  nghttp3_conn_del(conn);
+
+  assert_size(3, ==, nreleased);
+  assert_size(3, ==, nreleased2);
+  assert_size(0, ==, ud.ack.ncalled);
+}
+
+void test_nghttp3_conn_coalesce_data(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_callbacks callbacks = {
+    .acked_stream_data = acked_stream_data,
+  };
+  static const nghttp3_data_reader dr = {
+    .read_data = small_read_data,
+  };
+  static const nghttp3_data_buf_reader bdr = {
+    .read_data_buf = buf_read_data,
+  };
+  nghttp3_settings settings;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  uint64_t len;
+  userdata ud = {0};
+  int fin;
+  size_t nreleased = 0;
+  conn_options opts;
+
+  nghttp3_settings_default(&settings);
+  settings.read_data_veccnt = 16;
+  settings.data_coalesce_threshold = 100;
+
+  opts = (conn_options){
+    .callbacks = &callbacks,
+    .settings = &settings,
+    .user_data = &ud,
+  };
+
+  setup_default_client_with_options(&conn, opts);
+  conn_write_initial_streams(conn);
+
+  rv = nghttp3_conn_submit_request(conn, 0, req_nva, nghttp3_arraylen(req_nva),
+                                   &dr, NULL);
+
+  assert_int(0, ==, rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  /* HEADERS and DATA frame header, 10 small vectors, a large vector,
+     and 5 small vectors */
+  assert_int64(0, ==, stream_id);
+  assert_ptrdiff(4, ==, sveccnt);
+  assert_size(50, ==, vec[1].len);
+  assert_size(1000, ==, vec[2].len);
+  assert_ptr_equal(nulldata, vec[2].base);
+  assert_size(15, ==, vec[3].len);
+
+  len = nghttp3_vec_len(vec, (size_t)sveccnt);
+
+  rv = nghttp3_conn_add_write_offset(conn, 0, (size_t)len);
+
+  assert_int(0, ==, rv);
+
+  rv = nghttp3_conn_update_ack_offset(conn, 0, len);
+
+  assert_int(0, ==, rv);
+  assert_size(3, ==, ud.ack.ncalled);
+  assert_uint64(1065, ==, ud.ack.acc);
+
+  /* The copied nghttp3_data_buf is released immediately. */
+  rv = nghttp3_conn_submit_request_buf(
+    conn, 4, req_nva, nghttp3_arraylen(req_nva), &bdr, &nreleased);
+
+  assert_int(0, ==, rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  assert_int64(4, ==, stream_id);
+  assert_ptrdiff(2, ==, sveccnt);
+  assert_size(200, ==, vec[1].len);
+  assert_size(2, ==, nreleased);
+
+  nghttp3_conn_del(conn);
+
+  assert_size(3, ==, nreleased);
+}
+
+void test_nghttp3_conn_data_frame_min_len(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_data_reader dr = {
+    .read_data = step_then_block_read_data,
+  };
+  nghttp3_settings settings;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  uint64_t len, total[2];
+  userdata ud = {0};
+  int fin;
+  size_t i;
+  nghttp3_stream *stream;
+  conn_options opts;
+
+  for (i = 0; i < 2; ++i) {
+    nghttp3_settings_default(&settings);
+    /* The first iteration is the baseline which sends a DATA frame
+       per read_data call. */
+    settings.data_frame_min_len = i == 0 ? 0 : 1000;
+
+    opts = (conn_options){
+      .settings = &settings,
+      .user_data = &ud,
+    };
+
+    setup_default_client_with_options(&conn, opts);
+    conn_write_initial_streams(conn);
+
+    ud.data.left = 250;
+    ud.data.step = 100;
+
+    rv = nghttp3_conn_submit_request(conn, 0, req_nva,
+                                     nghttp3_arraylen(req_nva), &dr, NULL);
+
+    assert_int(0, ==, rv);
+
+    total[i] = 0;
+
+    for (;;) {
+      sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                           nghttp3_arraylen(vec));
+
+      assert_ptrdiff(0, <=, sveccnt);
+
+      if (stream_id == -1) {
+        break;
+      }
+
+      len = nghttp3_vec_len(vec, (size_t)sveccnt);
+
+      rv = nghttp3_conn_add_write_offset(conn, stream_id, (size_t)len);
+
+      assert_int(0, ==, rv);
+
+      total[i] += len;
+    }
+
+    assert_size(0, ==, ud.data.left);
+
+    stream = nghttp3_conn_find_stream(conn, 0);
+
+    assert_true(stream->flags & NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED);
+
+    nghttp3_conn_del(conn);
+  }
+
+  /* The baseline sends 3 DATA frames (100, 100, and 50 bytes) with 8
+     bytes of frame headers.  A single DATA frame of 250 bytes only
+     needs 3 bytes. */
+  assert_uint64(total[0] - 5, ==, total[1]);
+}
+
+void test_nghttp3_conn_file_reader(void) {
+  nghttp3_conn *conn;
+  static const nghttp3_data_buf_reader dr = {
+    .read_data_buf = file_read_data,
+  };
+  nghttp3_file_reader *reader;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  uint64_t len, ack_offset = 0;
+  int fin;
+  FILE *fp;
+  uint8_t data[16384];
+  size_t i, j, nwindow = 0, nread = 0;
+  const uint64_t offset = 5000;
+  const uint64_t filelen = 150000;
+
+  fp = tmpfile();
+
+  assert_not_null(fp);
+
+  for (i = 0; i < 10; ++i) {
+    for (j = 0; j < sizeof(data); ++j) {
+      data[j] = (uint8_t)((i * sizeof(data) + j) % 251);
+    }
+
+    assert_size(sizeof(data), ==, fwrite(data, 1, sizeof(data), fp));
+  }
+
+  assert_int(0, ==, fflush(fp));
+
+  rv = nghttp3_file_reader_new(&reader, fileno(fp), offset, filelen,
+                               nghttp3_mem_default());
+  if (rv == NGHTTP3_ERR_INVALID_STATE) {
+    fclose(fp);
+    return;
+  }
+
+  assert_int(0, ==, rv);
+
+  setup_default_client(&conn);
+  conn_write_initial_streams(conn);
+
+  rv = nghttp3_conn_submit_request_buf(
+    conn, 0, req_nva, nghttp3_arraylen(req_nva), &dr, reader);
+
+  assert_int(0, ==, rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    assert_ptrdiff(0, <=, sveccnt);
+
+    if (sveccnt == 0) {
+      break;
+    }
+
+    /* HEADERS and/or DATA frame header, followed by a window */
+    assert_ptrdiff(2, ==, sveccnt);
+    assert_size(reader->windowlen, >=, vec[1].len);
+
+    for (j = 0; j < vec[1].len; ++j) {
+      assert_uint8((uint8_t)((offset + nread + j) % 251), ==, vec[1].base[j]);
+    }
+
+    nread += vec[1].len;
+    ++nwindow;
+
+    len = nghttp3_vec_len(vec, (size_t)sveccnt);
+
+    rv = nghttp3_conn_add_write_offset(conn, stream_id, (size_t)len);
+
+    assert_int(0, ==, rv);
+
+    if (fin) {
+      break;
+    }
+
+    if (nwindow == 1) {
+      ack_offset = len;
+    }
+  }
+
+  assert_true(fin);
+  assert_size(filelen, ==, nread);
+  assert_size(3, ==, nwindow);
+  assert_size(1 + nwindow, ==, reader->nref);
+
+  /* The window is unmapped when it is acknowledged. */
+  rv = nghttp3_conn_update_ack_offset(conn, 0, ack_offset);
+
+  assert_int(0, ==, rv);
+  assert_size(nwindow, ==, reader->nref);
+
+  /* The remaining windows keep reader alive. */
+  nghttp3_file_reader_del(reader);
+
+  assert_size(nwindow - 1, ==, reader->nref);
+
+  nghttp3_conn_del(conn);
+  fclose(fp);
+}
+
 void test_nghttp3_conn_set_client_stream_priority(void) {
   nghttp3_conn *conn;
   static const uint8_t prihd[] = "u=0";
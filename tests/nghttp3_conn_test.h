@@ -50,7 +50,14 @@ munit_void_test_decl(test_nghttp3_conn_http_record_request_method)
 munit_void_test_decl(test_nghttp3_conn_http_error)
 munit_void_test_decl(test_nghttp3_conn_qpack_blocked_stream)
 munit_void_test_decl(test_nghttp3_conn_qpack_decoder_cancel_stream)
+munit_void_test_decl(test_nghttp3_conn_qpack_decoder_ack_delay)
+munit_void_test_decl(test_nghttp3_conn_prime_qpack)
+munit_void_test_decl(test_nghttp3_conn_join_cookie)
+munit_void_test_decl(test_nghttp3_conn_recv_header_fragment)
 munit_void_test_decl(test_nghttp3_conn_just_fin)
+munit_void_test_decl(test_nghttp3_conn_preamble)
+munit_void_test_decl(test_nghttp3_conn_factory)
+munit_void_test_decl(test_nghttp3_conn_factory_urgency_weights)
 munit_void_test_decl(test_nghttp3_conn_submit_response_read_blocked)
 munit_void_test_decl(test_nghttp3_conn_submit_info)
 munit_void_test_decl(test_nghttp3_conn_recv_uni)
@@ -60,10 +67,19 @@ munit_void_test_decl(test_nghttp3_conn_shutdown_client)
 munit_void_test_decl(test_nghttp3_conn_priority_update)
 munit_void_test_decl(test_nghttp3_conn_request_priority)
 munit_void_test_decl(test_nghttp3_conn_set_stream_priority)
+munit_void_test_decl(test_nghttp3_conn_weighted_sched)
+munit_void_test_decl(test_nghttp3_conn_writev_stream_hint)
+munit_void_test_decl(test_nghttp3_conn_stream_writable)
 munit_void_test_decl(test_nghttp3_conn_shutdown_stream_read)
+munit_void_test_decl(test_nghttp3_conn_recv_datav)
+munit_void_test_decl(test_nghttp3_conn_flush_consumed)
 munit_void_test_decl(test_nghttp3_conn_stream_data_overflow)
 munit_void_test_decl(test_nghttp3_conn_get_frame_payload_left)
 munit_void_test_decl(test_nghttp3_conn_update_ack_offset)
+munit_void_test_decl(test_nghttp3_conn_submit_request_buf)
+munit_void_test_decl(test_nghttp3_conn_coalesce_data)
+munit_void_test_decl(test_nghttp3_conn_data_frame_min_len)
+munit_void_test_decl(test_nghttp3_conn_file_reader)
 munit_void_test_decl(test_nghttp3_conn_set_client_stream_priority)
 munit_void_test_decl(test_nghttp3_conn_rx_http_state)
 munit_void_test_decl(test_nghttp3_conn_push)
@@ -29,3 +29,111 @@
 
 #include "nghttp3_conv.h"
 #include "nghttp3_test_helper.h"
+
+static const MunitTest tests[] = {
+  munit_void_test(test_nghttp3_put_uvarint),
+  munit_void_test(test_nghttp3_get_uvarintv),
+  munit_test_end(),
+};
+
+const MunitSuite conv_suite = {
+  .prefix = "/conv",
+  .tests = tests,
+};
+
+void test_nghttp3_put_uvarint(void) {
+  static const uint64_t nums[] = {
+    0, 63, 64, 16383, 16384, 1073741823, 1073741824, NGHTTP3_VARINT_MAX,
+  };
+  static const size_t lens[] = {1, 1, 2, 2, 4, 4, 8, 8};
+  uint8_t buf[8];
+  uint8_t *p;
+  uint64_t n;
+  size_t i;
+
+  for (i = 0; i < nghttp3_arraylen(nums); ++i) {
+    assert_size(lens[i], ==, nghttp3_put_uvarintlen(nums[i]));
+
+    p = nghttp3_put_uvarint(buf, nums[i]);
+
+    assert_ptrdiff((ptrdiff_t)lens[i], ==, p - buf);
+    assert_size(lens[i], ==, nghttp3_get_uvarintlen(buf));
+    assert_ptr_equal(p, nghttp3_get_uvarint(&n, buf));
+    assert_uint64(nums[i], ==, n);
+  }
+
+  {
+    static const uint8_t expected[] = {0xC2, 0x19, 0x7C, 0x5E,
+                                       0xFF, 0x14, 0xE8, 0x8C};
+
+    p = nghttp3_put_uvarint(buf, 151288809941952652ULL);
+
+    assert_ptrdiff(8, ==, p - buf);
+    assert_memory_equal(sizeof(expected), expected, buf);
+  }
+
+  {
+    static const uint8_t expected[] = {0x9D, 0x7F, 0x3E, 0x7D};
+
+    p = nghttp3_put_uvarint(buf, 494878333);
+
+    assert_ptrdiff(4, ==, p - buf);
+    assert_memory_equal(sizeof(expected), expected, buf);
+  }
+
+  {
+    static const uint8_t expected[] = {0x7B, 0xBD};
+
+    p = nghttp3_put_uvarint(buf, 15293);
+
+    assert_ptrdiff(2, ==, p - buf);
+    assert_memory_equal(sizeof(expected), expected, buf);
+  }
+}
+
+void test_nghttp3_get_uvarintv(void) {
+  static const uint8_t input[] = {
+    0x25, 0x7B, 0xBD, 0x9D, 0x7F, 0x3E, 0x7D, 0xC2, 0x19,
+    0x7C, 0x5E, 0xFF, 0x14, 0xE8, 0x8C, 0x00, 0x3F,
+  };
+  uint64_t dest[8];
+  const uint8_t *p;
+  size_t n;
+
+  p = input;
+  n = nghttp3_get_uvarintv(dest, nghttp3_arraylen(dest), &p,
+                           input + sizeof(input));
+
+  assert_size(6, ==, n);
+  assert_ptr_equal(input + sizeof(input), p);
+  assert_uint64(37, ==, dest[0]);
+  assert_uint64(15293, ==, dest[1]);
+  assert_uint64(494878333, ==, dest[2]);
+  assert_uint64(151288809941952652ULL, ==, dest[3]);
+  assert_uint64(0, ==, dest[4]);
+  assert_uint64(63, ==, dest[5]);
+
+  /* Limited by n */
+  p = input;
+  n = nghttp3_get_uvarintv(dest, 2, &p, input + sizeof(input));
+
+  assert_size(2, ==, n);
+  assert_ptr_equal(input + 3, p);
+  assert_uint64(37, ==, dest[0]);
+  assert_uint64(15293, ==, dest[1]);
+
+  /* Stops at an incomplete integer */
+  p = input;
+  n = nghttp3_get_uvarintv(dest, nghttp3_arraylen(dest), &p, input + 10);
+
+  assert_size(3, ==, n);
+  assert_ptr_equal(input + 7, p);
+  assert_uint64(494878333, ==, dest[2]);
+
+  /* Empty input */
+  p = input;
+  n = nghttp3_get_uvarintv(dest, nghttp3_arraylen(dest), &p, input);
+
+  assert_size(0, ==, n);
+  assert_ptr_equal(input, p);
+}
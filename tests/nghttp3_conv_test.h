@@ -29,4 +29,13 @@
 #  include <config.h>
 #endif /* defined(HAVE_CONFIG_H) */
 
+#define MUNIT_ENABLE_ASSERT_ALIASES
+
+#include "munit.h"
+
+extern const MunitSuite conv_suite;
+
+munit_void_test_decl(test_nghttp3_put_uvarint)
+munit_void_test_decl(test_nghttp3_get_uvarintv)
+
 #endif /* !defined(NGHTTP3_CONV_TEST_H) */
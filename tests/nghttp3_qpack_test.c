@@ -36,14 +36,20 @@ static const MunitTest tests[] = {
   munit_void_test(test_nghttp3_qpack_encoder_encode_try_encode),
   munit_void_test(test_nghttp3_qpack_encoder_encode_indexing_strat_eager),
   munit_void_test(test_nghttp3_qpack_encoder_still_blocked),
+  munit_void_test(test_nghttp3_qpack_encoder_path_estimate),
+  munit_void_test(test_nghttp3_qpack_encoder_encoding_strat_compact),
+  munit_void_test(test_nghttp3_qpack_encoder_crumble_cookie),
   munit_void_test(test_nghttp3_qpack_encoder_set_dtable_cap),
   munit_void_test(test_nghttp3_qpack_decoder_feedback),
   munit_void_test(test_nghttp3_qpack_decoder_stream_overflow),
+  munit_void_test(test_nghttp3_qpack_decoder_contiguous_dtable),
   munit_void_test(test_nghttp3_qpack_huffman),
   munit_void_test(test_nghttp3_qpack_huffman_decode_failure_state),
   munit_void_test(test_nghttp3_qpack_decoder_reconstruct_ricnt),
   munit_void_test(test_nghttp3_qpack_decoder_read_encoder),
   munit_void_test(test_nghttp3_qpack_encoder_read_decoder),
+  munit_void_test(test_nghttp3_qpack_decoder_read_request),
+  munit_void_test(test_nghttp3_qpack_decoder_value_fragment),
   munit_test_end(),
 };
 
@@ -457,6 +463,234 @@ void test_nghttp3_qpack_encoder_still_blocked(void) {
   nghttp3_buf_free(&pbuf, mem);
 }
 
+void test_nghttp3_qpack_encoder_path_estimate(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  static const nghttp3_nv nva[] = {
+    MAKE_NV(":status", "200"),
+    MAKE_NV("content-type", "text/foo"),
+  };
+  int rv;
+  nghttp3_buf pbuf, rbuf, ebuf;
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+  nghttp3_qpack_encoder_init(&enc, 4096, NGHTTP3_TEST_MAP_SEED, mem);
+
+  nghttp3_qpack_encoder_set_max_blocked_streams(&enc, 1);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(&enc, 4096);
+
+  /* 100ms RTT with 1% loss is too risky to reference unacknowledged
+     entries. */
+  nghttp3_qpack_encoder_set_path_estimate(&enc, 100 * NGHTTP3_MILLISECONDS,
+                                          10000);
+
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 0, nva,
+                                    nghttp3_arraylen(nva));
+
+  assert_int(0, ==, rv);
+  assert_size(0, <, nghttp3_buf_len(&ebuf));
+  assert_size(0, ==, nghttp3_qpack_encoder_get_num_blocked_streams2(&enc));
+  assert_null(nghttp3_qpack_encoder_find_stream(&enc, 0));
+
+  nghttp3_buf_reset(&pbuf);
+  nghttp3_buf_reset(&rbuf);
+  nghttp3_buf_reset(&ebuf);
+
+  /* 10ms RTT with the same loss is acceptable. */
+  nghttp3_qpack_encoder_set_path_estimate(&enc, 10 * NGHTTP3_MILLISECONDS,
+                                          10000);
+
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 4, nva,
+                                    nghttp3_arraylen(nva));
+
+  assert_int(0, ==, rv);
+  assert_size(1, ==, nghttp3_qpack_encoder_get_num_blocked_streams2(&enc));
+
+  nghttp3_qpack_encoder_free(&enc);
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+}
+
+void test_nghttp3_qpack_encoder_encoding_strat_compact(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  nghttp3_qpack_decoder dec;
+  static const nghttp3_nv nva[][3] = {
+    {
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV("x-request-id", "4e1b0b9c30a7d2f1"),
+      MAKE_NV("user-agent", "nghttp3/1.19.0"),
+    },
+    {
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV("x-request-id", "a83f6c0e51d94b27"),
+      MAKE_NV("user-agent", "nghttp3/1.19.0"),
+    },
+    {
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV("x-request-id", "07c2e98d4fb1a635"),
+      MAKE_NV("user-agent", "nghttp3/1.19.0"),
+    },
+  };
+  static const nghttp3_qpack_encoding_strat strats[] = {
+    NGHTTP3_QPACK_ENCODING_STRAT_FAST,
+    NGHTTP3_QPACK_ENCODING_STRAT_COMPACT,
+  };
+  size_t total[nghttp3_arraylen(strats)];
+  size_t dtablelen[nghttp3_arraylen(strats)];
+  int rv;
+  nghttp3_buf pbuf, rbuf, ebuf;
+  size_t i, j;
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+
+  for (i = 0; i < nghttp3_arraylen(strats); ++i) {
+    nghttp3_qpack_encoder_init(&enc, 4096, NGHTTP3_TEST_MAP_SEED, mem);
+    nghttp3_qpack_encoder_set_max_blocked_streams(&enc, 100);
+    nghttp3_qpack_encoder_set_max_dtable_capacity(&enc, 4096);
+    nghttp3_qpack_encoder_set_indexing_strat(
+      &enc, NGHTTP3_QPACK_INDEXING_STRAT_EAGER);
+    nghttp3_qpack_encoder_set_encoding_strat(&enc, strats[i]);
+
+    nghttp3_qpack_decoder_init(&dec, 4096, 100, mem);
+
+    total[i] = 0;
+
+    for (j = 0; j < nghttp3_arraylen(nva); ++j) {
+      rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf,
+                                        (int64_t)(j * 4), nva[j],
+                                        nghttp3_arraylen(nva[j]));
+
+      assert_int(0, ==, rv);
+
+      total[i] += nghttp3_buf_len(&pbuf) + nghttp3_buf_len(&rbuf) +
+                  nghttp3_buf_len(&ebuf);
+
+      check_decode_header(&dec, &pbuf, &rbuf, &ebuf, (int64_t)(j * 4), nva[j],
+                          nghttp3_arraylen(nva[j]), mem);
+    }
+
+    dtablelen[i] = nghttp3_ringbuf_len(&enc.ctx.dtable);
+
+    nghttp3_qpack_decoder_free(&dec);
+    nghttp3_qpack_encoder_free(&enc);
+  }
+
+  /* The fixed rules insert every x-request-id.  The cost model
+     inserts the first one only, and refers to its name afterwards. */
+  assert_size(5, ==, dtablelen[0]);
+  assert_size(3, ==, dtablelen[1]);
+  assert_size(total[0], >, total[1]);
+
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+}
+
+void test_nghttp3_qpack_encoder_crumble_cookie(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  nghttp3_qpack_decoder dec;
+  nghttp3_buf pbuf, rbuf, ebuf, dbuf;
+  static const nghttp3_nv nva[] = {
+    MAKE_NV("cookie", "session=0123456789abcdef0123456789abcdef; "
+                      "a=1;  prefs=lang-en-us-tz-america-new-york;"),
+  };
+  static const nghttp3_nv crumbs[] = {
+    MAKE_NV("cookie", "session=0123456789abcdef0123456789abcdef"),
+    MAKE_NV("cookie", "a=1"),
+    MAKE_NV("cookie", "prefs=lang-en-us-tz-america-new-york"),
+  };
+  static const nghttp3_nv nva2[] = {
+    MAKE_NV("cookie", ";"),
+  };
+  nghttp3_qpack_entry *ent;
+  nghttp3_ssize nread;
+  size_t rlen;
+  int rv;
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_init(&dbuf);
+
+  nghttp3_buf_reserve(&dbuf, 4096, mem);
+
+  nghttp3_qpack_encoder_init(&enc, 4096, NGHTTP3_TEST_MAP_SEED, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&enc, 1);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(&enc, 4096);
+  nghttp3_qpack_encoder_set_crumble_cookie(&enc, 1);
+
+  nghttp3_qpack_decoder_init(&dec, 4096, 1, mem);
+
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 0, nva,
+                                    nghttp3_arraylen(nva));
+
+  assert_int(0, ==, rv);
+
+  /* Short crumb is not indexed. */
+  assert_size(2, ==, nghttp3_ringbuf_len(&enc.ctx.dtable));
+
+  ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&enc.ctx.dtable, 1);
+
+  assert_memn_equal(crumbs[0].value, crumbs[0].valuelen, ent->nv.value->base,
+                    ent->nv.value->len);
+
+  ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&enc.ctx.dtable, 0);
+
+  assert_memn_equal(crumbs[2].value, crumbs[2].valuelen, ent->nv.value->base,
+                    ent->nv.value->len);
+
+  check_decode_header(&dec, &pbuf, &rbuf, &ebuf, 0, crumbs,
+                      nghttp3_arraylen(crumbs), mem);
+
+  nghttp3_qpack_decoder_write_decoder(&dec, &dbuf);
+
+  nread =
+    nghttp3_qpack_encoder_read_decoder(&enc, dbuf.pos, nghttp3_buf_len(&dbuf));
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&dbuf), ==, nread);
+  assert_uint64(2, ==, enc.krcnt);
+
+  /* The same cookie refers to the existing entries. */
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 4, nva,
+                                    nghttp3_arraylen(nva));
+
+  assert_int(0, ==, rv);
+  assert_size(2, ==, nghttp3_ringbuf_len(&enc.ctx.dtable));
+  assert_size(0, ==, nghttp3_buf_len(&ebuf));
+
+  rlen = nghttp3_buf_len(&rbuf);
+
+  check_decode_header(&dec, &pbuf, &rbuf, &ebuf, 4, crumbs,
+                      nghttp3_arraylen(crumbs), mem);
+
+  /* 2 dynamic indexed field lines plus a literal with static name
+     reference. */
+  assert_size(2 + 2 + crumbs[1].valuelen, >=, rlen);
+
+  /* Cookie without non-empty crumb is encoded as is. */
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 8, nva2,
+                                    nghttp3_arraylen(nva2));
+
+  assert_int(0, ==, rv);
+
+  check_decode_header(&dec, &pbuf, &rbuf, &ebuf, 8, nva2,
+                      nghttp3_arraylen(nva2), mem);
+
+  nghttp3_qpack_decoder_free(&dec);
+  nghttp3_qpack_encoder_free(&enc);
+  nghttp3_buf_free(&dbuf, mem);
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+}
+
 void test_nghttp3_qpack_encoder_set_dtable_cap(void) {
   const nghttp3_mem *mem = nghttp3_mem_default();
   nghttp3_qpack_encoder enc;
@@ -853,6 +1087,143 @@ void test_nghttp3_qpack_decoder_stream_overflow(void) {
   nghttp3_qpack_decoder_free(&dec);
 }
 
+void test_nghttp3_qpack_decoder_contiguous_dtable(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  nghttp3_qpack_decoder dec;
+  nghttp3_buf pbuf, rbuf, ebuf, dbuf;
+  nghttp3_nv nva[] = {
+    MAKE_NV(":path", "/"),
+    MAKE_NV("x-foo-0", "0123456789abcdef0123456789abcdef"),
+    MAKE_NV("user-agent", "0123456789abcdef0123456789abcdef"),
+  };
+  uint8_t name[] = "x-foo-0";
+  uint8_t value[] = "0123456789abcdef0123456789abcdef";
+  nghttp3_qpack_entry *ent, *eent;
+  nghttp3_rcbuf *held_name, *held_value;
+  nghttp3_ssize nread;
+  size_t i, j;
+  int rv;
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_init(&dbuf);
+
+  nghttp3_buf_reserve(&dbuf, 4096, mem);
+
+  nghttp3_qpack_encoder_init(&enc, 256, NGHTTP3_TEST_MAP_SEED, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&enc, 1);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(&enc, 256);
+
+  nghttp3_qpack_decoder_init(&dec, 256, 1, mem);
+  nghttp3_qpack_decoder_set_contiguous_dtable(&dec, 1);
+
+  held_name = NULL;
+  held_value = NULL;
+
+  for (i = 0; i < 16; ++i) {
+    name[sizeof(name) - 2] = (uint8_t)('0' + (i % 10));
+    value[i % (sizeof(value) - 1)] = (uint8_t)('A' + i);
+
+    nva[1].name = name;
+    nva[1].value = value;
+    nva[1].flags = NGHTTP3_NV_FLAG_TRY_INDEX;
+    nva[2].value = value;
+
+    rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, (int64_t)i * 4,
+                                      nva, nghttp3_arraylen(nva));
+
+    assert_int(0, ==, rv);
+
+    nread = nghttp3_qpack_decoder_read_encoder(&dec, ebuf.pos,
+                                               nghttp3_buf_len(&ebuf));
+
+    assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&ebuf), ==, nread);
+
+    decode_header_block(&dec, &pbuf, &rbuf, (int64_t)i * 4, mem);
+
+    nghttp3_buf_reset(&pbuf);
+    nghttp3_buf_reset(&rbuf);
+    nghttp3_buf_reset(&ebuf);
+
+    assert_size(nghttp3_ringbuf_len(&enc.ctx.dtable), ==,
+                nghttp3_ringbuf_len(&dec.ctx.dtable));
+
+    for (j = 0; j < nghttp3_ringbuf_len(&dec.ctx.dtable); ++j) {
+      ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&dec.ctx.dtable, j);
+      eent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&enc.ctx.dtable, j);
+
+      assert_uint64(eent->absidx, ==, ent->absidx);
+      assert_memn_equal(eent->nv.name->base, eent->nv.name->len,
+                        ent->nv.name->base, ent->nv.name->len);
+      assert_memn_equal(eent->nv.value->base, eent->nv.value->len,
+                        ent->nv.value->base, ent->nv.value->len);
+    }
+
+    assert_true(dec.arena.enabled);
+    assert_not_null(dec.arena.buf);
+    assert_size(512, ==, dec.arena.len);
+    assert_size(256, >=, dec.ctx.dtable_size);
+
+    if (i == 0) {
+      /* Keep the name and value of "x-foo-0" entry across its
+         eviction. */
+      ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&dec.ctx.dtable, 1);
+      held_name = ent->nv.name;
+      held_value = ent->nv.value;
+
+      assert_false(nghttp3_rcbuf_is_static(held_name));
+
+      nghttp3_rcbuf_incref(held_name);
+      nghttp3_rcbuf_incref(held_value);
+    }
+
+    nghttp3_qpack_decoder_write_decoder(&dec, &dbuf);
+
+    nread = nghttp3_qpack_encoder_read_decoder(&enc, dbuf.pos,
+                                               nghttp3_buf_len(&dbuf));
+
+    assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&dbuf), ==, nread);
+    nghttp3_buf_reset(&dbuf);
+  }
+
+  /* The first entries have been evicted, and the slots reused. */
+  assert_uint64(16, <, dec.ctx.next_absidx);
+  assert_not_null(dec.arena.free_list);
+
+  assert_memn_equal("x-foo-0", nghttp3_strlen_lit("x-foo-0"),
+                    nghttp3_rcbuf_get_buf(held_name).base,
+                    nghttp3_rcbuf_get_buf(held_name).len);
+  assert_memn_equal("A123456789abcdef0123456789abcdef",
+                    nghttp3_strlen_lit("A123456789abcdef0123456789abcdef"),
+                    nghttp3_rcbuf_get_buf(held_value).base,
+                    nghttp3_rcbuf_get_buf(held_value).len);
+
+  nghttp3_rcbuf_decref(held_value);
+  nghttp3_rcbuf_decref(held_name);
+
+  /* Keep the value of the newest entry across the decoder
+     destruction. */
+  ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&dec.ctx.dtable, 0);
+  held_value = ent->nv.value;
+  nghttp3_rcbuf_incref(held_value);
+
+  nghttp3_qpack_decoder_free(&dec);
+
+  assert_memn_equal(value, sizeof(value) - 1,
+                    nghttp3_rcbuf_get_buf(held_value).base,
+                    nghttp3_rcbuf_get_buf(held_value).len);
+
+  nghttp3_rcbuf_decref(held_value);
+
+  nghttp3_qpack_encoder_free(&enc);
+  nghttp3_buf_free(&dbuf, mem);
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+}
+
 void test_nghttp3_qpack_huffman(void) {
   size_t i, j;
   uint8_t raw[100], ebuf[4096], dbuf[4096];
@@ -1041,3 +1412,255 @@ void test_nghttp3_qpack_encoder_read_decoder(void) {
   nghttp3_buf_free(&rbuf, mem);
   nghttp3_buf_free(&pbuf, mem);
 }
+
+void test_nghttp3_qpack_decoder_read_request(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  nghttp3_qpack_decoder dec;
+  nghttp3_qpack_stream_context sctx;
+  nghttp3_qpack_nv qnv;
+  static const nghttp3_nv nva[] = {
+    MAKE_NV(":path", "/"),
+    MAKE_NV(":authority", "example.com"),
+    MAKE_NV(":method", "GET"),
+    MAKE_NV(":scheme", "https"),
+    MAKE_NV("x-raw", "~|~|~|~|~|~|~|~|"),
+    MAKE_NV("~|~|~|~|~|~|", "~|~|~|~|~|~|~|~|"),
+    MAKE_NV("x-empty", ""),
+    MAKE_NV("cookie", "a=b"),
+    MAKE_NV("user-agent", "nghttp3/1.0 (Linux)"),
+    MAKE_NV("x-tab", "a\tb"),
+    MAKE_NV("x-leading-ws", " a"),
+    MAKE_NV("x-trailing-ws", "a\t"),
+    MAKE_NV("x-ctl", "a\x01\x7f"),
+    MAKE_NV("X-Upper", "upper"),
+    MAKE_NV("x@", "bad-name"),
+  };
+  nghttp3_buf pbuf, rbuf, ebuf;
+  uint8_t hb[1024];
+  size_t hblen, i, j, k, step;
+  nghttp3_ssize nread;
+  uint8_t flags;
+  int rv;
+
+  for (step = 1; step <= 1024; step *= 4) {
+    nghttp3_buf_init(&pbuf);
+    nghttp3_buf_init(&rbuf);
+    nghttp3_buf_init(&ebuf);
+    nghttp3_qpack_encoder_init(&enc, 4096, NGHTTP3_TEST_MAP_SEED, mem);
+    nghttp3_qpack_encoder_set_max_blocked_streams(&enc, 1);
+    nghttp3_qpack_encoder_set_max_dtable_capacity(&enc, 4096);
+    nghttp3_qpack_decoder_init(&dec, 4096, 1, mem);
+
+    for (k = 0; k < 2; ++k) {
+      rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf,
+                                        (int64_t)k * 4, nva,
+                                        nghttp3_arraylen(nva));
+
+      assert_int(0, ==, rv);
+
+      nread = nghttp3_qpack_decoder_read_encoder(&dec, ebuf.pos,
+                                                 nghttp3_buf_len(&ebuf));
+
+      assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&ebuf), ==, nread);
+
+      hblen = nghttp3_buf_len(&pbuf) + nghttp3_buf_len(&rbuf);
+
+      assert_size(sizeof(hb), >=, hblen);
+
+      memcpy(hb, pbuf.pos, nghttp3_buf_len(&pbuf));
+      memcpy(hb + nghttp3_buf_len(&pbuf), rbuf.pos, nghttp3_buf_len(&rbuf));
+
+      nghttp3_qpack_stream_context_init(&sctx, (int64_t)k * 4, mem);
+
+      /* Feed the field section |step| bytes at a time */
+      for (i = 0, j = 0;;) {
+        nread = nghttp3_qpack_decoder_read_request(
+          &dec, &sctx, &qnv, &flags, hb + i, nghttp3_min(step, hblen - i),
+          i + step >= hblen);
+
+        assert_ptrdiff(0, <=, nread);
+
+        i += (size_t)nread;
+
+        if (flags & NGHTTP3_QPACK_DECODE_FLAG_FINAL) {
+          break;
+        }
+
+        if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+          assert_size(nghttp3_arraylen(nva), >, j);
+          assert_memn_equal(nva[j].name, nva[j].namelen, qnv.name->base,
+                            qnv.name->len);
+          assert_memn_equal(nva[j].value, nva[j].valuelen, qnv.value->base,
+                            qnv.value->len);
+          assert_int(
+            nghttp3_check_header_value(nva[j].value, nva[j].valuelen), ==,
+            !!(qnv.value->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE));
+
+          if (nva[j].name[0] != ':') {
+            assert_int(
+              nghttp3_check_header_name(nva[j].name, nva[j].namelen), ==,
+              !!(qnv.name->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_NAME));
+          }
+
+          nghttp3_rcbuf_decref(qnv.name);
+          nghttp3_rcbuf_decref(qnv.value);
+
+          ++j;
+        }
+      }
+
+      assert_size(hblen, ==, i);
+      assert_size(nghttp3_arraylen(nva), ==, j);
+
+      nghttp3_qpack_stream_context_free(&sctx);
+      nghttp3_buf_reset(&pbuf);
+      nghttp3_buf_reset(&rbuf);
+      nghttp3_buf_reset(&ebuf);
+
+      nghttp3_qpack_encoder_ack_everything(&enc);
+    }
+
+    nghttp3_qpack_decoder_free(&dec);
+    nghttp3_qpack_encoder_free(&enc);
+    nghttp3_buf_free(&ebuf, mem);
+    nghttp3_buf_free(&rbuf, mem);
+    nghttp3_buf_free(&pbuf, mem);
+  }
+}
+
+void test_nghttp3_qpack_decoder_value_fragment(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  nghttp3_qpack_decoder dec;
+  nghttp3_qpack_stream_context sctx;
+  nghttp3_qpack_nv qnv;
+  nghttp3_nv nva[5];
+  uint8_t path[100], rawvalue[200], huffvalue[300], wsvalue[200];
+  uint8_t value[512];
+  size_t valuelen = 0;
+  size_t nfrags = 0;
+  size_t i = 0;
+  nghttp3_buf pbuf, rbuf, ebuf;
+  nghttp3_ssize nread;
+  uint8_t flags;
+  size_t len;
+  int rv;
+
+  path[0] = '/';
+  memset(path + 1, 'p', sizeof(path) - 1);
+  /* '{' and '}' are longer in huffman encoding. */
+  for (len = 0; len < sizeof(rawvalue); ++len) {
+    rawvalue[len] = len & 1 ? '}' : '{';
+  }
+  memset(huffvalue, 'a', sizeof(huffvalue));
+  memset(wsvalue, 'a', sizeof(wsvalue));
+  wsvalue[sizeof(wsvalue) - 1] = ' ';
+
+  nva[0] = (nghttp3_nv){(uint8_t *)":path", path, nghttp3_strlen_lit(":path"),
+                        sizeof(path), NGHTTP3_NV_FLAG_NONE};
+  nva[1] = (nghttp3_nv){(uint8_t *)"x-raw", rawvalue,
+                        nghttp3_strlen_lit("x-raw"), sizeof(rawvalue),
+                        NGHTTP3_NV_FLAG_NONE};
+  nva[2] = (nghttp3_nv){(uint8_t *)"user-agent", huffvalue,
+                        nghttp3_strlen_lit("user-agent"), sizeof(huffvalue),
+                        NGHTTP3_NV_FLAG_NONE};
+  nva[3] = (nghttp3_nv){(uint8_t *)"x-ws", wsvalue, nghttp3_strlen_lit("x-ws"),
+                        sizeof(wsvalue), NGHTTP3_NV_FLAG_NONE};
+  nva[4] = (nghttp3_nv)MAKE_NV("x-small", "small");
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+
+  nghttp3_qpack_encoder_init(&enc, 0, NGHTTP3_TEST_MAP_SEED, mem);
+  nghttp3_qpack_decoder_init(&dec, 0, 0, mem);
+  nghttp3_qpack_decoder_set_value_fragment_size(&dec, 64);
+
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 0, nva,
+                                    nghttp3_arraylen(nva));
+
+  assert_int(0, ==, rv);
+  assert_size(0, ==, nghttp3_buf_len(&ebuf));
+
+  nghttp3_qpack_stream_context_init(&sctx, 0, mem);
+
+  nread = nghttp3_qpack_decoder_read_request(
+    &dec, &sctx, &qnv, &flags, pbuf.pos, nghttp3_buf_len(&pbuf), 0);
+
+  assert_ptrdiff((nghttp3_ssize)nghttp3_buf_len(&pbuf), ==, nread);
+
+  /* Feed the field section in small pieces. */
+  for (;;) {
+    len = nghttp3_min(nghttp3_buf_len(&rbuf), (size_t)7);
+
+    nread = nghttp3_qpack_decoder_read_request(
+      &dec, &sctx, &qnv, &flags, rbuf.pos, len, len == nghttp3_buf_len(&rbuf));
+
+    assert_ptrdiff(0, <=, nread);
+
+    rbuf.pos += nread;
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_FINAL) {
+      break;
+    }
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_FRAGMENT) {
+      assert_true(i == 1 || i == 2 || i == 3);
+      assert_size(64, >=, qnv.value->len);
+      assert_memn_equal(nva[i].name, nva[i].namelen, qnv.name->base,
+                        qnv.name->len);
+      assert_uint8(0, ==, qnv.value->base[qnv.value->len]);
+
+      memcpy(value + valuelen, qnv.value->base, qnv.value->len);
+      valuelen += qnv.value->len;
+      ++nfrags;
+
+      if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+        assert_memn_equal(nva[i].value, nva[i].valuelen, value, valuelen);
+        assert_size(2, <=, nfrags);
+
+        if (i == 3) {
+          assert_false(qnv.value->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE);
+        } else {
+          assert_true(qnv.value->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE);
+        }
+
+        valuelen = 0;
+        nfrags = 0;
+        ++i;
+      } else {
+        assert_false(qnv.value->flags & NGHTTP3_RCBUF_FLAG_VALID_FIELD_VALUE);
+      }
+
+      nghttp3_rcbuf_decref(qnv.name);
+      nghttp3_rcbuf_decref(qnv.value);
+
+      continue;
+    }
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+      /* Pseudo header fields and short values are not fragmented. */
+      assert_true(i == 0 || i == 4);
+      assert_memn_equal(nva[i].name, nva[i].namelen, qnv.name->base,
+                        qnv.name->len);
+      assert_memn_equal(nva[i].value, nva[i].valuelen, qnv.value->base,
+                        qnv.value->len);
+
+      nghttp3_rcbuf_decref(qnv.name);
+      nghttp3_rcbuf_decref(qnv.value);
+
+      ++i;
+    }
+  }
+
+  assert_size(nghttp3_arraylen(nva), ==, i);
+  assert_size(0, ==, nghttp3_buf_len(&rbuf));
+
+  nghttp3_qpack_stream_context_free(&sctx);
+  nghttp3_qpack_decoder_free(&dec);
+  nghttp3_qpack_encoder_free(&enc);
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+}
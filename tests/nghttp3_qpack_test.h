@@ -39,13 +39,19 @@ munit_void_test_decl(test_nghttp3_qpack_encoder_encode)
 munit_void_test_decl(test_nghttp3_qpack_encoder_encode_try_encode)
 munit_void_test_decl(test_nghttp3_qpack_encoder_encode_indexing_strat_eager)
 munit_void_test_decl(test_nghttp3_qpack_encoder_still_blocked)
+munit_void_test_decl(test_nghttp3_qpack_encoder_path_estimate)
+munit_void_test_decl(test_nghttp3_qpack_encoder_encoding_strat_compact)
+munit_void_test_decl(test_nghttp3_qpack_encoder_crumble_cookie)
 munit_void_test_decl(test_nghttp3_qpack_encoder_set_dtable_cap)
 munit_void_test_decl(test_nghttp3_qpack_decoder_feedback)
 munit_void_test_decl(test_nghttp3_qpack_decoder_stream_overflow)
+munit_void_test_decl(test_nghttp3_qpack_decoder_contiguous_dtable)
 munit_void_test_decl(test_nghttp3_qpack_huffman)
 munit_void_test_decl(test_nghttp3_qpack_huffman_decode_failure_state)
 munit_void_test_decl(test_nghttp3_qpack_decoder_reconstruct_ricnt)
 munit_void_test_decl(test_nghttp3_qpack_decoder_read_encoder)
 munit_void_test_decl(test_nghttp3_qpack_encoder_read_decoder)
+munit_void_test_decl(test_nghttp3_qpack_decoder_read_request)
+munit_void_test_decl(test_nghttp3_qpack_decoder_value_fragment)
 
 #endif /* !defined(NGHTTP3_QPACK_TEST_H) */
@@ -89,6 +89,19 @@ void test_nghttp3_settings_convert_to_latest(void) {
   assert_uint64(6831, ==, dest->glitch_ratelim_rate);
   assert_uint64(NGHTTP3_QPACK_INDEXING_STRAT_NONE, ==,
                 dest->qpack_indexing_strat);
+  assert_uint64(0, ==, dest->qpack_decoder_ack_delay);
+  assert_uint64(NGHTTP3_QPACK_ENCODING_STRAT_FAST, ==,
+                dest->qpack_encoding_strat);
+  assert_uint8(0, ==, dest->qpack_decoder_contiguous_dtable);
+  assert_uint8(0, ==, dest->qpack_encoder_crumble_cookie);
+  assert_uint8(0, ==, dest->qpack_decoder_join_cookie);
+  assert_size(0, ==, dest->qpack_decoder_value_fragment_size);
+  assert_null(dest->preamble);
+  assert_size(0, ==, dest->read_data_veccnt);
+  assert_size(0, ==, dest->data_coalesce_threshold);
+  assert_size(0, ==, dest->consumed_report_threshold);
+  assert_size(0, ==, dest->data_frame_min_len);
+  assert_null(dest->urgency_weights);
 }
 
 void test_nghttp3_settings_convert_to_old(void) {
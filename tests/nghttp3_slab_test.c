@@ -0,0 +1,225 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp3_slab_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nghttp3_slab.h"
+#include "nghttp3_mem.h"
+#include "nghttp3_macro.h"
+#include "nghttp3_test_helper.h"
+
+static const MunitTest tests[] = {
+  munit_void_test(test_nghttp3_slab_mem),
+  munit_void_test(test_nghttp3_slab_mem_realloc),
+  munit_test_end(),
+};
+
+const MunitSuite slab_suite = {
+  .prefix = "/slab",
+  .tests = tests,
+};
+
+void test_nghttp3_slab_mem(void) {
+  nghttp3_slab_mem *slab;
+  const nghttp3_mem *mem;
+  nghttp3_slab_mem_stat stat;
+  uint8_t *p, *q, *large;
+  size_t i;
+  int rv;
+
+  rv = nghttp3_slab_mem_new(&slab, NULL);
+
+  assert_int(0, ==, rv);
+
+  mem = nghttp3_slab_mem_get_mem(slab);
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_uint64(0, ==, stat.nalloc);
+  assert_size(0, ==, stat.nslab);
+  assert_size(0, ==, stat.inuse_bytes);
+
+  /* Small allocation is rounded up to the size class. */
+  p = nghttp3_mem_malloc(mem, 17);
+
+  assert_not_null(p);
+  assert_size(0, ==, (uintptr_t)p & 0xFU);
+
+  memset(p, 0xFF, 17);
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_uint64(1, ==, stat.nalloc);
+  assert_uint64(0, ==, stat.nlarge_alloc);
+  assert_size(1, ==, stat.nslab);
+  assert_size(32, ==, stat.inuse_bytes);
+
+  /* Freed chunk is reused for the same size class. */
+  nghttp3_mem_free(mem, p);
+
+  q = nghttp3_mem_calloc(mem, 3, 10);
+
+  assert_ptr_equal(p, q);
+
+  for (i = 0; i < 30; ++i) {
+    assert_uint8(0, ==, q[i]);
+  }
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_uint64(2, ==, stat.nalloc);
+  assert_uint64(1, ==, stat.nfree);
+  assert_size(1, ==, stat.nslab);
+  assert_size(32, ==, stat.inuse_bytes);
+
+  /* Different size class uses a different slab. */
+  p = nghttp3_mem_malloc(mem, 4096);
+
+  assert_not_null(p);
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_size(2, ==, stat.nslab);
+  assert_size(32 + 4096, ==, stat.inuse_bytes);
+
+  /* Large allocation is passed through to the underlying
+     allocator. */
+  large = nghttp3_mem_malloc(mem, 4097);
+
+  assert_not_null(large);
+
+  memset(large, 0xFF, 4097);
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_uint64(3, ==, stat.nalloc);
+  assert_uint64(1, ==, stat.nlarge_alloc);
+  assert_size(2, ==, stat.nslab);
+  assert_size(32 + 4096 + 4097, ==, stat.inuse_bytes);
+
+  nghttp3_mem_free(mem, large);
+  nghttp3_mem_free(mem, p);
+  nghttp3_mem_free(mem, q);
+  nghttp3_mem_free(mem, NULL);
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_uint64(4, ==, stat.nfree);
+  assert_size(2, ==, stat.nslab);
+  assert_size(0, ==, stat.inuse_bytes);
+
+  nghttp3_slab_mem_del(slab);
+}
+
+void test_nghttp3_slab_mem_realloc(void) {
+  nghttp3_slab_mem *slab;
+  const nghttp3_mem *mem;
+  nghttp3_slab_mem_stat stat;
+  uint8_t *p, *q;
+  size_t i;
+  int rv;
+
+  rv = nghttp3_slab_mem_new(&slab, NULL);
+
+  assert_int(0, ==, rv);
+
+  mem = nghttp3_slab_mem_get_mem(slab);
+
+  p = nghttp3_mem_realloc(mem, NULL, 10);
+
+  assert_not_null(p);
+
+  for (i = 0; i < 10; ++i) {
+    p[i] = (uint8_t)i;
+  }
+
+  /* Growing within the same size class returns the same pointer. */
+  q = nghttp3_mem_realloc(mem, p, 16);
+
+  assert_ptr_equal(p, q);
+
+  /* Growing beyond the size class moves the data. */
+  q = nghttp3_mem_realloc(mem, p, 100);
+
+  assert_not_null(q);
+  assert_true(p != q);
+
+  for (i = 0; i < 10; ++i) {
+    assert_uint8((uint8_t)i, ==, q[i]);
+  }
+
+  for (i = 10; i < 100; ++i) {
+    q[i] = (uint8_t)i;
+  }
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_size(128, ==, stat.inuse_bytes);
+
+  /* Growing to the large allocation */
+  p = nghttp3_mem_realloc(mem, q, 10000);
+
+  assert_not_null(p);
+
+  for (i = 0; i < 100; ++i) {
+    assert_uint8((uint8_t)i, ==, p[i]);
+  }
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_uint64(1, ==, stat.nlarge_alloc);
+  assert_size(10000, ==, stat.inuse_bytes);
+
+  p = nghttp3_mem_realloc(mem, p, 20000);
+
+  assert_not_null(p);
+
+  for (i = 0; i < 100; ++i) {
+    assert_uint8((uint8_t)i, ==, p[i]);
+  }
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_size(20000, ==, stat.inuse_bytes);
+
+  /* Shrinking back to the size class */
+  q = nghttp3_mem_realloc(mem, p, 50);
+
+  assert_not_null(q);
+
+  for (i = 0; i < 50; ++i) {
+    assert_uint8((uint8_t)i, ==, q[i]);
+  }
+
+  nghttp3_slab_mem_get_stat(slab, &stat);
+
+  assert_size(64, ==, stat.inuse_bytes);
+
+  nghttp3_mem_free(mem, q);
+
+  nghttp3_slab_mem_del(slab);
+}
@@ -32,6 +32,7 @@
 
 static const MunitTest tests[] = {
   munit_void_test(test_nghttp3_downcase_byte),
+  munit_void_test(test_nghttp3_cpymem_field_chars),
   munit_test_end(),
 };
 
@@ -52,3 +53,25 @@ void test_nghttp3_downcase_byte(void) {
     }
   }
 }
+
+void test_nghttp3_cpymem_field_chars(void) {
+  uint8_t src[3], dest[3];
+  uint8_t field_chars;
+  size_t i;
+
+  for (i = 0; i < 256; ++i) {
+    src[0] = 'a';
+    src[1] = (uint8_t)i;
+    src[2] = 'a';
+    field_chars = NGHTTP3_FIELD_CHAR_FLAG_ALL;
+
+    assert_ptr_equal(dest + sizeof(dest),
+                     nghttp3_cpymem_field_chars(dest, src, sizeof(src),
+                                                &field_chars));
+    assert_memory_equal(sizeof(src), src, dest);
+    assert_int(nghttp3_check_header_value(src, sizeof(src)), ==,
+               !!(field_chars & NGHTTP3_FIELD_CHAR_FLAG_VALUE));
+    assert_int(nghttp3_check_header_name(src, sizeof(src)), ==,
+               !!(field_chars & NGHTTP3_FIELD_CHAR_FLAG_NAME));
+  }
+}
@@ -36,5 +36,6 @@
 extern const MunitSuite str_suite;
 
 munit_void_test_decl(test_nghttp3_downcase_byte)
+munit_void_test_decl(test_nghttp3_cpymem_field_chars)
 
 #endif /* !defined(NGHTTP3_STR_TEST_H) */
@@ -32,6 +32,7 @@
 
 static const MunitTest tests[] = {
   munit_void_test(test_nghttp3_read_varint),
+  munit_void_test(test_nghttp3_read_frame_hd),
   munit_test_end(),
 };
 
@@ -180,3 +181,61 @@ void test_nghttp3_read_varint(void) {
     assert_ptrdiff(NGHTTP3_ERR_INVALID_ARGUMENT, ==, nread);
   }
 }
+
+void test_nghttp3_read_frame_hd(void) {
+  uint64_t type, len;
+  size_t nread;
+
+  {
+    /* 1 byte type + 2 bytes length */
+    static const uint8_t input[] = {0x01, 0x40, 0x80, 0xFF};
+
+    nread = nghttp3_read_frame_hd(&type, &len, input, input + sizeof(input));
+
+    assert_size(3, ==, nread);
+    assert_uint64(0x01, ==, type);
+    assert_uint64(0x80, ==, len);
+  }
+
+  {
+    /* 4 bytes type + 1 byte length */
+    static const uint8_t input[] = {0x80, 0x0F, 0x07, 0x00, 0x3F};
+
+    nread = nghttp3_read_frame_hd(&type, &len, input, input + sizeof(input));
+
+    assert_size(5, ==, nread);
+    assert_uint64(0x0F0700, ==, type);
+    assert_uint64(0x3F, ==, len);
+  }
+
+  {
+    /* Incomplete type */
+    static const uint8_t input[] = {0x40};
+
+    type = len = 1000000007;
+
+    nread = nghttp3_read_frame_hd(&type, &len, input, input + sizeof(input));
+
+    assert_size(0, ==, nread);
+    assert_uint64(1000000007, ==, type);
+    assert_uint64(1000000007, ==, len);
+  }
+
+  {
+    /* Type without length */
+    static const uint8_t input[] = {0x00};
+
+    nread = nghttp3_read_frame_hd(&type, &len, input, input + sizeof(input));
+
+    assert_size(0, ==, nread);
+  }
+
+  {
+    /* Incomplete length */
+    static const uint8_t input[] = {0x00, 0x80, 0x00, 0x00};
+
+    nread = nghttp3_read_frame_hd(&type, &len, input, input + sizeof(input));
+
+    assert_size(0, ==, nread);
+  }
+}